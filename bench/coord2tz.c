@@ -0,0 +1,156 @@
+/*
+	Copyright (C) 2014 CurlyMo
+
+	This file is part of pilight.
+
+	pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+	pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+/*
+ * Resolves a grid of coordinates over the whole world with coord2tz.
+ * The first lookup, which loads the tzdata, is timed separately. The
+ * zone of every coordinate can be written to a file, so the results
+ * of two builds can be compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../libs/pilight/core/pilight.h"
+#include "../libs/pilight/core/common.h"
+#include "../libs/pilight/core/log.h"
+#include "../libs/pilight/core/options.h"
+#include "../libs/pilight/core/datetime.h"
+#include "../libs/pilight/core/gc.h"
+
+static double elapsed(struct timeval *start) {
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	return (double)(end.tv_sec-start->tv_sec)+(double)(end.tv_usec-start->tv_usec)/1000000;
+}
+
+int main_gc(void) {
+	log_shell_disable();
+
+	datetime_gc();
+	options_gc();
+	log_gc();
+	gc_clear();
+
+	FREE(progname);
+	xfree();
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+	atomicinit();
+	gc_attach(main_gc);
+
+	/* Catch all exit signals for gc */
+	gc_catch();
+
+	log_shell_enable();
+	log_file_disable();
+	log_level_set(LOG_NOTICE);
+
+	struct options_t *options = NULL;
+	struct timeval start;
+	FILE *fp = NULL;
+	char *args = NULL, *tz = NULL;
+	int step = 2, lat = 0, lon = 0, nr = 0, found = 0;
+	int ret = EXIT_SUCCESS;
+
+	if((progname = MALLOC(23)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(progname, "pilight-bench-coord2tz");
+
+	options_add(&options, 'H', "help", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
+	options_add(&options, 's', "step", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, "[0-9]{1,3}");
+	options_add(&options, 'o', "output", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, NULL);
+
+	while (1) {
+		int c;
+		c = options_parse(&options, argc, argv, 1, &args);
+		if(c == -1)
+			break;
+		if(c == -2)
+			c = 'H';
+		switch (c) {
+			case 'H':
+				printf("Usage: %s [options]\n", progname);
+				printf("\t -H --help\t\tdisplay usage summary\n");
+				printf("\t -s --step=degrees\tgrid step, defaults to 2\n");
+				printf("\t -o --output=file\twrite the zone of every coordinate\n");
+				goto close;
+			break;
+			case 's':
+				step = atoi(args);
+			break;
+			case 'o':
+				if(fp != NULL) {
+					fclose(fp);
+				}
+				if((fp = fopen(args, "w")) == NULL) {
+					logprintf(LOG_ERR, "cannot write %s", args);
+					ret = EXIT_FAILURE;
+					goto close;
+				}
+			break;
+			default:
+				printf("Usage: %s [options]\n", progname);
+				ret = EXIT_FAILURE;
+				goto close;
+			break;
+		}
+	}
+
+	if(step <= 0) {
+		logprintf(LOG_ERR, "the grid step must be a positive number");
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+
+	gettimeofday(&start, NULL);
+	tz = coord2tz(4.9, 52.37);
+	printf("first lookup: %s in %.3f ms\n", (tz == NULL) ? "-" : tz, elapsed(&start)*1000);
+
+	/* Offsets keep the coordinates off the polygon points */
+	gettimeofday(&start, NULL);
+	for(lat=-90;lat<=90;lat+=step) {
+		for(lon=-180;lon<=180;lon+=step) {
+			tz = coord2tz(lon+0.61, lat+0.37);
+			nr++;
+			if(tz != NULL) {
+				found++;
+			}
+			if(fp != NULL) {
+				fprintf(fp, "%.2f %.2f %s\n", lon+0.61, lat+0.37, (tz == NULL) ? "-" : tz);
+			}
+		}
+	}
+	printf("grid lookups: %d, %d resolved, in %.3f s\n", nr, found, elapsed(&start));
+
+close:
+	if(fp != NULL) {
+		fclose(fp);
+	}
+	options_delete(options);
+	main_gc();
+	return ret;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+#
+#	Copyright (C) 2013 CurlyMo
+#
+#	This file is part of pilight.
+#
+#   pilight is free software: you can redistribute it and/or modify it under the
+#	terms of the GNU General Public License as published by the Free Software
+#	Foundation, either version 3 of the License, or (at your option) any later
+#	version.
+#
+#   pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+#	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+#	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with pilight. If not, see	<http://www.gnu.org/licenses/>
+#
+#	Measures how fast the daemon frames client messages. It pipelines many
+#	small identify messages on one connection and waits for all replies, then
+#	writes one large message in small pieces and waits for its reply.
+#
+#	Run it against a daemon with a fixed port in its settings:
+#	  bench/pipeline.py [host] [port] [messages]
+#
+import socket
+import sys
+import time
+
+host = sys.argv[1] if len(sys.argv) > 1 else "127.0.0.1"
+port = int(sys.argv[2]) if len(sys.argv) > 2 else 5000
+n = int(sys.argv[3]) if len(sys.argv) > 3 else 10000
+
+s = socket.create_connection((host, port))
+s.settimeout(60)
+msg = b'{"action":"identify"}\n\n'
+data = msg * n
+got = 0
+start = time.perf_counter()
+s.sendall(data)
+while got < n:
+	buf = s.recv(1 << 20)
+	if not buf:
+		break
+	got += buf.count(b"\n\n")
+dt = time.perf_counter() - start
+s.close()
+print("pipelined: %d/%d replies in %.3f s, %.0f msg/s" % (got, n, dt, got / dt))
+
+s = socket.create_connection((host, port))
+s.settimeout(60)
+data = b'{"action":"identify","pad":"' + b"x" * (4 << 20) + b'"}\n\n'
+start = time.perf_counter()
+for i in range(0, len(data), 4096):
+	s.sendall(data[i:i+4096])
+reply = s.recv(1024)
+dt = time.perf_counter() - start
+s.close()
+print("4 MB message in 4 KB writes: %s in %.3f s" % ("answered" if reply else "no reply", dt))
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+#
+#	Copyright (C) 2013 CurlyMo
+#
+#	This file is part of pilight.
+#
+#   pilight is free software: you can redistribute it and/or modify it under the
+#	terms of the GNU General Public License as published by the Free Software
+#	Foundation, either version 3 of the License, or (at your option) any later
+#	version.
+#
+#   pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+#	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+#	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with pilight. If not, see	<http://www.gnu.org/licenses/>
+#
+#	Loads the webserver in two ways. Several processes fetch /index.html over
+#	keep-alive connections. Then many websocket clients connect, and the
+#	script toggles a switch device through /send. It counts the state updates
+#	that reach the clients.
+#
+#	Run it against a daemon that has a switch device with the given id:
+#	  bench/webserver.py [host] [port] [device] [processes] [requests] [clients] [updates]
+#
+import base64
+import http.client
+import multiprocessing
+import os
+import select
+import socket
+import struct
+import sys
+import time
+import urllib.parse
+
+host = sys.argv[1] if len(sys.argv) > 1 else "127.0.0.1"
+port = int(sys.argv[2]) if len(sys.argv) > 2 else 5001
+device = sys.argv[3] if len(sys.argv) > 3 else "lamp"
+procs = int(sys.argv[4]) if len(sys.argv) > 4 else 8
+requests = int(sys.argv[5]) if len(sys.argv) > 5 else 500
+clients = int(sys.argv[6]) if len(sys.argv) > 6 else 16
+updates = int(sys.argv[7]) if len(sys.argv) > 7 else 300
+
+def fetch(n):
+	done = 0
+	c = http.client.HTTPConnection(host, port, timeout=30)
+	for i in range(n):
+		try:
+			c.request("GET", "/index.html")
+			r = c.getresponse()
+			r.read()
+			if r.status == 200:
+				done += 1
+		except (OSError, http.client.HTTPException):
+			c.close()
+			c = http.client.HTTPConnection(host, port, timeout=30)
+	c.close()
+	return done
+
+def connect():
+	s = socket.create_connection((host, port))
+	key = base64.b64encode(os.urandom(16)).decode()
+	s.sendall(("GET /websocket HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n"
+		"Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n"
+		"Sec-WebSocket-Version: 13\r\n\r\n" % (host, key)).encode())
+	buf = b""
+	while b"\r\n\r\n" not in buf:
+		buf += s.recv(4096)
+	s.setblocking(False)
+	return [s, buf.split(b"\r\n\r\n", 1)[1], 0]
+
+# Counts the complete frames about the device in each client buffer
+def drain(conns, match, timeout):
+	r, _, _ = select.select([c[0] for c in conns], [], [], timeout)
+	for c in conns:
+		if c[0] not in r:
+			continue
+		try:
+			c[1] += c[0].recv(1 << 20)
+		except BlockingIOError:
+			continue
+		while len(c[1]) >= 2:
+			l = c[1][1] & 127
+			o = 2
+			if l == 126:
+				if len(c[1]) < 4:
+					break
+				l = struct.unpack(">H", c[1][2:4])[0]
+				o = 4
+			elif l == 127:
+				if len(c[1]) < 10:
+					break
+				l = struct.unpack(">Q", c[1][2:10])[0]
+				o = 10
+			if len(c[1]) < o + l:
+				break
+			if match in c[1][o:o+l]:
+				c[2] += 1
+			c[1] = c[1][o+l:]
+
+if __name__ == "__main__":
+	start = time.perf_counter()
+	with multiprocessing.Pool(procs) as p:
+		done = sum(p.map(fetch, [requests] * procs))
+	dt = time.perf_counter() - start
+	print("static: %d/%d requests from %d processes in %.2f s, %.0f req/s" % (done, procs * requests, procs, dt, done / dt))
+
+	conns = [connect() for i in range(clients)]
+	time.sleep(0.5)
+	match = ('"devices":["%s"]' % device).encode()
+	c = http.client.HTTPConnection(host, port, timeout=30)
+	start = time.perf_counter()
+	for i in range(updates):
+		q = '{"action":"control","code":{"device":"%s","state":"%s"}}' % (device, "off" if i % 2 == 0 else "on")
+		c.request("GET", "/send?" + urllib.parse.quote(q))
+		c.getresponse().read()
+		drain(conns, match, 0)
+	# The first toggle can match the current state and then is not broadcast
+	while sum(x[2] for x in conns) < clients * (updates - 1) and time.perf_counter() - start < 30:
+		drain(conns, match, 0.1)
+	dt = time.perf_counter() - start
+	got = sum(x[2] for x in conns)
+	c.close()
+	for x in conns:
+		x[0].close()
+	print("websocket: %d/%d updates to %d clients in %.2f s, %.0f frames/s" % (got, clients * updates, clients, dt, got / dt))
@@ -42,6 +42,7 @@
 	#endif
 #endif
 #include <pthread.h>
+#include <semaphore.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
@@ -65,6 +66,7 @@
 #include "libs/pilight/core/proc.h"
 #include "libs/pilight/core/ntp.h"
 #include "libs/pilight/core/config.h"
+#include "libs/pilight/core/timer.h"
 
 #ifdef EVENTS
 	#include "libs/pilight/events/events.h"
@@ -123,11 +125,36 @@ typedef struct recvqueue_t {
 	int rawlen;
 	int hwtype;
 	int plslen;
-	struct recvqueue_t *next;
 } recvqueue_t;
 
-static struct recvqueue_t *recvqueue;
-static struct recvqueue_t *recvqueue_head;
+/*
+ * Preallocated single producer, single consumer ring of pulse trains.
+ * Each receiving hardware module, and the sender looping back raw codes,
+ * owns its own ring, so the receiver threads never allocate or lock.
+ * The head is only written by the producer. The tail is advanced by the
+ * consumer, or by the producer when it overwrites the oldest pulse train.
+ */
+typedef struct recvring_t {
+	char *name;
+	struct hardware_t *hw;
+	struct recvqueue_t *slots;
+	unsigned int size;
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	volatile unsigned long dropped;
+	volatile unsigned long overwritten;
+	unsigned long reported;
+	/* Sequence number of the last pulse train handed to a decoder,
+	   and of the next one that is allowed to be broadcasted */
+	unsigned long seq;
+	unsigned long committed;
+	struct recvring_t *next;
+} recvring_t;
+
+static struct recvring_t *recvrings = NULL;
+static struct recvring_t *recvring_sender = NULL;
+/* Ring the next decoder starts looking for pulse trains */
+static struct recvring_t *recvring_next = NULL;
 
 static pthread_mutex_t sendqueue_lock;
 static pthread_cond_t sendqueue_signal;
@@ -135,12 +162,20 @@ static pthread_mutexattr_t sendqueue_attr;
 static unsigned short sendqueue_init = 0;
 
 static int sendqueue_number = 0;
-static int recvqueue_number = 0;
 
-static pthread_mutex_t recvqueue_lock;
-static pthread_cond_t recvqueue_signal;
-static pthread_mutexattr_t recvqueue_attr;
+static sem_t recvqueue_signal;
 static unsigned short recvqueue_init = 0;
+/* Number of pulse trains each receiver ring can hold */
+static int recvqueue_size = RECEIVE_QUEUE_SIZE;
+/* Overwrite the oldest pulse train instead of dropping the newest one */
+static int recvqueue_overwrite = 0;
+/* Number of threads decoding pulse trains in parallel */
+static int recvqueue_workers = RECEIVE_WORKERS;
+/* Serializes the decoders taking pulse trains from the rings */
+static pthread_mutex_t recvqueue_lock;
+/* Lets the decoders broadcast in the order the pulse trains were received */
+static pthread_mutex_t recvcommit_lock;
+static pthread_cond_t recvcommit_signal;
 
 typedef struct bcqueue_t {
 	struct JsonNode *jmessage;
@@ -149,6 +184,10 @@ typedef struct bcqueue_t {
 	struct bcqueue_t *next;
 } bcqueue_t;
 
+/* The types of media a client can identify itself with */
+#define BROADCAST_MEDIA	4
+static const char *broadcast_media[BROADCAST_MEDIA] = { "web", "mobile", "desktop", "all" };
+
 static struct bcqueue_t *bcqueue;
 static struct bcqueue_t *bcqueue_head;
 
@@ -183,8 +222,6 @@ static int sockfd = 0;
 static pthread_t logpth;
 /* While loop conditions */
 static unsigned short main_loop = 1;
-/* Reset repeats after a certain amount of time */
-static struct timeval tv;
 /* Are we running standalone */
 static int standalone = 0;
 /* What is the minimum rawlenth to consider a pulse stream valid */
@@ -242,24 +279,27 @@ static void client_remove(int id) {
 	}
 }
 
-static void broadcast_queue(char *protoname, struct JsonNode *json, enum origin_t origin) {
+/* Queue a message for the broadcaster, which takes over the message */
+static void broadcast_queue_move(char *protoname, struct JsonNode *json, enum origin_t origin) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	if(main_loop == 1) {
 		pthread_mutex_lock(&bcqueue_lock);
-		if(bcqueue_number <= 1024) {
+		/* The broadcaster can have stopped while we waited for it */
+		if(main_loop == 1 && bcqueue_number <= 1024) {
 			struct bcqueue_t *bnode = MALLOC(sizeof(struct bcqueue_t));
 			if(bnode == NULL) {
 				fprintf(stderr, "out of memory\n");
 				exit(EXIT_FAILURE);
 			}
 
-			char *jstr = json_stringify(json, NULL);
-			bnode->jmessage = json_decode(jstr);
+			/* The message outlives the arena the caller may be using */
+			struct json_arena_t *arena = json_arena_use(NULL);
+			bnode->jmessage = json_move(json);
 			if(json_find_member(bnode->jmessage, "uuid") == NULL && strlen(pilight_uuid) > 0) {
 				json_append_member(bnode->jmessage, "uuid", json_mkstring(pilight_uuid));
 			}
-			json_free(jstr);
+			json_arena_use(arena);
 
 			if((bnode->protoname = MALLOC(strlen(protoname)+1)) == NULL) {
 				fprintf(stderr, "out of memory\n");
@@ -278,17 +318,87 @@ static void broadcast_queue(char *protoname, struct JsonNode *json, enum origin_
 			}
 
 			bcqueue_number++;
-		} else {
+			json = NULL;
+		} else if(main_loop == 1) {
 			logprintf(LOG_ERR, "broadcast queue full");
 		}
 		pthread_mutex_unlock(&bcqueue_lock);
 		pthread_cond_signal(&bcqueue_signal);
 	}
+	if(json != NULL) {
+		json_delete(json);
+	}
+}
+
+static void broadcast_queue(char *protoname, struct JsonNode *json, enum origin_t origin) {
+	struct json_arena_t *arena = json_arena_use(NULL);
+	struct JsonNode *jclone = json_clone(json);
+	json_arena_use(arena);
+
+	broadcast_queue_move(protoname, jclone, origin);
+}
+
+/*
+ * Remove the devices from a device update that should not be shown
+ * on a specific type of media. Returns the framed update, or NULL
+ * when none of the devices are shown on this media.
+ */
+static struct socket_buffer_t *broadcast_filter_media(struct json_arena_t *arena, struct JsonNode *jupdate, const char *media) {
+	struct json_arena_t *prev = json_arena_use(arena);
+	struct JsonNode *jtmp = json_clone(jupdate);
+	struct JsonNode *jdevices = json_find_member(jtmp, "devices");
+	struct socket_buffer_t *buffer = NULL;
+	unsigned short match1 = 0, match2 = 0;
+
+	if(jdevices != NULL) {
+		struct JsonNode *jchilds = json_first_child(jdevices);
+		struct gui_values_t *gui_values = NULL;
+		while(jchilds) {
+			match2 = 0;
+			if(jchilds->tag == JSON_STRING) {
+				if((gui_values = gui_media(jchilds->string_)) != NULL) {
+					while(gui_values) {
+						if(gui_values->type == JSON_STRING) {
+							if(strcmp(gui_values->string_, media) == 0 ||
+								 strcmp(gui_values->string_, "all") == 0 ||
+								 strcmp(media, "all") == 0) {
+									match1 = 1;
+									match2 = 1;
+							}
+						}
+						gui_values = gui_values->next;
+					}
+				} else {
+					match1 = 1;
+					match2 = 1;
+				}
+			}
+			if(match2 == 0) {
+				json_remove_from_parent(jchilds);
+			}
+			struct JsonNode *jtmp1 = jchilds;
+			jchilds = jchilds->next;
+			if(match2 == 0) {
+				json_delete(jtmp1);
+			}
+		}
+	}
+	if(match1 == 1) {
+		char *conf = json_stringify(jtmp, NULL);
+		buffer = socket_buffer_create(conf);
+		json_free(conf);
+	}
+	json_delete(jtmp);
+	json_arena_use(prev);
+
+	return buffer;
 }
 
 void *broadcast(void *param) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	/* Holds the temporary copies of the message being broadcasted */
+	struct json_arena_t *arena = json_arena_create(JSON_ARENA_SIZE);
 	int broadcasted = 0;
 
 	pthread_mutex_lock(&bcqueue_lock);
@@ -307,19 +417,29 @@ void *broadcast(void *param) {
 					double tmp = 0;
 					json_find_number(bcqueue->jmessage, "type", &tmp);
 					char *conf = json_stringify(bcqueue->jmessage, NULL);
+					struct socket_buffer_t *buffer = socket_buffer_create(conf);
 					struct clients_t *tmp_clients = clients;
 					while(tmp_clients) {
 						if(((int)tmp < 0 && tmp_clients->core == 1) ||
 						   ((int)tmp >= 0 && tmp_clients->config == 1) ||
 							 ((int)tmp == PROCESS && tmp_clients->stats == 1)) {
-							socket_write(tmp_clients->id, conf);
+							socket_write_buffer(tmp_clients->id, buffer);
 							broadcasted = 1;
 						}
 						tmp_clients = tmp_clients->next;
 					}
+#ifdef WEBSERVER
+					if(webserver_enable == 1 && webgui_websockets == 1) {
+						webserver_update(buffer);
+						broadcasted = 1;
+					}
+#endif
+					socket_buffer_unref(buffer);
 					if(pilight.runmode == ADHOC && sockfd > 0) {
-						struct JsonNode *jupdate = json_decode(conf);
+						struct json_arena_t *prev = json_arena_use(arena);
+						struct JsonNode *jupdate = json_clone(bcqueue->jmessage);
 						json_append_member(jupdate, "action", json_mkstring("update"));
+						json_arena_use(prev);
 						char *ret = json_stringify(jupdate, NULL);
 						socket_write(sockfd, ret);
 						broadcasted = 1;
@@ -333,67 +453,61 @@ void *broadcast(void *param) {
 				} else {
 					/* Update the config */
 					if(devices_update(bcqueue->protoname, bcqueue->jmessage, bcqueue->origin, &jret) == 0) {
-						char *tmp = json_stringify(jret, NULL);
+						struct socket_buffer_t *buffers[BROADCAST_MEDIA];
+						int filtered[BROADCAST_MEDIA], i = 0;
 						struct clients_t *tmp_clients = clients;
-						unsigned short match1 = 0, match2 = 0;
 
+						memset(filtered, 0, sizeof(filtered));
 						while(tmp_clients) {
 							if(tmp_clients->config == 1) {
-								struct JsonNode *jtmp = json_decode(tmp);
-								struct JsonNode *jdevices = json_find_member(jtmp, "devices");
-								if(jdevices != NULL) {
-									match1 = 0;
-									struct JsonNode *jchilds = json_first_child(jdevices);
-									struct gui_values_t *gui_values = NULL;
-									while(jchilds) {
-										match2 = 0;
-										if(jchilds->tag == JSON_STRING) {
-											if((gui_values = gui_media(jchilds->string_)) != NULL) {
-												while(gui_values) {
-													if(gui_values->type == JSON_STRING) {
-														if(strcmp(gui_values->string_, tmp_clients->media) == 0 ||
-															 strcmp(gui_values->string_, "all") == 0 ||
-															 strcmp(tmp_clients->media, "all") == 0) {
-																match1 = 1;
-																match2 = 1;
-														}
-													}
-													gui_values = gui_values->next;
-												}
-											} else {
-												match1 = 1;
-												match2 = 1;
-											}
-										}
-										if(match2 == 0) {
-											json_remove_from_parent(jchilds);
-										}
-										struct JsonNode *jtmp1 = jchilds;
-										jchilds = jchilds->next;
-										if(match2 == 0) {
-											json_delete(jtmp1);
-										}
+								for(i=0;i<BROADCAST_MEDIA-1;i++) {
+									if(strcmp(broadcast_media[i], tmp_clients->media) == 0) {
+										break;
 									}
 								}
-								if(match1 == 1) {
-									char *conf = json_stringify(jtmp, NULL);
-									socket_write(tmp_clients->id, conf);
-									logprintf(LOG_DEBUG, "broadcasted: %s", conf);
-									json_free(conf);
+								/* Filter the update only once for each type of media */
+								if(filtered[i] == 0) {
+									buffers[i] = broadcast_filter_media(arena, jret, broadcast_media[i]);
+									filtered[i] = 1;
+								}
+								if(buffers[i] != NULL) {
+									socket_write_buffer(tmp_clients->id, buffers[i]);
+									logprintf(LOG_DEBUG, "broadcasted: %.*s", (int)buffers[i]->msglen, buffers[i]->data);
 								}
-								json_delete(jtmp);
 							}
 							tmp_clients = tmp_clients->next;
 						}
+#ifdef WEBSERVER
+						/* The webgui is shown the updates of the web media */
+						if(webserver_enable == 1 && webgui_websockets == 1) {
+							if(filtered[0] == 0) {
+								buffers[0] = broadcast_filter_media(arena, jret, broadcast_media[0]);
+								filtered[0] = 1;
+							}
+							if(buffers[0] != NULL) {
+								webserver_update(buffers[0]);
+								logprintf(LOG_DEBUG, "broadcasted: %.*s", (int)buffers[0]->msglen, buffers[0]->data);
+							}
+						}
+#endif
+						for(i=0;i<BROADCAST_MEDIA;i++) {
+							if(filtered[i] == 1) {
+								socket_buffer_unref(buffers[i]);
+							}
+						}
 
-						json_free(tmp);
 						json_delete(jret);
 					}
 
 					/* The settings objects inside the broadcast queue is only of interest for the
 					   internal pilight functions. For the outside world we only communicate the
 					   message part of the queue so we remove the settings */
-					char *internal = json_stringify(bcqueue->jmessage, NULL);
+					struct JsonNode *jinternal = NULL;
+					if(pilight.runmode == ADHOC && sockfd > 0) {
+						struct json_arena_t *prev = json_arena_use(arena);
+						jinternal = json_clone(bcqueue->jmessage);
+						json_arena_use(prev);
+					}
 
 					struct JsonNode *jsettings = NULL;
 					if((jsettings = json_find_member(bcqueue->jmessage, "settings"))) {
@@ -444,30 +558,32 @@ void *broadcast(void *param) {
 					}
 
 					/* Write the message to all receivers */
+					struct socket_buffer_t *buffer = socket_buffer_create(out);
 					struct clients_t *tmp_clients = clients;
 					while(tmp_clients) {
 						if(tmp_clients->receiver == 1 && tmp_clients->forward == 0) {
 								if(strcmp(out, "{}") != 0 && nrchilds > 1) {
-									socket_write(tmp_clients->id, out);
+									socket_write_buffer(tmp_clients->id, buffer);
 									broadcasted = 1;
 								}
 						}
 						tmp_clients = tmp_clients->next;
 					}
+					socket_buffer_unref(buffer);
 
-					if(pilight.runmode == ADHOC && sockfd > 0) {
-						struct JsonNode *jupdate = json_decode(internal);
-						json_append_member(jupdate, "action", json_mkstring("update"));
-						char *ret = json_stringify(jupdate, NULL);
+					if(jinternal != NULL) {
+						struct json_arena_t *prev = json_arena_use(arena);
+						json_append_member(jinternal, "action", json_mkstring("update"));
+						json_arena_use(prev);
+						char *ret = json_stringify(jinternal, NULL);
 						socket_write(sockfd, ret);
 						broadcasted = 1;
-						json_delete(jupdate);
+						json_delete(jinternal);
 						json_free(ret);
 					}
 					if((broadcasted == 1 || nodaemon == 1) && (strcmp(out, "{}") != 0 && nrchilds > 1)) {
 						logprintf(LOG_DEBUG, "broadcasted: %s", out);
 					}
-					json_free(internal);
 					json_free(out);
 				}
 			}
@@ -477,144 +593,316 @@ void *broadcast(void *param) {
 			bcqueue = bcqueue->next;
 			FREE(tmp);
 			bcqueue_number--;
+			json_arena_reset(arena);
 			pthread_mutex_unlock(&bcqueue_lock);
 		} else {
 			pthread_cond_wait(&bcqueue_signal, &bcqueue_lock);
 		}
 	}
+	pthread_mutex_unlock(&bcqueue_lock);
+	json_arena_free(arena);
 	return (void *)NULL;
 }
 
-static void receive_queue(int *raw, int rawlen, int plslen, int hwtype) {
+static struct recvring_t *receive_ring_add(const char *name, struct hardware_t *hw) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	int i = 0;
+	struct recvring_t *ring = MALLOC(sizeof(struct recvring_t));
+	if(ring == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if((ring->name = MALLOC(strlen(name)+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(ring->name, name);
 
-	if(main_loop == 1) {
-		pthread_mutex_lock(&recvqueue_lock);
-		if(recvqueue_number <= 1024) {
-			struct recvqueue_t *rnode = MALLOC(sizeof(struct recvqueue_t));
-			if(rnode == NULL) {
-				fprintf(stderr, "out of memory\n");
-				exit(EXIT_FAILURE);
-			}
-			for(i=0;i<rawlen;i++) {
-				rnode->raw[i] = raw[i];
-			}
-			rnode->rawlen = rawlen;
-			rnode->plslen = plslen;
-			rnode->hwtype = hwtype;
+	/* Round up to a power of two so the indexes can wrap around */
+	ring->size = 1;
+	while(ring->size < (unsigned int)recvqueue_size) {
+		ring->size <<= 1;
+	}
+	if((ring->slots = MALLOC(sizeof(struct recvqueue_t)*ring->size)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	ring->hw = hw;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+	ring->overwritten = 0;
+	ring->reported = 0;
+	ring->seq = 0;
+	ring->committed = 0;
+	ring->next = recvrings;
+	recvrings = ring;
+
+	return ring;
+}
 
-			if(recvqueue_number == 0) {
-				recvqueue = rnode;
-				recvqueue_head = rnode;
-			} else {
-				recvqueue_head->next = rnode;
-				recvqueue_head = rnode;
-			}
+static struct recvring_t *receive_ring_get(struct hardware_t *hw) {
+	struct recvring_t *ring = recvrings;
+	while(ring) {
+		if(ring->hw == hw) {
+			return ring;
+		}
+		ring = ring->next;
+	}
+	return NULL;
+}
+
+static void receive_ring_gc(void) {
+	struct recvring_t *tmp = NULL;
+	while(recvrings) {
+		tmp = recvrings;
+		recvrings = recvrings->next;
+		FREE(tmp->slots);
+		FREE(tmp->name);
+		FREE(tmp);
+	}
+	recvring_sender = NULL;
+	recvring_next = NULL;
+}
 
-			recvqueue_number++;
+/* Called from the receiver threads, so this may not allocate, block or log */
+static void receive_queue(struct recvring_t *ring, int *raw, int rawlen, int plslen, int hwtype) {
+	struct recvqueue_t *rnode = NULL;
+	unsigned int head = 0, tail = 0;
+	int replaced = 0;
+
+	if(main_loop == 0 || ring == NULL || rawlen <= 0) {
+		return;
+	}
+	if(rawlen > MAXPULSESTREAMLENGTH) {
+		rawlen = MAXPULSESTREAMLENGTH;
+	}
+
+	head = ring->head;
+	tail = ring->tail;
+	__sync_synchronize();
+
+	if(head-tail >= ring->size) {
+		if(recvqueue_overwrite == 0) {
+			__sync_add_and_fetch(&ring->dropped, 1);
+			return;
+		}
+		/* If the consumer took the oldest pulse train in the meantime
+		   there is room again and nothing gets overwritten */
+		if(__sync_bool_compare_and_swap(&ring->tail, tail, tail+1)) {
+			__sync_add_and_fetch(&ring->overwritten, 1);
+			replaced = 1;
+		}
+	}
+
+	rnode = &ring->slots[head & (ring->size-1)];
+	memcpy(rnode->raw, raw, sizeof(int)*(size_t)rawlen);
+	rnode->rawlen = rawlen;
+	rnode->plslen = plslen;
+	rnode->hwtype = hwtype;
+
+	__sync_synchronize();
+	ring->head = head+1;
+
+	if(replaced == 0) {
+		sem_post(&recvqueue_signal);
+	}
+}
+
+static int receive_dequeue(struct recvring_t *ring, struct recvqueue_t *rnode) {
+	struct recvqueue_t *slot = NULL;
+	unsigned int tail = 0;
+
+	while(1) {
+		tail = ring->tail;
+		__sync_synchronize();
+		if(tail == ring->head) {
+			return -1;
+		}
+		slot = &ring->slots[tail & (ring->size-1)];
+		rnode->rawlen = slot->rawlen;
+		rnode->plslen = slot->plslen;
+		rnode->hwtype = slot->hwtype;
+		if(rnode->rawlen < 0 || rnode->rawlen > MAXPULSESTREAMLENGTH) {
+			rnode->rawlen = 0;
+		}
+		memcpy(rnode->raw, slot->raw, sizeof(int)*(size_t)rnode->rawlen);
+		__sync_synchronize();
+		/* The copy is only valid if the producer didn't overwrite this slot */
+		if(__sync_bool_compare_and_swap(&ring->tail, tail, tail+1)) {
+			return 0;
+		}
+	}
+}
+
+static void receive_ring_report(struct recvring_t *ring) {
+	unsigned long missed = ring->dropped+ring->overwritten;
+	if(missed != ring->reported) {
+		if(recvqueue_overwrite == 1) {
+			logprintf(LOG_ERR, "receiver queue of %s full, overwrote %lu pulse trains in total", ring->name, missed);
 		} else {
-			logprintf(LOG_ERR, "receiver queue full");
+			logprintf(LOG_ERR, "receiver queue of %s full, dropped %lu pulse trains in total", ring->name, missed);
 		}
-		pthread_mutex_unlock(&recvqueue_lock);
-		pthread_cond_signal(&recvqueue_signal);
+		ring->reported = missed;
 	}
 }
 
-static void receiver_create_message(protocol_t *protocol) {
+static void receiver_create_message(protocol_t *protocol, struct JsonNode *message) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	if(protocol->message != NULL) {
-		char *valid = json_stringify(protocol->message, NULL);
-		json_delete(protocol->message);
-		if(valid != NULL && json_validate(valid) == true) {
-			struct JsonNode *jmessage = json_mkobject();
-
-			json_append_member(jmessage, "message", json_decode(valid));
-			json_append_member(jmessage, "origin", json_mkstring("receiver"));
-			json_append_member(jmessage, "protocol", json_mkstring(protocol->id));
-			if(strlen(pilight_uuid) > 0) {
-				json_append_member(jmessage, "uuid", json_mkstring(pilight_uuid));
-			}
-			if(protocol->repeats > -1) {
-				json_append_member(jmessage, "repeats", json_mknumber(protocol->repeats, 0));
-			}
-			char *output = json_stringify(jmessage, NULL);
-			struct JsonNode *json = json_decode(output);
-			broadcast_queue(protocol->id, json, RECEIVER);
-			json_free(output);
-			json_delete(json);
-			json = NULL;
-			json_delete(jmessage);
+	if(message != NULL) {
+		/* Build the broadcast on the heap, so it can be queued as is */
+		struct json_arena_t *arena = json_arena_use(NULL);
+		struct JsonNode *jmessage = json_mkobject();
+
+		json_append_member(jmessage, "message", json_move(message));
+		json_append_member(jmessage, "origin", json_mkstring("receiver"));
+		json_append_member(jmessage, "protocol", json_mkstring(protocol->id));
+		if(strlen(pilight_uuid) > 0) {
+			json_append_member(jmessage, "uuid", json_mkstring(pilight_uuid));
+		}
+		if(protocol->repeats > -1) {
+			json_append_member(jmessage, "repeats", json_mknumber(protocol->repeats, 0));
 		}
-		json_free(valid);
+		json_arena_use(arena);
+
+		broadcast_queue_move(protocol->id, jmessage, RECEIVER);
 	}
-	protocol->message = NULL;
 }
 
-void *receive_parse_code(void *param) {
-	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+/*
+ * Broadcast the protocols matching a decoded pulse train. The decoders
+ * run in parallel, so wait until all pulse trains received earlier by
+ * the same hardware module are done. The repeats bookkeeping of the
+ * protocols is also done here, so it is never touched concurrently.
+ */
+static void receive_commit(struct recvring_t *ring, unsigned long seq, struct timeval *tv, int plslen, struct protocol_t **matches, struct JsonNode **messages, int nrmatches) {
+	struct protocol_t *protocol = NULL;
+	int i = 0;
 
-	pthread_mutex_lock(&recvqueue_lock);
-	while(main_loop) {
-		if(recvqueue_number > 0) {
-			pthread_mutex_lock(&recvqueue_lock);
+	pthread_mutex_lock(&recvcommit_lock);
+	while(ring->committed != seq && main_loop) {
+		pthread_cond_wait(&recvcommit_signal, &recvcommit_lock);
+	}
 
-			logprintf(LOG_STACK, "%s::unlocked", __FUNCTION__);
+	for(i=0;i<nrmatches;i++) {
+		if(main_loop == 0) {
+			if(messages[i] != NULL) {
+				json_delete(messages[i]);
+			}
+			continue;
+		}
+		protocol = matches[i];
+		if(protocol->first > 0) {
+			protocol->first = protocol->second;
+		}
+		protocol->second = 1000000 * (unsigned int)tv->tv_sec + (unsigned int)tv->tv_usec;
+		if(protocol->first == 0) {
+			protocol->first = protocol->second;
+		}
 
-			struct protocol_t *protocol = NULL;
-			struct protocols_t *pnode = protocols;
+		/* Reset # of repeats after a certain delay */
+		if(((int)protocol->second-(int)protocol->first) > 500000) {
+			protocol->repeats = 0;
+		}
 
-			while(pnode != NULL && main_loop) {
-				protocol = pnode->listener;
+		protocol->repeats++;
+		logprintf(LOG_DEBUG, "recevied pulse length of %d", plslen);
+		logprintf(LOG_DEBUG, "caught minimum # of repeats %d of %s", protocol->repeats, protocol->id);
+		receiver_create_message(protocol, messages[i]);
+	}
 
-				if((protocol->hwtype == recvqueue->hwtype || protocol->hwtype == -1 || recvqueue->hwtype == -1) &&
-				   (protocol->parseCode != NULL && protocol->validate != NULL)) {
+	ring->committed = seq+1;
+	pthread_cond_broadcast(&recvcommit_signal);
+	pthread_mutex_unlock(&recvcommit_lock);
+}
 
-					if(recvqueue->rawlen < MAXPULSESTREAMLENGTH) {
-						protocol->raw = recvqueue->raw;
-					}
-					protocol->rawlen = recvqueue->rawlen;
+void *receive_parse_code(void *param) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-					if(protocol->validate() == 0) {
-						logprintf(LOG_DEBUG, "possible %s protocol", protocol->id);
-						gettimeofday(&tv, NULL);
-						if(protocol->first > 0) {
-							protocol->first = protocol->second;
-						}
-						protocol->second = 1000000 * (unsigned int)tv.tv_sec + (unsigned int)tv.tv_usec;
-						if(protocol->first == 0) {
-							protocol->first = protocol->second;
-						}
+	/* All messages of a pulse train are built in this arena */
+	struct json_arena_t *arena = json_arena_create(JSON_ARENA_SIZE);
+	struct recvqueue_t recvqueue;
+	struct recvring_t *ring = NULL, *start = NULL;
+	struct protocol_decode_t decode;
+	struct timeval tv;
+	unsigned long seq = 0;
+	int found = 0;
 
-						/* Reset # of repeats after a certain delay */
-						if(((int)protocol->second-(int)protocol->first) > 500000) {
-							protocol->repeats = 0;
-						}
+	while(main_loop) {
+		if(sem_wait(&recvqueue_signal) != 0) {
+			continue;
+		}
+		if(main_loop == 0) {
+			break;
+		}
 
-						protocol->repeats++;
-						if(protocol->parseCode != NULL) {
-							logprintf(LOG_DEBUG, "recevied pulse length of %d", recvqueue->plslen);
-							logprintf(LOG_DEBUG, "caught minimum # of repeats %d of %s", protocol->repeats, protocol->id);
-							logprintf(LOG_DEBUG, "called %s parseRaw()", protocol->id);
-							protocol->parseCode();
-							receiver_create_message(protocol);
-						}
-					}
-				}
-				pnode = pnode->next;
+		logprintf(LOG_STACK, "%s::unlocked", __FUNCTION__);
+
+		/* Take turns between the receiver rings */
+		pthread_mutex_lock(&recvqueue_lock);
+		found = 0;
+		if(recvring_next == NULL) {
+			recvring_next = recvrings;
+		}
+		ring = start = recvring_next;
+		while(ring != NULL) {
+			if(receive_dequeue(ring, &recvqueue) == 0) {
+				seq = ring->seq++;
+				found = 1;
+			}
+			receive_ring_report(ring);
+			if((recvring_next = ring->next) == NULL) {
+				recvring_next = recvrings;
+			}
+			if(found == 1 || recvring_next == start) {
+				break;
 			}
+			ring = recvring_next;
+		}
+		pthread_mutex_unlock(&recvqueue_lock);
 
-			struct recvqueue_t *tmp = recvqueue;
-			recvqueue = recvqueue->next;
-			FREE(tmp);
-			recvqueue_number--;
-			pthread_mutex_unlock(&recvqueue_lock);
-		} else {
-			pthread_cond_wait(&recvqueue_signal, &recvqueue_lock);
+		if(found == 0) {
+			/* A producer is still overwriting the oldest pulse
+			   train, so give back the signal and try again */
+			sem_post(&recvqueue_signal);
+			usleep(1000);
+			continue;
+		}
+		gettimeofday(&tv, NULL);
+
+		struct protocol_t *protocol = NULL;
+		struct protocol_t *candidates[protocol_dispatch_size()+1];
+		struct protocol_t *matches[protocol_dispatch_size()+1];
+		struct JsonNode *messages[protocol_dispatch_size()+1];
+		int nrcandidates = 0, nrmatches = 0, i = 0;
+
+		/* Only validate the protocols that could match this rawlen and footer */
+		nrcandidates = protocol_dispatch(recvqueue.raw, recvqueue.rawlen, recvqueue.hwtype, candidates);
+
+		json_arena_use(arena);
+		for(i=0;i<nrcandidates && main_loop;i++) {
+			protocol = candidates[i];
+
+			decode.raw = recvqueue.raw;
+			decode.rawlen = recvqueue.rawlen;
+			decode.message = NULL;
+
+			if(protocol->validate(&decode) == 0) {
+				logprintf(LOG_DEBUG, "possible %s protocol", protocol->id);
+				logprintf(LOG_DEBUG, "called %s parseRaw()", protocol->id);
+				protocol->parseCode(&decode);
+				matches[nrmatches] = protocol;
+				messages[nrmatches] = decode.message;
+				nrmatches++;
+			}
 		}
+
+		receive_commit(ring, seq, &tv, recvqueue.plslen, matches, messages, nrmatches);
+		json_arena_use(NULL);
+		json_arena_reset(arena);
 	}
+	json_arena_free(arena);
 	return (void *)NULL;
 }
 
@@ -650,13 +938,14 @@ void *send_code(void *param) {
 			struct JsonNode *message = NULL;
 
 			if(sendqueue->message != NULL && strcmp(sendqueue->message, "{}") != 0) {
-				if(json_validate(sendqueue->message) == true) {
+				struct JsonNode *jmessage = NULL;
+				if((jmessage = json_decode(sendqueue->message)) != NULL) {
 					if(message == NULL) {
 						message = json_mkobject();
 					}
 					json_append_member(message, "origin", json_mkstring("sender"));
 					json_append_member(message, "protocol", json_mkstring(protocol->id));
-					json_append_member(message, "message", json_decode(sendqueue->message));
+					json_append_member(message, "message", jmessage);
 					if(strlen(sendqueue->uuid) > 0) {
 						json_append_member(message, "uuid", json_mkstring(sendqueue->uuid));
 					}
@@ -664,11 +953,12 @@ void *send_code(void *param) {
 				}
 			}
 			if(sendqueue->settings != NULL && strcmp(sendqueue->settings, "{}") != 0) {
-				if(json_validate(sendqueue->settings) == true) {
+				struct JsonNode *jsettings = NULL;
+				if((jsettings = json_decode(sendqueue->settings)) != NULL) {
 					if(message == NULL) {
 						message = json_mkobject();
 					}
-					json_append_member(message, "settings", json_decode(sendqueue->settings));
+					json_append_member(message, "settings", jsettings);
 				}
 			}
 
@@ -702,7 +992,7 @@ void *send_code(void *param) {
 				}
 				if(strcmp(protocol->id, "raw") == 0) {
 					int plslen = sendqueue->code[sendqueue->length-1]/PULSE_DIV;
-					receive_queue(sendqueue->code, sendqueue->length, plslen, -1);
+					receive_queue(recvring_sender, sendqueue->code, sendqueue->length, plslen, -1);
 				}
 				if(hw->receiveOOK != NULL || hw->receivePulseTrain != NULL) {
 					hw->wait = 0;
@@ -712,12 +1002,11 @@ void *send_code(void *param) {
 			} else {
 				if(strcmp(protocol->id, "raw") == 0) {
 					int plslen = sendqueue->code[sendqueue->length-1]/PULSE_DIV;
-					receive_queue(sendqueue->code, sendqueue->length, plslen, -1);
+					receive_queue(recvring_sender, sendqueue->code, sendqueue->length, plslen, -1);
 				}
 			}
 			if(message != NULL) {
-				broadcast_queue(sendqueue->protoname, message, sendqueue->origin);
-				json_delete(message);
+				broadcast_queue_move(sendqueue->protoname, message, sendqueue->origin);
 				message = NULL;
 			}
 
@@ -738,6 +1027,7 @@ void *send_code(void *param) {
 			pthread_cond_wait(&sendqueue_signal, &sendqueue_lock);
 		}
 	}
+	pthread_mutex_unlock(&sendqueue_lock);
 	return (void *)NULL;
 }
 
@@ -746,6 +1036,12 @@ static int send_queue(struct JsonNode *json, enum origin_t origin) {
 	pthread_mutex_lock(&sendqueue_lock);
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	/* Webserver workers can still send while the sender already stopped */
+	if(main_loop == 0) {
+		pthread_mutex_unlock(&sendqueue_lock);
+		return -1;
+	}
+
 	int match = 0, raw[MAXPULSESTREAMLENGTH-1];
 	struct timeval tcurrent;
 	struct clients_t *tmp_clients = NULL;
@@ -1098,6 +1394,88 @@ static int control_device(struct devices_t *dev, char *state, struct JsonNode *v
 	return -1;
 }
 
+/*
+ * Runs the send, control and registry actions of the socket
+ * and webserver clients. Returns 0 on success and -1 on failure.
+ * The value of a registry get is stored in jsend.
+ */
+static int client_action(struct JsonNode *json, struct JsonNode **jsend) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	char *action = NULL;
+
+	if(json_find_string(json, "action", &action) != 0) {
+		return -1;
+	}
+	if(strcmp(action, "send") == 0) {
+		return send_queue(json, SENDER);
+	} else if(strcmp(action, "control") == 0) {
+		struct JsonNode *code = NULL;
+		struct devices_t *dev = NULL;
+		char *device = NULL;
+		if((code = json_find_member(json, "code")) == NULL || code->tag != JSON_OBJECT) {
+			logprintf(LOG_ERR, "client did not send any codes");
+		/* Check if a location and device are given */
+		} else if(json_find_string(code, "device", &device) != 0) {
+			logprintf(LOG_ERR, "client did not send a device");
+		/* Check if the device and location exists in the config file */
+		} else if(devices_get(device, &dev) == 0) {
+			char *state = NULL;
+			struct JsonNode *values = NULL;
+
+			json_find_string(code, "state", &state);
+			if((values = json_find_member(code, "values")) != NULL) {
+				values = json_first_child(values);
+			}
+			return control_device(dev, state, values, SENDER);
+		} else {
+			logprintf(LOG_ERR, "the device \"%s\" does not exist", device);
+		}
+	} else if(strcmp(action, "registry") == 0) {
+		struct JsonNode *value = NULL;
+		char *type = NULL;
+		char *key = NULL;
+		char *sval = NULL;
+		double nval = 0.0;
+		int dec = 0;
+		if(json_find_string(json, "type", &type) != 0) {
+			logprintf(LOG_ERR, "client did not send a type of action");
+		} else if(json_find_string(json, "key", &key) != 0) {
+			logprintf(LOG_ERR, "client did not send a registry key");
+		} else if(strcmp(type, "set") == 0) {
+			if((value = json_find_member(json, "value")) == NULL) {
+				logprintf(LOG_ERR, "client did not send a registry value");
+			} else if(value->tag == JSON_NUMBER) {
+				return registry_set_number(key, value->number_, value->decimals_);
+			} else if(value->tag == JSON_STRING) {
+				return registry_set_string(key, value->string_);
+			} else {
+				logprintf(LOG_ERR, "registry value can only be a string or number");
+			}
+		} else if(strcmp(type, "remove") == 0) {
+			return registry_remove_value(key);
+		} else if(strcmp(type, "get") == 0) {
+			if(registry_get_number(key, &nval, &dec) == 0) {
+				*jsend = json_mkobject();
+				json_append_member(*jsend, "message", json_mkstring("registry"));
+				json_append_member(*jsend, "value", json_mknumber(nval, dec));
+				json_append_member(*jsend, "key", json_mkstring(key));
+				return 0;
+			} else if(registry_get_string(key, &sval) == 0) {
+				*jsend = json_mkobject();
+				json_append_member(*jsend, "message", json_mkstring("registry"));
+				json_append_member(*jsend, "value", json_mkstring(sval));
+				json_append_member(*jsend, "key", json_mkstring(key));
+				FREE(sval);
+				return 0;
+			} else {
+				logprintf(LOG_ERR, "registry key '%s' doesn't exists", key);
+			}
+		}
+	}
+	return -1;
+}
+
 /* Parse the incoming buffer from the client */
 static void socket_parse_data(int i, char *buffer) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
@@ -1131,11 +1509,10 @@ static void socket_parse_data(int i, char *buffer) {
 		if(strstr(buffer, " HTTP/")) {
 			client_webserver_parse_code(i, buffer);
 			socket_close(sd);
-		} else if(json_validate(buffer) == true) {
+		} else if((json = json_decode(buffer)) != NULL) {
 #else
-		if(json_validate(buffer) == true) {
+		if((json = json_decode(buffer)) != NULL) {
 #endif
-			json = json_decode(buffer);
 			if((json_find_string(json, "action", &action)) == 0) {
 				tmp_clients = clients;
 				while(tmp_clients) {
@@ -1239,116 +1616,19 @@ static void socket_parse_data(int i, char *buffer) {
 						}
 					}
 					socket_write(sd, "{\"status\":\"success\"}");
-				} else if(strcmp(action, "send") == 0) {
-					if(send_queue(json, SENDER) == 0) {
-						socket_write(sd, "{\"status\":\"success\"}");
-					} else {
+				} else if(strcmp(action, "send") == 0 ||
+				   strcmp(action, "control") == 0 ||
+				   strcmp(action, "registry") == 0) {
+					struct JsonNode *jsend = NULL;
+					if(client_action(json, &jsend) != 0) {
 						socket_write(sd, "{\"status\":\"failed\"}");
-					}
-				} else if(strcmp(action, "control") == 0) {
-					struct JsonNode *code = NULL;
-					struct devices_t *dev = NULL;
-					char *device = NULL;
-					if((code = json_find_member(json, "code")) == NULL || code->tag != JSON_OBJECT) {
-						logprintf(LOG_ERR, "client did not send any codes");
+					} else if(jsend != NULL) {
+						char *output = json_stringify(jsend, NULL);
+						socket_write(sd, output);
+						json_free(output);
+						json_delete(jsend);
 					} else {
-						/* Check if a location and device are given */
-						if(json_find_string(code, "device", &device) != 0) {
-							logprintf(LOG_ERR, "client did not send a device");
-						/* Check if the device and location exists in the config file */
-						} else if(devices_get(device, &dev) == 0) {
-							char *state = NULL;
-							struct JsonNode *values = NULL;
-
-							json_find_string(code, "state", &state);
-							if((values = json_find_member(code, "values")) != NULL) {
-								values = json_first_child(values);
-							}
-
-							if(control_device(dev, state, values, SENDER) == 0) {
-								socket_write(sd, "{\"status\":\"success\"}");
-							} else {
-								socket_write(sd, "{\"status\":\"failed\"}");
-							}
-						} else {
-							logprintf(LOG_ERR, "the device \"%s\" does not exist", device);
-						}
-					}
-				} else if(strcmp(action, "registry") == 0) {
-					struct JsonNode *value = NULL;
-					char *type = NULL;
-					char *key = NULL;
-					char *sval = NULL;
-					double nval = 0.0;
-					int dec = 0;
-					if(json_find_string(json, "type", &type) != 0) {
-						logprintf(LOG_ERR, "client did not send a type of action");
-					} else {
-						if(strcmp(type, "set") == 0) {
-							if(json_find_string(json, "key", &key) != 0) {
-								logprintf(LOG_ERR, "client did not send a registry key");
-								socket_write(sd, "{\"status\":\"failed\"}");
-							} else if((value = json_find_member(json, "value")) == NULL) {
-								logprintf(LOG_ERR, "client did not send a registry value");
-								socket_write(sd, "{\"status\":\"failed\"}");
-							} else {
-								if(value->tag == JSON_NUMBER) {
-									if(registry_set_number(key, value->number_, value->decimals_) == 0) {
-										socket_write(sd, "{\"status\":\"success\"}");
-									} else {
-										socket_write(sd, "{\"status\":\"failed\"}");
-									}
-								} else if(value->tag == JSON_STRING) {
-									if(registry_set_string(key, value->string_) == 0) {
-										socket_write(sd, "{\"status\":\"success\"}");
-									} else {
-										socket_write(sd, "{\"status\":\"failed\"}");
-									}
-								} else {
-									logprintf(LOG_ERR, "registry value can only be a string or number");
-									socket_write(sd, "{\"status\":\"failed\"}");
-								}
-							}
-						} else if(strcmp(type, "remove") == 0) {
-							if(json_find_string(json, "key", &key) != 0) {
-								logprintf(LOG_ERR, "client did not send a registry key");
-								socket_write(sd, "{\"status\":\"failed\"}");
-							} else {
-								if(registry_remove_value(key) == 0) {
-									socket_write(sd, "{\"status\":\"success\"}");
-								} else {
-									socket_write(sd, "{\"status\":\"failed\"}");
-								}
-							}
-						} else if(strcmp(type, "get") == 0) {
-							if(json_find_string(json, "key", &key) != 0) {
-								logprintf(LOG_ERR, "client did not send a registry key");
-								socket_write(sd, "{\"status\":\"failed\"}");
-							} else {
-								if(registry_get_number(key, &nval, &dec) == 0) {
-									struct JsonNode *jsend = json_mkobject();
-									json_append_member(jsend, "message", json_mkstring("registry"));
-									json_append_member(jsend, "value", json_mknumber(nval, dec));
-									json_append_member(jsend, "key", json_mkstring(key));
-									char *output = json_stringify(jsend, NULL);
-									socket_write(sd, output);
-									json_free(output);
-									json_delete(jsend);
-								} else if(registry_get_string(key, &sval) == 0) {
-									struct JsonNode *jsend = json_mkobject();
-									json_append_member(jsend, "message", json_mkstring("registry"));
-									json_append_member(jsend, "value", json_mkstring(sval));
-									json_append_member(jsend, "key", json_mkstring(key));
-									char *output = json_stringify(jsend, NULL);
-									socket_write(sd, output);
-									json_free(output);
-									json_delete(jsend);
-								} else {
-									logprintf(LOG_ERR, "registry key '%s' doesn't exists", key);
-									socket_write(sd, "{\"status\":\"failed\"}");
-								}
-							}
-						}
+						socket_write(sd, "{\"status\":\"success\"}");
 					}
 				} else if(strcmp(action, "request config") == 0) {
 					struct JsonNode *jsend = json_mkobject();
@@ -1453,6 +1733,7 @@ void *receivePulseTrain(void *param) {
 #endif
 
 	struct hardware_t *hw = (hardware_t *)param;
+	struct recvring_t *ring = receive_ring_get(hw);
 	pthread_mutex_lock(&hw->lock);
 	hw->running = 1;
 
@@ -1464,7 +1745,7 @@ void *receivePulseTrain(void *param) {
 			hw->receivePulseTrain(&r);
 			plslen = r.pulses[r.length-1]/PULSE_DIV;
 			if(r.length > 0) {
-				receive_queue(r.pulses, r.length, plslen, hw->hwtype);
+				receive_queue(ring, r.pulses, r.length, plslen, hw->hwtype);
 			} else if(r.length == -1) {
 				hw->init();
 				sleep(1);
@@ -1500,6 +1781,7 @@ void *receiveOOK(void *param) {
 #endif
 
 	struct hardware_t *hw = (hardware_t *)param;
+	struct recvring_t *ring = receive_ring_get(hw);
 	pthread_mutex_lock(&hw->lock);
 	hw->running = 1;
 	while(main_loop == 1 && hw->receiveOOK != NULL && hw->stop == 0) {
@@ -1519,7 +1801,7 @@ void *receiveOOK(void *param) {
 					}
 					/* Let's do a little filtering here as well */
 					if(r.length >= minrawlen && r.length <= maxrawlen) {
-						receive_queue(r.pulses, r.length, plslen, hw->hwtype);
+						receive_queue(ring, r.pulses, r.length, plslen, hw->hwtype);
 					}
 					r.length = 0;
 				}
@@ -1551,8 +1833,8 @@ void *clientize(void *param) {
 	struct JsonNode *jchilds = NULL;
 	struct JsonNode *tmp = NULL;
   char *recvBuff = NULL, *output = NULL;
-	char *message = NULL, *action = NULL;
-	char *origin = NULL, *protocol = NULL;
+	char *message = NULL, *protocol = NULL;
+	char action[16], origin[16];
 	int client_loop = 0, config_synced = 0;
 
 	while(main_loop) {
@@ -1621,8 +1903,7 @@ void *clientize(void *param) {
 
 		if(socket_read(sockfd, &recvBuff, 0) == 0) {
 			logprintf(LOG_DEBUG, "socket recv: %s", recvBuff);
-			if(json_validate(recvBuff) == true) {
-				json = json_decode(recvBuff);
+			if((json = json_decode(recvBuff)) != NULL) {
 				if(json_find_string(json, "message", &message) == 0) {
 					if(strcmp(message, "config") == 0) {
 						struct JsonNode *jconfig = NULL;
@@ -1684,21 +1965,20 @@ void *clientize(void *param) {
 			char **array = NULL;
 			unsigned int z = explode(recvBuff, "\n", &array), q = 0;
 			for(q=0;q<z;q++) {
-				if(json_validate(array[q]) == true) {
-					json = json_decode(array[q]);
-					if(json_find_string(json, "action", &action) == 0) {
-						if(strcmp(action, "send") == 0 ||
-						   strcmp(action, "control") == 0) {
-							socket_parse_data(sockfd, array[q]);
-						}
-					} else if(json_find_string(json, "origin", &origin) == 0 &&
-							json_find_string(json, "protocol", &protocol) == 0) {
-							if(strcmp(origin, "receiver") == 0 ||
-								 strcmp(origin, "sender") == 0) {
-								broadcast_queue(protocol, json, NODE);
+				/* Only decode the messages we act upon */
+				if(json_peek_string(array[q], "action", action, sizeof(action)) == true) {
+					if(strcmp(action, "send") == 0 ||
+					   strcmp(action, "control") == 0) {
+						socket_parse_data(sockfd, array[q]);
+					}
+				} else if(json_peek_string(array[q], "origin", origin, sizeof(origin)) == true &&
+						(strcmp(origin, "receiver") == 0 || strcmp(origin, "sender") == 0)) {
+					if((json = json_decode(array[q])) != NULL) {
+						if(json_find_string(json, "protocol", &protocol) == 0) {
+							broadcast_queue(protocol, json, NODE);
 						}
+						json_delete(json);
 					}
-					json_delete(json);
 				}
 			}
 			array_free(&array, z);
@@ -1758,6 +2038,8 @@ static void daemonize(void) {
 int main_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	int i = 0;
+
 	running = 0;
 	pilight.running = 0;
 	main_loop = 0;
@@ -1784,8 +2066,12 @@ int main_gc(void) {
 #endif
 
 	if(recvqueue_init == 1) {
-		pthread_mutex_unlock(&recvqueue_lock);
-		pthread_cond_signal(&recvqueue_signal);
+		for(i=0;i<recvqueue_workers;i++) {
+			sem_post(&recvqueue_signal);
+		}
+		pthread_mutex_lock(&recvcommit_lock);
+		pthread_cond_broadcast(&recvcommit_signal);
+		pthread_mutex_unlock(&recvcommit_lock);
 		usleep(1000);
 	}
 
@@ -1838,6 +2124,7 @@ int main_gc(void) {
 		FREE(master_server);
 	}
 
+	timer_gc();
 	datetime_gc();
 	ssdp_gc();
 	options_gc();
@@ -1848,6 +2135,14 @@ int main_gc(void) {
 	ntp_gc();
 	whitelist_free();
 	threads_gc();
+	if(recvqueue_init == 1) {
+		receive_ring_gc();
+		sem_destroy(&recvqueue_signal);
+		pthread_mutex_destroy(&recvqueue_lock);
+		pthread_mutex_destroy(&recvcommit_lock);
+		pthread_cond_destroy(&recvcommit_signal);
+		recvqueue_init = 0;
+	}
 #ifndef _WIN32
 	wiringXGC();
 #endif
@@ -2024,6 +2319,7 @@ void *pilight_stats(void *param) {
 						json_append_member(code, "ram", json_mknumber(ram, 16));
 					}
 					logprintf(LOG_DEBUG, "cpu: %f%%, ram: %f%%", cpu, ram);
+					logprintf(LOG_DEBUG, "protocol validations avoided: %lu", protocol_dispatch_avoided());
 					json_append_member(procProtocol->message, "values", code);
 					json_append_member(procProtocol->message, "origin", json_mkstring("core"));
 					json_append_member(procProtocol->message, "type", json_mknumber(PROCESS, 0));
@@ -2060,7 +2356,7 @@ int start_pilight(int argc, char **argv) {
 	int f = 0;
 #endif
 	char *stmp = NULL, *args = NULL, *p = NULL;
-	int port = 0;
+	int port = 0, i = 0;
 
 	wiringXLog = logprintf;
 
@@ -2282,6 +2578,7 @@ int start_pilight(int argc, char **argv) {
 	pilight.broadcast = &broadcast_queue;
 	pilight.send = &send_queue;
 	pilight.control = &control_device;
+	pilight.action = &client_action;
 
 	if(config_read() != EXIT_SUCCESS) {
 		goto clear;
@@ -2338,6 +2635,10 @@ int start_pilight(int argc, char **argv) {
 		log_level_set(itmp);
 	}
 
+	if(settings_find_number("log-flush-interval", &itmp) == 0) {
+		log_flush_interval_set(itmp);
+	}
+
 	if(settings_find_string("log-file", &stmp) == 0) {
 		if(log_file_set(stmp) == EXIT_FAILURE) {
 			goto clear;
@@ -2391,6 +2692,7 @@ int start_pilight(int argc, char **argv) {
 		}
 		tmp = tmp->next;
 	}
+	protocol_dispatch_init();
 
 	settings_find_number("port", &port);
 	settings_find_number("standalone", &standalone);
@@ -2444,10 +2746,16 @@ int start_pilight(int argc, char **argv) {
 	pthread_cond_init(&sendqueue_signal, NULL);
 	sendqueue_init = 1;
 
-	pthread_mutexattr_init(&recvqueue_attr);
-	pthread_mutexattr_settype(&recvqueue_attr, PTHREAD_MUTEX_RECURSIVE);
-	pthread_mutex_init(&recvqueue_lock, &recvqueue_attr);
-	pthread_cond_init(&recvqueue_signal, NULL);
+	settings_find_number("receive-queue-size", &recvqueue_size);
+	if(settings_find_string("receive-queue-policy", &stmp) == 0 && strcmp(stmp, "overwrite-oldest") == 0) {
+		recvqueue_overwrite = 1;
+	}
+	settings_find_number("receive-workers", &recvqueue_workers);
+	sem_init(&recvqueue_signal, 0, 0);
+	pthread_mutex_init(&recvqueue_lock, NULL);
+	pthread_mutex_init(&recvcommit_lock, NULL);
+	pthread_cond_init(&recvcommit_signal, NULL);
+	recvring_sender = receive_ring_add("sender", NULL);
 	recvqueue_init = 1;
 
 	pthread_mutexattr_init(&bcqueue_attr);
@@ -2463,6 +2771,8 @@ int start_pilight(int argc, char **argv) {
 
 	/* Start threads library that keeps track of all threads used */
 	threads_start();
+	/* The timers of the devices do not survive the fork either */
+	timer_start();
 
 	/* The daemon running in client mode, register a seperate thread that
 	   communicates with the server */
@@ -2487,6 +2797,9 @@ int start_pilight(int argc, char **argv) {
 			}
 			tmp_confhw->hardware->wait = 0;
 			tmp_confhw->hardware->stop = 0;
+			if(tmp_confhw->hardware->comtype == COMOOK || tmp_confhw->hardware->comtype == COMPLSTRAIN) {
+				receive_ring_add(tmp_confhw->hardware->id, tmp_confhw->hardware);
+			}
 			if(tmp_confhw->hardware->comtype == COMOOK) {
 				threads_register(tmp_confhw->hardware->id, &receiveOOK, (void *)tmp_confhw->hardware, 0);
 			} else if(tmp_confhw->hardware->comtype == COMPLSTRAIN) {
@@ -2496,7 +2809,9 @@ int start_pilight(int argc, char **argv) {
 		tmp_confhw = tmp_confhw->next;
 	}
 
-	threads_register("receive parser", &receive_parse_code, (void *)NULL, 0);
+	for(i=0;i<recvqueue_workers;i++) {
+		threads_register("receive parser", &receive_parse_code, (void *)NULL, 0);
+	}
 
 #ifdef EVENTS
 	if(pilight.runmode == STANDALONE) {
@@ -2512,11 +2827,6 @@ int start_pilight(int argc, char **argv) {
 	/* Register a seperate thread for the webserver */
 	if(webserver_enable == 1 && pilight.runmode == STANDALONE) {
 		webserver_start();
-		/* Register a seperate thread in which the webserver communicates the main daemon */
-		threads_register("webserver client", &webserver_clientize, (void *)NULL, 0);
-		if(webgui_websockets == 1) {
-			threads_register("webserver broadcast", &webserver_broadcast, (void *)NULL, 0);
-		}
 	} else {
 		webserver_enable = 0;
 	}
@@ -36,7 +36,6 @@
 #include "../core/config.h"
 #include "../core/ssdp.h"
 #include "../core/firmware.h"
-#include "../core/datetime.h"
 
 #include "../protocols/protocol.h"
 
@@ -49,15 +48,532 @@ struct config_t *config_devices;
 /* Struct to store the locations */
 static struct devices_t *devices = NULL;
 
+/* Hash table of the devices by their id */
+static struct devices_t **devices_hash = NULL;
+static unsigned int devices_hash_size = 0;
+static unsigned int devices_hash_count = 0;
+
+/* A code can be matched on this many id options at most */
+#define DEVICES_MAX_IDS		(sizeof(unsigned int)*8)
+
+/*
+ * The match plan of a protocol: its DEVICES_ID options in option
+ * order. Ids of devices and received codes are packed in this
+ * order, and a bitmask tells which of these options are present.
+ */
+typedef struct devices_plan_t {
+	struct protocol_t *protocol;
+	unsigned int hash;
+	unsigned int nrids;
+	struct options_t **ids;
+	struct devices_plan_t *next;
+} devices_plan_t;
+
+/* A device setting that codes of a protocol update */
+typedef struct devices_step_t {
+	struct devices_settings_t *setting;
+	/* The value option, or NULL for the state setting */
+	struct options_t *option;
+} devices_step_t;
+
+/* A device that codes of a protocol can update */
+typedef struct devices_bind_t {
+	struct devices_t *device;
+	struct devices_plan_t *plan;
+	int nrsteps;
+	struct devices_step_t *steps;
+	/* The id values of each id setting, nrids per setting */
+	int nrkeys;
+	struct devices_values_t **keys;
+	struct devices_bind_t *next;
+} devices_bind_t;
+
+/*
+ * Packed id key of a device. Every id setting is indexed once for
+ * each subset of the id options it holds, because a code that only
+ * carries some of these options still matches the device. Entries
+ * are kept in configuration order.
+ */
+typedef struct devices_index_t {
+	unsigned int hash;
+	unsigned int mask;
+	struct devices_bind_t *bind;
+	struct devices_values_t **values;
+	struct devices_index_t *next;
+} devices_index_t;
+
+static struct devices_plan_t **devices_plans = NULL;
+static unsigned int devices_plans_size = 0;
+static struct devices_bind_t *devices_binds = NULL;
+static struct devices_index_t **devices_index = NULL;
+static unsigned int devices_index_size = 0;
+
+static unsigned int devices_hash_string(unsigned int hash, const char *str) {
+	while(*str) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619U;
+	}
+	/* Keep "ab","c" apart from "a","bc" */
+	hash ^= 0xff;
+	hash *= 16777619U;
+	return hash;
+}
+
+static unsigned int devices_hash_value(unsigned int hash, int type, const char *string_, double number_) {
+	long long n = 0;
+
+	hash ^= (unsigned int)type;
+	hash *= 16777619U;
+	if(type == JSON_STRING) {
+		hash = devices_hash_string(hash, string_);
+	} else {
+		/* Numbers are compared within EPSILON, so only hash the integer part */
+		n = llround(number_);
+		hash ^= (unsigned int)(n ^ (n >> 32));
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static unsigned int devices_hash_mask(struct devices_plan_t *plan, unsigned int mask) {
+	unsigned int hash = plan->hash;
+
+	hash ^= mask;
+	hash *= 16777619U;
+	return hash;
+}
+
+static void devices_hash_add(struct devices_t *dev) {
+	struct devices_t **table = NULL;
+	struct devices_t *tmp = NULL;
+	unsigned int size = 0, i = 0, h = 0;
+
+	if(devices_hash_count >= devices_hash_size/2) {
+		size = (devices_hash_size == 0) ? 16 : devices_hash_size*2;
+		if((table = MALLOC(sizeof(struct devices_t *)*size)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(table, 0, sizeof(struct devices_t *)*size);
+		for(i=0;i<devices_hash_size;i++) {
+			while(devices_hash[i]) {
+				tmp = devices_hash[i];
+				devices_hash[i] = tmp->hnext;
+				h = devices_hash_string(2166136261U, tmp->id) & (size-1);
+				tmp->hnext = table[h];
+				table[h] = tmp;
+			}
+		}
+		if(devices_hash != NULL) {
+			FREE(devices_hash);
+		}
+		devices_hash = table;
+		devices_hash_size = size;
+	}
+
+	h = devices_hash_string(2166136261U, dev->id) & (devices_hash_size-1);
+	dev->hnext = devices_hash[h];
+	devices_hash[h] = dev;
+	devices_hash_count++;
+}
+
+static struct devices_plan_t *devices_plan_get(const char *protoname) {
+	struct devices_plan_t *plan = NULL;
+	unsigned int hash = 0;
+
+	if(devices_plans == NULL) {
+		return NULL;
+	}
+
+	hash = devices_hash_string(2166136261U, protoname);
+	plan = devices_plans[hash & (devices_plans_size-1)];
+	while(plan) {
+		if(plan->hash == hash && strcmp(plan->protocol->id, protoname) == 0) {
+			return plan;
+		}
+		plan = plan->next;
+	}
+	return NULL;
+}
+
+static void devices_plan_init(void) {
+	struct devices_plan_t *plan = NULL;
+	struct protocols_t *pptr = NULL;
+	struct options_t *opt = NULL;
+	unsigned int nrprotocols = 0, h = 0;
+
+	pptr = protocols;
+	while(pptr) {
+		nrprotocols++;
+		pptr = pptr->next;
+	}
+
+	devices_plans_size = 16;
+	while(devices_plans_size < nrprotocols*2) {
+		devices_plans_size *= 2;
+	}
+	if((devices_plans = MALLOC(sizeof(struct devices_plan_t *)*devices_plans_size)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(devices_plans, 0, sizeof(struct devices_plan_t *)*devices_plans_size);
+
+	pptr = protocols;
+	while(pptr) {
+		if((plan = MALLOC(sizeof(struct devices_plan_t))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		plan->protocol = pptr->listener;
+		plan->hash = devices_hash_string(2166136261U, plan->protocol->id);
+		plan->nrids = 0;
+		plan->ids = NULL;
+
+		opt = plan->protocol->options;
+		while(opt) {
+			if(opt->conftype == DEVICES_ID && plan->nrids < DEVICES_MAX_IDS) {
+				if((plan->ids = REALLOC(plan->ids, sizeof(struct options_t *)*(plan->nrids+1))) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+				plan->ids[plan->nrids++] = opt;
+			}
+			opt = opt->next;
+		}
+
+		h = plan->hash & (devices_plans_size-1);
+		plan->next = devices_plans[h];
+		devices_plans[h] = plan;
+
+		pptr = pptr->next;
+	}
+}
+
+static struct devices_bind_t *devices_bind_create(struct devices_t *dptr, struct devices_plan_t *plan) {
+	struct devices_bind_t *bind = NULL;
+	struct devices_settings_t *sptr = NULL;
+	struct devices_values_t *vptr = NULL;
+	struct devices_values_t **values = NULL;
+	struct options_t *opt = NULL;
+	unsigned int i = 0;
+
+	if((bind = MALLOC(sizeof(struct devices_bind_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	bind->device = dptr;
+	bind->plan = plan;
+	bind->nrsteps = 0;
+	bind->steps = NULL;
+	bind->nrkeys = 0;
+	bind->keys = NULL;
+	bind->next = NULL;
+
+	sptr = dptr->settings;
+	while(sptr) {
+		opt = plan->protocol->options;
+		while(opt) {
+			if(strcmp(sptr->name, opt->name) == 0
+			   && opt->conftype == DEVICES_VALUE
+			   && opt->argtype == OPTION_HAS_VALUE) {
+				if((bind->steps = REALLOC(bind->steps, sizeof(struct devices_step_t)*(size_t)(bind->nrsteps+1))) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+				bind->steps[bind->nrsteps].setting = sptr;
+				bind->steps[bind->nrsteps].option = opt;
+				bind->nrsteps++;
+			}
+			opt = opt->next;
+		}
+		if(strcmp(sptr->name, "state") == 0) {
+			if((bind->steps = REALLOC(bind->steps, sizeof(struct devices_step_t)*(size_t)(bind->nrsteps+1))) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			bind->steps[bind->nrsteps].setting = sptr;
+			bind->steps[bind->nrsteps].option = NULL;
+			bind->nrsteps++;
+		}
+		if(strcmp(sptr->name, "id") == 0) {
+			if((bind->keys = REALLOC(bind->keys, sizeof(struct devices_values_t *)*plan->nrids*(size_t)(bind->nrkeys+1))) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			values = &bind->keys[plan->nrids*(unsigned int)bind->nrkeys];
+			for(i=0;i<plan->nrids;i++) {
+				values[i] = NULL;
+				vptr = sptr->values;
+				while(vptr) {
+					if(strcmp(vptr->name, plan->ids[i]->name) == 0) {
+						values[i] = vptr;
+						break;
+					}
+					vptr = vptr->next;
+				}
+			}
+			bind->nrkeys++;
+		}
+		sptr = sptr->next;
+	}
+
+	return bind;
+}
+
+static void devices_index_init(void) {
+	struct devices_index_t **tails = NULL;
+	struct devices_index_t *list = NULL;
+	struct devices_index_t *last = NULL;
+	struct devices_index_t *node = NULL;
+	struct devices_bind_t *bind = NULL;
+	struct devices_bind_t *lastbind = NULL;
+	struct devices_values_t **values = NULL;
+	struct devices_plan_t *plan = NULL;
+	struct devices_t *dptr = NULL;
+	struct protocols_t *pptr = NULL;
+	struct protocols_t *tmp_protocols = NULL;
+	unsigned int mask = 0, sub = 0, hash = 0, h = 0, i = 0, nrnodes = 0;
+	int match = 0, x = 0;
+
+	devices_plan_init();
+
+	dptr = devices;
+	while(dptr) {
+		pptr = protocols;
+		while(pptr) {
+			/* Can codes of this protocol update this device */
+			match = 0;
+			tmp_protocols = dptr->protocols;
+			while(tmp_protocols) {
+				if(protocol_device_exists(pptr->listener, tmp_protocols->name) == 0) {
+					match = 1;
+					break;
+				}
+				tmp_protocols = tmp_protocols->next;
+			}
+			plan = devices_plan_get(pptr->listener->id);
+			if(match == 0 || plan == NULL || plan->nrids == 0) {
+				pptr = pptr->next;
+				continue;
+			}
+
+			bind = devices_bind_create(dptr, plan);
+			if(lastbind == NULL) {
+				devices_binds = bind;
+			} else {
+				lastbind->next = bind;
+			}
+			lastbind = bind;
+
+			for(x=0;x<bind->nrkeys;x++) {
+				values = &bind->keys[plan->nrids*(unsigned int)x];
+				mask = 0;
+				for(i=0;i<plan->nrids;i++) {
+					if(values[i] != NULL) {
+						mask |= (1U << i);
+					}
+				}
+				/* Walk all non-empty subsets of the mask */
+				for(sub=mask;sub>0;sub=(sub-1)&mask) {
+					hash = devices_hash_mask(plan, sub);
+					for(i=0;i<plan->nrids;i++) {
+						if((sub & (1U << i)) != 0) {
+							hash = devices_hash_value(hash, values[i]->type, values[i]->string_, values[i]->number_);
+						}
+					}
+					if((node = MALLOC(sizeof(struct devices_index_t))) == NULL) {
+						fprintf(stderr, "out of memory\n");
+						exit(EXIT_FAILURE);
+					}
+					node->hash = hash;
+					node->mask = sub;
+					node->bind = bind;
+					node->values = values;
+					node->next = NULL;
+					if(last == NULL) {
+						list = node;
+					} else {
+						last->next = node;
+					}
+					last = node;
+					nrnodes++;
+				}
+			}
+			pptr = pptr->next;
+		}
+		dptr = dptr->next;
+	}
+
+	devices_index_size = 16;
+	while(devices_index_size < nrnodes*2) {
+		devices_index_size *= 2;
+	}
+	if((devices_index = MALLOC(sizeof(struct devices_index_t *)*devices_index_size)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if((tails = MALLOC(sizeof(struct devices_index_t *)*devices_index_size)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(devices_index, 0, sizeof(struct devices_index_t *)*devices_index_size);
+	memset(tails, 0, sizeof(struct devices_index_t *)*devices_index_size);
+
+	while(list) {
+		node = list;
+		list = list->next;
+		node->next = NULL;
+
+		h = node->hash & (devices_index_size-1);
+		if(tails[h] == NULL) {
+			devices_index[h] = node;
+		} else {
+			tails[h]->next = node;
+		}
+		tails[h] = node;
+	}
+	FREE(tails);
+}
+
+static void devices_index_gc(void) {
+	struct devices_index_t *itmp = NULL;
+	struct devices_plan_t *ptmp = NULL;
+	struct devices_bind_t *btmp = NULL;
+	unsigned int i = 0;
+
+	if(devices_index != NULL) {
+		for(i=0;i<devices_index_size;i++) {
+			while(devices_index[i]) {
+				itmp = devices_index[i];
+				devices_index[i] = itmp->next;
+				FREE(itmp);
+			}
+		}
+		FREE(devices_index);
+	}
+	devices_index_size = 0;
+
+	while(devices_binds) {
+		btmp = devices_binds;
+		devices_binds = devices_binds->next;
+		if(btmp->steps != NULL) {
+			FREE(btmp->steps);
+		}
+		if(btmp->keys != NULL) {
+			FREE(btmp->keys);
+		}
+		FREE(btmp);
+	}
+
+	if(devices_plans != NULL) {
+		for(i=0;i<devices_plans_size;i++) {
+			while(devices_plans[i]) {
+				ptmp = devices_plans[i];
+				devices_plans[i] = ptmp->next;
+				if(ptmp->ids != NULL) {
+					FREE(ptmp->ids);
+				}
+				FREE(ptmp);
+			}
+		}
+		FREE(devices_plans);
+	}
+	devices_plans_size = 0;
+}
+
+/*
+ * Return the first index entry from node onwards that carries the
+ * packed id of the received code and belongs to another device
+ * than prev.
+ */
+static struct devices_index_t *devices_index_match(struct devices_index_t *node, struct devices_t *prev, struct devices_plan_t *plan, unsigned int hash, unsigned int mask, JsonNode **jids) {
+	struct devices_values_t *vptr = NULL;
+	unsigned int i = 0;
+
+	while(node) {
+		if(node->hash == hash && node->mask == mask &&
+		   node->bind->plan == plan && node->bind->device != prev) {
+			for(i=0;i<plan->nrids;i++) {
+				if((mask & (1U << i)) != 0) {
+					vptr = node->values[i];
+					if(vptr->type != (int)jids[i]->tag) {
+						break;
+					}
+					if(vptr->type == JSON_STRING && strcmp(vptr->string_, jids[i]->string_) != 0) {
+						break;
+					}
+					if(vptr->type == JSON_NUMBER && fabs(vptr->number_-jids[i]->number_) >= EPSILON) {
+						break;
+					}
+				}
+			}
+			if(i == plan->nrids) {
+				return node;
+			}
+		}
+		node = node->next;
+	}
+	return NULL;
+}
+
+static time_t devices_timestamp(time_t *utct) {
+	/* time() already counts in UTC, so there is nothing to convert */
+	if(*utct == 0) {
+		*utct = time(NULL);
+	}
+	return *utct;
+}
+
+/*
+ * Add the value of a device setting to the update message unless it
+ * is already there. The message is only created once it is certain
+ * to be sent, which is why a state that did not change is held back
+ * in pending until then.
+ */
+static int devices_values_add(JsonNode **rval, struct devices_settings_t **pending, time_t *utct, struct devices_settings_t *sptr, int update) {
+	char *stmp = NULL;
+	double itmp = 0.0;
+
+	if(*rval == NULL) {
+		if(update == 0) {
+			if(*pending == NULL) {
+				*pending = sptr;
+			}
+			return 0;
+		}
+		*rval = json_mkobject();
+		json_append_member(*rval, "timestamp", json_mknumber((double)devices_timestamp(utct), 0));
+		if(*pending != NULL) {
+			devices_values_add(rval, pending, utct, *pending, 1);
+			*pending = NULL;
+		}
+	}
+
+	if(sptr->values->type == JSON_STRING && json_find_string(*rval, sptr->name, &stmp) != 0) {
+		json_append_member(*rval, sptr->name, json_mkstring(sptr->values->string_));
+		return 1;
+	} else if(sptr->values->type == JSON_NUMBER && json_find_number(*rval, sptr->name, &itmp) != 0) {
+		json_append_member(*rval, sptr->name, json_mknumber(sptr->values->number_, sptr->values->decimals));
+		return 1;
+	}
+	return 0;
+}
+
 int devices_update(char *protoname, JsonNode *json, enum origin_t origin, JsonNode **out) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	/* The match plan of the used protocol */
+	struct devices_plan_t *plan = NULL;
+	/* The pointer to the matching index entries */
+	struct devices_index_t *node = NULL;
 	/* The pointer to the devices devices */
-	struct devices_t *dptr = devices;
+	struct devices_t *dptr = NULL;
 	/* The pointer to the device settings */
 	struct devices_settings_t *sptr = NULL;
-	/* The pointer to the device settings */
-	struct devices_values_t *vptr = NULL;
+	/* The state setting that has to go in the update message */
+	struct devices_settings_t *pending = NULL;
+	/* The pointer to the device settings to update */
+	struct devices_step_t *step = NULL;
 	/* The pointer to the registered protocols */
 	struct protocol_t *protocol = NULL;
 	/* The pointer to the protocol options */
@@ -66,10 +582,12 @@ int devices_update(char *protoname, JsonNode *json, enum origin_t origin, JsonNo
 	JsonNode *message = json_find_member(json, "message");
 	/* Get the settings part of the sended code */
 	JsonNode *settings = json_find_member(json, "settings");
+	/* The id values of the sended code in plan order */
+	JsonNode *jids[DEVICES_MAX_IDS];
 	/* The return JSON object will all updated devices */
-	JsonNode *rroot = json_mkobject();
-	JsonNode *rdev = json_mkarray();
-	JsonNode *rval = json_mkobject();
+	JsonNode *rroot = NULL;
+	JsonNode *rdev = NULL;
+	JsonNode *rval = NULL;
 
 	/* Temporarily char pointer */
 	char *stmp = NULL;
@@ -88,350 +606,279 @@ int devices_update(char *protoname, JsonNode *json, enum origin_t origin, JsonNo
 	int valueType = 0;
 	/* The UUID of this device */
 	char *uuid = NULL;
+	/* The time of this update */
+	time_t utct = 0;
 
-	/* Make sure the character pointers are empty */
-	memset(sstring_, '\0', sizeof(sstring_));
-	memset(vstring_, '\0', sizeof(vstring_));
-
-	/* Check if the found settings matches the send code */
-	unsigned int match = 0, match1 = 0, match2 = 0;
+	/* The packed id of the sended code */
+	unsigned int mask = 0, hash = 0, i = 0;
+	int x = 0, match = 0;
 
 	/* Is is a valid new state / value */
 	int is_valid = 1;
 
 	/* Retrieve the used protocol */
-	struct protocols_t *pnode = protocols;
-	while(pnode) {
-		protocol = pnode->listener;
-		if(strcmp(protocol->id, protoname) == 0) {
-			break;
+	if((plan = devices_plan_get(protoname)) == NULL || devices_index == NULL) {
+		return -1;
+	}
+	protocol = plan->protocol;
+
+	/* Pack the id of the sended code */
+	for(i=0;i<plan->nrids;i++) {
+		if((jids[i] = json_find_member(message, plan->ids[i]->name)) != NULL) {
+			if(jids[i]->tag != JSON_STRING && jids[i]->tag != JSON_NUMBER) {
+				return -1;
+			}
+			mask |= (1U << i);
+		}
+	}
+	if(mask == 0) {
+		return -1;
+	}
+	hash = devices_hash_mask(plan, mask);
+	for(i=0;i<plan->nrids;i++) {
+		if((mask & (1U << i)) != 0) {
+			hash = devices_hash_value(hash, jids[i]->tag, jids[i]->string_, jids[i]->number_);
 		}
-		pnode = pnode->next;
 	}
 
-	time_t timenow = time(NULL);
-	struct tm gmt;
-	memset(&gmt, '\0', sizeof(struct tm));
-#ifdef _WIN32
-	struct tm *tm;
-	tm = gmtime(&timenow);
-	memcpy(&gmt, tm, sizeof(struct tm));
-#else
-	gmtime_r(&timenow, &gmt);
-#endif
-	char utc[] = "UTC";
-	time_t utct = datetime2ts(gmt.tm_year+1900, gmt.tm_mon+1, gmt.tm_mday, gmt.tm_hour, gmt.tm_min, gmt.tm_sec, utc);
-	json_append_member(rval, "timestamp", json_mknumber((double)utct, 0));
+	node = devices_index_match(devices_index[hash & (devices_index_size-1)], NULL, plan, hash, mask, jids);
+	if(node == NULL) {
+		return -1;
+	}
+
+	/* Make sure the character pointers are empty */
+	memset(sstring_, '\0', sizeof(sstring_));
+	memset(vstring_, '\0', sizeof(vstring_));
+
+	/* Retrieve the new device state */
+	opt = protocol->options;
+	while(opt) {
+		if(opt->conftype == DEVICES_STATE) {
+			if(opt->argtype == OPTION_NO_VALUE) {
+				if(json_find_string(message, "state", &stmp) == 0) {
+					strcpy(sstring_, stmp);
+					stateType = JSON_STRING;
+				}
+				if(json_find_number(message, "state", &itmp) == 0) {
+					snumber_ = itmp;
+					stateType = JSON_NUMBER;
+				}
+			} else if(opt->argtype == OPTION_HAS_VALUE) {
+				if(json_find_string(message, opt->name, &stmp) == 0) {
+					strcpy(sstring_, stmp);
+					stateType = JSON_STRING;
+				}
+				struct JsonNode *jtmp = NULL;
+				if((jtmp = json_find_member(message, opt->name)) != NULL &&
+				    jtmp->tag == JSON_NUMBER) {
+					snumber_ = jtmp->number_;
+					sdecimals_ = jtmp->decimals_;
+					stateType = JSON_NUMBER;
+				}
+			}
+		}
+		opt = opt->next;
+	}
 
 	json_find_string(json, "uuid", &uuid);
 
-	if((opt = protocol->options)) {
-		/* Loop through all devices */
-
-		while(dptr) {
-			/*
-			 * uuid 				= The UUID of the pilight instance that received the specific information.
-			 * pilight_uuid	= The UUID of the currently running pilight instance this function was called on.
-			 * dev_uuid 		= The UUID of the device set by the user or the UUID of pilight instance that read the config.
-			 * ori_uuid			= The UUID of the pilight instance that parsed the config (mostly the master).
-			 * cst_uuid			= The UUID manually set the UUID of these devices
-			 *
-			 */
-			int uuidmatch = 0;
-			if(uuid != NULL && dptr->dev_uuid != NULL && dptr->ori_uuid != NULL && strlen(pilight_uuid) > 0) {
-				if(dptr->cst_uuid == 1) {
-					/* If the user forced the device UUID and it matches the UUID of the recieved code */
-					if(strcmp(dptr->dev_uuid, uuid) == 0) {
-						uuidmatch = 1;
-					}
-				} else {
+	/* Loop through all matching devices */
+	while(node) {
+		dptr = node->bind->device;
+		/*
+		 * uuid 				= The UUID of the pilight instance that received the specific information.
+		 * pilight_uuid	= The UUID of the currently running pilight instance this function was called on.
+		 * dev_uuid 		= The UUID of the device set by the user or the UUID of pilight instance that read the config.
+		 * ori_uuid			= The UUID of the pilight instance that parsed the config (mostly the master).
+		 * cst_uuid			= The UUID manually set the UUID of these devices
+		 *
+		 */
+		int uuidmatch = 0;
+		if(uuid != NULL && dptr->dev_uuid != NULL && dptr->ori_uuid != NULL && strlen(pilight_uuid) > 0) {
+			if(dptr->cst_uuid == 1) {
+				/* If the user forced the device UUID and it matches the UUID of the recieved code */
+				if(strcmp(dptr->dev_uuid, uuid) == 0) {
 					uuidmatch = 1;
 				}
-			} else if(uuid == NULL || strlen(pilight_uuid) == 0) {
+			} else {
 				uuidmatch = 1;
 			}
-			if(uuidmatch == 1) {
-				struct protocols_t *tmp_protocols = dptr->protocols;
-				match = 0;
-				while(tmp_protocols) {
-					if(protocol_device_exists(protocol, tmp_protocols->name) == 0) {
-						match = 1;
-						break;
+		} else if(uuid == NULL || strlen(pilight_uuid) == 0) {
+			uuidmatch = 1;
+		}
+		if(uuidmatch == 1) {
+			is_valid = 1;
+
+			if(protocol->checkValues) {
+				is_valid = 0;
+				JsonNode *jcode = json_mkobject();
+				for(x=0;x<node->bind->nrsteps;x++) {
+					opt = node->bind->steps[x].option;
+					/* Check if there are values that can be updated */
+					if(opt == NULL) {
+						continue;
+					}
+					memset(vstring_, '\0', sizeof(vstring_));
+					vnumber_ = -1;
+					if(json_find_string(message, opt->name, &stmp) == 0) {
+						strcpy(vstring_, stmp);
+						valueType = JSON_STRING;
+						is_valid = 1;
+					}
+					struct JsonNode *jtmp = NULL;
+					if((jtmp = json_find_member(message, opt->name)) != NULL &&
+					    jtmp->tag == JSON_NUMBER) {
+						vnumber_ = jtmp->number_;
+						vdecimals_ = jtmp->decimals_;
+						valueType = JSON_NUMBER;
+						is_valid = 1;
 					}
-					tmp_protocols = tmp_protocols->next;
-				}
 
-				if(match == 1) {
-					sptr = dptr->settings;
-					/* Loop through all settings */
-					while(sptr) {
-						match1 = 0; match2 = 0;
-
-						/* Check how many id's we need to match */
-						opt = protocol->options;
-						while(opt) {
-							if(opt->conftype == DEVICES_ID) {
-								JsonNode *jtmp = json_first_child(message);
-								while(jtmp) {
-									if(strcmp(jtmp->key, opt->name) == 0) {
-										match1++;
-									}
-									jtmp = jtmp->next;
-								}
-							}
-							opt = opt->next;
+					/* Check if the protocol settings of this device are valid to
+					   make sure no errors occur in the config.json. */
+					JsonNode *jsettings = json_first_child(settings);
+					while(jsettings) {
+						if(jsettings->tag == JSON_NUMBER) {
+							json_append_member(jcode, jsettings->key, json_mknumber(jsettings->number_, jsettings->decimals_));
+						} else if(jsettings->tag == JSON_STRING) {
+							json_append_member(jcode, jsettings->key, json_mkstring(jsettings->string_));
 						}
+						jsettings = jsettings->next;
+					}
+					if(valueType == JSON_STRING) {
+						json_append_member(jcode, opt->name, json_mkstring(vstring_));
+					} else {
+						json_append_member(jcode, opt->name, json_mknumber(vnumber_, vdecimals_));
+					}
+				}
+				if(protocol->checkValues(jcode) != 0) {
+					is_valid = 0;
+				}
+				json_delete(jcode);
+			}
 
-						/* Loop through all protocol options */
-						opt = protocol->options;
-						while(opt) {
-							if(opt->conftype == DEVICES_ID && strcmp(sptr->name, "id") == 0) {
-								/* Check the devices id's to match a device */
-								vptr = sptr->values;
-								while(vptr) {
-									if(strcmp(vptr->name, opt->name) == 0) {
-										if(json_find_string(message, opt->name, &stmp) == 0 &&
-										   vptr->type == JSON_STRING &&
-										   strcmp(stmp, vptr->string_) == 0) {
-											match2++;
-										}
-										if(json_find_number(message, opt->name, &itmp) == 0 &&
-										   vptr->type == JSON_NUMBER &&
-										   fabs(vptr->number_-itmp) < EPSILON) {
-											match2++;
-										}
-									}
-									vptr = vptr->next;
-								}
-							}
+			for(x=0;x<node->bind->nrsteps;x++) {
+				step = &node->bind->steps[x];
+				sptr = step->setting;
+				opt = step->option;
+
+				/* Check if there are values that can be updated */
+				if(opt != NULL) {
+					int upd_value = 1;
+					memset(vstring_, '\0', sizeof(vstring_));
+					vnumber_ = -1;
+					vdecimals_ = 0;
+					struct JsonNode *jtmp = NULL;
+					if(json_find_string(message, opt->name, &stmp) == 0) {
+						strcpy(vstring_, stmp);
+						valueType = JSON_STRING;
+					} else if((jtmp = json_find_member(message, opt->name)) != NULL &&
+					           jtmp->tag == JSON_NUMBER) {
+						vnumber_ = jtmp->number_;
+						vdecimals_ = jtmp->decimals_;
+						valueType = JSON_NUMBER;
+					} else {
+						upd_value = 0;
+					}
 
-							/* Retrieve the new device state */
-							if(opt->conftype == DEVICES_STATE) {
-								if(opt->argtype == OPTION_NO_VALUE) {
-									if(json_find_string(message, "state", &stmp) == 0) {
-										strcpy(sstring_, stmp);
-										stateType = JSON_STRING;
-									}
-									if(json_find_number(message, "state", &itmp) == 0) {
-										snumber_ = itmp;
-										stateType = JSON_NUMBER;
-									}
-								} else if(opt->argtype == OPTION_HAS_VALUE) {
-									if(json_find_string(message, opt->name, &stmp) == 0) {
-										strcpy(sstring_, stmp);
-										stateType = JSON_STRING;
-									}
-									struct JsonNode *jtmp = NULL;
-									if((jtmp = json_find_member(message, opt->name)) != NULL &&
-									    jtmp->tag == JSON_NUMBER) {
-										snumber_ = jtmp->number_;
-										sdecimals_ = jtmp->decimals_;
-										stateType = JSON_NUMBER;
-									}
-								}
+					if(is_valid == 1 && upd_value == 1) {
+						if(valueType == JSON_STRING &&
+						   strlen(vstring_) > 0 &&
+						   sptr->values->type == JSON_STRING &&
+						   strcmp(sptr->values->string_, vstring_) != 0) {
+							if((sptr->values->string_ = REALLOC(sptr->values->string_, strlen(vstring_)+1)) == NULL) {
+								fprintf(stderr, "out of memory\n");
+								exit(EXIT_FAILURE);
 							}
-							opt = opt->next;
+							strcpy(sptr->values->string_, vstring_);
+							sptr->values->type = JSON_STRING;
+						} else if(valueType == JSON_NUMBER &&
+								  sptr->values->type == JSON_NUMBER &&
+								  fabs(sptr->values->number_-vnumber_) >= EPSILON) {
+							sptr->values->number_ = vnumber_;
+							sptr->values->decimals = vdecimals_;
+							sptr->values->type = JSON_NUMBER;
 						}
-						if(match1 > 0 && match2 > 0 && match1 == match2) {
-							break;
+						if(devices_values_add(&rval, &pending, &utct, sptr, 1) == 1) {
+							update = 1;
 						}
-						sptr = sptr->next;
+						dptr->timestamp = devices_timestamp(&utct);
 					}
-					is_valid = 1;
-
-					/* If we matched a device, update it's state */
-					if(match1 > 0 && match2 > 0 && match1 == match2) {
-						if(protocol->checkValues) {
-							is_valid = 0;
-							JsonNode *jcode = json_mkobject();
-							sptr = dptr->settings;
-							while(sptr) {
-								opt = protocol->options;
-								/* Loop through all protocol options */
-								while(opt) {
-									/* Check if there are values that can be updated */
-									if(strcmp(sptr->name, opt->name) == 0
-									   && (opt->conftype == DEVICES_VALUE)
-									   && opt->argtype == OPTION_HAS_VALUE) {
-										memset(vstring_, '\0', sizeof(vstring_));
-										vnumber_ = -1;
-										if(json_find_string(message, opt->name, &stmp) == 0) {
-											strcpy(vstring_, stmp);
-											valueType = JSON_STRING;
-											is_valid = 1;
-										}
-										struct JsonNode *jtmp = NULL;
-										if((jtmp = json_find_member(message, opt->name)) != NULL &&
-										    jtmp->tag == JSON_NUMBER) {
-											vnumber_ = jtmp->number_;
-											vdecimals_ = jtmp->decimals_;
-											valueType = JSON_NUMBER;
-											is_valid = 1;
-										}
-
-										/* Check if the protocol settings of this device are valid to
-										   make sure no errors occur in the config.json. */
-										JsonNode *jsettings = json_first_child(settings);
-										while(jsettings) {
-											if(jsettings->tag == JSON_NUMBER) {
-												json_append_member(jcode, jsettings->key, json_mknumber(jsettings->number_, jsettings->decimals_));
-											} else if(jsettings->tag == JSON_STRING) {
-												json_append_member(jcode, jsettings->key, json_mkstring(jsettings->string_));
-											}
-											jsettings = jsettings->next;
-										}
-										if(valueType == JSON_STRING) {
-											json_append_member(jcode, opt->name, json_mkstring(vstring_));
-										} else {
-											json_append_member(jcode, opt->name, json_mknumber(vnumber_, vdecimals_));
-										}
-									}
-									opt = opt->next;
-								}
-								sptr = sptr->next;
-							}
-							if(protocol->checkValues(jcode) != 0) {
-								is_valid = 0;
-							}
-							json_delete(jcode);
+				/* Check if we need to update the state */
+				} else {
+					if((stateType == JSON_STRING &&
+						sptr->values->type == JSON_STRING &&
+						strcmp(sptr->values->string_, sstring_) != 0)) {
+						if((sptr->values->string_ = REALLOC(sptr->values->string_, strlen(sstring_)+1)) == NULL) {
+							fprintf(stderr, "out of memory\n");
+							exit(EXIT_FAILURE);
 						}
+						strcpy(sptr->values->string_, sstring_);
+						sptr->values->type = JSON_STRING;
+						dptr->timestamp = devices_timestamp(&utct);
+						update = 1;
+					} else if((stateType == JSON_NUMBER &&
+							   sptr->values->type == JSON_NUMBER &&
+							   fabs(sptr->values->number_-snumber_) < EPSILON)) {
+						sptr->values->number_ = snumber_;
+						sptr->values->decimals = sdecimals_;
+						sptr->values->type = JSON_NUMBER;
+						dptr->timestamp = devices_timestamp(&utct);
+						update = 1;
+					}
+					devices_values_add(&rval, &pending, &utct, sptr, update);
+				}
+			}
 
-						sptr = dptr->settings;
-						while(sptr) {
-							opt = protocol->options;
-							/* Loop through all protocol options */
-							while(opt) {
-								/* Check if there are values that can be updated */
-								if(strcmp(sptr->name, opt->name) == 0
-								   && (opt->conftype == DEVICES_VALUE)
-								   && opt->argtype == OPTION_HAS_VALUE) {
-									int upd_value = 1;
-									memset(vstring_, '\0', sizeof(vstring_));
-									vnumber_ = -1;
-									vdecimals_ = 0;
-									struct JsonNode *jtmp = NULL;
-									if(json_find_string(message, opt->name, &stmp) == 0) {
-										strcpy(vstring_, stmp);
-										valueType = JSON_STRING;
-									} else if((jtmp = json_find_member(message, opt->name)) != NULL &&
-									           jtmp->tag == JSON_NUMBER) {
-										vnumber_ = jtmp->number_;
-										vdecimals_ = jtmp->decimals_;
-										valueType = JSON_NUMBER;
-									} else {
-										upd_value = 0;
-									}
-
-									if(is_valid == 1 && upd_value == 1) {
-										if(valueType == JSON_STRING &&
-										   strlen(vstring_) > 0 &&
-										   sptr->values->type == JSON_STRING &&
-										   strcmp(sptr->values->string_, vstring_) != 0) {
-											if((sptr->values->string_ = REALLOC(sptr->values->string_, strlen(vstring_)+1)) == NULL) {
-												fprintf(stderr, "out of memory\n");
-												exit(EXIT_FAILURE);
-											}
-											strcpy(sptr->values->string_, vstring_);
-											sptr->values->type = JSON_STRING;
-										} else if(valueType == JSON_NUMBER &&
-												  sptr->values->type == JSON_NUMBER &&
-												  fabs(sptr->values->number_-vnumber_) >= EPSILON) {
-											sptr->values->number_ = vnumber_;
-											sptr->values->decimals = vdecimals_;
-											sptr->values->type = JSON_NUMBER;
-										}
-										if(sptr->values->type == JSON_STRING && json_find_string(rval, sptr->name, &stmp) != 0) {
-											json_append_member(rval, sptr->name, json_mkstring(sptr->values->string_));
-											update = 1;
-										} else if(sptr->values->type == JSON_NUMBER && json_find_number(rval, sptr->name, &itmp) != 0) {
-											json_append_member(rval, sptr->name, json_mknumber(sptr->values->number_, sptr->values->decimals));
-											update = 1;
-										}
-										dptr->timestamp = utct;
-									}
-									//break;
-								}
-								opt = opt->next;
-							}
-
-							/* Check if we need to update the state */
-							if(strcmp(sptr->name, "state") == 0) {
-								if((stateType == JSON_STRING &&
-									sptr->values->type == JSON_STRING &&
-									strcmp(sptr->values->string_, sstring_) != 0)) {
-									if((sptr->values->string_ = REALLOC(sptr->values->string_, strlen(sstring_)+1)) == NULL) {
-										fprintf(stderr, "out of memory\n");
-										exit(EXIT_FAILURE);
-									}
-									strcpy(sptr->values->string_, sstring_);
-									sptr->values->type = JSON_STRING;
-									dptr->timestamp = utct;
-									update = 1;
-								} else if((stateType == JSON_NUMBER &&
-										   sptr->values->type == JSON_NUMBER &&
-										   fabs(sptr->values->number_-snumber_) < EPSILON)) {
-									sptr->values->number_ = snumber_;
-									sptr->values->decimals = sdecimals_;
-									sptr->values->type = JSON_NUMBER;
-									dptr->timestamp = utct;
-									update = 1;
-								}
-								if(sptr->values->type == JSON_STRING && json_find_string(rval, sptr->name, &stmp) != 0) {
-									json_append_member(rval, sptr->name, json_mkstring(sptr->values->string_));
-								} else if(sptr->values->type == JSON_NUMBER && json_find_number(rval, sptr->name, &itmp) != 0) {
-									json_append_member(rval, sptr->name, json_mknumber(sptr->values->number_, sptr->values->decimals));
-								}
-								//break;
-							}
-							if(update == 1) {
-								match = 0;
-								struct JsonNode *jchild = json_first_child(rdev);
-								while(jchild) {
-									if(jchild->tag == JSON_STRING && strcmp(dptr->id, jchild->string_) == 0) {
-										match = 1;
-										break;
-									}
-									jchild = jchild->next;
-								}
-								if(match == 0) {
+			if(update == 1) {
+				if(rdev == NULL) {
+					rdev = json_mkarray();
+				}
+				match = 0;
+				struct JsonNode *jchild = json_first_child(rdev);
+				while(jchild) {
+					if(jchild->tag == JSON_STRING && strcmp(dptr->id, jchild->string_) == 0) {
+						match = 1;
+						break;
+					}
+					jchild = jchild->next;
+				}
+				if(match == 0) {
 #ifdef EVENTS
-								/*
-								 * If the action itself it not triggering a device update, something
-								 * else is. We therefor need to abort the running action to let
-								 * the new state persist.
-								 */
-									if(dptr->action_thread->running == 1 && origin != ACTION) {
-										event_action_thread_stop(dptr);
-									}
+				/*
+				 * If the action itself it not triggering a device update, something
+				 * else is. We therefor need to abort the running action to let
+				 * the new state persist.
+				 */
+					if(origin != ACTION) {
+						event_action_thread_stop(dptr);
+					}
 
-									/*
-									 * We store the rule number that triggered the device change.
-									 * The eventing library can then check if the same rule is
-									 * triggered again so infinite loops can be prevented.
-									 */
-									if(origin == ACTION) {
-										if(dptr->action_thread->obj != NULL) {
-											dptr->prevrule = dptr->lastrule;
-											dptr->lastrule = dptr->action_thread->obj->rule->nr;
-										}
-									} else {
-										dptr->lastrule = -1;
-										dptr->prevrule = -1;
-									}
-#endif
-									json_append_element(rdev, json_mkstring(dptr->id));
-								}
-							}
-							sptr = sptr->next;
+					/*
+					 * We store the rule number that triggered the device change.
+					 * The eventing library can then check if the same rule is
+					 * triggered again so infinite loops can be prevented.
+					 */
+					if(origin == ACTION) {
+						int nr = event_action_thread_rule(dptr);
+						if(nr != -1) {
+							dptr->prevrule = dptr->lastrule;
+							dptr->lastrule = nr;
 						}
+					} else {
+						dptr->lastrule = -1;
+						dptr->prevrule = -1;
 					}
+#endif
+					json_append_element(rdev, json_mkstring(dptr->id));
 				}
 			}
-			dptr = dptr->next;
 		}
+		node = devices_index_match(node->next, dptr, plan, hash, mask, jids);
 	}
 
 	if(update == 1) {
+		rroot = json_mkobject();
 		json_append_member(rroot, "origin", json_mkstring("update"));
 		json_append_member(rroot, "type",  json_mknumber((int)protocol->devtype, 0));
 		if(strlen(pilight_uuid) > 0 && (protocol->hwtype == SENSOR || protocol->hwtype == HWRELAY)) {
@@ -441,10 +888,6 @@ int devices_update(char *protoname, JsonNode *json, enum origin_t origin, JsonNo
 		json_append_member(rroot, "values", rval);
 
 		*out = rroot;
-	} else {
-		json_delete(rdev);
-		json_delete(rval);
-		json_delete(rroot);
 	}
 
 	return (update == 1) ? 0 : -1;
@@ -455,7 +898,11 @@ int devices_get(char *sid, struct devices_t **dev) {
 
 	struct devices_t *dptr = NULL;
 
-	dptr = devices;
+	if(devices_hash == NULL) {
+		return 1;
+	}
+
+	dptr = devices_hash[devices_hash_string(2166136261U, sid) & (devices_hash_size-1)];
 	while(dptr) {
 		if(strcmp(dptr->id, sid) == 0) {
 			if(dev != NULL) {
@@ -463,7 +910,7 @@ int devices_get(char *sid, struct devices_t **dev) {
 			}
 			return 0;
 		}
-		dptr = dptr->next;
+		dptr = dptr->hnext;
 	}
 
 	return 1;
@@ -1520,13 +1967,9 @@ static int devices_parse(JsonNode *root) {
 					}
 				}
 				/* Check for duplicate fields */
-				tmp_devices = devices;
-				while(tmp_devices) {
-					if(strcmp(tmp_devices->id, jdevices->key) == 0) {
-						logprintf(LOG_ERR, "config device #%d \"%s\", duplicate", i, jdevices->key);
-						have_error = 1;
-					}
-					tmp_devices = tmp_devices->next;
+				if(devices_get(jdevices->key, NULL) == 0) {
+					logprintf(LOG_ERR, "config device #%d \"%s\", duplicate", i, jdevices->key);
+					have_error = 1;
 				}
 
 				if((dnode = MALLOC(sizeof(struct devices_t))) == NULL) {
@@ -1547,10 +1990,15 @@ static int devices_parse(JsonNode *root) {
 				dnode->timestamp = 0;
 				dnode->protocol_threads = NULL;
 				dnode->settings = NULL;
+				dnode->hnext = NULL;
 				dnode->next = NULL;
 				dnode->protocols = NULL;
 
 #ifdef EVENTS
+				dnode->lastrule = -1;
+				dnode->prevrule = -1;
+				dnode->rules = NULL;
+				dnode->nrrules = 0;
 				event_action_thread_init(dnode);
 #endif
 
@@ -1630,6 +2078,7 @@ static int devices_parse(JsonNode *root) {
 					dnode->next = devices;
 					devices = dnode;
 				}
+				devices_hash_add(dnode);
 
 				if(have_error) {
 					goto clear;
@@ -1651,12 +2100,23 @@ int devices_gc(void) {
 	struct devices_values_t *vtmp;
 	struct protocols_t *ptmp;
 
+	devices_index_gc();
+
+	if(devices_hash != NULL) {
+		FREE(devices_hash);
+	}
+	devices_hash_size = 0;
+	devices_hash_count = 0;
+
 	/* Free devices structure */
 	while(devices) {
 		dtmp = devices;
 
 #ifdef EVENTS
 		event_action_thread_free(dtmp);
+		if(dtmp->rules != NULL) {
+			FREE(dtmp->rules);
+		}
 #endif
 
 		while(dtmp->settings) {
@@ -1724,6 +2184,7 @@ int devices_gc(void) {
 
 static int devices_read(JsonNode *root) {
 	if(devices_parse(root) == 0 && devices_validate_settings() == 0) {
+		devices_index_init();
 		return 0;
 	} else {
 		return 1;
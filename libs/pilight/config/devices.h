@@ -83,11 +83,15 @@ struct devices_t {
 #ifdef EVENTS
 	int lastrule;
 	int prevrule;
-	struct event_action_thread_t *action_thread;
+	/* Rules referencing this device, ordered by rule number */
+	struct rules_t **rules;
+	int nrrules;
+	struct event_action_queue_t *action_queue;
 #endif
 	struct protocols_t *protocols;
 	struct devices_settings_t *settings;
 	struct threadqueue_t **protocol_threads;
+	struct devices_t *hnext;
 	struct devices_t *next;
 };
 
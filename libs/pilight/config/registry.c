@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include "../core/pilight.h"
 #include "../core/common.h"
@@ -33,6 +34,8 @@
 #include "registry.h"
 
 struct JsonNode *registry = NULL;
+/* Socket clients, webserver workers and hardware threads all use the registry */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int registry_get_value_recursive(struct JsonNode *root, const char *key, void **value, void **decimals, int type) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
@@ -170,60 +173,92 @@ static int registry_remove_value_recursive(struct JsonNode *root, const char *ke
 int registry_get_string(const char *key, char **value) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	if(registry == NULL) {
-		return -1;
+	char *p = NULL;
+	int ret = -1;
+
+	pthread_mutex_lock(&registry_lock);
+	if(registry != NULL) {
+		ret = registry_get_value_recursive(registry, key, (void *)&p, NULL, JSON_STRING);
+	}
+	/* The node can be changed as soon as the lock is released */
+	if(ret == 0) {
+		if((*value = MALLOC(strlen(p)+1)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		strcpy(*value, p);
 	}
-	return registry_get_value_recursive(registry, key, (void *)value, NULL, JSON_STRING);
+	pthread_mutex_unlock(&registry_lock);
+	return ret;
 }
 
 int registry_get_number(const char *key, double *value, int *decimals) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	if(registry == NULL) {
-		return -1;
-	}
 	void *p = NULL;
 	void *q = NULL;
-	int ret = registry_get_value_recursive(registry, key, &p, &q, JSON_NUMBER);
+	int ret = -1;
+
+	pthread_mutex_lock(&registry_lock);
+	if(registry != NULL) {
+		ret = registry_get_value_recursive(registry, key, &p, &q, JSON_NUMBER);
+	}
 	if(ret == 0) {
 		*value = *(double *)p;
 		*decimals = *(int *)q;
 	}
+	pthread_mutex_unlock(&registry_lock);
 	return ret;
 }
 
 int registry_set_string(const char *key, char *value) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	int ret = 0;
+
+	pthread_mutex_lock(&registry_lock);
 	if(registry == NULL) {
 		registry = json_mkobject();
 	}
-	return registry_set_value_recursive(registry, key, (void *)value, 0, JSON_STRING);
+	ret = registry_set_value_recursive(registry, key, (void *)value, 0, JSON_STRING);
+	pthread_mutex_unlock(&registry_lock);
+	return ret;
 }
 
 int registry_set_number(const char *key, double value, int decimals) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	void *p = (void *)&value;
+	int ret = 0;
+
+	pthread_mutex_lock(&registry_lock);
 	if(registry == NULL) {
 		registry = json_mkobject();
 	}
-	void *p = (void *)&value;
-	return registry_set_value_recursive(registry, key, p, decimals, JSON_NUMBER);
+	ret = registry_set_value_recursive(registry, key, p, decimals, JSON_NUMBER);
+	pthread_mutex_unlock(&registry_lock);
+	return ret;
 }
 
 int registry_remove_value(const char *key) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	if(registry == NULL) {
-		return -1;
+	int ret = -1;
+
+	pthread_mutex_lock(&registry_lock);
+	if(registry != NULL) {
+		ret = registry_remove_value_recursive(registry, key);
 	}
-	return registry_remove_value_recursive(registry, key);
+	pthread_mutex_unlock(&registry_lock);
+	return ret;
 }
 
 static int registry_parse(JsonNode *root) {
 	if(root->tag == JSON_OBJECT) {
 		char *content = json_stringify(root, NULL);
+		pthread_mutex_lock(&registry_lock);
 		registry = json_decode(content);
+		pthread_mutex_unlock(&registry_lock);
 		json_free(content);
 	} else {
 		logprintf(LOG_ERR, "config registry should be of an object type");
@@ -233,21 +268,25 @@ static int registry_parse(JsonNode *root) {
 }
 
 static JsonNode *registry_sync(int level, const char *display) {
+	struct JsonNode *jret = NULL;
+
+	pthread_mutex_lock(&registry_lock);
 	if(registry != NULL) {
 		char *content = json_stringify(registry, NULL);
-		struct JsonNode *jret = json_decode(content);
+		jret = json_decode(content);
 		json_free(content);
-		return jret;
-	} else {
-		return NULL;
 	}
+	pthread_mutex_unlock(&registry_lock);
+	return jret;
 }
 
 int registry_gc(void) {
+	pthread_mutex_lock(&registry_lock);
 	if(registry != NULL) {
 		json_delete(registry);
 	}
 	registry = NULL;
+	pthread_mutex_unlock(&registry_lock);
 	logprintf(LOG_DEBUG, "garbage collected config registry library");
 	return 1;
 }
@@ -36,9 +36,65 @@
 #include "../events/action.h"
 #include "../events/function.h"
 #include "rules.h"
+#include "devices.h"
 #include "gui.h"
 
 static struct rules_t *rules = NULL;
+/* Rules that only reference datetime or sunriseset devices */
+static struct rules_t **rules_timed = NULL;
+static int nrrules_timed = 0;
+
+int rules_timer_device(struct devices_t *dev) {
+	struct protocols_t *tmp = dev->protocols;
+
+	if(tmp == NULL) {
+		return 0;
+	}
+	while(tmp) {
+		if(tmp->listener->devtype != DATETIME &&
+		   strcmp(tmp->listener->id, "sunriseset") != 0) {
+			return 0;
+		}
+		tmp = tmp->next;
+	}
+	return 1;
+}
+
+/*
+ * Link the rule to the devices it references so the
+ * eventing loop only has to look at the rules affected
+ * by an update. Rules depending on time devices only are
+ * kept aside on the timed list.
+ */
+static void rules_index_add(struct rules_t *node) {
+	struct devices_t *dev = NULL;
+	int i = 0, timed = 1;
+
+	for(i=0;i<node->nrdevices;i++) {
+		if(devices_get(node->devices[i], &dev) == 0) {
+			if(rules_timer_device(dev) == 0) {
+				timed = 0;
+			}
+		}
+	}
+	if(node->nrdevices > 0 && timed == 1) {
+		if((rules_timed = REALLOC(rules_timed, sizeof(struct rules_t *)*(size_t)(nrrules_timed+1))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		rules_timed[nrrules_timed++] = node;
+		return;
+	}
+	for(i=0;i<node->nrdevices;i++) {
+		if(devices_get(node->devices[i], &dev) == 0) {
+			if((dev->rules = REALLOC(dev->rules, sizeof(struct rules_t *)*(size_t)(dev->nrrules+1))) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			dev->rules[dev->nrrules++] = node;
+		}
+	}
+}
 
 static int rules_parse(JsonNode *root) {
 	int have_error = 0, match = 0, x = 0;
@@ -93,6 +149,7 @@ static int rules_parse(JsonNode *root) {
 					node->status = 0;
 					node->devices = NULL;
 					node->actions = NULL;
+					node->compiled = NULL;
 					node->nr = i;
 					if((node->name = MALLOC(strlen(jrules->key)+1)) == NULL) {
 						fprintf(stderr, "out of memory\n");
@@ -116,6 +173,11 @@ static int rules_parse(JsonNode *root) {
 					strcpy(node->rule, rule);
 					node->active = (unsigned short)active;
 
+					if(have_error == 0) {
+						event_compile_rule(node);
+						rules_index_add(node);
+					}
+
 					tmp = rules;
 					if(tmp) {
 						while(tmp->next != NULL) {
@@ -189,6 +251,11 @@ struct rules_t *rules_get(void) {
 	return rules;
 }
 
+struct rules_t **rules_get_timed(int *nr) {
+	*nr = nrrules_timed;
+	return rules_timed;
+}
+
 int rules_gc(void) {
 	struct rules_t *tmp_rules = NULL;
 	struct rules_values_t *tmp_values = NULL;
@@ -197,6 +264,7 @@ int rules_gc(void) {
 
 	while(rules) {
 		tmp_rules = rules;
+		event_free_rule(tmp_rules);
 		FREE(tmp_rules->name);
 		FREE(tmp_rules->rule);
 		for(i=0;i<tmp_rules->nrdevices;i++) {
@@ -239,6 +307,11 @@ int rules_gc(void) {
 	}
 	rules = NULL;
 
+	if(rules_timed != NULL) {
+		FREE(rules_timed);
+	}
+	nrrules_timed = 0;
+
 	logprintf(LOG_DEBUG, "garbage collected config rules library");
 	return 1;
 }
@@ -54,6 +54,8 @@ typedef struct rules_t {
 	/* Arguments to be send to the action */
 	struct rules_actions_t *actions;
 	struct rules_values_t *values;
+	/* Condition as compiled by event_compile_rule */
+	struct event_node_t *compiled;
 	struct rules_t *next;
 } rules_t;
 
@@ -62,5 +64,7 @@ struct config_t *config_rules;
 void rules_init(void);
 int rules_gc(void);
 struct rules_t *rules_get(void);
+struct rules_t **rules_get_timed(int *nr);
+int rules_timer_device(struct devices_t *dev);
 
 #endif
@@ -228,6 +228,63 @@ static int settings_parse(JsonNode *root) {
 			} else {
 				settings_add_number(jsettings->key, (int)jsettings->number_);
 			}
+		} else if(strcmp(jsettings->key, "receive-queue-size") == 0) {
+			if(jsettings->tag != JSON_NUMBER) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 1024", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else if((int)jsettings->number_ < 1 || (int)jsettings->number_ > 1024) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 1024", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else {
+				settings_add_number(jsettings->key, (int)jsettings->number_);
+			}
+		} else if(strcmp(jsettings->key, "receive-workers") == 0) {
+			if(jsettings->tag != JSON_NUMBER) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 32", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else if((int)jsettings->number_ < 1 || (int)jsettings->number_ > 32) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 32", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else {
+				settings_add_number(jsettings->key, (int)jsettings->number_);
+			}
+		} else if(strcmp(jsettings->key, "action-workers") == 0) {
+			if(jsettings->tag != JSON_NUMBER) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 32", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else if((int)jsettings->number_ < 1 || (int)jsettings->number_ > 32) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 32", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else {
+				settings_add_number(jsettings->key, (int)jsettings->number_);
+			}
+		} else if(strcmp(jsettings->key, "receive-queue-policy") == 0) {
+			if(jsettings->tag != JSON_STRING || jsettings->string_ == NULL ||
+			   (strcmp(jsettings->string_, "drop-newest") != 0 && strcmp(jsettings->string_, "overwrite-oldest") != 0)) {
+				logprintf(LOG_ERR, "config setting \"%s\" must be either \"drop-newest\" or \"overwrite-oldest\"", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else {
+				settings_add_string(jsettings->key, jsettings->string_);
+			}
+		} else if(strcmp(jsettings->key, "log-flush-interval") == 0) {
+			if(jsettings->tag != JSON_NUMBER) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 0 till 3600", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else if((int)jsettings->number_ < 0 || (int)jsettings->number_ > 3600) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 0 till 3600", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else {
+				settings_add_number(jsettings->key, (int)jsettings->number_);
+			}
 		} else if(strcmp(jsettings->key, "log-level") == 0) {
 			if(jsettings->tag != JSON_NUMBER) {
 				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 0 till 6", jsettings->key);
@@ -356,6 +413,18 @@ static int settings_parse(JsonNode *root) {
 			} else {
 				settings_add_number(jsettings->key, (int)jsettings->number_);
 			}
+		} else if(strcmp(jsettings->key, "webserver-workers") == 0) {
+			if(jsettings->tag != JSON_NUMBER) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 32", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else if((int)jsettings->number_ < 1 || (int)jsettings->number_ > 32) {
+				logprintf(LOG_ERR, "config setting \"%s\" must contain a number from 1 till 32", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else {
+				settings_add_number(jsettings->key, (int)jsettings->number_);
+			}
 		} else if(strcmp(jsettings->key, "webserver-cache") == 0 ||
 		          strcmp(jsettings->key, "webgui-websockets") == 0) {
 			if(jsettings->tag != JSON_NUMBER) {
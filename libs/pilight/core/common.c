@@ -415,7 +415,7 @@ int which(const char *program) {
 
 	n = explode(path, ":", &array);
 	for(i=0;i<n;i++) {
-		char exec[strlen(array[i])+8];
+		char exec[strlen(array[i])+strlen(program)+2];
 		strcpy(exec, array[i]);
 		strcat(exec, "/");
 		strcat(exec, program);
@@ -217,12 +217,11 @@ int config_read(void) {
 	fclose(fp);
 
 	/* Validate JSON and turn into JSON object */
-	if(json_validate(content) == false) {
+	if((root = json_decode(content)) == NULL) {
 		logprintf(LOG_ERR, "config is not in a valid json format");
 		FREE(content);
 		return EXIT_FAILURE;
 	}
-	root = json_decode(content);
 
 	if(config_parse(root) != EXIT_SUCCESS) {
 		FREE(content);
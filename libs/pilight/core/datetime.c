@@ -29,11 +29,13 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <pthread.h>
 #ifndef _WIN32
 	#ifdef __mips__
 		#define __USE_UNIX98
 	#endif
+	#include <sys/mman.h>
 #endif
 
 #include "json.h"
@@ -42,7 +44,13 @@
 #include "mem.h"
 
 #define NRCOUNTRIES 	408
-#define PRECISION 		1
+/*
+ * The tzdata points are stored in tenths of degrees, coordinates are
+ * scaled the same way. A point further than TZMARGIN degrees away from
+ * a coordinate is never looked at.
+ */
+#define TZSCALE 		10
+#define TZMARGIN 		4
 
 #ifndef min
 	#define min(a,b) (((a)<(b))?(a):(b))
@@ -51,9 +59,64 @@
 	#define max(a,b) (((a)>(b))?(a):(b))
 #endif
 
-static int ***tzcoords;
-static unsigned int tznrpolys[NRCOUNTRIES];
-static char tznames[NRCOUNTRIES][30];
+/*
+ * Uniform grid over the polygon points. A cell lists the polygons
+ * with a point inside it in ascending order. coord2tz only looks at
+ * points less than the widest margin away, so a lookup only needs
+ * the polygons of the cells around the coordinate.
+ */
+#define TZGRID_CELL		(TZMARGIN*TZSCALE)
+#define TZGRID_COLS		((360*TZSCALE)/TZGRID_CELL+1)
+#define TZGRID_ROWS		((180*TZSCALE)/TZGRID_CELL+1)
+
+/*
+ * The polygons are read from TZDATA_BIN, which pilight-tzdata compiles
+ * from TZDATA_FILE at build time. The file is mapped read-only as is,
+ * so loading it costs nothing and the pages are shared between all
+ * processes. A header is followed by the zones and by the points of
+ * all zones. Everything is stored in the byte order of the machine
+ * that compiled it, a file from another machine fails the version
+ * check. Without a valid binary file the same layout is built from
+ * the JSON file on the heap.
+ */
+#define TZDATA_MAGIC		"PLTZ"
+#define TZDATA_VERSION	1
+
+typedef struct tzdata_header_t {
+	char magic[4];
+	uint32_t version;
+	uint32_t nrzones;
+	uint32_t nrpoints;
+} tzdata_header_t;
+
+typedef struct tzdata_zone_t {
+	char name[32];
+	/* Index of the first point of the zone */
+	uint32_t offset;
+	uint32_t nrpoints;
+	/* The first point of the polygon walk, derived from all points */
+	int16_t start[2];
+} tzdata_zone_t;
+
+typedef struct tzcache_t {
+	int x;
+	int y;
+	char *tz;
+	struct tzcache_t *next;
+} tzcache_t;
+
+static unsigned char *tzdata = NULL;
+static size_t tzdatalen = 0;
+static int tzdatamapped = 0;
+static struct tzdata_zone_t *tzzones = NULL;
+static int16_t (*tzpoints)[2] = NULL;
+static unsigned int tznrzones = 0;
+static unsigned short *tzgrid[TZGRID_COLS][TZGRID_ROWS];
+static unsigned short tzgridlen[TZGRID_COLS][TZGRID_ROWS];
+/* Coordinates that were already looked up, like those of devices */
+#define TZCACHE_SIZE	64
+static struct tzcache_t *tzcache = NULL;
+static int tzcachelen = 0;
 static int tzdatafilled = 0;
 static pthread_mutex_t tzlock;
 static pthread_mutexattr_t tzattr;
@@ -66,6 +129,276 @@ static int tz_lock_initialized = 0;
 static int fillingtzdata = 0;
 static int searchingtz = 0;
 
+static int tzcell(int v, int range, int cells) {
+	int cell = (v + range) / TZGRID_CELL;
+
+	if(cell < 0) {
+		return 0;
+	}
+	return (cell >= cells) ? cells-1 : cell;
+}
+
+static void tzindex(void) {
+	int i = 0, cx = 0, cy = 0;
+	unsigned int a = 0;
+
+	memset(tzgridlen, 0, sizeof(tzgridlen));
+	for(i=0;i<tznrzones;i++) {
+		for(a=0;a<tzzones[i].nrpoints;a++) {
+			int16_t *p = tzpoints[tzzones[i].offset+a];
+
+			cx = tzcell(p[0], 180*TZSCALE, TZGRID_COLS);
+			cy = tzcell(p[1], 90*TZSCALE, TZGRID_ROWS);
+			if(tzgridlen[cx][cy] > 0 && tzgrid[cx][cy][tzgridlen[cx][cy]-1] == i) {
+				continue;
+			}
+			if((tzgrid[cx][cy] = realloc(tzgrid[cx][cy], sizeof(unsigned short)*(tzgridlen[cx][cy]+1))) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			tzgrid[cx][cy][tzgridlen[cx][cy]++] = (unsigned short)i;
+		}
+	}
+}
+
+/* Checks that all zones and points of a tzdata blob are inside of it */
+static int tzdata_check(unsigned char *data, size_t len) {
+	struct tzdata_header_t *header = (struct tzdata_header_t *)data;
+	struct tzdata_zone_t *zones = NULL;
+	unsigned int i = 0;
+
+	if(len < sizeof(struct tzdata_header_t) ||
+	   memcmp(header->magic, TZDATA_MAGIC, 4) != 0 ||
+	   header->version != TZDATA_VERSION ||
+	   header->nrzones > NRCOUNTRIES ||
+	   len != sizeof(struct tzdata_header_t)
+	          +header->nrzones*sizeof(struct tzdata_zone_t)
+	          +header->nrpoints*sizeof(int16_t)*2) {
+		return -1;
+	}
+	zones = (struct tzdata_zone_t *)&data[sizeof(struct tzdata_header_t)];
+	for(i=0;i<header->nrzones;i++) {
+		if(memchr(zones[i].name, '\0', sizeof(zones[i].name)) == NULL ||
+		   zones[i].offset > header->nrpoints ||
+		   zones[i].nrpoints > header->nrpoints-zones[i].offset) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Builds a tzdata blob from the JSON tzdata. The JSON is a list of
+ * objects with a zone name and its list of [longitude, latitude]
+ * points.
+ */
+static int tzdata_build(char *content, unsigned char **out, size_t *len) {
+	struct tzdata_header_t *header = NULL;
+	struct tzdata_zone_t *zones = NULL;
+	int16_t (*points)[2] = NULL;
+	JsonNode *root = NULL, *alist = NULL, *country = NULL;
+	JsonNode *coords = NULL, *lonlat = NULL;
+	unsigned int nrzones = 0, nrpoints = 0, i = 0, x = 0, y = 0;
+	unsigned char *data = NULL;
+	int p1x = 0, p1y = 0;
+
+	if((root = json_decode(content)) == NULL) {
+		logprintf(LOG_ERR, "tzdata is not in a valid json format");
+		return -1;
+	}
+
+	for(alist=json_first_child(root);alist!=NULL;alist=alist->next) {
+		for(country=json_first_child(alist);country!=NULL;country=country->next) {
+			nrzones++;
+			for(coords=json_first_child(country);coords!=NULL;coords=coords->next) {
+				nrpoints++;
+			}
+		}
+	}
+	if(nrzones > NRCOUNTRIES) {
+		logprintf(LOG_ERR, "tzdata has more than %d timezones", NRCOUNTRIES);
+		json_delete(root);
+		return -1;
+	}
+
+	*len = sizeof(struct tzdata_header_t)
+	      +nrzones*sizeof(struct tzdata_zone_t)
+	      +nrpoints*sizeof(int16_t)*2;
+	if((data = calloc(*len, 1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	header = (struct tzdata_header_t *)data;
+	zones = (struct tzdata_zone_t *)&data[sizeof(struct tzdata_header_t)];
+	points = (int16_t (*)[2])&zones[nrzones];
+
+	memcpy(header->magic, TZDATA_MAGIC, 4);
+	header->version = TZDATA_VERSION;
+	header->nrzones = nrzones;
+	header->nrpoints = nrpoints;
+
+	for(alist=json_first_child(root);alist!=NULL;alist=alist->next) {
+		for(country=json_first_child(alist);country!=NULL;country=country->next) {
+			if(strlen(country->key) >= sizeof(zones[i].name)) {
+				logprintf(LOG_ERR, "tzdata timezone name too long: %s", country->key);
+				json_delete(root);
+				free(data);
+				return -1;
+			}
+			strcpy(zones[i].name, country->key);
+			zones[i].offset = x;
+			p1x = 0;
+			p1y = 0;
+			for(coords=json_first_child(country);coords!=NULL;coords=coords->next) {
+				y = 0;
+				for(lonlat=json_first_child(coords);lonlat!=NULL && y<2;lonlat=lonlat->next) {
+					if(lonlat->number_ < INT16_MIN || lonlat->number_ > INT16_MAX) {
+						logprintf(LOG_ERR, "tzdata coordinate out of range in %s", country->key);
+						json_delete(root);
+						free(data);
+						return -1;
+					}
+					points[x][y++] = (int16_t)lonlat->number_;
+				}
+				if(points[x][0] < p1x || p1x == 0) {
+					p1x = points[x][0];
+				}
+				if(points[x][1] < p1y && p1y == 0) {
+					p1y = points[x][1];
+				}
+				x++;
+			}
+			zones[i].nrpoints = x-zones[i].offset;
+			zones[i].start[0] = (int16_t)p1x;
+			zones[i].start[1] = (int16_t)p1y;
+			i++;
+		}
+	}
+	json_delete(root);
+
+	*out = data;
+	return 0;
+}
+
+static char *tzdata_read(char *file, size_t *len) {
+	char *content = NULL;
+	FILE *fp = NULL;
+	struct stat st;
+
+	if((fp = fopen(file, "rb")) == NULL) {
+		return NULL;
+	}
+	fstat(fileno(fp), &st);
+	*len = (size_t)st.st_size;
+
+	if((content = calloc(*len+1, sizeof(char))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if(fread(content, sizeof(char), *len, fp) != *len) {
+		free(content);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+	return content;
+}
+
+int tzdata_compile(char *in, char *out) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	unsigned char *data = NULL;
+	char *content = NULL;
+	size_t len = 0;
+	FILE *fp = NULL;
+
+	if((content = tzdata_read(in, &len)) == NULL) {
+		logprintf(LOG_ERR, "cannot read tzdata file: %s", in);
+		return EXIT_FAILURE;
+	}
+	if(tzdata_build(content, &data, &len) != 0) {
+		free(content);
+		return EXIT_FAILURE;
+	}
+	free(content);
+
+	if((fp = fopen(out, "wb")) == NULL) {
+		logprintf(LOG_ERR, "cannot write tzdata file: %s", out);
+		free(data);
+		return EXIT_FAILURE;
+	}
+	if(fwrite(data, 1, len, fp) != len) {
+		logprintf(LOG_ERR, "cannot write tzdata file: %s", out);
+		fclose(fp);
+		free(data);
+		return EXIT_FAILURE;
+	}
+	fclose(fp);
+	free(data);
+	return EXIT_SUCCESS;
+}
+
+/* Maps the compiled tzdata, returns -1 when it is missing or invalid */
+static int tzdata_map(char *file) {
+	unsigned char *data = NULL;
+	size_t len = 0;
+#ifdef _WIN32
+	if((data = (unsigned char *)tzdata_read(file, &len)) == NULL) {
+		return -1;
+	}
+	if(tzdata_check(data, len) != 0) {
+		logprintf(LOG_NOTICE, "tzdata file %s is not valid", file);
+		free(data);
+		return -1;
+	}
+	tzdatamapped = 0;
+#else
+	struct stat st;
+	int fd = 0;
+
+	if((fd = open(file, O_RDONLY)) < 0) {
+		return -1;
+	}
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+	len = (size_t)st.st_size;
+	data = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		return -1;
+	}
+	if(tzdata_check(data, len) != 0) {
+		logprintf(LOG_NOTICE, "tzdata file %s is not valid", file);
+		munmap(data, len);
+		return -1;
+	}
+	tzdatamapped = 1;
+#endif
+	tzdata = data;
+	tzdatalen = len;
+	return 0;
+}
+
+static void tzdata_free(void) {
+#ifndef _WIN32
+	if(tzdatamapped == 1) {
+		munmap(tzdata, tzdatalen);
+	} else {
+		free(tzdata);
+	}
+#else
+	free(tzdata);
+#endif
+	tzdata = NULL;
+	tzdatalen = 0;
+	tzdatamapped = 0;
+	tzzones = NULL;
+	tzpoints = NULL;
+	tznrzones = 0;
+}
+
 static int fillTZData(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -91,95 +424,585 @@ static int fillTZData(void) {
 		}
 		return EXIT_SUCCESS;
 	}
-	char *content = NULL;
-	JsonNode *root = NULL;
-	FILE *fp;
-	size_t bytes;
-	struct stat st;
 
+	char tzdatabin[] = TZDATA_BIN;
 	char tzdatafile[] = TZDATA_FILE;
-	/* Read JSON tzdata file */
-	if((fp = fopen(tzdatafile, "rb")) == NULL) {
-		logprintf(LOG_ERR, "cannot read tzdata file: %s", tzdatafile);
-		return EXIT_FAILURE;
+	char *content = NULL;
+	size_t len = 0;
+
+	logprintf(LOG_DEBUG, "loading timezone database...");
+	if(tzdata_map(tzdatabin) != 0) {
+		/* Fall back to the JSON tzdata */
+		if((content = tzdata_read(tzdatafile, &len)) == NULL) {
+			logprintf(LOG_ERR, "cannot read tzdata file: %s", tzdatafile);
+		} else if(tzdata_build(content, &tzdata, &tzdatalen) != 0) {
+			tzdata = NULL;
+		}
+		if(content != NULL) {
+			free(content);
+		}
+		if(tzdata == NULL) {
+			fillingtzdata = 0;
+			if(tz_lock_initialized == 1) {
+				pthread_mutex_unlock(&tzlock);
+			}
+			return EXIT_FAILURE;
+		}
+		tzdatamapped = 0;
 	}
 
-	fstat(fileno(fp), &st);
-	bytes = (size_t)st.st_size;
+	tznrzones = ((struct tzdata_header_t *)tzdata)->nrzones;
+	tzzones = (struct tzdata_zone_t *)&tzdata[sizeof(struct tzdata_header_t)];
+	tzpoints = (int16_t (*)[2])&tzzones[tznrzones];
+
+	tzindex();
+	tzdatafilled = 1;
+	fillingtzdata = 0;
+	if(tz_lock_initialized == 1) {
+		pthread_mutex_unlock(&tzlock);
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Timezone rules are read once per zone from the TZif files in
+ * ZONEINFO_DIR into a table of transitions. Times beyond the last
+ * transition follow the POSIX TZ rule at the end of the file. Zones
+ * are only freed by datetime_gc, so the list of loaded zones can be
+ * searched without taking a lock.
+ */
+typedef struct tztype_t {
+	int offset;
+	int isdst;
+} tztype_t;
+
+/* Start or end of daylight saving time in a POSIX TZ rule */
+typedef struct tzrule_t {
+	/* 'J' julian day without leap day, 'D' zero based day or 'M' month.week.day */
+	char type;
+	int month;
+	int week;
+	int day;
+	/* Seconds after local midnight */
+	int time;
+} tzrule_t;
+
+typedef struct tzinfo_t {
+	char *name;
+	int ntrans;
+	int64_t *trans;
+	unsigned char *idx;
+	int ntypes;
+	struct tztype_t *types;
+	int hasrule;
+	int hasdst;
+	int stdoff;
+	int dstoff;
+	struct tzrule_t start;
+	struct tzrule_t end;
+	struct tzinfo_t *next;
+} tzinfo_t;
+
+static struct tzinfo_t *volatile tzinfo = NULL;
+static pthread_mutex_t tzinfo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t tz_days(int64_t year, int month, int day) {
+	int64_t era = 0, yoe = 0, doy = 0, doe = 0;
+
+	year -= (month <= 2);
+	era = (year >= 0 ? year : year-399) / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static int tz_leap(int64_t year) {
+	return ((year % 4) == 0 && (year % 100) != 0) || (year % 400) == 0;
+}
+
+/* Break seconds since the epoch down without looking at any timezone */
+static void tz_civil(int64_t secs, struct tm *tm) {
+	int64_t days = secs / 86400, rem = secs % 86400;
+	int64_t era = 0, doe = 0, yoe = 0, doy = 0, mp = 0, year = 0;
+
+	if(rem < 0) {
+		rem += 86400;
+		days--;
+	}
+	memset(tm, '\0', sizeof(struct tm));
+	tm->tm_hour = (int)(rem / 3600);
+	tm->tm_min = (int)((rem % 3600) / 60);
+	tm->tm_sec = (int)(rem % 60);
+	tm->tm_wday = (int)(((days + 4) % 7 + 7) % 7);
+
+	era = (days + 719468 >= 0 ? days + 719468 : days + 719468 - 146096) / 146097;
+	doe = days + 719468 - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	year = yoe + era * 400 + (mp >= 10);
+
+	tm->tm_mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+	tm->tm_mon = (int)(mp < 10 ? mp + 2 : mp - 10);
+	tm->tm_year = (int)(year - 1900);
+	tm->tm_yday = (int)(days - tz_days(year, 1, 1));
+}
+
+/* Local time at which a rule takes effect in a year */
+static int64_t tz_rule_time(struct tzrule_t *rule, int64_t year) {
+	int mdays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	int64_t days = 0;
+	int wday = 0;
+
+	switch(rule->type) {
+		case 'J':
+			days = tz_days(year, 1, 1) + rule->day - 1;
+			if(tz_leap(year) && rule->day >= 60) {
+				days++;
+			}
+		break;
+		case 'D':
+			days = tz_days(year, 1, 1) + rule->day;
+		break;
+		default:
+			if(tz_leap(year)) {
+				mdays[1] = 29;
+			}
+			days = tz_days(year, rule->month, 1);
+			wday = (int)(((days + 4) % 7 + 7) % 7);
+			days += (rule->day - wday + 7) % 7 + (rule->week - 1) * 7;
+			while(days >= tz_days(year, rule->month, 1) + mdays[rule->month-1]) {
+				days -= 7;
+			}
+		break;
+	}
+	return days * 86400 + rule->time;
+}
+
+static const char *tz_parse_name(const char *s) {
+	const char *p = s;
+
+	if(*p == '<') {
+		if((p = strchr(p, '>')) == NULL) {
+			return NULL;
+		}
+		return p+1;
+	}
+	while(isalpha((unsigned char)*p)) {
+		p++;
+	}
+	return (p-s >= 3) ? p : NULL;
+}
+
+/* [+-]hh[:mm[:ss]] in seconds */
+static const char *tz_parse_offset(const char *s, int *secs) {
+	int sign = 1, part = 0, i = 0;
+
+	if(*s == '+' || *s == '-') {
+		sign = (*s == '-') ? -1 : 1;
+		s++;
+	}
+	if(!isdigit((unsigned char)*s)) {
+		return NULL;
+	}
+	*secs = 0;
+	for(i=0;i<3;i++) {
+		part = 0;
+		while(isdigit((unsigned char)*s)) {
+			part = part * 10 + (*s - '0');
+			s++;
+		}
+		*secs += part * (i == 0 ? 3600 : (i == 1 ? 60 : 1));
+		if(*s != ':' || !isdigit((unsigned char)s[1])) {
+			break;
+		}
+		s++;
+	}
+	*secs *= sign;
+	return s;
+}
+
+static const char *tz_parse_rule(const char *s, struct tzrule_t *rule) {
+	rule->time = 7200;
+	if(*s == 'M') {
+		rule->type = 'M';
+		if(sscanf(s, "M%d.%d.%d", &rule->month, &rule->week, &rule->day) != 3 ||
+		   rule->month < 1 || rule->month > 12 || rule->week < 1 || rule->week > 5 ||
+		   rule->day < 0 || rule->day > 6) {
+			return NULL;
+		}
+		s++;
+		while(isdigit((unsigned char)*s) || *s == '.') {
+			s++;
+		}
+	} else {
+		rule->type = 'D';
+		if(*s == 'J') {
+			rule->type = 'J';
+			s++;
+		}
+		if(!isdigit((unsigned char)*s)) {
+			return NULL;
+		}
+		rule->day = atoi(s);
+		while(isdigit((unsigned char)*s)) {
+			s++;
+		}
+	}
+	if(*s == '/') {
+		s = tz_parse_offset(s+1, &rule->time);
+	}
+	return s;
+}
+
+/* A POSIX TZ string like "CET-1CEST,M3.5.0,M10.5.0/3" */
+static int tz_parse_posix(struct tzinfo_t *zone, const char *s) {
+	int offset = 0;
+
+	if((s = tz_parse_name(s)) == NULL || (s = tz_parse_offset(s, &offset)) == NULL) {
+		return -1;
+	}
+	/* POSIX offsets count west of UTC */
+	zone->stdoff = -offset;
+	zone->dstoff = zone->stdoff + 3600;
+	zone->hasdst = 0;
+	zone->hasrule = 1;
+	if(*s == '\0' || *s == '\n') {
+		return 0;
+	}
+	if((s = tz_parse_name(s)) == NULL) {
+		return -1;
+	}
+	if(*s != ',' && *s != '\0' && *s != '\n') {
+		if((s = tz_parse_offset(s, &offset)) == NULL) {
+			return -1;
+		}
+		zone->dstoff = -offset;
+	}
+	if(*s != ',' || (s = tz_parse_rule(s+1, &zone->start)) == NULL ||
+	   *s != ',' || (s = tz_parse_rule(s+1, &zone->end)) == NULL) {
+		zone->hasrule = 0;
+		return -1;
+	}
+	zone->hasdst = 1;
+	return 0;
+}
+
+static int64_t tz_be(const unsigned char *p, int size) {
+	uint64_t v = 0;
+	int i = 0;
+
+	for(i=0;i<size;i++) {
+		v = (v << 8) | p[i];
+	}
+	if(size == 4) {
+		return (int64_t)(int32_t)(uint32_t)v;
+	}
+	return (int64_t)v;
+}
+
+/* Read the version 1 or, when present, the 64 bit version 2+ data of a TZif file */
+static int tz_parse_tzif(struct tzinfo_t *zone, const unsigned char *buf, size_t len) {
+	const unsigned char *p = buf, *end = buf + len, *footer = NULL;
+	size_t counts[6], size = 0;
+	int timesize = 4, i = 0;
+	char rule[128];
+
+	if(len < 44 || memcmp(buf, "TZif", 4) != 0) {
+		return -1;
+	}
+	while(1) {
+		if(end - p < 44 || memcmp(p, "TZif", 4) != 0) {
+			return -1;
+		}
+		for(i=0;i<6;i++) {
+			counts[i] = (size_t)tz_be(&p[20+i*4], 4);
+		}
+		/* isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt */
+		size = counts[3] * (size_t)timesize + counts[3] + counts[4] * 6 + counts[5] +
+			counts[2] * (size_t)(timesize + 4) + counts[0] + counts[1];
+		if(counts[4] == 0 || (size_t)(end - p - 44) < size) {
+			return -1;
+		}
+		if(timesize == 4 && buf[4] >= '2') {
+			p += 44 + size;
+			timesize = 8;
+			continue;
+		}
+		break;
+	}
 
-	if((content = calloc(bytes+1, sizeof(char))) == NULL) {
+	p += 44;
+	zone->ntrans = (int)counts[3];
+	zone->ntypes = (int)counts[4];
+	if((zone->trans = MALLOC(sizeof(int64_t)*(counts[3]+1))) == NULL ||
+	   (zone->idx = MALLOC(counts[3]+1)) == NULL ||
+	   (zone->types = MALLOC(sizeof(struct tztype_t)*counts[4])) == NULL) {
 		fprintf(stderr, "out of memory\n");
-		fclose(fp);
-		fillingtzdata = 0;
 		exit(EXIT_FAILURE);
 	}
+	for(i=0;i<zone->ntrans;i++) {
+		zone->trans[i] = tz_be(p, timesize);
+		p += timesize;
+	}
+	for(i=0;i<zone->ntrans;i++) {
+		if((zone->idx[i] = *p++) >= zone->ntypes) {
+			return -1;
+		}
+	}
+	for(i=0;i<zone->ntypes;i++) {
+		zone->types[i].offset = (int)tz_be(p, 4);
+		zone->types[i].isdst = p[4];
+		p += 6;
+	}
 
-	if(fread(content, sizeof(char), bytes, fp) == -1) {
-		logprintf(LOG_ERR, "cannot read tzdata file: %s", tzdatafile);
+	if(timesize == 8) {
+		footer = p + counts[5] + counts[2] * 12 + counts[0] + counts[1];
+		if(footer < end && *footer == '\n') {
+			for(i=0;footer+1+i < end && footer[1+i] != '\n' && i < (int)sizeof(rule)-1;i++) {
+				rule[i] = (char)footer[1+i];
+			}
+			rule[i] = '\0';
+			if(i > 0) {
+				tz_parse_posix(zone, rule);
+			}
+		}
+	}
+	return 0;
+}
+
+static int tz_read_file(struct tzinfo_t *zone, const char *file) {
+	unsigned char *buf = NULL;
+	struct stat st;
+	FILE *fp = NULL;
+	int ret = -1;
+
+	if((fp = fopen(file, "rb")) == NULL) {
+		return -1;
+	}
+	if(fstat(fileno(fp), &st) == 0 && st.st_size > 0) {
+		if((buf = MALLOC((size_t)st.st_size)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		if(fread(buf, 1, (size_t)st.st_size, fp) == (size_t)st.st_size) {
+			ret = tz_parse_tzif(zone, buf, (size_t)st.st_size);
+		}
+		FREE(buf);
 	}
 	fclose(fp);
+	return ret;
+}
 
-	/* Validate JSON and turn into JSON object */
-	if(json_validate(content) == false) {
-		logprintf(LOG_ERR, "tzdata is not in a valid json format");
-		free(content);
-		fillingtzdata = 0;
-		return EXIT_FAILURE;
+static void tz_free(struct tzinfo_t *zone) {
+	if(zone->trans != NULL) {
+		FREE(zone->trans);
 	}
+	if(zone->idx != NULL) {
+		FREE(zone->idx);
+	}
+	if(zone->types != NULL) {
+		FREE(zone->types);
+	}
+	FREE(zone->name);
+	FREE(zone);
+}
 
-	logprintf(LOG_DEBUG, "loading timezone database...");
-	root = json_decode(content);
-
-	JsonNode *alist = json_first_child(root);
-	unsigned int i = 0, x = 0, y = 0;
-	while(alist) {
-		JsonNode *country = json_first_child(alist);
-		while(country) {
-			strcpy(tznames[i], country->key);
-			if((tzcoords = realloc(tzcoords, sizeof(int **)*(i+1))) == NULL) {
-				fprintf(stderr, "out of memory\n");
-				exit(EXIT_FAILURE);
-			}
-			tzcoords[i] = NULL;
-			JsonNode *coords = json_first_child(country);
-			x = 0;
-			while(coords) {
-				y = 0;
-				if((tzcoords[i] = realloc(tzcoords[i], sizeof(int *)*(x+1))) == NULL) {
-					fprintf(stderr, "out of memory\n");
-					exit(EXIT_FAILURE);
-				}
-				tzcoords[i][x] = NULL;
-				if((tzcoords[i][x] = malloc(sizeof(int)*2)) == NULL) {
-					fprintf(stderr, "out of memory\n");
-					exit(EXIT_FAILURE);
-				}
-				JsonNode *lonlat = json_first_child(coords);
-				while(lonlat) {
-					tzcoords[i][x][y] = (int)lonlat->number_;
-					y++;
-					lonlat = lonlat->next;
-				}
-				x++;
-				coords = coords->next;
+static struct tzinfo_t *tz_load(const char *name) {
+	struct tzinfo_t *zone = NULL;
+	char file[255], *tz = getenv("TZ");
+	int loaded = -1;
+
+	if((zone = MALLOC(sizeof(struct tzinfo_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(zone, '\0', sizeof(struct tzinfo_t));
+	if((zone->name = MALLOC(strlen(name)+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(zone->name, name);
+
+	if(strlen(name) > 0) {
+		if(strstr(name, "..") == NULL && strlen(ZONEINFO_DIR)+strlen(name) < sizeof(file)) {
+			snprintf(file, sizeof(file), "%s%s", ZONEINFO_DIR, name);
+			loaded = tz_read_file(zone, file);
+		}
+	/* The zone of the system, following the rules of tzset */
+	} else if(tz != NULL && strlen(tz) > 0) {
+		if(*tz == ':') {
+			tz++;
+		}
+		if(*tz == '/') {
+			loaded = tz_read_file(zone, tz);
+		} else if(strstr(tz, "..") == NULL && strlen(ZONEINFO_DIR)+strlen(tz) < sizeof(file)) {
+			snprintf(file, sizeof(file), "%s%s", ZONEINFO_DIR, tz);
+			loaded = tz_read_file(zone, file);
+		}
+		if(loaded != 0) {
+			loaded = tz_parse_posix(zone, tz);
+		}
+	} else {
+		loaded = tz_read_file(zone, "/etc/localtime");
+	}
+
+	if(loaded != 0) {
+		logprintf(LOG_DEBUG, "could not load timezone \"%s\", using UTC", name);
+		tz_free(zone);
+		if((zone = MALLOC(sizeof(struct tzinfo_t))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(zone, '\0', sizeof(struct tzinfo_t));
+		if((zone->name = MALLOC(strlen(name)+1)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		strcpy(zone->name, name);
+		zone->hasrule = 1;
+	}
+	return zone;
+}
+
+struct tzinfo_t *tzinfo_get(char *tz) {
+	struct tzinfo_t *zone = NULL;
+	const char *name = (tz != NULL) ? tz : "";
+
+	for(zone=tzinfo;zone!=NULL;zone=zone->next) {
+		if(strcmp(zone->name, name) == 0) {
+			return zone;
+		}
+	}
+
+	pthread_mutex_lock(&tzinfo_lock);
+	for(zone=tzinfo;zone!=NULL;zone=zone->next) {
+		if(strcmp(zone->name, name) == 0) {
+			break;
+		}
+	}
+	if(zone == NULL) {
+		zone = tz_load(name);
+		zone->next = tzinfo;
+		/* Readers must see a complete zone once it is in the list */
+		__sync_synchronize();
+		tzinfo = zone;
+	}
+	pthread_mutex_unlock(&tzinfo_lock);
+	return zone;
+}
+
+/* The local time type in effect at t */
+static void tz_find(struct tzinfo_t *zone, int64_t t, int *offset, int *dst) {
+	int64_t year = 0, start = 0, end = 0;
+	int lo = 0, hi = 0, mid = 0;
+	struct tm tm;
+
+	if(zone->hasrule == 1 && (zone->ntrans == 0 || t >= zone->trans[zone->ntrans-1])) {
+		*offset = zone->stdoff;
+		*dst = 0;
+		if(zone->hasdst == 1) {
+			tz_civil(t + zone->stdoff, &tm);
+			year = tm.tm_year + 1900;
+			start = tz_rule_time(&zone->start, year) - zone->stdoff;
+			end = tz_rule_time(&zone->end, year) - zone->dstoff;
+			if((start < end) ? (t >= start && t < end) : !(t >= end && t < start)) {
+				*offset = zone->dstoff;
+				*dst = 1;
 			}
-			tznrpolys[i] = x;
-			i++;
-			country = country->next;
 		}
-		alist = alist->next;
+		return;
 	}
-	json_delete(root);
-	free(content);
-	tzdatafilled = 1;
-	fillingtzdata = 0;
-	if(tz_lock_initialized == 1) {
-		pthread_mutex_unlock(&tzlock);
+	if(zone->ntrans == 0 || t < zone->trans[0]) {
+		*offset = zone->types[0].offset;
+		*dst = zone->types[0].isdst;
+		return;
 	}
-	return EXIT_SUCCESS;
+	lo = 0;
+	hi = zone->ntrans-1;
+	while(lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if(zone->trans[mid] <= t) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	*offset = zone->types[zone->idx[lo]].offset;
+	*dst = zone->types[zone->idx[lo]].isdst;
+}
+
+int tzinfo_offset(struct tzinfo_t *zone, time_t t, int *dst) {
+	int offset = 0, isdst = 0;
+
+	tz_find(zone, (int64_t)t, &offset, &isdst);
+	if(dst != NULL) {
+		*dst = isdst;
+	}
+	return offset;
+}
+
+/* The offset of standard time in effect at t, leaving out daylight saving time */
+static int tz_stdoffset(struct tzinfo_t *zone, time_t t) {
+	int offset = 0, dst = 0, i = 0;
+
+	tz_find(zone, (int64_t)t, &offset, &dst);
+	if(dst == 0) {
+		return offset;
+	}
+	if(zone->hasrule == 1 && (zone->ntrans == 0 || t >= zone->trans[zone->ntrans-1])) {
+		return zone->stdoff;
+	}
+	for(i=zone->ntrans-1;i>=0;i--) {
+		if(zone->trans[i] <= t && zone->types[zone->idx[i]].isdst == 0) {
+			return zone->types[zone->idx[i]].offset;
+		}
+	}
+	for(i=0;i<zone->ntypes;i++) {
+		if(zone->types[i].isdst == 0) {
+			return zone->types[i].offset;
+		}
+	}
+	return offset;
+}
+
+struct tm *tzinfo_localtime(struct tzinfo_t *zone, time_t t, struct tm *tm) {
+	int offset = 0, dst = 0;
+
+	tz_find(zone, (int64_t)t, &offset, &dst);
+	tz_civil((int64_t)t + offset, tm);
+	tm->tm_isdst = dst;
+	return tm;
+}
+
+time_t tzinfo_mktime(struct tzinfo_t *zone, struct tm *tm) {
+	int64_t year = (int64_t)tm->tm_year + 1900 + tm->tm_mon / 12, wall = 0, t = 0;
+	int month = tm->tm_mon % 12, offset = 0, check = 0, dst = 0;
+
+	if(month < 0) {
+		month += 12;
+		year--;
+	}
+	wall = (tz_days(year, month+1, 1) + tm->tm_mday - 1) * 86400 +
+		(int64_t)tm->tm_hour * 3600 + (int64_t)tm->tm_min * 60 + tm->tm_sec;
+
+	/* Settle on the offset in effect at the resulting time */
+	tz_find(zone, wall, &offset, &dst);
+	tz_find(zone, wall - offset, &offset, &dst);
+	t = wall - offset;
+	tz_find(zone, t, &check, &dst);
+	/* Wall clock times skipped by a change to summer time are moved forward */
+	if(check != offset) {
+		t = wall - ((check < offset) ? check : offset);
+	}
+
+	tzinfo_localtime(zone, (time_t)t, tm);
+	return (time_t)t;
 }
 
 int datetime_gc(void) {
+	struct tzinfo_t *zone = NULL;
 	int i = 0, a = 0;
 /*
 	Extra checks for gracefull (early)
@@ -192,16 +1015,29 @@ int datetime_gc(void) {
 		usleep(10);
 	}
 	if(tzdatafilled == 1) {
-		for(i=0;i<NRCOUNTRIES;i++) {
-			unsigned int n = tznrpolys[i];
-			for(a=0;a<n;a++) {
-				free(tzcoords[i][a]);
+		tzdata_free();
+		tzdatafilled = 0;
+		for(i=0;i<TZGRID_COLS;i++) {
+			for(a=0;a<TZGRID_ROWS;a++) {
+				if(tzgrid[i][a] != NULL) {
+					free(tzgrid[i][a]);
+					tzgrid[i][a] = NULL;
+				}
 			}
-			free(tzcoords[i]);
 		}
-		free(tzcoords);
-		logprintf(LOG_DEBUG, "garbage collected datetime library");
 	}
+	while(tzcache != NULL) {
+		struct tzcache_t *tmp = tzcache;
+		tzcache = tzcache->next;
+		FREE(tmp);
+	}
+	tzcachelen = 0;
+	while(tzinfo != NULL) {
+		zone = tzinfo;
+		tzinfo = tzinfo->next;
+		tz_free(zone);
+	}
+	logprintf(LOG_DEBUG, "garbage collected datetime library");
 	return EXIT_SUCCESS;
 }
 
@@ -220,30 +1056,50 @@ char *coord2tz(double longitude, double latitude) {
 		pthread_mutex_lock(&tzlock);
 	}
 	searchingtz = 1;
+	struct tzcache_t *cache = NULL;
+	unsigned char candidate[NRCOUNTRIES];
 	int i = 0, a = 0, margin = 1, inside = 0;
+	int cx = 0, cy = 0, cx1 = 0, cy1 = 0, cx2 = 0, cy2 = 0;
 	char *tz = NULL;
 
-	margin *= (int)pow(10, PRECISION);
-	int y = (int)round(latitude*(int)pow(10, PRECISION));
-	int x = (int)round(longitude*(int)pow(10, PRECISION));
-
-	while(!inside && margin < (5*(int)pow(10, PRECISION))) {
-		for(i=0;i<NRCOUNTRIES;i++) {
-			unsigned int n = tznrpolys[i];
-			if(n > 0) {
-				int p1x = 0;
-				int p1y = 0;
-				for(a=0;a<n;a++) {
-					if(tzcoords[i][a][0] < p1x || ((int)p1x == 0)) {
-						p1x = tzcoords[i][a][0];
-					}
-					if(tzcoords[i][a][1] < p1y && ((int)p1y == 0)) {
-						p1y = tzcoords[i][a][1];
-					}
-				}
+	margin *= TZSCALE;
+	int y = (int)round(latitude*TZSCALE);
+	int x = (int)round(longitude*TZSCALE);
+
+	for(cache=tzcache;cache!=NULL;cache=cache->next) {
+		if(cache->x == x && cache->y == y) {
+			searchingtz = 0;
+			if(tz_lock_initialized == 1) {
+				pthread_mutex_unlock(&tzlock);
+			}
+			return cache->tz;
+		}
+	}
+
+	/* Only polygons with points within the widest margin can match */
+	memset(candidate, 0, sizeof(candidate));
+	cx1 = tzcell(x-TZGRID_CELL, 180*TZSCALE, TZGRID_COLS);
+	cx2 = tzcell(x+TZGRID_CELL, 180*TZSCALE, TZGRID_COLS);
+	cy1 = tzcell(y-TZGRID_CELL, 90*TZSCALE, TZGRID_ROWS);
+	cy2 = tzcell(y+TZGRID_CELL, 90*TZSCALE, TZGRID_ROWS);
+	for(cx=cx1;cx<=cx2;cx++) {
+		for(cy=cy1;cy<=cy2;cy++) {
+			for(a=0;a<tzgridlen[cx][cy];a++) {
+				candidate[tzgrid[cx][cy][a]] = 1;
+			}
+		}
+	}
+
+	while(!inside && margin <= TZMARGIN*TZSCALE) {
+		for(i=0;i<tznrzones;i++) {
+			unsigned int n = tzzones[i].nrpoints;
+			if(n > 0 && candidate[i] == 1) {
+				int16_t (*points)[2] = &tzpoints[tzzones[i].offset];
+				int p1x = tzzones[i].start[0];
+				int p1y = tzzones[i].start[1];
 				for(a=0;a<n+1;a++) {
-					int p2x = tzcoords[i][a % (int)n][0];
-					int p2y = tzcoords[i][a % (int)n][1];
+					int p2x = points[a % (int)n][0];
+					int p2y = points[a % (int)n][1];
 					if((round(p2x)-margin < round(x) && round(p2x)+margin > round(x))
 					   &&(round(p2y)-margin < round(y) && round(p2y)+margin > round(y))) {
 						int xinters = 0;
@@ -254,7 +1110,7 @@ char *coord2tz(double longitude, double latitude) {
 										xinters = (y-p1y)*(p2x-p1x)/(p2y-p1y)+p1x;
 									}
 									if(p1x == p2x || x <= xinters) {
-										tz = tznames[i];
+										tz = tzzones[i].name;
 										inside = 1;
 										break;
 									}
@@ -270,10 +1126,22 @@ char *coord2tz(double longitude, double latitude) {
 				}
 			}
 		}
-		margin /= (int)pow(10, PRECISION);
-		margin++;
-		margin *= (int)pow(10, PRECISION);
+		margin += TZSCALE;
+	}
+
+	if(tzcachelen < TZCACHE_SIZE) {
+		if((cache = MALLOC(sizeof(struct tzcache_t))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		cache->x = x;
+		cache->y = y;
+		cache->tz = tz;
+		cache->next = tzcache;
+		tzcache = cache;
+		tzcachelen++;
 	}
+
 	searchingtz = 0;
 	if(tz_lock_initialized == 1) {
 		pthread_mutex_unlock(&tzlock);
@@ -284,16 +1152,9 @@ char *coord2tz(double longitude, double latitude) {
 time_t datetime2ts(int year, int month, int day, int hour, int minutes, int seconds, char *tz) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	atomiclock();
- 	time_t t;
- 	struct tm tm = {0};
-	char oritz[64];
-	memset(oritz, '\0', 64);
-
-	if(getenv("TZ") != NULL) {
-		strcpy(oritz, getenv("TZ"));
-	}
+	struct tm tm;
 
+	memset(&tm, '\0', sizeof(struct tm));
 	tm.tm_sec = seconds;
 	tm.tm_min = minutes;
 	tm.tm_hour = hour;
@@ -301,65 +1162,15 @@ time_t datetime2ts(int year, int month, int day, int hour, int minutes, int seco
 	tm.tm_mon = month-1;
 	tm.tm_year = year-1900;
 
-	if(tz != NULL) {
-		setenv("TZ", tz, 1);
-	}
-	tzset();
-
-	t = mktime(&tm);
-
-	if(strlen(oritz) > 0) {
-		setenv("TZ", oritz, 1);
-	} else {
-		unsetenv("TZ");
-	}
-	tzset();
-
-	atomicunlock();
-	return t;
+	return tzinfo_mktime(tzinfo_get(tz), &tm);
 }
 
 int tzoffset(char *tz1, char *tz2) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	atomiclock();
+	time_t now = time(NULL);
 
-	time_t utc, tzsearch, now;
-	struct tm tm;
-	char oritz[64];
-
-	memset(&tm, '\0', sizeof(struct tm));
-	memset(oritz, '\0', 64);
-
-	if(getenv("TZ") != NULL) {
-		strcpy(oritz, getenv("TZ"));
-	}
-
-	now = time(NULL);
-#ifdef _WIN32
-	localtime(&now);
-#else
-	localtime_r(&now, &tm);
-#endif
-
-	setenv("TZ", tz1, 1);
-	tzset();
-	utc = mktime(&tm);
-
-	setenv("TZ", tz2, 1);
-	tzset();
-	tzsearch = mktime(&tm);
-
-	if(strlen(oritz) > 0) {
-		setenv("TZ", oritz, 1);
-	} else {
-		unsetenv("TZ");
-	}
-	tzset();
-
-	atomicunlock();
-
-	return (int)((utc-tzsearch)/3600);
+	return (tz_stdoffset(tzinfo_get(tz2), now)-tz_stdoffset(tzinfo_get(tz1), now))/3600;
 }
 
 int ctzoffset(void) {
@@ -390,39 +1201,9 @@ int ctzoffset(void) {
 int isdst(time_t t, char *tz) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	char oritz[64];
 	int dst = 0;
 
-	memset(oritz, '\0', 64);
-	if(getenv("TZ") != NULL) {
-		strcpy(oritz, getenv("TZ"));
-	}
-
-	atomiclock();
-
-	setenv("TZ", tz, 1);
-	tzset();
-
-#ifdef _WIN32
-	struct tm *tm1;
-	if((tm1 = localtime(&t)) != 0) {
-		dst = tm1->tm_isdst;
-#else
-	struct tm tm;
-	if(localtime_r(&t, &tm) != NULL) {
-		dst = tm.tm_isdst;
-#endif
-	}
-
-	if(strlen(oritz) > 0) {
-		setenv("TZ", oritz, 1);
-	} else {
-		unsetenv("TZ");
-	}
-	tzset();
-
-	atomicunlock();
-
+	tzinfo_offset(tzinfo_get(tz), t, &dst);
 	return dst;
 }
 
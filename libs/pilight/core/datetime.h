@@ -21,7 +21,21 @@
 
 #include <sys/time.h>
 
+/*
+ * A timezone by its zoneinfo name, like "Europe/Amsterdam", or the
+ * timezone of the system for NULL. The conversions do not change TZ
+ * or take any lock, so they can be used from every thread.
+ */
+struct tzinfo_t *tzinfo_get(char *tz);
+/* Seconds east of UTC at t */
+int tzinfo_offset(struct tzinfo_t *zone, time_t t, int *dst);
+struct tm *tzinfo_localtime(struct tzinfo_t *zone, time_t t, struct tm *tm);
+/* Like mktime, with tm_isdst left to the timezone rules */
+time_t tzinfo_mktime(struct tzinfo_t *zone, struct tm *tm);
+
 int datetime_gc(void);
+/* Compiles the JSON tzdata into the binary file coord2tz maps */
+int tzdata_compile(char *in, char *out);
 char *coord2tz(double longitude, double latitude);
 time_t datetime2ts(int year, int month, int day, int hour, int minutes, int seconds, char *tz);
 struct tm *localtztime(char *tz, time_t t);
@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "fcache.h"
 #include "common.h"
@@ -29,6 +30,9 @@
 #include "log.h"
 #include "gc.h"
 
+/* Files are added by all webserver workers, they are looked up without locking */
+static pthread_mutex_t fcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int fcache_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -76,7 +80,9 @@ void fcache_remove_node(struct fcache_t **cache, char *name) {
 int fcache_rm(char *filename) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	pthread_mutex_lock(&fcache_lock);
 	fcache_remove_node(&fcache, filename);
+	pthread_mutex_unlock(&fcache_lock);
 	logprintf(LOG_DEBUG, "removed %s from cache", filename);
 	return 1;
 }
@@ -129,9 +135,24 @@ int fcache_add(char *filename) {
 			exit(EXIT_FAILURE);
 		}
 		strcpy(node->name, filename);
+		fclose(fp);
+
+		pthread_mutex_lock(&fcache_lock);
+		struct fcache_t *ftmp = fcache;
+		while(ftmp) {
+			/* Another worker was first */
+			if(strcmp(ftmp->name, filename) == 0) {
+				pthread_mutex_unlock(&fcache_lock);
+				FREE(node->name);
+				FREE(node->bytes);
+				FREE(node);
+				return 0;
+			}
+			ftmp = ftmp->next;
+		}
 		node->next = fcache;
 		fcache = node;
-		fclose(fp);
+		pthread_mutex_unlock(&fcache_lock);
 		return 0;
 	}
 	fclose(fp);
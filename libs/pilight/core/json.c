@@ -35,14 +35,134 @@
 		exit(EXIT_FAILURE);                     \
 	} while (0)
 
+/* Arenas */
+
+typedef struct json_block_t {
+	struct json_block_t *next;
+	size_t size;
+	size_t used;
+	double data[];
+} json_block_t;
+
+struct json_arena_t {
+	struct json_block_t *first;
+	struct json_block_t *cur;
+	size_t size;
+};
+
+/* The arena the nodes of the calling thread are allocated from */
+static __thread json_arena_t *arena_current = NULL;
+
+#define ARENA_ALIGN(a) (((a) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+static json_block_t *arena_block(size_t size)
+{
+	json_block_t *block = (json_block_t*) malloc(sizeof(json_block_t) + size);
+	if (block == NULL)
+		out_of_memory();
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+static void *arena_alloc(json_arena_t *arena, size_t size)
+{
+	json_block_t *block = arena->cur;
+	void *ret;
+
+	size = ARENA_ALIGN(size);
+	while (block->size - block->used < size) {
+		/* Reuse the blocks that were left over by a reset first */
+		if (block->next == NULL || block->next->size < size) {
+			json_block_t *next = arena_block(size > arena->size ? size : arena->size);
+			next->next = block->next;
+			block->next = next;
+		}
+		block = block->next;
+		block->used = 0;
+		arena->cur = block;
+	}
+	ret = (char *)block->data + block->used;
+	block->used += size;
+	return ret;
+}
+
+/* Grow the last allocation in place when possible */
+static void *arena_realloc(json_arena_t *arena, void *ptr, size_t old, size_t size)
+{
+	json_block_t *block = arena->cur;
+	void *ret;
+
+	if ((char *)ptr + ARENA_ALIGN(old) == (char *)block->data + block->used &&
+	    block->used - ARENA_ALIGN(old) + ARENA_ALIGN(size) <= block->size) {
+		block->used = block->used - ARENA_ALIGN(old) + ARENA_ALIGN(size);
+		return ptr;
+	}
+	ret = arena_alloc(arena, size);
+	memcpy(ret, ptr, old);
+	return ret;
+}
+
+json_arena_t *json_arena_create(size_t size)
+{
+	json_arena_t *arena = (json_arena_t*) malloc(sizeof(json_arena_t));
+	if (arena == NULL)
+		out_of_memory();
+	arena->size = ARENA_ALIGN(size);
+	arena->first = arena_block(arena->size);
+	arena->cur = arena->first;
+	return arena;
+}
+
+json_arena_t *json_arena_use(json_arena_t *arena)
+{
+	json_arena_t *prev = arena_current;
+	arena_current = arena;
+	return prev;
+}
+
+void json_arena_reset(json_arena_t *arena)
+{
+	arena->cur = arena->first;
+	arena->first->used = 0;
+}
+
+void json_arena_free(json_arena_t *arena)
+{
+	json_block_t *block;
+
+	if (arena == NULL)
+		return;
+	if (arena_current == arena)
+		arena_current = NULL;
+	while ((block = arena->first) != NULL) {
+		arena->first = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+JsonNode *json_decode_arena(json_arena_t *arena, const char *json)
+{
+	json_arena_t *prev = json_arena_use(arena);
+	JsonNode *ret = json_decode(json);
+	json_arena_use(prev);
+	return ret;
+}
+
 /* Sadly, strdup is not portable. */
 static char *json_strdup(const char *str)
 {
-	char *ret = (char*) malloc(strlen(str) + 1);
-	memset(ret, 0, strlen(str) + 1);
-	if (ret == NULL)
+	size_t len = strlen(str) + 1;
+	char *ret;
+
+	if (arena_current != NULL) {
+		ret = (char*) arena_alloc(arena_current, len);
+	} else if ((ret = (char*) malloc(len)) == NULL) {
 		out_of_memory();
-	strcpy(ret, str);
+	}
+	memcpy(ret, str, len);
 	return ret;
 }
 
@@ -53,14 +173,30 @@ typedef struct
 	char *cur;
 	char *end;
 	char *start;
+	json_arena_t *arena;
 } SB;
 
 static void sb_init(SB *sb)
 {
 	sb->start = (char*) malloc(17);
-	memset(sb->start, 0, 17);
 	if (sb->start == NULL)
 		out_of_memory();
+	memset(sb->start, 0, 17);
+	sb->cur = sb->start;
+	sb->end = sb->start + 16;
+	sb->arena = NULL;
+}
+
+/* A string buffer that ends up in a node, so it follows the arena in use */
+static void sb_init_node(SB *sb)
+{
+	if (arena_current == NULL) {
+		sb_init(sb);
+		return;
+	}
+	sb->arena = arena_current;
+	sb->start = (char*) arena_alloc(sb->arena, 17);
+	memset(sb->start, 0, 17);
 	sb->cur = sb->start;
 	sb->end = sb->start + 16;
 }
@@ -80,9 +216,13 @@ static void sb_grow(SB *sb, int need)
 		alloc *= 2;
 	} while (alloc < length + need);
 
-	sb->start = (char*) realloc(sb->start, alloc + 1);
-	if (sb->start == NULL)
-		out_of_memory();
+	if (sb->arena != NULL) {
+		sb->start = (char*) arena_realloc(sb->arena, sb->start, (sb->end - sb->start) + 1, alloc + 1);
+	} else {
+		sb->start = (char*) realloc(sb->start, alloc + 1);
+		if (sb->start == NULL)
+			out_of_memory();
+	}
 	sb->cur = sb->start + length;
 	sb->end = sb->start + alloc;
 }
@@ -114,7 +254,8 @@ static char *sb_finish(SB *sb)
 
 static void sb_free(SB *sb)
 {
-	free(sb->start);
+	if (sb->arena == NULL)
+		free(sb->start);
 }
 
 /*
@@ -414,7 +555,8 @@ void json_delete(JsonNode *node)
 
 		switch (node->tag) {
 			case JSON_STRING:
-				free(node->string_);
+				if (!(node->arena_ & JSON_ARENA_STRING))
+					free(node->string_);
 				break;
 			case JSON_ARRAY:
 			case JSON_OBJECT:
@@ -429,7 +571,8 @@ void json_delete(JsonNode *node)
 			default:;
 		}
 
-		free(node);
+		if (!(node->arena_ & JSON_ARENA_NODE))
+			free(node);
 	}
 }
 
@@ -448,6 +591,119 @@ bool json_validate(const char *json)
 	return true;
 }
 
+/*
+ * Move *sp from the start of an object to the value of the member named
+ * by the len bytes of key. Keys without escapes are compared in place.
+ */
+static bool peek_member(const char **sp, const char *key, size_t len)
+{
+	const char *s = *sp;
+	const char *k;
+	char *str;
+	bool match;
+
+	if (*s++ != '{')
+		return false;
+	skip_space(&s);
+	if (*s == '}')
+		return false;
+
+	for (;;) {
+		k = s + 1;
+		if (!parse_string(&s, NULL))
+			return false;
+		if (memchr(k, '\\', s - 1 - k) == NULL) {
+			match = ((size_t)(s - 1 - k) == len && memcmp(k, key, len) == 0);
+		} else {
+			k--;
+			if (!parse_string(&k, &str))
+				return false;
+			match = (strlen(str) == len && memcmp(str, key, len) == 0);
+			if (arena_current == NULL)
+				free(str);
+		}
+		skip_space(&s);
+
+		if (*s++ != ':')
+			return false;
+		skip_space(&s);
+
+		if (match) {
+			*sp = s;
+			return true;
+		}
+
+		if (!parse_value(&s, NULL))
+			return false;
+		skip_space(&s);
+
+		if (*s++ != ',')
+			return false;
+		skip_space(&s);
+	}
+}
+
+const char *json_peek(const char *json, const char *path)
+{
+	const char *s = json;
+	const char *dot;
+
+	skip_space(&s);
+	for (;;) {
+		dot = strchr(path, '.');
+		if (!peek_member(&s, path, dot != NULL ? (size_t)(dot - path) : strlen(path)))
+			return NULL;
+		if (dot == NULL)
+			return s;
+		path = dot + 1;
+	}
+}
+
+bool json_peek_string(const char *json, const char *path, char *out, size_t size)
+{
+	const char *s = json_peek(json, path);
+	const char *start;
+	char *str;
+	size_t len;
+	bool ret;
+
+	if (s == NULL || *s != '"')
+		return false;
+
+	start = s + 1;
+	if (!parse_string(&s, NULL))
+		return false;
+	len = s - 1 - start;
+
+	/* Strings without escapes are copied as they are */
+	if (memchr(start, '\\', len) == NULL) {
+		if (len >= size)
+			return false;
+		memcpy(out, start, len);
+		out[len] = '\0';
+		return true;
+	}
+
+	s = start - 1;
+	if (!parse_string(&s, &str))
+		return false;
+	if ((ret = (strlen(str) < size)))
+		strcpy(out, str);
+	if (arena_current == NULL)
+		free(str);
+	return ret;
+}
+
+JsonNode *json_peek_node(const char *json, const char *path)
+{
+	const char *s = json_peek(json, path);
+	JsonNode *ret;
+
+	if (s == NULL || !parse_value(&s, &ret))
+		return NULL;
+	return ret;
+}
+
 JsonNode *json_find_element(JsonNode *array, int index)
 {
 	JsonNode *element;
@@ -488,9 +744,15 @@ JsonNode *json_first_child(const JsonNode *node)
 
 static JsonNode *mknode(JsonTag tag)
 {
-	JsonNode *ret = (JsonNode*) calloc(1, sizeof(JsonNode));
-	if (ret == NULL)
+	JsonNode *ret;
+
+	if (arena_current != NULL) {
+		ret = (JsonNode*) arena_alloc(arena_current, sizeof(JsonNode));
+		memset(ret, 0, sizeof(JsonNode));
+		ret->arena_ = JSON_ARENA_NODE;
+	} else if ((ret = (JsonNode*) calloc(1, sizeof(JsonNode))) == NULL) {
 		out_of_memory();
+	}
 	ret->tag = tag;
 	return ret;
 }
@@ -507,10 +769,13 @@ JsonNode *json_mkbool(bool b)
 	return ret;
 }
 
+/* The string must come from the arena in use, if any */
 static JsonNode *mkstring(char *s)
 {
 	JsonNode *ret = mknode(JSON_STRING);
 	ret->string_ = s;
+	if (arena_current != NULL)
+		ret->arena_ |= JSON_ARENA_STRING;
 	return ret;
 }
 
@@ -563,9 +828,12 @@ static void prepend_node(JsonNode *parent, JsonNode *child)
 	parent->children.head = child;
 }
 
+/* The key must come from the arena in use, if any */
 static void append_member(JsonNode *object, char *key, JsonNode *value)
 {
 	value->key = key;
+	if (arena_current != NULL)
+		value->arena_ |= JSON_ARENA_KEY;
 	append_node(object, value);
 }
 
@@ -599,6 +867,8 @@ void json_prepend_member(JsonNode *object, const char *key, JsonNode *value)
 	assert(value->parent == NULL);
 
 	value->key = json_strdup(key);
+	if (arena_current != NULL)
+		value->arena_ |= JSON_ARENA_KEY;
 	prepend_node(object, value);
 }
 
@@ -616,7 +886,9 @@ void json_remove_from_parent(JsonNode *node)
 		else
 			parent->children.tail = node->prev;
 
-		free(node->key);
+		if (!(node->arena_ & JSON_ARENA_KEY))
+			free(node->key);
+		node->arena_ &= ~JSON_ARENA_KEY;
 
 		node->parent = NULL;
 		node->prev = node->next = NULL;
@@ -624,6 +896,69 @@ void json_remove_from_parent(JsonNode *node)
 	}
 }
 
+JsonNode *json_clone(const JsonNode *node)
+{
+	JsonNode *ret, *child;
+
+	if (node == NULL)
+		return NULL;
+
+	switch (node->tag) {
+		case JSON_STRING:
+			ret = json_mkstring(node->string_);
+			break;
+		case JSON_ARRAY:
+		case JSON_OBJECT:
+			ret = mknode(node->tag);
+			json_foreach(child, node) {
+				if (node->tag == JSON_OBJECT)
+					append_member(ret, json_strdup(child->key), json_clone(child));
+				else
+					append_node(ret, json_clone(child));
+			}
+			break;
+		default:
+			ret = mknode(node->tag);
+			ret->bool_ = node->bool_;
+			ret->number_ = node->number_;
+			break;
+	}
+	ret->decimals_ = node->decimals_;
+	return ret;
+}
+
+/* Is the tree, apart from the key of its root, allocated on the heap */
+static bool on_heap(const JsonNode *node, bool root)
+{
+	const JsonNode *child;
+
+	if (node->arena_ & (JSON_ARENA_NODE | JSON_ARENA_STRING))
+		return false;
+	if (!root && (node->arena_ & JSON_ARENA_KEY))
+		return false;
+	json_foreach(child, node) {
+		if (!on_heap(child, false))
+			return false;
+	}
+	return true;
+}
+
+JsonNode *json_move(JsonNode *node)
+{
+	JsonNode *ret;
+
+	if (node == NULL)
+		return NULL;
+
+	if (arena_current == NULL && on_heap(node, true)) {
+		json_remove_from_parent(node);
+		return node;
+	}
+	ret = json_clone(node);
+	json_delete(node);
+	return ret;
+}
+
 static bool parse_value(const char **sp, JsonNode **out)
 {
 	const char *s = *sp;
@@ -788,7 +1123,7 @@ success:
 	return true;
 
 failure_free_key:
-	if (out)
+	if (out && arena_current == NULL)
 		free(key);
 failure:
 	json_delete(ret);
@@ -807,7 +1142,7 @@ bool parse_string(const char **sp, char **out)
 		return false;
 
 	if (out) {
-		sb_init(&sb);
+		sb_init_node(&sb);
 		sb_need(&sb, 4);
 		b = sb.cur;
 	} else {
@@ -37,7 +37,12 @@
 
 #define JsonTag			int
 
+#define JSON_ARENA_NODE		0x1
+#define JSON_ARENA_KEY		0x2
+#define JSON_ARENA_STRING	0x4
+
 typedef struct JsonNode JsonNode;
+typedef struct json_arena_t json_arena_t;
 
 struct JsonNode
 {
@@ -49,6 +54,8 @@ struct JsonNode
 	char *key; /* Must be valid UTF-8. */
 
 	JsonTag tag;
+	/* Which parts of this node are owned by an arena (JSON_ARENA_*) */
+	unsigned char arena_;
 	union {
 		/* JSON_BOOL */
 		bool bool_;
@@ -70,6 +77,10 @@ struct JsonNode
 
 /*** Encoding, decoding, and validation ***/
 
+/*
+ * json_decode validates while it parses and returns NULL for invalid input,
+ * so there is no need to call json_validate first.
+ */
 JsonNode   *json_decode         (const char *json);
 char       *json_encode         (const JsonNode *node);
 char       *json_encode_string  (const char *str);
@@ -78,6 +89,37 @@ void        json_delete         (JsonNode *node);
 
 bool        json_validate       (const char *json);
 
+/*** Arenas ***/
+
+/*
+ * While an arena is in use by a thread, every node and string that thread
+ * creates is bump allocated from the arena. Such trees are freed all at once
+ * by resetting the arena. json_delete only frees the heap allocated parts of
+ * a tree, so heap and arena nodes may be mixed, as long as no arena node
+ * outlives a reset of its arena.
+ */
+json_arena_t *json_arena_create (size_t size);
+json_arena_t *json_arena_use    (json_arena_t *arena);
+void          json_arena_reset  (json_arena_t *arena);
+void          json_arena_free   (json_arena_t *arena);
+JsonNode     *json_decode_arena (json_arena_t *arena, const char *json);
+
+/*** Pull parsing ***/
+
+/*
+ * Find a member of an object without building a tree. The path names the
+ * members of nested objects separated by dots, like "code.protocol". The
+ * members in front of it are only scanned and nothing behind it is looked
+ * at, so finding a member does not mean the whole document is valid.
+ *
+ * json_peek returns where the value starts in json or NULL. json_peek_string
+ * copies a string value to out, failing when it takes more than size bytes.
+ * json_peek_node decodes just the value, from the arena in use if any.
+ */
+const char *json_peek           (const char *json, const char *path);
+bool        json_peek_string    (const char *json, const char *path, char *out, size_t size);
+JsonNode   *json_peek_node      (const char *json, const char *path);
+
 /*** Lookup and traversal ***/
 
 JsonNode   *json_find_element   (JsonNode *array, int index);
@@ -106,6 +148,14 @@ void json_prepend_member(JsonNode *object, const char *key, JsonNode *value);
 
 void json_remove_from_parent(JsonNode *node);
 
+/*
+ * json_clone deep copies a tree. json_move hands a tree over to the caller:
+ * a tree on the heap is detached from its parent and returned as is, any
+ * other tree is cloned and deleted. Both allocate from the arena in use.
+ */
+JsonNode *json_clone(const JsonNode *node);
+JsonNode *json_move(JsonNode *node);
+
 void json_free(void *a);
 
 /*** Debugging ***/
@@ -40,6 +40,7 @@
 
 struct logqueue_t {
 	char *line;
+	int prio;
 	struct logqueue_t *next;
 } logqueue_t;
 
@@ -60,31 +61,105 @@ static pthread_t pth;
 static char *logfile = NULL;
 static int filelog = 1;
 static int shelllog = 0;
-static int loglevel = LOG_DEBUG;
+int loglevel = LOG_DEBUG;
 
-void logwrite(char *line) {
+/*
+ * The log file stays open and lines are collected in logbuf. The
+ * buffer is written when it is full, when an error is logged, or
+ * when it has been waiting for flushinterval seconds.
+ */
+static FILE *lf = NULL;
+static char logbuf[LOG_BUFFER_SIZE];
+static size_t logbuflen = 0;
+static size_t logsize = 0;
+static time_t lastflush = 0;
+static int flushinterval = LOG_FLUSH_INTERVAL;
+
+static void logclose(void) {
+	if(lf != NULL) {
+		fclose(lf);
+		lf = NULL;
+	}
+}
+
+static int logopen(void) {
 	struct stat sb;
-	FILE *lf = NULL;
-	if(logfile != NULL) {
-		if((stat(logfile, &sb)) == 0) {
-			if(sb.st_nlink != 0 && sb.st_size > LOG_MAX_SIZE) {
-				if(lf != NULL) {
-					fclose(lf);
-				}
-				char tmp[strlen(logfile)+5];
-				strcpy(tmp, logfile);
-				strcat(tmp, ".old");
-				rename(logfile, tmp);
-			}
-		}
-		if((lf = fopen(logfile, "a")) == NULL) {
-			filelog = 0;
-		} else {
-			fwrite(line, sizeof(char), strlen(line), lf);
+
+	if(lf != NULL) {
+		return 0;
+	}
+	if((lf = fopen(logfile, "a")) == NULL) {
+		filelog = 0;
+		return -1;
+	}
+	if(fstat(fileno(lf), &sb) == 0) {
+		logsize = (size_t)sb.st_size;
+	} else {
+		logsize = 0;
+	}
+	return 0;
+}
+
+static void logrotate(void) {
+	char tmp[strlen(logfile)+5];
+	strcpy(tmp, logfile);
+	strcat(tmp, ".old");
+
+	logclose();
+	rename(logfile, tmp);
+	logsize = 0;
+}
+
+static void logflush(void) {
+	struct stat sb;
+
+	lastflush = time(NULL);
+	if(logbuflen == 0 || logfile == NULL) {
+		logbuflen = 0;
+		return;
+	}
+	/* Reopen when the file was moved or removed behind our back */
+	if(lf != NULL && ((stat(logfile, &sb)) != 0 || sb.st_nlink == 0)) {
+		logclose();
+	}
+	if(logsize > LOG_MAX_SIZE) {
+		logrotate();
+	}
+	if(logopen() == 0) {
+		fwrite(logbuf, sizeof(char), logbuflen, lf);
+		fflush(lf);
+		logsize += logbuflen;
+	}
+	logbuflen = 0;
+}
+
+void logwrite(char *line, int prio) {
+	size_t len = 0;
+
+	if(logfile == NULL) {
+		return;
+	}
+
+	len = strlen(line);
+	if(logbuflen+len > sizeof(logbuf)) {
+		logflush();
+	}
+	if(len > sizeof(logbuf)) {
+		if(logopen() == 0) {
+			fwrite(line, sizeof(char), len, lf);
 			fflush(lf);
-			fclose(lf);
-			lf = NULL;
+			logsize += len;
 		}
+	} else {
+		if(logbuflen == 0) {
+			lastflush = time(NULL);
+		}
+		memcpy(&logbuf[logbuflen], line, len);
+		logbuflen += len;
+	}
+
+	if(prio <= LOG_ERR || flushinterval == 0 || time(NULL)-lastflush >= flushinterval) {
+		logflush();
 	}
 }
 
@@ -108,7 +183,7 @@ int log_gc(void) {
 			tmp = logqueue;
 			if(tmp->line != NULL) {
 				if(filelog == 1 && logfile != NULL) {
-					logwrite(tmp->line);
+					logwrite(tmp->line, tmp->prio);
 				} else {
 					/* [ Datetime ] Progname: */
 					/*  24 + 14 + 2 */
@@ -141,21 +216,29 @@ int log_gc(void) {
 		}
 		pthread_join(pth, NULL);
 	}
+	logflush();
+	logclose();
 	if(logfile != NULL) {
 		FREE(logfile);
 	}
 	return 1;
 }
 
-void logprintf(int prio, const char *format_str, ...) {
+void (logprintf)(int prio, const char *format_str, ...) {
 	struct timeval tv;
 	struct tm tm;
 	va_list ap, apcpy;
-	char fmt[64], buf[64], *line = MALLOC(128);
+	char fmt[64], buf[64], *line = NULL;
 	int save_errno = -1, pos = 0, bytes = 0;
 
+	if(loglevel < prio) {
+		return;
+	}
+
 	memset(&tm, '\0', sizeof(struct tm));
 
+	line = MALLOC(128);
+
 	if(line == NULL) {
 		fprintf(stderr, "out of memory\n");
 		exit(EXIT_FAILURE);
@@ -249,6 +332,7 @@ void logprintf(int prio, const char *format_str, ...) {
 				}
 				memset(node->line, '\0', (size_t)pos+1);
 				strcpy(node->line, line);
+				node->prio = prio;
 				node->next = NULL;
 
 				if(logqueue_number == 0) {
@@ -274,6 +358,8 @@ void logprintf(int prio, const char *format_str, ...) {
 }
 
 void *logloop(void *param) {
+	struct timespec ts;
+
 	pth = pthread_self();
 
 	pthactive = 1;
@@ -284,7 +370,7 @@ void *logloop(void *param) {
 		if(logqueue_number > 0) {
 			pthread_mutex_lock(&logqueue_lock);
 
-			logwrite(logqueue->line);
+			logwrite(logqueue->line, logqueue->prio);
 
 			struct logqueue_t *tmp = logqueue;
 			FREE(tmp->line);
@@ -292,10 +378,19 @@ void *logloop(void *param) {
 			FREE(tmp);
 			logqueue_number--;
 			pthread_mutex_unlock(&logqueue_lock);
+		} else if(logbuflen > 0) {
+			if(time(NULL)-lastflush >= flushinterval) {
+				logflush();
+			} else {
+				ts.tv_sec = lastflush+flushinterval;
+				ts.tv_nsec = 0;
+				pthread_cond_timedwait(&logqueue_signal, &logqueue_lock, &ts);
+			}
 		} else {
 			pthread_cond_wait(&logqueue_signal, &logqueue_lock);
 		}
 	}
+	logflush();
 
 	pthactive = 0;
 	return (void *)NULL;
@@ -343,6 +438,15 @@ int log_file_set(char *log) {
 	char *logpath = NULL;
 	FILE *lf = NULL;
 
+	if(pthinitialized == 1) {
+		pthread_mutex_lock(&logqueue_lock);
+	}
+	logflush();
+	logclose();
+	if(pthinitialized == 1) {
+		pthread_mutex_unlock(&logqueue_lock);
+	}
+
 	atomiclock();
 	/* basename isn't thread safe */
 	char *filename = basename(log);
@@ -422,6 +526,10 @@ int log_file_set(char *log) {
 	return EXIT_SUCCESS;
 }
 
+void log_flush_interval_set(int interval) {
+	flushinterval = interval;
+}
+
 void log_level_set(int level) {
 	loglevel = level;
 }
@@ -32,9 +32,27 @@
 	#include <syslog.h>
 #endif
 
+#include "defines.h"
+
 #define LOG_STACK		255
 
+extern int loglevel;
+
 void logprintf(int prio, const char *format_str, ...);
+
+/*
+ * Check the level before the arguments are evaluated so suppressed
+ * messages cost a single compare. Messages above LOG_MAX_LEVEL are
+ * removed at compile time. The parenthesized name still refers to
+ * the function, e.g. when it is handed out as a callback.
+ */
+#define logprintf(prio, ...) \
+	do { \
+		if((prio) <= LOG_MAX_LEVEL && (prio) <= loglevel) { \
+			(logprintf)((prio), __VA_ARGS__); \
+		} \
+	} while(0)
+
 void logperror(int prio, const char *s);
 void *logloop(void *param);
 void log_file_enable(void);
@@ -42,6 +60,7 @@ void log_file_disable(void);
 void log_shell_enable(void);
 void log_shell_disable(void);
 int log_file_set(char *file);
+void log_flush_interval_set(int interval);
 void log_level_set(int level);
 int log_level_get(void);
 int log_gc(void);
@@ -127,6 +127,9 @@ typedef struct _stati64 ns_stat_t;
 #include <arpa/inet.h>  // For inet_pton() when NS_ENABLE_IPV6 is defined
 #include <netinet/in.h>
 #include <sys/socket.h>
+#if defined(__linux__) && !defined(SO_REUSEPORT)
+#include <asm/socket.h>     // SO_REUSEPORT is hidden by _XOPEN_SOURCE
+#endif
 #include <sys/select.h>
 #define closesocket(x) close(x)
 #define __cdecl
@@ -719,6 +722,12 @@ static sock_t ns_open_listening_socket(union socket_address *sa, int proto) {
       // SO_REUSEADDR was designed for, and leads to hard-to-track failure
       // scenarios. Therefore, SO_REUSEADDR was disabled on Windows.
       !setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on)) &&
+#ifdef SO_REUSEPORT
+      // Lets every webserver worker bind its own listening socket
+      // to the same port, the kernel spreads the connections. Kernels
+      // without it make the bind of the second worker fail instead.
+      (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on)) || 1) &&
+#endif
 #endif
       !bind(sock, &sa->sa, sa_len) &&
       (proto == SOCK_DGRAM || listen(sock, SOMAXCONN) == 0)) {
@@ -49,6 +49,8 @@ struct pilight_t {
 	void (*broadcast)(char *name, JsonNode *message, enum origin_t origin);
 	int (*send)(JsonNode *json, enum origin_t origin);
 	int (*control)(struct devices_t *dev, char *state, JsonNode *values, enum origin_t origin);
+	/* A send, control or registry action of a client, with an optional reply */
+	int (*action)(JsonNode *json, JsonNode **reply);
 	runmode_t runmode;
 	/* pilight actually runs in this stage and the configuration is fully validated */
 	int running;
@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "sha256cache.h"
 #include "common.h"
@@ -30,6 +31,9 @@
 #include "gc.h"
 #include "../../polarssl/polarssl/sha256.h"
 
+/* Hashes are added by all webserver workers, they are looked up without locking */
+static pthread_mutex_t sha256cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int sha256cache_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -75,7 +79,9 @@ void sha256cache_remove_node(struct sha256cache_t **cache, char *name) {
 int sha256cache_rm(char *name) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	pthread_mutex_lock(&sha256cache_lock);
 	sha256cache_remove_node(&sha256cache, name);
+	pthread_mutex_unlock(&sha256cache_lock);
 
 	logprintf(LOG_DEBUG, "removed %s from cache", name);
 	return 1;
@@ -129,9 +135,23 @@ int sha256cache_add(char *name) {
 		sprintf(&node->hash[i], "%02x", output[i/2]);
 	}
 	
+	FREE(password);
+
+	pthread_mutex_lock(&sha256cache_lock);
+	struct sha256cache_t *tmp = sha256cache;
+	while(tmp) {
+		/* Another worker was first */
+		if(strcmp(tmp->name, name) == 0) {
+			pthread_mutex_unlock(&sha256cache_lock);
+			FREE(node->name);
+			FREE(node);
+			return 0;
+		}
+		tmp = tmp->next;
+	}
 	node->next = sha256cache;
 	sha256cache = node;
-	FREE(password);
+	pthread_mutex_unlock(&sha256cache_lock);
 	return 0;
 }
 
@@ -48,21 +48,75 @@
 	#include <netdb.h>
 	#include <arpa/inet.h>
 #endif
+#ifdef __linux__
+	#include <sys/epoll.h>
+#endif
+#include <stdint.h>
+#include <pthread.h>
+#ifndef _WIN32
+	#include <sys/uio.h>
+#endif
 
 #include "pilight.h"
 #include "network.h"
 #include "log.h"
 #include "gc.h"
 #include "socket.h"
+#include "json.h"
 #include "../config/settings.h"
 
+/*
+ * Connected clients. The table starts with MAX_CLIENTS slots and
+ * doubles when it runs full. Slot 0 holds our own loopback socket.
+ * The read buffer of a slot is only touched by the socket_wait
+ * thread and is kept for the next client that takes the slot.
+ * Messages that could not be written right away wait in the
+ * output queue of the slot until the socket is writable again.
+ */
+typedef struct socket_client_t {
+	int fd;
+	/* Whether the client ends its messages with EOSS */
+	int framed;
+	char *buffer;
+	size_t len;
+	size_t size;
+	/* Start of the first unhandled frame and where to look for its end */
+	size_t head;
+	size_t scan;
+	/* Ring of pending messages, the first one partly written */
+	struct socket_buffer_t **queue;
+	int qsize;
+	int qhead;
+	int qcount;
+	size_t qoffset;
+	size_t qbytes;
+} socket_client_t;
+
+/* The listening socket has no slot in the client table */
+#define SOCKET_SERVER		UINT32_MAX
+#define SOCKET_EVENTS		64
+#define SOCKET_IOV			64
+
+#define SOCKET_READ			1
+#define SOCKET_WRITE		2
+
+typedef struct socket_event_t {
+	int fd;
+	uint32_t slot;
+	int events;
+} socket_event_t;
+
 static char recvBuff[BUFFER_SIZE];
-static char *waitMessage = NULL;
 static unsigned short socket_loop = 1;
 static unsigned int socket_port = 0;
 static int socket_loopback = 0;
 static int socket_server = 0;
-static int socket_clients[MAX_CLIENTS];
+static struct socket_client_t *socket_clients = NULL;
+static int socket_nrclients = 0;
+static pthread_mutex_t socket_lock = PTHREAD_MUTEX_INITIALIZER;
+#ifdef __linux__
+static int socket_epoll = -1;
+#endif
 
 int socket_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
@@ -74,21 +128,19 @@ int socket_gc(void) {
 		 socket_read functions can actually close and the
 		 all threads using sockets can end gracefully */
 
-	for(x=1;x<MAX_CLIENTS;x++) {
-		if(socket_clients[x] > 0) {
-			send(socket_clients[x], "1", 1, MSG_NOSIGNAL);
+	pthread_mutex_lock(&socket_lock);
+	for(x=1;x<socket_nrclients;x++) {
+		if(socket_clients[x].fd > 0) {
+			send(socket_clients[x].fd, "1", 1, MSG_NOSIGNAL);
 		}
 	}
+	pthread_mutex_unlock(&socket_lock);
 
 	if(socket_loopback > 0) {
 		send(socket_loopback, "1", 1, MSG_NOSIGNAL);
 		socket_close(socket_loopback);
 	}
 
-	if(waitMessage != NULL) {
-		FREE(waitMessage);
-	}
-
 	logprintf(LOG_DEBUG, "garbage collected socket library");
 	return EXIT_SUCCESS;
 }
@@ -111,7 +163,15 @@ int socket_start(unsigned short port) {
 #endif
 
 	memset(&address, '\0', sizeof(struct sockaddr_in));
-	memset(socket_clients, 0, sizeof(socket_clients));
+
+	pthread_mutex_lock(&socket_lock);
+	socket_nrclients = MAX_CLIENTS;
+	if((socket_clients = REALLOC(socket_clients, sizeof(struct socket_client_t)*(size_t)socket_nrclients)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(socket_clients, 0, sizeof(struct socket_client_t)*(size_t)socket_nrclients);
+	pthread_mutex_unlock(&socket_lock);
 
 	//create a master socket
 	if((socket_server = socket(AF_INET, SOCK_STREAM, 0)) == 0)  {
@@ -141,8 +201,8 @@ int socket_start(unsigned short port) {
 	}
 
 	int x = 0;
-	//try to specify maximum of 3 pending connections for the master socket
-	if((x = listen(socket_server, 3)) < 0) {
+	//let connections queue up while the socket thread accepts a burst of clients
+	if((x = listen(socket_server, SOMAXCONN)) < 0) {
 		logprintf(LOG_ERR, "failed to listen to socket");
 		exit(EXIT_FAILURE);
 	}
@@ -164,7 +224,7 @@ int socket_start(unsigned short port) {
 	   or else the select statement will wait forever for an activity */
 	char localhost[16] = "127.0.0.1";
 	socket_loopback = socket_connect(localhost, (unsigned short)socket_port);
-	socket_clients[0] = socket_loopback;
+	socket_clients[0].fd = socket_loopback;
 	logprintf(LOG_INFO, "daemon listening to port: %d", socket_port);
 
 	return 0;
@@ -230,7 +290,15 @@ int socket_get_fd(void) {
 int socket_get_clients(int i) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	return socket_clients[i];
+	int sd = 0;
+
+	pthread_mutex_lock(&socket_lock);
+	if(i >= 0 && i < socket_nrclients) {
+		sd = socket_clients[i].fd;
+	}
+	pthread_mutex_unlock(&socket_lock);
+
+	return sd;
 }
 
 int socket_connect(char *address, unsigned short port) {
@@ -311,6 +379,147 @@ int socket_connect(char *address, unsigned short port) {
 	}
 }
 
+static int socket_would_block(void) {
+#ifdef _WIN32
+	return (WSAGetLastError() == WSAEWOULDBLOCK);
+#else
+	return (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+}
+
+/* The slot of a connected client, socket_lock must be held */
+static struct socket_client_t *socket_slot(int fd) {
+	int i = 0;
+
+	for(i=1;i<socket_nrclients;i++) {
+		if(socket_clients[i].fd == fd) {
+			return &socket_clients[i];
+		}
+	}
+	return NULL;
+}
+
+static void socket_queue_clear(struct socket_client_t *client) {
+	while(client->qcount > 0) {
+		socket_buffer_unref(client->queue[client->qhead]);
+		client->qhead = (client->qhead+1) % client->qsize;
+		client->qcount--;
+	}
+	client->qhead = 0;
+	client->qoffset = 0;
+	client->qbytes = 0;
+}
+
+static void socket_queue_push(struct socket_client_t *client, struct socket_buffer_t *buffer, size_t offset) {
+	struct socket_buffer_t **queue = NULL;
+	int i = 0;
+
+	if(client->qcount == client->qsize) {
+		if((queue = MALLOC(sizeof(struct socket_buffer_t *)*(size_t)(client->qsize*2+8))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		for(i=0;i<client->qcount;i++) {
+			queue[i] = client->queue[(client->qhead+i) % client->qsize];
+		}
+		if(client->queue != NULL) {
+			FREE(client->queue);
+		}
+		client->queue = queue;
+		client->qsize = client->qsize*2+8;
+		client->qhead = 0;
+	}
+	if(client->qcount == 0) {
+		client->qoffset = offset;
+	}
+	client->queue[(client->qhead+client->qcount) % client->qsize] = socket_buffer_ref(buffer);
+	client->qcount++;
+	client->qbytes += buffer->len-offset;
+}
+
+/*
+ * Write as much of the output queue as the socket takes in one
+ * writev. Returns -1 when the connection is broken.
+ */
+static int socket_flush(struct socket_client_t *client) {
+	struct socket_buffer_t *buffer = NULL;
+	ssize_t bytes = 0;
+	size_t left = 0;
+	int i = 0, n = 0;
+
+	while(client->qcount > 0) {
+#ifdef _WIN32
+		buffer = client->queue[client->qhead];
+		bytes = send(client->fd, &buffer->data[client->qoffset], buffer->len-client->qoffset, MSG_NOSIGNAL);
+#else
+		struct iovec iov[SOCKET_IOV];
+
+		n = (client->qcount < SOCKET_IOV) ? client->qcount : SOCKET_IOV;
+		for(i=0;i<n;i++) {
+			buffer = client->queue[(client->qhead+i) % client->qsize];
+			iov[i].iov_base = buffer->data;
+			iov[i].iov_len = buffer->len;
+		}
+		iov[0].iov_base = &((char *)iov[0].iov_base)[client->qoffset];
+		iov[0].iov_len -= client->qoffset;
+		bytes = writev(client->fd, iov, n);
+#endif
+		if(bytes == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			if(socket_would_block()) {
+				return 0;
+			}
+			return -1;
+		}
+
+		client->qbytes -= (size_t)bytes;
+		while(bytes > 0) {
+			buffer = client->queue[client->qhead];
+			left = buffer->len-client->qoffset;
+			if((size_t)bytes < left) {
+				client->qoffset += (size_t)bytes;
+				break;
+			}
+			bytes -= (ssize_t)left;
+			socket_buffer_unref(buffer);
+			client->qhead = (client->qhead+1) % client->qsize;
+			client->qcount--;
+			client->qoffset = 0;
+		}
+	}
+	return 0;
+}
+
+/* Write a whole buffer to a socket that is not one of our clients */
+static int socket_send_all(int sockfd, const char *data, size_t len) {
+	struct timeval tv;
+	fd_set fdset;
+	size_t ptr = 0;
+	int bytes = 0;
+
+	while(ptr < len) {
+		if((bytes = (int)send(sockfd, &data[ptr], len-ptr, MSG_NOSIGNAL)) == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			if(socket_would_block()) {
+				FD_ZERO(&fdset);
+				FD_SET((unsigned long)sockfd, &fdset);
+				tv.tv_sec = 3;
+				tv.tv_usec = 0;
+				if(select(sockfd+1, NULL, &fdset, NULL, &tv) > 0) {
+					continue;
+				}
+			}
+			return -1;
+		}
+		ptr += (size_t)bytes;
+	}
+	return 0;
+}
+
 void socket_close(int sockfd) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -326,87 +535,177 @@ void socket_close(int sockfd) {
 			logprintf(LOG_DEBUG, "client disconnected, ip %s, port %d", buf, ntohs(address.sin_port));
 		}
 
-		for(i=0;i<MAX_CLIENTS;i++) {
-			if(socket_clients[i] == sockfd) {
-				socket_clients[i] = 0;
+		pthread_mutex_lock(&socket_lock);
+		for(i=0;i<socket_nrclients;i++) {
+			if(socket_clients[i].fd == sockfd) {
+				socket_queue_clear(&socket_clients[i]);
+				socket_clients[i].fd = 0;
 				break;
 			}
 		}
 		shutdown(sockfd, 2);
 		close(sockfd);
+		pthread_mutex_unlock(&socket_lock);
 	}
 }
 
 int socket_write(int sockfd, const char *msg, ...) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	struct socket_buffer_t *buffer = NULL;
 	va_list ap;
-	int bytes = -1;
-	int ptr = 0, n = 0, x = BUFFER_SIZE, len = (int)strlen(EOSS);
-	char *sendBuff = NULL;
-	if(strlen(msg) > 0 && sockfd > 0) {
+	char sendBuff[BUFFER_SIZE];
+	size_t len = strlen(EOSS);
+	int n = 0;
 
+	if(strlen(msg) > 0 && sockfd > 0) {
+		/* Most messages fit the stack buffer and are formatted once */
 		va_start(ap, msg);
-#ifdef _WIN32
-		n = _vscprintf(msg, ap);
-#else
-		n = vsnprintf(NULL, 0, msg, ap);
-#endif
-		if(n == -1) {
+		n = vsnprintf(sendBuff, BUFFER_SIZE, msg, ap);
+		va_end(ap);
+		if(n < 0) {
 			logprintf(LOG_ERR, "improperly formatted string: %s", msg);
 			return -1;
 		}
-		n += (int)len;
-		va_end(ap);
 
-		if((sendBuff = MALLOC((size_t)n)) == NULL) {
+		if((buffer = MALLOC(sizeof(struct socket_buffer_t))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		buffer->msglen = (size_t)n;
+		buffer->len = buffer->msglen+len;
+		buffer->refs = 1;
+		if((buffer->data = MALLOC(buffer->len+1)) == NULL) {
 			fprintf(stderr, "out of memory\n");
 			exit(EXIT_FAILURE);
 		}
-		memset(sendBuff, '\0', (size_t)n);
+		if(n < BUFFER_SIZE) {
+			memcpy(buffer->data, sendBuff, (size_t)n);
+		} else {
+			va_start(ap, msg);
+			vsnprintf(buffer->data, buffer->msglen+1, msg, ap);
+			va_end(ap);
+		}
+		memcpy(&buffer->data[buffer->msglen], EOSS, len);
+		buffer->data[buffer->len] = '\0';
 
-		va_start(ap, msg);
-		vsprintf(sendBuff, msg, ap);
-		va_end(ap);
+		n = socket_write_buffer(sockfd, buffer);
+		socket_buffer_unref(buffer);
+	}
+	return n;
+}
 
-		memcpy(&sendBuff[n-len], EOSS, (size_t)len);
+/*
+ * Frame a message with the end of stream delimiter once, so the same
+ * buffer can be written to many clients without formatting and copying
+ * it again for each of them. The buffer starts with a single reference.
+ */
+struct socket_buffer_t *socket_buffer_create(const char *msg) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-		while(ptr < n) {
-			if((n-ptr) < BUFFER_SIZE) {
-				x = (n-ptr);
-			} else {
-				x = BUFFER_SIZE;
-			}
-			if((bytes = (int)send(sockfd, &sendBuff[ptr], (size_t)x, MSG_NOSIGNAL)) == -1) {
-				/* Change the delimiter into regular newlines */
-				sendBuff[n-(len-1)] = '\0';
-				sendBuff[n-(len)] = '\n';
-				logprintf(LOG_DEBUG, "socket write failed: %s", sendBuff);
-				FREE(sendBuff);
-				return -1;
-			}
-			ptr += bytes;
-		}
+	struct socket_buffer_t *buffer = NULL;
+	size_t len = strlen(EOSS);
+
+	if((buffer = MALLOC(sizeof(struct socket_buffer_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	buffer->msglen = strlen(msg);
+	buffer->len = buffer->msglen+len;
+	if((buffer->data = MALLOC(buffer->len+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(buffer->data, msg, buffer->msglen);
+	memcpy(&buffer->data[buffer->msglen], EOSS, len);
+	buffer->data[buffer->len] = '\0';
+	buffer->refs = 1;
+
+	return buffer;
+}
 
-		if(strncmp(&sendBuff[0], "BEAT", 4) != 0) {
-			/* Change the delimiter into regular newlines */
-			sendBuff[n-(len-1)] = '\0';
-			sendBuff[n-(len)] = '\n';
-			logprintf(LOG_DEBUG, "socket write succeeded: %s", sendBuff);
+struct socket_buffer_t *socket_buffer_ref(struct socket_buffer_t *buffer) {
+	__sync_add_and_fetch(&buffer->refs, 1);
+	return buffer;
+}
+
+void socket_buffer_unref(struct socket_buffer_t *buffer) {
+	if(buffer != NULL && __sync_sub_and_fetch(&buffer->refs, 1) == 0) {
+		FREE(buffer->data);
+		FREE(buffer);
+	}
+}
+
+/*
+ * Write a buffer to a socket without blocking. What the socket
+ * does not take right away is queued for the socket_wait thread.
+ * Clients that fall more than SOCKET_HIGH_WATER bytes behind are
+ * disconnected.
+ */
+int socket_write_buffer(int sockfd, struct socket_buffer_t *buffer) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	struct socket_client_t *client = NULL;
+	int bytes = 0, ret = 0;
+
+	if(buffer->msglen == 0 || sockfd <= 0) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&socket_lock);
+	if((client = socket_slot(sockfd)) == NULL) {
+		pthread_mutex_unlock(&socket_lock);
+		ret = socket_send_all(sockfd, buffer->data, buffer->len);
+	} else if(client->qcount == 0) {
+		do {
+			bytes = (int)send(sockfd, buffer->data, buffer->len, MSG_NOSIGNAL);
+		} while(bytes == -1 && errno == EINTR);
+		if(bytes == -1 && socket_would_block()) {
+			bytes = 0;
+		}
+		if(bytes == -1) {
+			ret = -1;
+		} else if((size_t)bytes < buffer->len) {
+			socket_queue_push(client, buffer, (size_t)bytes);
 		}
-		FREE(sendBuff);
+		pthread_mutex_unlock(&socket_lock);
+	} else if(client->qbytes+buffer->len > SOCKET_HIGH_WATER) {
+		logprintf(LOG_NOTICE, "client fd %d is %zu bytes behind, disconnecting", sockfd, client->qbytes);
+		socket_queue_clear(client);
+		/* Let the socket_wait thread see the hangup and remove the client */
+		shutdown(sockfd, 2);
+		pthread_mutex_unlock(&socket_lock);
+		return -1;
+	} else {
+		socket_queue_push(client, buffer, 0);
+		ret = socket_flush(client);
+		pthread_mutex_unlock(&socket_lock);
 	}
-	return n;
+
+	if(ret == -1) {
+		logprintf(LOG_DEBUG, "socket write failed: %.*s", (int)buffer->msglen, buffer->data);
+		return -1;
+	}
+
+	if(strncmp(buffer->data, "BEAT", 4) != 0) {
+		logprintf(LOG_DEBUG, "socket write succeeded: %.*s", (int)buffer->msglen, buffer->data);
+	}
+
+	return (int)buffer->len;
 }
 
-void socket_rm_client(int i, struct socket_callback_t *socket_callback) {
+static void socket_rm_client(int i, int sd, struct socket_callback_t *socket_callback) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	struct sockaddr_in address;
 	int addrlen = sizeof(address);
-	int sd = socket_clients[i];
 	char buf[INET_ADDRSTRLEN+1];
 
+	/* The client could already be closed by another thread */
+	if(socket_get_clients(i) != sd) {
+		return;
+	}
+
 	//Somebody disconnected, get his details and print
 	getpeername(sd, (struct sockaddr*)&address, (socklen_t*)&addrlen);
 	memset(&buf, '\0', INET_ADDRSTRLEN+1);
@@ -415,9 +714,14 @@ void socket_rm_client(int i, struct socket_callback_t *socket_callback) {
 	if(socket_callback->client_disconnected_callback)
 		socket_callback->client_disconnected_callback(i);
 	//Close the socket and mark as 0 in list for reuse
-	shutdown(sd, 2);
-	close(sd);
-	socket_clients[i] = 0;
+	pthread_mutex_lock(&socket_lock);
+	if(socket_clients[i].fd == sd) {
+		socket_queue_clear(&socket_clients[i]);
+		shutdown(sd, 2);
+		close(sd);
+		socket_clients[i].fd = 0;
+	}
+	pthread_mutex_unlock(&socket_lock);
 }
 
 int socket_read(int sockfd, char **message, time_t timeout) {
@@ -472,9 +776,12 @@ int socket_read(int sockfd, char **message, time_t timeout) {
 						fprintf(stderr, "out of memory\n");
 						exit(EXIT_FAILURE);
 					}
-					memset(&(*message)[(ptr-bytes)], '\0', (size_t)bytes+1);
 					memcpy(&(*message)[(ptr-bytes)], recvBuff, (size_t)bytes);
-					msglen = strlen(*message);
+					(*message)[ptr] = '\0';
+					/* Only the new bytes need to be searched for the end of the string */
+					if(msglen == (size_t)(ptr-bytes)) {
+						msglen += strlen(&(*message)[msglen]);
+					}
 				}
 				if(*message && msglen > 0) {
 					/* When a stream is larger then the buffer size, it has to contain
@@ -485,14 +792,16 @@ int socket_read(int sockfd, char **message, time_t timeout) {
 						/* If the socket contains buffered TCP messages, separate them by
 						   changing the delimiters into newlines */
 						if(ptr > msglen) {
-							int i = 0;
+							int i = 0, x = 0;
 							for(i=0;i<ptr;i++) {
-								if(i+(len-1) < ptr && strncmp(&(*message)[i], EOSS, (size_t)len) == 0) {
-									memmove(&(*message)[i], message[i+(len-1)], (size_t)(ptr-(i+(len-1))));
-									ptr-=(len-1);
-									(*message)[i] = '\n';
+								if(i+len <= ptr && strncmp(&(*message)[i], EOSS, (size_t)len) == 0) {
+									(*message)[x++] = '\n';
+									i += len-1;
+								} else {
+									(*message)[x++] = (*message)[i];
 								}
 							}
+							ptr = x;
 							(*message)[ptr] = '\0';
 						} else {
 							if(l == 0) {
@@ -514,129 +823,412 @@ int socket_read(int sockfd, char **message, time_t timeout) {
 	return -1;
 }
 
-void *socket_wait(void *param) {
-	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+static void socket_poll_init(void) {
+#ifdef __linux__
+	struct epoll_event ev;
 
-	struct socket_callback_t *socket_callback = (struct socket_callback_t *)param;
+	if((socket_epoll = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		logprintf(LOG_ERR, "could not create epoll instance");
+		exit(EXIT_FAILURE);
+	}
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.u64 = ((uint64_t)(uint32_t)socket_server << 32) | SOCKET_SERVER;
+	epoll_ctl(socket_epoll, EPOLL_CTL_ADD, socket_server, &ev);
+#endif
+}
+
+static void socket_poll_add(int fd, int slot) {
+#ifdef __linux__
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.u64 = ((uint64_t)(uint32_t)fd << 32) | (uint32_t)slot;
+	if(epoll_ctl(socket_epoll, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		logprintf(LOG_ERR, "could not watch client fd %d", fd);
+	}
+#endif
+}
+
+static void socket_poll_gc(void) {
+#ifdef __linux__
+	if(socket_epoll > -1) {
+		close(socket_epoll);
+		socket_epoll = -1;
+	}
+#endif
+}
+
+/*
+ * Wait until the listening socket or one of the clients
+ * becomes readable. Without epoll the client table is
+ * scanned with select.
+ */
+static int socket_poll_wait(struct socket_event_t *events, int max) {
+	int n = 0, i = 0;
+#ifdef __linux__
+	struct epoll_event ev[SOCKET_EVENTS];
+
+	if(max > SOCKET_EVENTS) {
+		max = SOCKET_EVENTS;
+	}
+	do {
+		n = epoll_wait(socket_epoll, ev, max, -1);
+	} while(n == -1 && errno == EINTR && socket_loop);
+
+	for(i=0;i<n;i++) {
+		events[i].fd = (int)(ev[i].data.u64 >> 32);
+		events[i].slot = (uint32_t)(ev[i].data.u64 & 0xFFFFFFFF);
+		events[i].events = 0;
+		if(ev[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			events[i].events |= SOCKET_READ;
+		}
+		if(ev[i].events & EPOLLOUT) {
+			events[i].events |= SOCKET_WRITE;
+		}
+	}
+#else
+	fd_set readfds, writefds;
+	int max_sd = socket_server, sd = 0, x = 0;
+
+	do {
+		FD_ZERO(&readfds);
+		FD_ZERO(&writefds);
+		FD_SET((unsigned long)socket_server, &readfds);
+		pthread_mutex_lock(&socket_lock);
+		for(i=1;i<socket_nrclients;i++) {
+			if((sd = socket_clients[i].fd) > 0) {
+				FD_SET((unsigned long)sd, &readfds);
+				if(socket_clients[i].qcount > 0) {
+					FD_SET((unsigned long)sd, &writefds);
+				}
+				if(sd > max_sd) {
+					max_sd = sd;
+				}
+			}
+		}
+		pthread_mutex_unlock(&socket_lock);
+		x = select(max_sd + 1, &readfds, &writefds, NULL, NULL);
+	} while(x == -1 && errno == EINTR && socket_loop);
+
+	if(x > 0) {
+		if(FD_ISSET((unsigned long)socket_server, &readfds)) {
+			events[n].fd = socket_server;
+			events[n].slot = SOCKET_SERVER;
+			events[n].events = SOCKET_READ;
+			n++;
+		}
+		pthread_mutex_lock(&socket_lock);
+		for(i=1;i<socket_nrclients && n<max;i++) {
+			if((sd = socket_clients[i].fd) > 0) {
+				events[n].events = 0;
+				if(FD_ISSET((unsigned long)sd, &readfds)) {
+					events[n].events |= SOCKET_READ;
+				}
+				if(FD_ISSET((unsigned long)sd, &writefds)) {
+					events[n].events |= SOCKET_WRITE;
+				}
+				if(events[n].events != 0) {
+					events[n].fd = sd;
+					events[n].slot = (uint32_t)i;
+					n++;
+				}
+			}
+		}
+		pthread_mutex_unlock(&socket_lock);
+	}
+#endif
+	return n;
+}
 
+static void socket_accept(struct socket_callback_t *socket_callback) {
 	char buf[INET_ADDRSTRLEN+1];
-	int activity;
-	int i, sd;
-	int max_sd;
 	struct sockaddr_in address;
-	int socket_client = 0;
-	int addrlen = sizeof(address);
-	fd_set readfds;
+	int socket_client = 0, i = 0, slot = -1;
+	socklen_t addrlen = sizeof(address);
 #ifdef _WIN32
 	unsigned long on = 1;
 #endif
 
+	/* The listening socket is edge triggered, so take all pending connections */
 	while(socket_loop) {
-		do {
-			//clear the socket set
-			FD_ZERO(&readfds);
-
-			//add master socket to set
-			FD_SET((unsigned long)socket_get_fd(), &readfds);
-			max_sd = socket_get_fd();
-
-			//add child sockets to set
-			for(i=0;i<MAX_CLIENTS;i++) {
-				//socket descriptor
-				sd = socket_clients[i];
-				//if valid socket descriptor then add to read list
-				if(sd > 0)
-					FD_SET((unsigned long)sd, &readfds);
-
-				//highest file descriptor number, need it for the select function
-				if(sd > max_sd)
-					max_sd = sd;
+		addrlen = sizeof(address);
+		if((socket_client = accept(socket_get_fd(), (struct sockaddr *)&address, &addrlen)) < 0) {
+			if(socket_would_block() || errno == EINTR || errno == ECONNABORTED) {
+				break;
 			}
-			//wait for an activity on one of the sockets, timeout is NULL, so wait indefinitely
-			activity = select(max_sd + 1, &readfds, NULL, NULL, NULL);
-		} while(activity == -1 && errno == EINTR && socket_loop);
-
-		/* Immediatly stop loop if the select was waken up by the garbage collector */
-		if(socket_loop == 0) {
-			break;
+			logprintf(LOG_ERR, "failed to accept client");
+			exit(EXIT_FAILURE);
 		}
-		//If something happened on the master socket, then its an incoming connection
-		if(FD_ISSET((unsigned long)socket_get_fd(), &readfds)) {
-			if((socket_client = accept(socket_get_fd(), (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
-				logprintf(LOG_ERR, "failed to accept client");
-				exit(EXIT_FAILURE);
-			}
-			memset(&buf, '\0', INET_ADDRSTRLEN+1);
-			inet_ntop(AF_INET, (void *)&(address.sin_addr), buf, INET_ADDRSTRLEN+1);
-			if(whitelist_check(buf) != 0) {
-				logprintf(LOG_INFO, "rejected client, ip: %s, port: %d", buf, ntohs(address.sin_port));
-				shutdown(socket_client, 2);
-				close(socket_client);
-			} else {
-				//inform user of socket number - used in send and receive commands
-				logprintf(LOG_INFO, "new client, ip: %s, port: %d", buf, ntohs(address.sin_port));
-				logprintf(LOG_DEBUG, "client fd: %d", socket_client);
-				//send new connection accept message
-				//socket_write(socket_client, "{\"message\":\"accept connection\"}");
-
-				static struct linger linger = { 0, 0 };
-				socklen_t lsize = sizeof(struct linger);
-				setsockopt(socket_client, SOL_SOCKET, SO_LINGER, (void *)&linger, lsize);
+		memset(&buf, '\0', INET_ADDRSTRLEN+1);
+		inet_ntop(AF_INET, (void *)&(address.sin_addr), buf, INET_ADDRSTRLEN+1);
+		if(whitelist_check(buf) != 0) {
+			logprintf(LOG_INFO, "rejected client, ip: %s, port: %d", buf, ntohs(address.sin_port));
+			shutdown(socket_client, 2);
+			close(socket_client);
+			continue;
+		}
+		//inform user of socket number - used in send and receive commands
+		logprintf(LOG_INFO, "new client, ip: %s, port: %d", buf, ntohs(address.sin_port));
+		logprintf(LOG_DEBUG, "client fd: %d", socket_client);
+
+		static struct linger linger = { 0, 0 };
+		socklen_t lsize = sizeof(struct linger);
+		setsockopt(socket_client, SOL_SOCKET, SO_LINGER, (void *)&linger, lsize);
 #ifdef _WIN32
-				int flags = ioctlsocket(socket_client, FIONBIO, &on);
+		ioctlsocket(socket_client, FIONBIO, &on);
 #else
- 				int flags = fcntl(socket_client, F_GETFL, 0);
+		int flags = fcntl(socket_client, F_GETFL, 0);
+		if(flags != -1) {
+			fcntl(socket_client, F_SETFL, flags | O_NONBLOCK);
+		}
 #endif
- 				if(flags != -1) {
+
+		//add new socket to the table of sockets
+		pthread_mutex_lock(&socket_lock);
+		slot = -1;
+		for(i=1;i<socket_nrclients;i++) {
+			if(socket_clients[i].fd == 0) {
+				slot = i;
+				break;
+			}
+		}
+		if(slot == -1) {
+			slot = socket_nrclients;
+			socket_nrclients *= 2;
+			if((socket_clients = REALLOC(socket_clients, sizeof(struct socket_client_t)*(size_t)socket_nrclients)) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			memset(&socket_clients[slot], 0, sizeof(struct socket_client_t)*(size_t)(socket_nrclients-slot));
+		}
+		socket_clients[slot].fd = socket_client;
+		socket_clients[slot].framed = 0;
+		socket_clients[slot].len = 0;
+		socket_clients[slot].head = 0;
+		socket_clients[slot].scan = 0;
+		socket_queue_clear(&socket_clients[slot]);
+		pthread_mutex_unlock(&socket_lock);
+
+		socket_poll_add(socket_client, slot);
+		if(socket_callback->client_connected_callback)
+			socket_callback->client_connected_callback(slot);
+		logprintf(LOG_DEBUG, "client id: %d", slot);
+	}
+}
+
+/*
+ * Hand a message to the data callback line by line, like the
+ * old reader did when it merged buffered messages. The lines are
+ * terminated in place and passed on without copying. Returns -1
+ * when the client should be dropped or got closed meanwhile.
+ */
+static int socket_dispatch(int i, int sd, char *message, size_t len, struct socket_callback_t *socket_callback) {
+	char *line = message, *nl = NULL, *end = &message[len];
+
+	if((len == 1 && message[0] == '1') || (len == 4 && strncmp(message, "BEAT", 4) == 0)) {
+		return -1;
+	}
+	while(line < end) {
+		if((nl = memchr(line, '\n', (size_t)(end-line))) == NULL) {
+			nl = end;
+		}
+		*nl = '\0';
+		if(nl > line && socket_callback->client_data_callback) {
+			socket_callback->client_data_callback(i, line);
+			if(socket_get_clients(i) != sd) {
+				return -1;
+			}
+		}
+		line = nl+1;
+	}
+	return 0;
+}
+
+/*
+ * Find the next EOSS delimited frame in the client buffer. The
+ * search continues where the previous one stopped, so bytes are
+ * only looked at once however the stream is split up. Returns
+ * the length of the frame at client->head or -1 when the frame
+ * is not complete yet.
+ */
+static ssize_t socket_next_frame(struct socket_client_t *client) {
+	size_t len = strlen(EOSS);
+	char *p = &client->buffer[client->scan], *end = &client->buffer[client->len];
+	ssize_t frame = 0;
+
+	while((p = memchr(p, EOSS[0], (size_t)(end-p))) != NULL) {
+		if((size_t)(end-p) < len) {
+			break;
+		}
+		if(memcmp(p, EOSS, len) == 0) {
+			frame = (ssize_t)(p-&client->buffer[client->head]);
+			client->head = (size_t)(p-client->buffer)+len;
+			client->scan = client->head;
+			return frame;
+		}
+		p++;
+	}
+	/* A delimiter may be split over two reads */
+	client->scan = (client->len-client->head < len) ? client->head : client->len-(len-1);
+	return -1;
+}
+
+/*
+ * Read everything the client has sent so far into its buffer and
+ * dispatch each complete message. Returns -1 when the connection
+ * was closed by the peer or should be dropped.
+ */
+static int socket_read_client(int i, int sd, struct socket_callback_t *socket_callback) {
+	struct socket_client_t *client = &socket_clients[i];
+	char *start = NULL;
+	size_t rest = 0;
+	ssize_t frame = 0;
+	int bytes = 0, eof = 0;
+
+	while(socket_loop) {
+		if(client->size-client->len < BUFFER_SIZE+1) {
+			/* Reclaim the space of handled frames before growing */
+			if(client->head > 0) {
+				client->len -= client->head;
+				client->scan -= client->head;
+				memmove(client->buffer, &client->buffer[client->head], client->len);
+				client->head = 0;
+			}
+			if(client->size-client->len < BUFFER_SIZE+1) {
+				client->size = (client->size == 0) ? BUFFER_SIZE+1 : client->size*2;
+				if((client->buffer = REALLOC(client->buffer, client->size)) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		bytes = (int)recv(sd, &client->buffer[client->len], BUFFER_SIZE, 0);
+		if(bytes > 0) {
+			client->len += (size_t)bytes;
+		} else if(bytes == -1 && errno == EINTR) {
+			continue;
+		} else if(bytes == -1 && socket_would_block()) {
+			break;
+		} else {
+			eof = 1;
+			break;
+		}
+	}
+	/* Leave the client alone when pilight is stopping */
+	if(socket_loop == 0) {
+		return 0;
+	}
+
+	client->buffer[client->len] = '\0';
+	while(1) {
+		start = &client->buffer[client->head];
+		if((frame = socket_next_frame(client)) == -1) {
+			break;
+		}
+		client->framed = 1;
+		/* The callback runs on this thread, so the buffer is still ours */
+		if(socket_dispatch(i, sd, start, (size_t)frame, socket_callback) == -1) {
+			return -1;
+		}
+	}
+
+	rest = client->len-client->head;
+	/*
+	 * Clients that never use the delimiter send one message at a time,
+	 * ended by a newline or as a bare json object. Anything else is
+	 * the start of a message that is still on its way. Only a closing
+	 * brace or the bare "1" goodbye can end such a message, so a large
+	 * message is not parsed again on every read.
+	 */
+	if(rest > 0 && client->framed == 0 &&
+	   (start[rest-1] == '\n' ||
+	   ((start[rest-1] == '}' || rest == 1) && json_validate(start) == true))) {
+		if(socket_dispatch(i, sd, start, rest, socket_callback) == -1) {
+			return -1;
+		}
+		rest = 0;
+	}
+	if(rest == 0) {
+		client->len = 0;
+		client->head = 0;
+		client->scan = 0;
+	}
+
+	if(eof == 1) {
+		return -1;
+	}
+	return 0;
+}
+
+void *socket_wait(void *param) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	struct socket_callback_t *socket_callback = (struct socket_callback_t *)param;
+	struct socket_event_t events[SOCKET_EVENTS];
+	int i = 0, n = 0, x = 0;
+
 #ifdef _WIN32
-					ioctlsocket(socket_client, FIONBIO, &on);
+	unsigned long on = 1;
+	ioctlsocket(socket_get_fd(), FIONBIO, &on);
 #else
- 					fcntl(socket_client, F_SETFL, flags | O_NONBLOCK);
+	x = fcntl(socket_get_fd(), F_GETFL, 0);
+	if(x != -1) {
+		fcntl(socket_get_fd(), F_SETFL, x | O_NONBLOCK);
+	}
 #endif
-				}
+	socket_poll_init();
+
+	while(socket_loop) {
+		n = socket_poll_wait(events, SOCKET_EVENTS);
 
-				//add new socket to array of sockets
-				for(i=0;i<MAX_CLIENTS;i++) {
-					//if position is empty
-					if(socket_clients[i] == 0) {
-						socket_clients[i] = socket_client;
-						if(socket_callback->client_connected_callback)
-							socket_callback->client_connected_callback(i);
-						logprintf(LOG_DEBUG, "client id: %d", i);
-						break;
+		/* Immediatly stop loop if the wait was woken up by the garbage collector */
+		if(socket_loop == 0) {
+			break;
+		}
+		for(x=0;x<n && socket_loop;x++) {
+			if(events[x].slot == SOCKET_SERVER) {
+				//If something happened on the master socket, then its an incoming connection
+				socket_accept(socket_callback);
+			} else {
+				//else its some IO operation on some other socket :)
+				i = (int)events[x].slot;
+				if(socket_get_clients(i) != events[x].fd) {
+					continue;
+				}
+				if(events[x].events & SOCKET_WRITE) {
+					pthread_mutex_lock(&socket_lock);
+					if(socket_clients[i].fd == events[x].fd && socket_flush(&socket_clients[i]) == -1) {
+						socket_queue_clear(&socket_clients[i]);
+						/* The read below sees the hangup */
+						shutdown(events[x].fd, 2);
+						events[x].events |= SOCKET_READ;
 					}
+					pthread_mutex_unlock(&socket_lock);
+				}
+				if((events[x].events & SOCKET_READ) &&
+				   socket_read_client(i, events[x].fd, socket_callback) == -1) {
+					socket_rm_client(i, events[x].fd, socket_callback);
 				}
 			}
 		}
+	}
 
-		//else its some IO operation on some other socket :)
-		for(i=1;i<MAX_CLIENTS;i++) {
-			sd = socket_clients[i];
-			if(FD_ISSET((unsigned long)socket_clients[i], &readfds)) {
-				FD_CLR((unsigned long)socket_clients[i], &readfds);
-				if(socket_read(sd, &waitMessage, 0) == 0) {
-					if(socket_callback->client_data_callback) {
-						size_t l = strlen(waitMessage);
-						if(l > 0) {
-							if(strstr(waitMessage, "\n") != NULL) {
-								char **array = NULL;
-								unsigned int n = explode(waitMessage, "\n", &array), q = 0;
-								for(q=0;q<n;q++) {
-									socket_callback->client_data_callback(i, array[q]);
-								}
-								array_free(&array, n);
-							} else {
-								socket_callback->client_data_callback(i, waitMessage);
-							}
-						}
-					}
-				} else {
-					socket_rm_client(i, socket_callback);
-					i--;
-				}
-			}
+	socket_poll_gc();
+	pthread_mutex_lock(&socket_lock);
+	for(i=0;i<socket_nrclients;i++) {
+		if(socket_clients[i].buffer != NULL) {
+			FREE(socket_clients[i].buffer);
+		}
+		socket_queue_clear(&socket_clients[i]);
+		if(socket_clients[i].queue != NULL) {
+			FREE(socket_clients[i].queue);
 		}
 	}
+	FREE(socket_clients);
+	socket_nrclients = 0;
+	pthread_mutex_unlock(&socket_lock);
 
 #ifdef _WIN32
 	return 0;
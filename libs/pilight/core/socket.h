@@ -27,12 +27,24 @@ typedef struct socket_callback_t {
     void (*client_data_callback)(int, char*);
 } socket_callback_t;
 
+/* A message framed once and shared by all clients it is written to */
+typedef struct socket_buffer_t {
+	char *data;
+	size_t len;
+	size_t msglen;
+	int refs;
+} socket_buffer_t;
+
 /* Start the socket server */
 int socket_start(unsigned short port);
 int socket_connect(char *address, unsigned short port);
 int socket_timeout_connect(int sockfd, struct sockaddr *serv_addr, int usec);
 void socket_close(int i);
 int socket_write(int sockfd, const char *msg, ...);
+struct socket_buffer_t *socket_buffer_create(const char *msg);
+struct socket_buffer_t *socket_buffer_ref(struct socket_buffer_t *buffer);
+void socket_buffer_unref(struct socket_buffer_t *buffer);
+int socket_write_buffer(int sockfd, struct socket_buffer_t *buffer);
 int socket_read(int sockfd, char **out, time_t timeout);
 void *socket_wait(void *param);
 int socket_gc(void);
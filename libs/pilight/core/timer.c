@@ -0,0 +1,419 @@
+/*
+	Copyright (C) 2013 - 2014 CurlyMo
+
+	This file is part of pilight.
+
+	pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+	pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "pilight.h"
+#include "common.h"
+#include "threads.h"
+#include "log.h"
+#include "timer.h"
+
+/*
+ * Hierarchical timer wheel. Each level has TIMER_SLOTS slots and
+ * every slot of a level spans all slots of the level below it.
+ * Tasks are put on the level matching their distance in ticks
+ * and move down a level each time the level below wraps around.
+ */
+#define TIMER_TICK		100
+#define TIMER_BITS		6
+#define TIMER_SLOTS		(1 << TIMER_BITS)
+#define TIMER_MASK		(TIMER_SLOTS - 1)
+#define TIMER_LEVELS	4
+
+/*
+ * Due tasks, run in the order they became due. Clock tasks have
+ * a lane and a worker of their own, so polls that block on the
+ * network or on hardware never hold back the time based rules.
+ */
+#define TIMER_LANES		2
+
+typedef struct timer_lane_t {
+	struct timer_task_t *ready;
+	struct timer_task_t *ready_tail;
+	pthread_cond_t signal_ready;
+} timer_lane_t;
+
+static struct timer_task_t *wheel[TIMER_LEVELS][TIMER_SLOTS];
+static struct timer_lane_t lanes[TIMER_LANES] = {
+	{ NULL, NULL, PTHREAD_COND_INITIALIZER },
+	{ NULL, NULL, PTHREAD_COND_INITIALIZER }
+};
+static unsigned long current = 0;
+static int nrtasks = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t signal_tick = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t signal_done = PTHREAD_COND_INITIALIZER;
+static pthread_t pth;
+static pthread_t *workers = NULL;
+static int nrworkers = 0;
+static int loop = 0;
+static int timer_init = 0;
+static int timer_running = 0;
+
+static unsigned long timer_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long)ts.tv_sec * 1000) + ((unsigned long)ts.tv_nsec / 1000000);
+}
+
+static void timer_link(struct timer_task_t **list, struct timer_task_t *task) {
+	task->list = list;
+	task->prev = NULL;
+	task->next = *list;
+	if(*list != NULL) {
+		(*list)->prev = task;
+	}
+	*list = task;
+}
+
+static void timer_ready(struct timer_task_t *task) {
+	struct timer_lane_t *lane = &lanes[task->lane];
+
+	task->list = &lane->ready;
+	task->prev = lane->ready_tail;
+	task->next = NULL;
+	if(lane->ready_tail != NULL) {
+		lane->ready_tail->next = task;
+	} else {
+		lane->ready = task;
+	}
+	lane->ready_tail = task;
+	pthread_cond_signal(&lane->signal_ready);
+}
+
+static void timer_unlink(struct timer_task_t *task) {
+	if(task->list == NULL) {
+		return;
+	}
+	if(task == lanes[task->lane].ready_tail) {
+		lanes[task->lane].ready_tail = task->prev;
+	}
+	if(task->prev != NULL) {
+		task->prev->next = task->next;
+	} else {
+		*task->list = task->next;
+	}
+	if(task->next != NULL) {
+		task->next->prev = task->prev;
+	}
+	task->list = NULL;
+	task->prev = NULL;
+	task->next = NULL;
+}
+
+static void timer_insert(struct timer_task_t *task) {
+	unsigned long delta = 0;
+	int level = 0;
+
+	if(task->expires <= current) {
+		timer_ready(task);
+		return;
+	}
+
+	delta = task->expires - current;
+	while(level < TIMER_LEVELS-1 && delta >= (1UL << (TIMER_BITS*(level+1)))) {
+		level++;
+	}
+	/* Tasks beyond the last level are moved down when that slot comes by */
+	if(delta >= (1UL << (TIMER_BITS*TIMER_LEVELS))) {
+		timer_link(&wheel[level][(current >> (TIMER_BITS*level)) & TIMER_MASK], task);
+	} else {
+		timer_link(&wheel[level][(task->expires >> (TIMER_BITS*level)) & TIMER_MASK], task);
+	}
+}
+
+static void timer_schedule(struct timer_task_t *task, int msec) {
+	int ticks = (msec + TIMER_TICK - 1) / TIMER_TICK;
+
+	if(task->jitter > 0) {
+		ticks += (rand() % (task->jitter + 1)) / TIMER_TICK;
+	}
+	task->expires = current + (unsigned long)ticks;
+	timer_insert(task);
+}
+
+/* Reinsert the tasks of a slot so they end up a level lower */
+static void timer_cascade(int level) {
+	struct timer_task_t *tmp = wheel[level][(current >> (TIMER_BITS*level)) & TIMER_MASK];
+	struct timer_task_t *next = NULL;
+
+	wheel[level][(current >> (TIMER_BITS*level)) & TIMER_MASK] = NULL;
+	while(tmp) {
+		next = tmp->next;
+		tmp->list = NULL;
+		timer_insert(tmp);
+		tmp = next;
+	}
+}
+
+static void timer_tick(void) {
+	struct timer_task_t *tmp = NULL, *next = NULL;
+	int level = 0;
+
+	current++;
+	while(level < TIMER_LEVELS-1 && ((current >> (TIMER_BITS*level)) & TIMER_MASK) == 0) {
+		level++;
+		timer_cascade(level);
+	}
+
+	tmp = wheel[0][current & TIMER_MASK];
+	wheel[0][current & TIMER_MASK] = NULL;
+	while(tmp) {
+		next = tmp->next;
+		tmp->list = NULL;
+		timer_insert(tmp);
+		tmp = next;
+	}
+}
+
+static void *timer_loop(void *param) {
+	struct timeval tp;
+	struct timespec ts;
+	unsigned long next = timer_now() + TIMER_TICK, now = 0;
+	long wait = 0;
+
+	pthread_mutex_lock(&lock);
+	while(loop) {
+		now = timer_now();
+		while(now >= next) {
+			timer_tick();
+			next += TIMER_TICK;
+		}
+		if(nrtasks == 0) {
+			pthread_cond_wait(&signal_tick, &lock);
+			next = timer_now() + TIMER_TICK;
+			continue;
+		}
+		wait = (long)(next - now);
+		gettimeofday(&tp, NULL);
+		ts.tv_sec = tp.tv_sec + (wait / 1000);
+		ts.tv_nsec = (tp.tv_usec * 1000) + ((wait % 1000) * 1000000);
+		if(ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&signal_tick, &lock, &ts);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return (void *)NULL;
+}
+
+static void *timer_worker(void *param) {
+	struct timer_lane_t *lane = (struct timer_lane_t *)param;
+	struct timer_task_t *task = NULL;
+
+	pthread_mutex_lock(&lock);
+	while(loop) {
+		if(lane->ready != NULL) {
+			task = lane->ready;
+			timer_unlink(task);
+			task->running = 1;
+			pthread_mutex_unlock(&lock);
+
+			task->callback(task->param);
+
+			pthread_mutex_lock(&lock);
+			task->running = 0;
+			if(task->cancelled == 0) {
+				if(task->pending == 1) {
+					task->pending = 0;
+					timer_ready(task);
+				} else {
+					timer_schedule(task, task->interval);
+				}
+			}
+			pthread_cond_broadcast(&signal_done);
+		} else {
+			pthread_cond_wait(&lane->signal_ready, &lock);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return (void *)NULL;
+}
+
+static void timer_setup(void) {
+	int i = 0;
+
+	memset(wheel, 0, sizeof(wheel));
+	for(i=0;i<TIMER_LANES;i++) {
+		lanes[i].ready = NULL;
+		lanes[i].ready_tail = NULL;
+	}
+	current = 0;
+	loop = 1;
+	timer_init = 1;
+}
+
+/*
+ * Threads do not survive the fork of the daemon, so tasks
+ * added before timer_start only wait on the wheel.
+ */
+void timer_start(void) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	int i = 0;
+
+	pthread_mutex_lock(&lock);
+	if(timer_init == 0) {
+		timer_setup();
+	}
+	if(timer_running == 1) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	/* One extra worker serves the clock lane */
+	nrworkers = TIMER_WORKERS+1;
+	if((workers = MALLOC(sizeof(pthread_t)*(size_t)nrworkers)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	threads_create(&pth, NULL, timer_loop, (void *)NULL);
+	for(i=0;i<nrworkers;i++) {
+		threads_create(&workers[i], NULL, timer_worker, (void *)&lanes[(i == 0) ? TIMER_CLOCK : TIMER_POLL]);
+	}
+	timer_running = 1;
+	pthread_mutex_unlock(&lock);
+}
+
+static struct timer_task_t *timer_new(const char *name, int lane, int first, int interval, int jitter, void (*callback)(void *param), void *param) {
+	struct timer_task_t *task = NULL;
+
+	if((task = MALLOC(sizeof(struct timer_task_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if((task->name = MALLOC(strlen(name)+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(task->name, name);
+	task->interval = interval;
+	task->jitter = jitter;
+	task->lane = lane;
+	task->running = 0;
+	task->pending = 0;
+	task->cancelled = 0;
+	task->callback = callback;
+	task->param = param;
+	task->list = NULL;
+	task->prev = NULL;
+	task->next = NULL;
+
+	pthread_mutex_lock(&lock);
+	if(timer_init == 0) {
+		timer_setup();
+	}
+	timer_schedule(task, first);
+	nrtasks++;
+	pthread_cond_signal(&signal_tick);
+	pthread_mutex_unlock(&lock);
+
+	logprintf(LOG_DEBUG, "registered timer for %s every %d ms", name, interval);
+
+	return task;
+}
+
+struct timer_task_t *timer_add(const char *name, int first, int interval, int jitter, void (*callback)(void *param), void *param) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	return timer_new(name, TIMER_POLL, first, interval, jitter, callback, param);
+}
+
+struct timer_task_t *timer_add_clock(const char *name, int first, int interval, int jitter, void (*callback)(void *param), void *param) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	return timer_new(name, TIMER_CLOCK, first, interval, jitter, callback, param);
+}
+
+void timer_trigger(struct timer_task_t *task) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	if(task == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	if(task->cancelled == 0 && task->list != &lanes[task->lane].ready) {
+		if(task->running == 1) {
+			task->pending = 1;
+		} else {
+			timer_unlink(task);
+			timer_ready(task);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void timer_cancel(struct timer_task_t *task) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	if(task == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	task->cancelled = 1;
+	timer_unlink(task);
+	while(task->running == 1) {
+		pthread_cond_wait(&signal_done, &lock);
+	}
+	nrtasks--;
+	pthread_mutex_unlock(&lock);
+
+	FREE(task->name);
+	FREE(task);
+}
+
+int timer_gc(void) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	int i = 0;
+
+	if(timer_running == 1) {
+		pthread_mutex_lock(&lock);
+		loop = 0;
+		pthread_cond_broadcast(&signal_tick);
+		for(i=0;i<TIMER_LANES;i++) {
+			pthread_cond_broadcast(&lanes[i].signal_ready);
+		}
+		pthread_mutex_unlock(&lock);
+
+		pthread_join(pth, NULL);
+		for(i=0;i<nrworkers;i++) {
+			pthread_join(workers[i], NULL);
+		}
+		FREE(workers);
+		nrworkers = 0;
+		timer_running = 0;
+	}
+	timer_init = 0;
+
+	logprintf(LOG_DEBUG, "garbage collected timer library");
+	return 0;
+}
@@ -0,0 +1,62 @@
+/*
+	Copyright (C) 2013 - 2014 CurlyMo
+
+	This file is part of pilight.
+
+	pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+	pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#define TIMER_POLL		0
+#define TIMER_CLOCK		1
+
+typedef struct timer_task_t {
+	char *name;
+	/* Tick at which the task is due */
+	unsigned long expires;
+	int interval;
+	int jitter;
+	/* TIMER_POLL or TIMER_CLOCK */
+	int lane;
+	int running;
+	/* Triggered while running, so it runs again right after */
+	int pending;
+	int cancelled;
+	void (*callback)(void *param);
+	void *param;
+	/* Wheel slot or ready list the task is linked in */
+	struct timer_task_t **list;
+	struct timer_task_t *prev;
+	struct timer_task_t *next;
+} timer_task_t;
+
+/*
+ * Run callback after first milliseconds and then every
+ * interval milliseconds, counted from the end of the previous
+ * run. A random delay of up to jitter milliseconds is added
+ * to each run to spread tasks with the same interval.
+ */
+struct timer_task_t *timer_add(const char *name, int first, int interval, int jitter, void (*callback)(void *param), void *param);
+/* The same for short tasks that must run on time, like clock ticks */
+struct timer_task_t *timer_add_clock(const char *name, int first, int interval, int jitter, void (*callback)(void *param), void *param);
+/* Run the task as soon as a worker is free, or after its current run */
+void timer_trigger(struct timer_task_t *task);
+/* Start running the tasks, once the daemon has forked */
+void timer_start(void);
+/* Remove the task and wait for a running callback to finish */
+void timer_cancel(struct timer_task_t *task);
+int timer_gc(void);
+
+#endif
@@ -62,57 +62,84 @@ static char *webserver_authentication_password = NULL;
 static unsigned short webserver_loop = 1;
 static unsigned short webserver_php = 1;
 static char *webserver_root = NULL;
-#ifdef WEBSERVER_HTTPS
-static struct mg_server *mgserver[WEBSERVER_WORKERS+1];
-#else
-static struct mg_server *mgserver[WEBSERVER_WORKERS];
-#endif
-static char *recvBuff = NULL;
+static int webserver_workers = WEBSERVER_WORKERS;
 static unsigned short webserver_root_free = 0;
 static unsigned short webserver_user_free = 0;
 
-static int sockfd = 0;
-
-typedef enum {
-	WELCOME,
-	IDENTIFY,
-	REJECT,
-	SYNC
-} steps_t;
-
+/* Updates shared with the daemon clients, written to all websockets */
 typedef struct webqueue_t {
-	char *message;
+	struct socket_buffer_t *buffer;
 	struct webqueue_t *next;
 } webqueue_t;
 
-static struct webqueue_t *webqueue;
-static struct webqueue_t *webqueue_head;
+/*
+ * Every poll worker owns a mongoose server with its own listening
+ * socket on the same port and the connections accepted by it. Updates
+ * are queued for each worker and written to its websockets by the
+ * worker itself.
+ */
+typedef struct webworker_t {
+	struct mg_server *server;
+	/* Protects the queue */
+	pthread_mutex_t lock;
+	/* Held while waking up the worker */
+	pthread_mutex_t wakeup;
+	struct webqueue_t *queue;
+	struct webqueue_t *head;
+	int number;
+	int running;
+} webworker_t;
+
+static struct webworker_t *webworkers = NULL;
+static int webworkers_number = 0;
 
+/*
+ * Waking up a worker waits until the worker polls, so it is left to
+ * the webserver broadcast thread instead of the daemon. The lock also
+ * keeps the workers alive while an update is queued for them.
+ */
 static pthread_mutex_t webqueue_lock;
 static pthread_cond_t webqueue_signal;
-static pthread_mutexattr_t webqueue_attr;
 static unsigned short webqueue_init = 0;
+static int webqueue_pending = 0;
+static int webqueue_running = 0;
 
-static int webqueue_number = 0;
+static void webserver_queue_free(struct webworker_t *worker) {
+	struct webqueue_t *tmp = NULL;
+
+	while(worker->queue != NULL) {
+		tmp = worker->queue;
+		socket_buffer_unref(tmp->buffer);
+		worker->queue = tmp->next;
+		FREE(tmp);
+	}
+	worker->head = NULL;
+	worker->number = 0;
+}
 
 int webserver_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	int i = 0;
 
-	while(webqueue_number > 0) {
-		struct webqueue_t *tmp = webqueue;
-		FREE(webqueue->message);
-		webqueue = webqueue->next;
-		FREE(tmp);
-		webqueue_number--;
-	}
-
-	webserver_loop = 0;
-
+	/* Once the loop ended under the lock no update walks the workers anymore */
 	if(webqueue_init == 1) {
-		pthread_mutex_unlock(&webqueue_lock);
+		pthread_mutex_lock(&webqueue_lock);
+		webserver_loop = 0;
 		pthread_cond_signal(&webqueue_signal);
+		pthread_mutex_unlock(&webqueue_lock);
+	} else {
+		webserver_loop = 0;
+	}
+
+	/* The workers notice the end of the loop after at most one poll */
+	for(i=0;i<webworkers_number;i++) {
+		while(webworkers[i].running == 1) {
+			usleep(1000);
+		}
+	}
+	while(webqueue_running == 1) {
+		usleep(1000);
 	}
 
 	if(webserver_root_free) {
@@ -122,17 +149,16 @@ int webserver_gc(void) {
 		FREE(webserver_user);
 	}
 
-#ifdef WEBSERVER_HTTPS
-	for(i=0;i<WEBSERVER_WORKERS+1;i++) {
-#else
-	for(i=0;i<WEBSERVER_WORKERS;i++) {
-#endif
-		if(mgserver[i] != NULL) {
-			mg_wakeup_server(mgserver[i]);
-		}
-		usleep(100);
-		mg_destroy_server(&mgserver[i]);
+	for(i=0;i<webworkers_number;i++) {
+		mg_destroy_server(&webworkers[i].server);
+		webserver_queue_free(&webworkers[i]);
+		pthread_mutex_destroy(&webworkers[i].lock);
+		pthread_mutex_destroy(&webworkers[i].wakeup);
+	}
+	if(webworkers != NULL) {
+		FREE(webworkers);
 	}
+	webworkers_number = 0;
 
 	fcache_gc();
 	sha256cache_gc();
@@ -309,12 +335,43 @@ static int webserver_auth_handler(struct mg_connection *conn) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	if(webserver_authentication_username != NULL && webserver_authentication_password != NULL) {
-		return mg_authorize_input(conn, webserver_authentication_username, webserver_authentication_password, mg_get_option(mgserver[0], "auth_domain"));
+		return mg_authorize_input(conn, webserver_authentication_username, webserver_authentication_password, mg_get_option(((struct webworker_t *)conn->server_param)->server, "auth_domain"));
 	} else {
 		return MG_TRUE;
 	}
 }
 
+static void webserver_reply(struct mg_connection *conn, JsonNode *jsend) {
+	char *output = json_stringify(jsend, NULL);
+	if(conn->is_websocket) {
+		mg_websocket_write(conn, 1, output, strlen(output));
+	} else {
+		mg_send_data(conn, output, strlen(output));
+	}
+	json_free(output);
+}
+
+/*
+ * Hand an action of a webgui client to the daemon. Returns 0 on
+ * success, 1 when a reply was already written to the client and
+ * -1 on failure.
+ */
+static int webserver_action(struct mg_connection *conn, JsonNode *json) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	struct JsonNode *jsend = NULL;
+
+	if(pilight.action == NULL || pilight.action(json, &jsend) != 0) {
+		return -1;
+	}
+	if(jsend != NULL) {
+		webserver_reply(conn, jsend);
+		json_delete(jsend);
+		return 1;
+	}
+	return 0;
+}
+
 static int webserver_request_handler(struct mg_connection *conn) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -323,7 +380,7 @@ static int webserver_request_handler(struct mg_connection *conn) {
 	char *mimetype = NULL;
 	int size = 0;
 	unsigned char *p;
-	static unsigned char buffer[4096];
+	unsigned char buffer[4096];
 	struct filehandler_t *filehandler = (struct filehandler_t *)conn->connection_param;
 	unsigned int chunk = WEBSERVER_CHUNK_SIZE;
 	struct stat st;
@@ -367,11 +424,17 @@ static int webserver_request_handler(struct mg_connection *conn) {
 						output[z-output] = '\0';
 					}
 					urldecode(output, decoded);
-					if(json_validate(decoded) == true) {
-						socket_write(sockfd, decoded);
-						char *a = "{\"message\":\"success\"}";
-						mg_send_data(conn, a, strlen(a));
-						return MG_TRUE;
+					JsonNode *json = NULL;
+					if((json = json_decode(decoded)) != NULL) {
+						int ret = webserver_action(conn, json);
+						json_delete(json);
+						if(ret == 0) {
+							char *a = "{\"message\":\"success\"}";
+							mg_send_data(conn, a, strlen(a));
+							return MG_TRUE;
+						} else if(ret == 1) {
+							return MG_TRUE;
+						}
 					}
 				}
 				char *b = "{\"message\":\"failed\"}";
@@ -413,7 +476,7 @@ static int webserver_request_handler(struct mg_connection *conn) {
 				return MG_TRUE;
 			} else if(strcmp(&conn->uri[(rstrstr(conn->uri, "/")-conn->uri)], "/") == 0) {
 				char indexes[255];
-				strcpy(indexes, mg_get_option(mgserver[0], "index_files"));
+				strcpy(indexes, mg_get_option(((struct webworker_t *)conn->server_param)->server, "index_files"));
 
 				char **array = NULL;
 				unsigned int n = explode((char *)indexes, ",", &array), q = 0;
@@ -768,8 +831,8 @@ static int webserver_request_handler(struct mg_connection *conn) {
 		strncpy(input, conn->content, conn->content_len);
 		input[conn->content_len] = '\0';
 
-		if(json_validate(input) == true) {
-			JsonNode *json = json_decode(input);
+		JsonNode *json = NULL;
+		if((json = json_decode(input)) != NULL) {
 			char *action = NULL;
 			if(json_find_string(json, "action", &action) == 0) {
 				if(strcmp(action, "request config") == 0) {
@@ -787,8 +850,7 @@ static int webserver_request_handler(struct mg_connection *conn) {
 					json_free(output);
 					json_delete(jsend);
 				} else if(strcmp(action, "control") == 0 || strcmp(action, "registry") == 0) {
-					/* Write all codes coming from the webserver to the daemon */
-					socket_write(sockfd, input);
+					webserver_action(conn, json);
 				}
 			}
 			json_delete(json);
@@ -821,159 +883,133 @@ static int webserver_connect_handler(struct mg_connection *conn) {
 	return MG_FALSE;
 }
 
+/* Write the updates queued for a worker to its websockets */
+static void webserver_worker_flush(struct webworker_t *worker) {
+	struct webqueue_t *queue = NULL, *tmp = NULL;
+	struct mg_connection *c = NULL;
+
+	pthread_mutex_lock(&worker->lock);
+	queue = worker->queue;
+	worker->queue = NULL;
+	worker->head = NULL;
+	worker->number = 0;
+	pthread_mutex_unlock(&worker->lock);
+
+	while(queue != NULL) {
+		for(c=mg_next(worker->server, NULL); c != NULL; c = mg_next(worker->server, c)) {
+			if(c->is_websocket && webserver_loop == 1) {
+				mg_websocket_write(c, 1, queue->buffer->data, queue->buffer->msglen);
+			}
+		}
+		tmp = queue;
+		queue = queue->next;
+		socket_buffer_unref(tmp->buffer);
+		FREE(tmp);
+	}
+}
+
 static void *webserver_worker(void *param) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	struct webworker_t *worker = (struct webworker_t *)param;
+
 	while(webserver_loop) {
-		if(mg_poll_server(mgserver[(intptr_t)param], 1000) == 0) {
-			sleep(1);
-		}
+		mg_poll_server(worker->server, 1000);
+		webserver_worker_flush(worker);
 	}
+
+	/*
+	 * The broadcast thread can be waiting for this worker
+	 * to poll while it holds the wakeup lock.
+	 */
+	while(pthread_mutex_trylock(&worker->wakeup) != 0) {
+		mg_poll_server(worker->server, 10);
+	}
+	worker->running = 0;
+	pthread_mutex_unlock(&worker->wakeup);
 	return NULL;
 }
 
-static void webserver_queue(char *message) {
+void webserver_update(struct socket_buffer_t *buffer) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
+	int i = 0;
+
+	if(webgui_websockets == 0 || webqueue_init == 0) {
+		return;
+	}
+
+	/* The workers are freed by webserver_gc after it ended the loop */
 	pthread_mutex_lock(&webqueue_lock);
-	if(webqueue_number <= 1024) {
-		struct webqueue_t *wnode = MALLOC(sizeof(struct webqueue_t));
-		if(wnode == NULL) {
-			fprintf(stderr, "out of memory\n");
-			exit(EXIT_FAILURE);
-		}
-		if((wnode->message = MALLOC(strlen(message)+1)) == NULL) {
-			fprintf(stderr, "out of memory\n");
-			exit(EXIT_FAILURE);
-		}
-		strcpy(wnode->message, message);
+	if(webserver_loop == 0) {
+		pthread_mutex_unlock(&webqueue_lock);
+		return;
+	}
+
+	for(i=0;i<webworkers_number;i++) {
+		struct webworker_t *worker = &webworkers[i];
+		pthread_mutex_lock(&worker->lock);
+		if(worker->number <= 1024) {
+			struct webqueue_t *wnode = MALLOC(sizeof(struct webqueue_t));
+			if(wnode == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			wnode->buffer = socket_buffer_ref(buffer);
+			wnode->next = NULL;
 
-		if(webqueue_number == 0) {
-			webqueue = wnode;
-			webqueue_head = wnode;
+			if(worker->number == 0) {
+				worker->queue = wnode;
+				worker->head = wnode;
+			} else {
+				worker->head->next = wnode;
+				worker->head = wnode;
+			}
+
+			worker->number++;
 		} else {
-			webqueue_head->next = wnode;
-			webqueue_head = wnode;
+			logprintf(LOG_ERR, "webserver queue full");
 		}
-
-		webqueue_number++;
-	} else {
-		logprintf(LOG_ERR, "webserver queue full");
+		pthread_mutex_unlock(&worker->lock);
 	}
-	pthread_mutex_unlock(&webqueue_lock);
+
+	webqueue_pending = 1;
 	pthread_cond_signal(&webqueue_signal);
+	pthread_mutex_unlock(&webqueue_lock);
 }
 
-void *webserver_broadcast(void *param) {
+static void *webserver_broadcast(void *param) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	int i = 0;
-	pthread_mutex_lock(&webqueue_lock);
-	struct mg_connection *c = NULL;
 
+	pthread_mutex_lock(&webqueue_lock);
 	while(webserver_loop) {
-		if(webqueue_number > 0) {
-			pthread_mutex_lock(&webqueue_lock);
+		if(webqueue_pending == 1) {
+			webqueue_pending = 0;
+			pthread_mutex_unlock(&webqueue_lock);
 
 			logprintf(LOG_STACK, "%s::unlocked", __FUNCTION__);
 
-#ifdef WEBSERVER_HTTPS
-			for(i=0;i<WEBSERVER_WORKERS+1;i++) {
-#else
-			for(i=0;i<WEBSERVER_WORKERS;i++) {
-#endif
-				for(c=mg_next(mgserver[i], NULL); c != NULL; c = mg_next(mgserver[i], c)) {
-					if(c->is_websocket && webserver_loop == 1) {
-						mg_websocket_write(c, 1, webqueue->message, strlen(webqueue->message));
-					}
+			for(i=0;i<webworkers_number;i++) {
+				struct webworker_t *worker = &webworkers[i];
+				pthread_mutex_lock(&worker->wakeup);
+				if(worker->running == 1 && worker->number > 0) {
+					mg_wakeup_server(worker->server);
 				}
+				pthread_mutex_unlock(&worker->wakeup);
 			}
 
-			struct webqueue_t *tmp = webqueue;
-			FREE(webqueue->message);
-			webqueue = webqueue->next;
-			FREE(tmp);
-			webqueue_number--;
-			pthread_mutex_unlock(&webqueue_lock);
+			pthread_mutex_lock(&webqueue_lock);
 		} else {
 			pthread_cond_wait(&webqueue_signal, &webqueue_lock);
 		}
 	}
+	webqueue_running = 0;
+	pthread_mutex_unlock(&webqueue_lock);
 	return (void *)NULL;
 }
 
-void *webserver_clientize(void *param) {
-	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
-
-	unsigned int failures = 0;
-	while(webserver_loop && failures <= 5) {
-		struct ssdp_list_t *ssdp_list = NULL;
-		int standalone = 0;
-		settings_find_number("standalone", &standalone);
-		if(ssdp_seek(&ssdp_list) == -1 || standalone == 1) {
-			logprintf(LOG_NOTICE, "no pilight ssdp connections found");
-			char server[16] = "127.0.0.1";
-			if((sockfd = socket_connect(server, (unsigned short)socket_get_port())) == -1) {
-				logprintf(LOG_ERR, "could not connect to pilight-daemon");
-				failures++;
-				continue;
-			}
-		} else {
-			if((sockfd = socket_connect(ssdp_list->ip, ssdp_list->port)) == -1) {
-				logprintf(LOG_ERR, "could not connect to pilight-daemon");
-				failures++;
-				continue;
-			}
-		}
-		if(ssdp_list != NULL) {
-			ssdp_free(ssdp_list);
-		}
-
-		struct JsonNode *jclient = json_mkobject();
-		struct JsonNode *joptions = json_mkobject();
-		json_append_member(jclient, "action", json_mkstring("identify"));
-		json_append_member(joptions, "config", json_mknumber(1, 0));
-		json_append_member(joptions, "core", json_mknumber(1, 0));
-		json_append_member(jclient, "options", joptions);
-		json_append_member(jclient, "media", json_mkstring("web"));
-		char *out = json_stringify(jclient, NULL);
-		socket_write(sockfd, out);
-		json_free(out);
-		json_delete(jclient);
-
-		if(socket_read(sockfd, &recvBuff, 0) != 0
-			 || strcmp(recvBuff, "{\"status\":\"success\"}") != 0) {
-				failures++;
-			continue;
-		}
-		failures = 0;
-		while(webserver_loop) {
-			if(webgui_websockets == 1) {
-				if(socket_read(sockfd, &recvBuff, 0) != 0) {
-					break;
-				} else {
-					char **array = NULL;
-					unsigned int n = explode(recvBuff, "\n", &array), i = 0;
-					for(i=0;i<n;i++) {
-						webserver_queue(array[i]);
-					}
-					array_free(&array, n);
-				}
-			} else {
-				sleep(1);
-			}
-		}
-	}
-
-	if(recvBuff != NULL) {
-		FREE(recvBuff);
-		recvBuff = NULL;
-	}
-	if(sockfd > 0) {
-		socket_close(sockfd);
-	}
-	return 0;
-}
-
 static int webserver_handler(struct mg_connection *conn, enum mg_event ev) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -1012,14 +1048,6 @@ int webserver_start(void) {
 		logprintf(LOG_NOTICE, "php support disabled due to missing base64 executable");
 	}
 
-	if(webqueue_init == 0) {
-		pthread_mutexattr_init(&webqueue_attr);
-		pthread_mutexattr_settype(&webqueue_attr, PTHREAD_MUTEX_RECURSIVE);
-		pthread_mutex_init(&webqueue_lock, &webqueue_attr);
-		pthread_cond_init(&webqueue_signal, NULL);
-		webqueue_init = 1;
-	}
-
 	/* Check on what port the webserver needs to run */
 	settings_find_number("webserver-http-port", &webserver_http_port);
 
@@ -1053,36 +1081,64 @@ int webserver_start(void) {
 		webserver_user_free = 1;
 	}
 
-	int z = 0;
+	settings_find_number("webserver-workers", &webserver_workers);
+
+	int z = 0, i = 0;
+#ifdef WEBSERVER_HTTPS
+	webworkers_number = webserver_workers+1;
+#else
+	webworkers_number = webserver_workers;
+#endif
+	if((webworkers = MALLOC(sizeof(struct webworker_t)*(size_t)webworkers_number)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(webworkers, 0, sizeof(struct webworker_t)*(size_t)webworkers_number);
+	for(i=0;i<webworkers_number;i++) {
+		pthread_mutex_init(&webworkers[i].lock, NULL);
+		pthread_mutex_init(&webworkers[i].wakeup, NULL);
+		webworkers[i].server = mg_create_server((void *)&webworkers[i], webserver_handler);
+		mg_set_option(webworkers[i].server, "auth_domain", "pilight");
+	}
+
 #ifdef WEBSERVER_HTTPS
 	char ssl[BUFFER_SIZE];
-	char id[2];
 	memset(ssl, '\0', BUFFER_SIZE);
 
-	sprintf(id, "%d", z);
 	snprintf(ssl, BUFFER_SIZE, "ssl://%d:/etc/pilight/ssl.pem", webserver_https_port);
-	mgserver[z] = mg_create_server((void *)id, webserver_handler);
-	mg_set_option(mgserver[z], "listening_port", ssl);
-	mg_set_option(mgserver[z], "auth_domain", "pilight");
-	char msg[25];
-	sprintf(msg, "webserver worker #%d", z);
-	threads_register(msg, &webserver_worker, (void *)(intptr_t)z, 0);
+	mg_set_option(webworkers[z].server, "listening_port", ssl);
 	z = 1;
 #endif
 
 	char webport[10] = {'\0'};
 	sprintf(webport, "%d", webserver_http_port);
 
-	int i = 0;
-	for(i=z;i<WEBSERVER_WORKERS+z;i++) {
-		char id[2];
-		sprintf(id, "%d", i);
-		mgserver[i] = mg_create_server((void *)id, webserver_handler);
-		mg_set_option(mgserver[i], "listening_port", webport);
-		mg_set_option(mgserver[i], "auth_domain", "pilight");
-		char msg[25];
-		sprintf(msg, "webserver worker #%d", i);
-		threads_register(msg, &webserver_worker, (void *)(intptr_t)i, 0);
+	for(i=z;i<webworkers_number;i++) {
+		if(mg_set_option(webworkers[i].server, "listening_port", webport) != NULL) {
+			if(i == z) {
+				logprintf(LOG_ERR, "webserver cannot bind to port %s", webport);
+			} else {
+				/* Without SO_REUSEPORT the workers share the socket of the first */
+				mg_copy_listeners(webworkers[z].server, webworkers[i].server);
+			}
+		}
+	}
+
+	if(webqueue_init == 0) {
+		pthread_mutex_init(&webqueue_lock, NULL);
+		pthread_cond_init(&webqueue_signal, NULL);
+		webqueue_init = 1;
+	}
+
+	for(i=0;i<webworkers_number;i++) {
+		char msg[32];
+		snprintf(msg, sizeof(msg), "webserver worker #%d", i);
+		webworkers[i].running = 1;
+		threads_register(msg, &webserver_worker, (void *)&webworkers[i], 0);
+	}
+	if(webgui_websockets == 1) {
+		webqueue_running = 1;
+		threads_register("webserver broadcast", &webserver_broadcast, (void *)NULL, 0);
 	}
 
 	logprintf(LOG_DEBUG, "webserver listening to port %s", webport);
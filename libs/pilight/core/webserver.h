@@ -19,10 +19,12 @@
 #ifndef _WEBSERVER_H_
 #define _WEBSERVER_H_
 
+#include "socket.h"
+
 int webserver_gc(void);
 int webserver_start(void);
-void *webserver_clientize(void *param);
-void *webserver_broadcast(void *param);
+/* Queue an update of the daemon for all websockets */
+void webserver_update(struct socket_buffer_t *buffer);
 char *webserver_mimetype(const char *str);
 void webserver_create_header(unsigned char **p, const char *message, char *mimetype, unsigned int len);
 
@@ -27,6 +27,7 @@
 #include <sys/time.h>
 #include <libgen.h>
 #include <dirent.h>
+#include <stdint.h>
 #ifndef _WIN32
 	#include <dlfcn.h>
 #endif
@@ -42,6 +43,29 @@
 #include "action.h"
 #include "actions/action_header.h"
 
+/*
+ * Actions are run by a fixed pool of workers. Each device
+ * keeps its own queue of actions, which is put on the ready
+ * list when it has work. A device is served by a single
+ * worker at a time, so its actions run in order.
+ */
+static pthread_mutex_t action_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t action_signal = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t action_done = PTHREAD_COND_INITIALIZER;
+static struct event_action_queue_t *action_ready = NULL;
+static struct event_action_queue_t *action_ready_tail = NULL;
+/* Devices with new actions while dispatching is held */
+static struct event_action_queue_t *action_held = NULL;
+static struct event_action_queue_t *action_held_tail = NULL;
+static int action_hold = 0;
+static struct event_action_thread_t **action_running = NULL;
+static pthread_t *action_pth = NULL;
+static int action_workers = ACTION_WORKERS;
+static int action_pool_init = 0;
+static int action_loop = 1;
+
+static void event_action_pool_stop(void);
+
 #ifndef _WIN32
 void event_action_remove(char *name) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
@@ -185,6 +209,7 @@ void event_action_register(struct event_actions_t **act, const char *name) {
 	(*act)->run = NULL;
 	(*act)->nrthreads = 0;
 	(*act)->checkArguments = NULL;
+	(*act)->coalesce = 1;
 
 	(*act)->next = event_actions;
 	event_actions = (*act);
@@ -194,6 +219,9 @@ int event_action_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	struct event_actions_t *tmp_action = NULL;
+
+	event_action_pool_stop();
+
 	while(event_actions) {
 		tmp_action = event_actions;
 		if(tmp_action->nrthreads > 0) {
@@ -215,138 +243,389 @@ int event_action_gc(void) {
 void event_action_thread_init(struct devices_t *dev) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	if((dev->action_thread = MALLOC(sizeof(struct event_action_thread_t))) == NULL) {
+	if((dev->action_queue = MALLOC(sizeof(struct event_action_queue_t))) == NULL) {
 		fprintf(stderr, "out of memory\n");
 		exit(EXIT_FAILURE);
 	}
+	dev->action_queue->scheduled = 0;
+	dev->action_queue->lastrule = -1;
+	dev->action_queue->running = NULL;
+	dev->action_queue->jobs = NULL;
+	dev->action_queue->device = dev;
+	dev->action_queue->next = NULL;
+}
+
+static void event_action_cancel(struct event_action_thread_t *thread) {
+	pthread_mutex_lock(&thread->mutex);
+	thread->loop = 0;
+	pthread_cond_broadcast(&thread->cond);
+	pthread_mutex_unlock(&thread->mutex);
+}
 
-	pthread_mutexattr_init(&dev->action_thread->attr);
-	pthread_mutexattr_settype(&dev->action_thread->attr, PTHREAD_MUTEX_RECURSIVE);
-	pthread_mutex_init(&dev->action_thread->mutex, &dev->action_thread->attr);
-	pthread_cond_init(&dev->action_thread->cond, NULL);
-	dev->action_thread->running = 0;
-	dev->action_thread->obj = NULL;
-	dev->action_thread->action = NULL;
-	dev->action_thread->loop = 0;
-	dev->action_thread->initialized = 0;
-	memset(&dev->action_thread->pth, '\0', sizeof(pthread_t));
+static void event_action_job_free(struct event_action_thread_t *thread) {
+	pthread_mutex_destroy(&thread->mutex);
+	pthread_cond_destroy(&thread->cond);
+	if(thread->parsedargs != NULL) {
+		json_delete(thread->parsedargs);
+	}
+	FREE(thread->action);
+	FREE(thread);
 }
 
-void event_action_thread_start(struct devices_t *dev, char *name, void *(*func)(void *), struct rules_actions_t *obj) {
-	struct event_action_thread_t *thread = dev->action_thread;
+static void event_action_schedule(struct event_action_queue_t *queue) {
+	queue->next = NULL;
+	if(action_hold > 0) {
+		if(action_held_tail != NULL) {
+			action_held_tail->next = queue;
+		} else {
+			action_held = queue;
+		}
+		action_held_tail = queue;
+	} else {
+		if(action_ready_tail != NULL) {
+			action_ready_tail->next = queue;
+		} else {
+			action_ready = queue;
+		}
+		action_ready_tail = queue;
+		pthread_cond_signal(&action_signal);
+	}
+}
 
-	if(thread->running == 1) {
-		logprintf(LOG_DEBUG, "aborting previous \"%s\" action for device \"%s\"", thread->action, dev->id);
+static void event_action_unlink(struct event_action_queue_t **head, struct event_action_queue_t **tail, struct event_action_queue_t *queue) {
+	struct event_action_queue_t *tmp = *head, *prev = NULL;
+
+	while(tmp != NULL && tmp != queue) {
+		prev = tmp;
+		tmp = tmp->next;
+	}
+	if(tmp == NULL) {
+		return;
 	}
+	if(prev != NULL) {
+		prev->next = queue->next;
+	} else {
+		*head = queue->next;
+	}
+	if(*tail == queue) {
+		*tail = prev;
+	}
+	queue->next = NULL;
+}
 
-	thread->loop = 0;
+/*
+ * Actions started while dispatching is held are only
+ * queued. Actions superseded before the release are
+ * therefore dropped and never reach the hardware.
+ */
+void event_action_hold(void) {
+	pthread_mutex_lock(&action_lock);
+	action_hold++;
+	pthread_mutex_unlock(&action_lock);
+}
 
-	pthread_mutex_unlock(&thread->mutex);
-	pthread_cond_signal(&thread->cond);
+void event_action_release(void) {
+	struct event_action_queue_t *queue = NULL;
+
+	pthread_mutex_lock(&action_lock);
+	if(action_hold > 0 && --action_hold == 0) {
+		while(action_held) {
+			queue = action_held;
+			action_held = action_held->next;
+			event_action_schedule(queue);
+		}
+		action_held_tail = NULL;
+	}
+	pthread_mutex_unlock(&action_lock);
+}
+
+static void *event_action_worker(void *param) {
+	int id = (int)(intptr_t)param;
+	struct event_action_queue_t *queue = NULL;
+	struct event_action_thread_t *thread = NULL;
+
+	pthread_mutex_lock(&action_lock);
+	while(action_loop == 1) {
+		if(action_ready != NULL) {
+			queue = action_ready;
+			if((action_ready = action_ready->next) == NULL) {
+				action_ready_tail = NULL;
+			}
+			queue->next = NULL;
+
+			/* All actions of this device were aborted in the meantime */
+			if(queue->jobs == NULL) {
+				queue->scheduled = 0;
+				continue;
+			}
 
-	while(thread->running > 0) {
-		usleep(10);
+			thread = queue->jobs;
+			queue->jobs = thread->next;
+			thread->next = NULL;
+			queue->running = thread;
+			if(thread->obj != NULL && thread->obj->rule != NULL) {
+				queue->lastrule = thread->obj->rule->nr;
+			}
+			action_running[id] = thread;
+			pthread_mutex_unlock(&action_lock);
+
+			thread->func((void *)thread);
+
+			pthread_mutex_lock(&action_lock);
+			action_running[id] = NULL;
+			queue->running = NULL;
+			event_action_job_free(thread);
+			/* Serve the other devices before the next action of this one */
+			if(queue->jobs != NULL) {
+				event_action_schedule(queue);
+			} else {
+				queue->scheduled = 0;
+			}
+			pthread_cond_broadcast(&action_done);
+		} else {
+			pthread_cond_wait(&action_signal, &action_lock);
+		}
 	}
+	pthread_mutex_unlock(&action_lock);
+
+	return (void *)NULL;
+}
+
+static void event_action_pool_start(void) {
+	int i = 0;
 
-	if(thread->initialized == 1) {
-		pthread_join(thread->pth, NULL);
-		thread->initialized = 0;
+	if(settings_find_number("action-workers", &action_workers) != 0) {
+		action_workers = ACTION_WORKERS;
 	}
+	if((action_pth = MALLOC(sizeof(pthread_t)*(size_t)action_workers)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if((action_running = MALLOC(sizeof(struct event_action_thread_t *)*(size_t)action_workers)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	action_loop = 1;
+	for(i=0;i<action_workers;i++) {
+		action_running[i] = NULL;
+		threads_create(&action_pth[i], NULL, event_action_worker, (void *)(intptr_t)i);
+	}
+	action_pool_init = 1;
+}
 
-	// if(thread->param != NULL) {
-		// json_delete(thread->param);
-		// thread->param = NULL;
-	// }
+static void event_action_pool_stop(void) {
+	int i = 0;
 
-	// if(param != NULL) {
-		// char *json = json_stringify(param, NULL);
-		// thread->param = json_decode(json);
-		// json_free(json);
-	// }
+	if(action_pool_init == 0) {
+		return;
+	}
 
+	pthread_mutex_lock(&action_lock);
+	action_loop = 0;
+	for(i=0;i<action_workers;i++) {
+		if(action_running[i] != NULL) {
+			event_action_cancel(action_running[i]);
+		}
+	}
+	pthread_cond_broadcast(&action_signal);
+	pthread_mutex_unlock(&action_lock);
+
+	for(i=0;i<action_workers;i++) {
+		pthread_join(action_pth[i], NULL);
+	}
+	FREE(action_pth);
+	FREE(action_running);
+	action_ready = NULL;
+	action_ready_tail = NULL;
+	action_held = NULL;
+	action_held_tail = NULL;
+	action_pool_init = 0;
+}
+
+void event_action_thread_start(struct devices_t *dev, char *name, void *(*func)(void *), struct rules_actions_t *obj) {
+	struct event_action_queue_t *queue = dev->action_queue;
+	struct event_action_thread_t *thread = NULL, *tmp = NULL, *prev = NULL, *next = NULL;
+	int coalesce = (obj != NULL && obj->action != NULL && obj->action->coalesce == 1);
+
+	if((thread = MALLOC(sizeof(struct event_action_thread_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if((thread->action = MALLOC(strlen(name)+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(thread->action, name);
+	pthread_mutex_init(&thread->mutex, NULL);
+	pthread_cond_init(&thread->cond, NULL);
+	thread->running = 0;
+	thread->loop = 1;
+	thread->coalesced = 0;
+	thread->superseded = 0;
+	thread->func = func;
 	thread->obj = obj;
+	thread->parsedargs = NULL;
 	thread->device = dev;
-	thread->loop = 1;
-	thread->action = REALLOC(thread->action, strlen(name)+1);
-	strcpy(thread->action, name);
+	thread->next = NULL;
+
+	/*
+	 * The rule parses its arguments again each time it fires,
+	 * so the action keeps its own copy on the heap.
+	 */
+	if(obj != NULL && obj->parsedargs != NULL) {
+		struct json_arena_t *arena = json_arena_use(NULL);
+		thread->parsedargs = json_clone(obj->parsedargs);
+		json_arena_use(arena);
+	}
+
+	pthread_mutex_lock(&action_lock);
+	if(action_pool_init == 0) {
+		event_action_pool_start();
+	}
+
+	/*
+	 * The new action supersedes all actions that are still
+	 * running or waiting for this device. They are told so
+	 * through their token. Waiting actions are only dropped
+	 * when both they and the new action allow it, so only the
+	 * last one reaches the device. An action that reads the live
+	 * device state, like toggle, keeps its predecessors queued.
+	 * Those still do their immediate work, but give way to the
+	 * new action at their first wait, like a running action.
+	 */
+	if(queue->running != NULL) {
+		logprintf(LOG_DEBUG, "aborting previous \"%s\" action for device \"%s\"", queue->running->action, dev->id);
+		event_action_cancel(queue->running);
+		if(queue->running->func == func) {
+			thread->coalesced = 1;
+		}
+	}
+	prev = NULL;
+	tmp = queue->jobs;
+	while(tmp) {
+		next = tmp->next;
+		if(coalesce == 1 && tmp->obj != NULL && tmp->obj->action != NULL && tmp->obj->action->coalesce == 1) {
+			logprintf(LOG_DEBUG, "dropped superseded \"%s\" action for device \"%s\"", tmp->action, dev->id);
+			if(prev != NULL) {
+				prev->next = next;
+			} else {
+				queue->jobs = next;
+			}
+			event_action_job_free(tmp);
+		} else {
+			tmp->superseded = 1;
+			prev = tmp;
+		}
+		tmp = next;
+	}
+	if(prev != NULL) {
+		prev->next = thread;
+	} else {
+		queue->jobs = thread;
+	}
 
-	thread->initialized = 1;
-	threads_create(&thread->pth, NULL, func, (void *)thread);
+	if(queue->scheduled == 0) {
+		queue->scheduled = 1;
+		event_action_schedule(queue);
+	}
+	pthread_mutex_unlock(&action_lock);
 }
 
-int event_action_thread_wait(struct devices_t *dev, int interval) {
+int event_action_thread_wait(struct event_action_thread_t *thread, int interval) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	struct timeval tp;
 	struct timespec ts;
-
-	pthread_mutex_unlock(&dev->action_thread->mutex);
+	int ret = 0;
 
 	gettimeofday(&tp, NULL);
-	ts.tv_sec = tp.tv_sec;
-	ts.tv_nsec = tp.tv_usec * 1000;
-	ts.tv_sec += interval;
+	ts.tv_sec = tp.tv_sec + (interval / 1000000);
+	ts.tv_nsec = (tp.tv_usec + (interval % 1000000)) * 1000;
+	if(ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
 
-	pthread_mutex_lock(&dev->action_thread->mutex);
+	pthread_mutex_lock(&thread->mutex);
+	if(thread->superseded == 1) {
+		thread->loop = 0;
+	}
+	while(thread->loop == 1 && ret == 0) {
+		ret = pthread_cond_timedwait(&thread->cond, &thread->mutex, &ts);
+	}
+	pthread_mutex_unlock(&thread->mutex);
 
-	return pthread_cond_timedwait(&dev->action_thread->cond, &dev->action_thread->mutex, &ts);
+	return ret;
+}
+
+/*
+ * Abort all actions of the device and wait for the
+ * running one to finish.
+ */
+static void event_action_thread_abort(struct devices_t *dev) {
+	struct event_action_queue_t *queue = dev->action_queue;
+	struct event_action_thread_t *tmp = NULL;
+
+	pthread_mutex_lock(&action_lock);
+	while(queue->jobs) {
+		tmp = queue->jobs;
+		queue->jobs = queue->jobs->next;
+		event_action_job_free(tmp);
+	}
+	if(queue->running != NULL) {
+		logprintf(LOG_DEBUG, "aborting running \"%s\" action for device \"%s\"", queue->running->action, dev->id);
+		event_action_cancel(queue->running);
+		while(queue->running != NULL && action_pool_init == 1) {
+			pthread_cond_wait(&action_done, &action_lock);
+		}
+	}
+	pthread_mutex_unlock(&action_lock);
 }
 
 void event_action_thread_stop(struct devices_t *dev) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	struct event_action_thread_t *thread = NULL;
-
 	if(dev != NULL) {
-		thread = dev->action_thread;
-		if(thread->running == 1) {
-			logprintf(LOG_DEBUG, "aborting running \"%s\" action for device \"%s\"", thread->action, dev->id);
-
-			thread->loop = 0;
-			pthread_mutex_unlock(&thread->mutex);
-			pthread_cond_signal(&thread->cond);
-
-			while(thread->running > 0) {
-				usleep(10);
-			}
-		}
-		if(thread->initialized == 1) {
-			pthread_join(thread->pth, NULL);
-			thread->initialized = 0;
-		}
+		event_action_thread_abort(dev);
 	}
 }
 
 void event_action_thread_free(struct devices_t *dev) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
-	struct event_action_thread_t *thread = NULL;
+	struct event_action_queue_t *queue = NULL;
 
 	if(dev != NULL) {
-		thread = dev->action_thread;
-		if(thread->running == 1) {
-			logprintf(LOG_DEBUG, "aborting running \"%s\" action for device \"%s\"", thread->action, dev->id);
-
-			thread->loop = 0;
-			pthread_mutex_unlock(&thread->mutex);
-			pthread_cond_signal(&thread->cond);
-			while(thread->running > 0) {
-				usleep(10);
-			}
-		}
-		if(thread->action != NULL) {
-			FREE(thread->action);
-		}
-		// if(thread->param != NULL) {
-			// json_delete(thread->param);
-			// thread->param = NULL;
-		// }
-		if(thread->initialized == 1) {
-			pthread_join(thread->pth, NULL);
-			thread->initialized = 0;
+		event_action_thread_abort(dev);
+
+		/* Make sure no worker picks up this device anymore */
+		pthread_mutex_lock(&action_lock);
+		queue = dev->action_queue;
+		if(queue->scheduled == 1) {
+			event_action_unlink(&action_ready, &action_ready_tail, queue);
+			event_action_unlink(&action_held, &action_held_tail, queue);
 		}
-		FREE(dev->action_thread);
+		pthread_mutex_unlock(&action_lock);
+
+		FREE(dev->action_queue);
+	}
+}
+
+/*
+ * The rule of the action that was started last for this device.
+ * The action has usually ended by the time its device update
+ * comes back, so the rule is kept on the queue.
+ */
+int event_action_thread_rule(struct devices_t *dev) {
+	int nr = -1;
+
+	if(dev != NULL && dev->action_queue != NULL) {
+		pthread_mutex_lock(&action_lock);
+		nr = dev->action_queue->lastrule;
+		pthread_mutex_unlock(&action_lock);
 	}
+
+	return nr;
 }
 
 void event_action_started(struct event_action_thread_t *thread) {
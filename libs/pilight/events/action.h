@@ -20,6 +20,7 @@
 #define _ACTION_H_
 
 typedef struct event_action_thread_t event_action_thread_t;
+typedef struct event_action_queue_t event_action_queue_t;
 typedef struct event_actions_t event_actions_t;
 
 #include "../core/json.h"
@@ -32,22 +33,41 @@ struct event_actions_t {
 	int nrthreads;
 	int (*run)(struct rules_actions_t *obj);
 	int (*checkArguments)(struct rules_actions_t *obj);
+	/* Superseded actions that did not start yet can be dropped */
+	unsigned short coalesce;
 	struct options_t *options;
 
 	struct event_actions_t *next;
 };
 
+/* A single action run, loop is cleared when it gets superseded */
 struct event_action_thread_t {
 	int running;
 	int loop;
-	int initialized;
+	/* Replaces a running action of the same kind */
+	int coalesced;
+	/* Newer actions are queued behind it, so it stops at its first wait */
+	int superseded;
 	char *action;
-	pthread_t pth;
+	void *(*func)(void *);
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
-	pthread_mutexattr_t attr;
 	struct rules_actions_t *obj;
+	/* The rule arguments as they were when the action was started */
+	struct JsonNode *parsedargs;
 	struct devices_t *device;
+	struct event_action_thread_t *next;
+};
+
+/* The actions waiting to be run for a device */
+struct event_action_queue_t {
+	int scheduled;
+	/* Rule of the last action that was started, kept after it ended */
+	int lastrule;
+	struct event_action_thread_t *running;
+	struct event_action_thread_t *jobs;
+	struct devices_t *device;
+	struct event_action_queue_t *next;
 };
 
 struct event_actions_t *event_actions;
@@ -55,11 +75,14 @@ struct event_actions_t *event_actions;
 void event_action_init(void);
 void event_action_register(struct event_actions_t **act, const char *name);
 int event_action_gc(void);
+void event_action_hold(void);
+void event_action_release(void);
 void event_action_thread_init(struct devices_t *dev);
-int event_action_thread_wait(struct devices_t *dev, int interval);
+int event_action_thread_wait(struct event_action_thread_t *thread, int interval);
 void event_action_thread_start(struct devices_t *dev, char *name, void *(*func)(void *), struct rules_actions_t *obj);
 void event_action_thread_stop(struct devices_t *dev);
 void event_action_thread_free(struct devices_t *dev);
+int event_action_thread_rule(struct devices_t *dev);
 void event_action_stopped(struct event_action_thread_t *thread);
 void event_action_started(struct event_action_thread_t *thread);
 
@@ -442,7 +442,7 @@ static int checkArguments(struct rules_actions_t *obj) {
 
 static void *thread(void *param) {
 	struct event_action_thread_t *pth = (struct event_action_thread_t *)param;
-	struct JsonNode *json = pth->obj->parsedargs;
+	struct JsonNode *json = pth->parsedargs;
 	struct JsonNode *jedimlevel = NULL;
 	struct JsonNode *jsdimlevel = NULL;
 	struct JsonNode *jto = NULL;
@@ -653,6 +653,18 @@ static void *thread(void *param) {
 			dimdiff = 0;
 			interval = 0;
 		}
+		/*
+		 * When we replace a running dim action and the device is already
+		 * on its way to the new dimlevel, continue from where it is instead
+		 * of starting all over again.
+		 */
+		if(pth->coalesced == 1 && match2 == 1 && old_state != NULL && strcmp(old_state, "on") == 0) {
+			if(direction == INCREASING && cur_dimlevel >= old_dimlevel && cur_dimlevel <= new_dimlevel) {
+				old_dimlevel = (int)cur_dimlevel+1;
+			} else if(direction == DECREASING && cur_dimlevel <= old_dimlevel && cur_dimlevel >= new_dimlevel) {
+				old_dimlevel = (int)cur_dimlevel-1;
+			}
+		}
 	}
 
 	/*
@@ -674,9 +686,9 @@ static void *thread(void *param) {
 				}
 				timer++;
 				if(type_after > 1) {
-					sleep(1);
+					event_action_thread_wait(pth, 1000000);
 				} else {
-					usleep(1000);
+					event_action_thread_wait(pth, 1000);
 				}
 			}
 
@@ -702,9 +714,9 @@ static void *thread(void *param) {
 					}
 					timer++;
 					if(type_for > 1) {
-						sleep(1);
+						event_action_thread_wait(pth, 1000000);
 					} else {
-						usleep(1000);
+						event_action_thread_wait(pth, 1000);
 					}
 				}
 			}
@@ -718,9 +730,9 @@ static void *thread(void *param) {
 			}
 			timer++;
 			if(type_after > 1) {
-				sleep(1);
+				event_action_thread_wait(pth, 1000000);
 			} else {
-				usleep(1000);
+				event_action_thread_wait(pth, 1000);
 			}
 		}
 		if(direction == INCREASING) {
@@ -738,9 +750,9 @@ static void *thread(void *param) {
 					}
 					timer++;
 					if(type_in > 1) {
-						sleep(1);
+						event_action_thread_wait(pth, 1000000);
 					} else {
-						usleep(1000);
+						event_action_thread_wait(pth, 1000);
 					}
 				}
 			}
@@ -759,9 +771,9 @@ static void *thread(void *param) {
 					}
 					timer++;
 					if(type_in > 1) {
-						sleep(1);
+						event_action_thread_wait(pth, 1000000);
 					} else {
-						usleep(1000);
+						event_action_thread_wait(pth, 1000);
 					}
 				}
 			}
@@ -789,9 +801,9 @@ static void *thread(void *param) {
 				}
 				timer++;
 				if(type_for > 1) {
-					sleep(1);
+					event_action_thread_wait(pth, 1000000);
 				} else {
-					usleep(1000);
+					event_action_thread_wait(pth, 1000);
 				}
 			}
 		}
@@ -850,7 +862,7 @@ void actionDimInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "dim";
-	module->version = "3.3";
+	module->version = "3.5";
 	module->reqversion = "6.0";
 	module->reqcommit = "152";
 }
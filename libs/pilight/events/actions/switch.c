@@ -249,7 +249,7 @@ static int checkArguments(struct rules_actions_t *obj) {
 
 static void *thread(void *param) {
 	struct event_action_thread_t *pth = (struct event_action_thread_t *)param;
-	struct JsonNode *json = pth->obj->parsedargs;
+	struct JsonNode *json = pth->parsedargs;
 	struct JsonNode *jto = NULL;
 	struct JsonNode *jafter = NULL;
 	struct JsonNode *jfor = NULL;
@@ -388,9 +388,9 @@ static void *thread(void *param) {
 		}
 		timer++;
 		if(type_after > 1) {
-			sleep(1);
+			event_action_thread_wait(pth, 1000000);
 		} else {
-			usleep(1000);
+			event_action_thread_wait(pth, 1000);
 		}
 	}
 
@@ -408,9 +408,9 @@ static void *thread(void *param) {
 			}
 			timer++;
 			if(type_for > 1) {
-				sleep(1);
+				event_action_thread_wait(pth, 1000000);
 			} else {
-				usleep(1000);
+				event_action_thread_wait(pth, 1000);
 			}
 		}
 	}
@@ -470,7 +470,7 @@ void actionSwitchInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "switch";
-	module->version = "3.1";
+	module->version = "3.2";
 	module->reqversion = "6.0";
 	module->reqcommit = "152";
 }
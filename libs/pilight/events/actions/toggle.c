@@ -198,13 +198,15 @@ void actionToggleInit(void) {
 	options_add(&action_toggle->options, 'b', "BETWEEN", OPTION_HAS_VALUE, DEVICES_VALUE, JSON_STRING, NULL, NULL);
 
 	action_toggle->run = &run;
+	/* Each toggle depends on the state left by the previous one */
+	action_toggle->coalesce = 0;
 	action_toggle->checkArguments = &checkArguments;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "toggle";
-	module->version = "2.1";
+	module->version = "2.2";
 	module->reqversion = "6.0";
 	module->reqcommit = "58";
 }
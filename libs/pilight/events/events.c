@@ -73,7 +73,8 @@ static pthread_mutexattr_t events_attr;
 static unsigned short eventslock_init = 0;
 
 typedef struct eventsqueue_t {
-	struct JsonNode *jconfig;
+	/* The devices of an update, the rest of it is not used */
+	struct JsonNode *jdevices;
 	struct eventsqueue_t *next;
 } eventsqueue_t;
 
@@ -82,6 +83,11 @@ static struct eventsqueue_t *eventsqueue_head;
 static int eventsqueue_number = 0;
 static int running = 0;
 
+/* Rules affected by the event being processed */
+static struct rules_t **matched = NULL;
+static int nrmatched = 0;
+static int szmatched = 0;
+
 int events_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -96,6 +102,12 @@ int events_gc(void) {
 		usleep(10);
 	}
 
+	if(matched != NULL) {
+		FREE(matched);
+	}
+	nrmatched = 0;
+	szmatched = 0;
+
 	event_operator_gc();
 	event_action_gc();
 	event_function_gc();
@@ -719,11 +731,39 @@ close:
 	return error;
 }
 
+/*
+ * Operators without a typed callback take numbers when
+ * they have a numeric callback and strings otherwise.
+ */
+static int event_operator_type(struct event_operators_t *op) {
+	if(op->callback_typed != NULL) {
+		return op->type;
+	} else if(op->callback_number != NULL) {
+		return JSON_NUMBER;
+	}
+	return JSON_STRING;
+}
+
+/*
+ * The text parser substitutes the outcome of an operator
+ * in the rule itself, numbers are printed as they always were.
+ */
+static void event_value_print(struct varcont_t *v, char *out, size_t len) {
+	if(v->type_ == JSON_BOOL) {
+		snprintf(out, len, "%s", (v->number_ > 0) ? "1" : "0");
+	} else if(v->type_ == JSON_NUMBER) {
+		snprintf(out, len, "%f", v->number_);
+	} else {
+		snprintf(out, len, "%s", v->string_);
+	}
+}
+
 static int event_parse_formula(char **rule, struct rules_t *obj, int depth, unsigned short validate) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	struct varcont_t v1;
 	struct varcont_t v2;
+	struct varcont_t v3;
 	char *var1 = NULL, *func = NULL, *var2 = NULL, *tmp = *rule, *search = NULL;
 	int element = 0, i = 0, match = 0, error = 0, hasquote = 0, hadquote = 0, rtype = 0;
 	char var1quotes[2], var2quotes[2], funcquotes[2];
@@ -817,17 +857,28 @@ static int event_parse_formula(char **rule, struct rules_t *obj, int depth, unsi
 			match = 0;
 			struct event_operators_t *tmp_operator = event_operators;
 			while(tmp_operator) {
-				int type = 0;
-				if(tmp_operator->callback_number) {
-					type = JSON_NUMBER;
-				} else {
-					type = JSON_STRING;
-				}
+				int type = event_operator_type(tmp_operator);
 
 				if(strcmp(func, tmp_operator->name) == 0) {
 					match = 1;
 					int ret1 = 0, ret2 = 0;
-					if(tmp_operator->callback_string != NULL) {
+					if(tmp_operator->callback_typed != NULL) {
+						ret1 = event_lookup_variable(var1, obj, type, &v1, &rtype, validate, RULE);
+						ret2 = event_lookup_variable(var2, obj, type, &v2, &rtype, validate, RULE);
+						if(rtype != type) {
+							error = -1;
+							goto close;
+						} else if(ret1 == -1 || ret2 == -1) {
+							error = -1;
+							goto close;
+						} else {
+							/* Solve the formula */
+							v1.type_ = type;
+							v2.type_ = type;
+							tmp_operator->callback_typed(&v1, &v2, &v3);
+							event_value_print(&v3, res, 255);
+						}
+					} else if(tmp_operator->callback_string != NULL) {
 						ret1 = event_lookup_variable(var1, obj, type, &v1, &rtype, validate, RULE);
 						ret2 = event_lookup_variable(var2, obj, type, &v2, &rtype, validate, RULE);
 						if(rtype != type) {
@@ -1016,6 +1067,65 @@ static int event_parse_action_arguments(char *arguments, struct rules_t *obj, in
 	return error;
 }
 
+static int event_action_exec(struct rules_actions_t *node, struct rules_t *obj, int validate) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	struct JsonNode *jchild = NULL;
+	struct JsonNode *jchild1 = NULL;
+	struct JsonNode *jvalue = NULL;
+	char *output = NULL;
+	int error = 0;
+
+	output = json_stringify(node->arguments, NULL);
+	if(node->parsedargs != NULL) {
+		json_delete(node->parsedargs);
+		node->parsedargs = NULL;
+	}
+	node->parsedargs = json_decode(output);
+	jchild = json_first_child(node->parsedargs);
+	while(jchild) {
+		if((jvalue = json_find_member(jchild, "value")) != NULL) {
+			jchild1 = json_first_child(jvalue);
+			while(jchild1) {
+				if(jchild1->tag == JSON_STRING) {
+					if((error = event_parse_action_arguments(jchild1->string_, obj, validate)) == 0) {
+						if(isNumeric(jchild1->string_) == 0) {
+							int dec = nrDecimals(jchild1->string_);
+							int nr = atof(jchild1->string_);
+							json_free(jchild1->string_);
+							jchild1->tag = JSON_NUMBER;
+							jchild1->number_ = nr;
+							jchild1->decimals_ = dec;
+						}
+					} else {
+						break;
+					}
+				}
+				jchild1 = jchild1->next;
+			}
+		}
+		jchild = jchild->next;
+	}
+
+	if(error == 0) {
+		if(validate == 1) {
+			if(node->action != NULL) {
+				if(node->action->checkArguments != NULL) {
+					error = node->action->checkArguments(node);
+				}
+			}
+		} else {
+			if(node->action != NULL) {
+				if(node->action->run != NULL) {
+					error = node->action->run(node);
+				}
+			}
+		}
+	}
+	json_free(output);
+	return error;
+}
+
 static int event_parse_action(char *action, struct rules_t *obj, int validate) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 	struct JsonNode *jchild = NULL;
@@ -1325,53 +1435,7 @@ static int event_parse_action(char *action, struct rules_t *obj, int validate) {
 		if(error != 0) {
 			break;
 		} else {
-			output = json_stringify(node->arguments, NULL);
-			if(node->parsedargs != NULL) {
-				json_delete(node->parsedargs);
-				node->parsedargs = NULL;
-			}
-			node->parsedargs = json_decode(output);
-			jchild = json_first_child(node->parsedargs);
-			while(jchild) {
-				if((jvalue = json_find_member(jchild, "value")) != NULL) {
-					jchild1 = json_first_child(jvalue);
-					while(jchild1) {
-						if(jchild1->tag == JSON_STRING) {
-							if((error = event_parse_action_arguments(jchild1->string_, obj, validate)) == 0) {
-								if(isNumeric(jchild1->string_) == 0) {
-									int dec = nrDecimals(jchild1->string_);
-									int nr = atof(jchild1->string_);
-									json_free(jchild1->string_);
-									jchild1->tag = JSON_NUMBER;
-									jchild1->number_ = nr;
-									jchild1->decimals_ = dec;
-								}
-							} else {
-								break;
-							}
-						}
-						jchild1 = jchild1->next;
-					}
-				}
-				jchild = jchild->next;
-			}
-
-			if(error == 0) {
-				if(validate == 1) {
-					if(node->action != NULL) {
-						if(node->action->checkArguments != NULL) {
-							error = node->action->checkArguments(node);
-						}
-					}
-				} else {
-					if(node->action != NULL) {
-						if(node->action->run != NULL) {
-							error = node->action->run(node);
-						}
-					}
-				}
-			}
-			json_free(output);
+			error = event_action_exec(node, obj, validate);
 		}
 		if(error != 0) {
 			break;
@@ -1632,6 +1696,735 @@ close:
 	return error;
 }
 
+/*
+ * Compiled rules
+ *
+ * At validation time each condition is turned into a tree so the
+ * events loop does not have to parse the rule text again on every
+ * device update. Conditions are lists of formulas joined by AND / OR,
+ * formulas are lists of operands joined by operators and operands are
+ * plain values, device variables, hooked subconditions or functions.
+ * Device variables point directly to their devices_settings_t.
+ * Rules the compiler does not understand keep using event_parse_rule.
+ */
+
+#define EVENT_CONDITION	0
+#define EVENT_FORMULA		1
+#define EVENT_VALUE			2
+#define EVENT_DEVICE		3
+#define EVENT_FUNCTION	4
+
+typedef struct event_node_t {
+	unsigned short type;
+	/* Raw text of values, devices and functions */
+	char *text;
+	/* Value without surrounding quotes */
+	char *word;
+	/* Value as resolved for the operator it belongs to */
+	struct varcont_t value;
+	struct devices_settings_t *settings;
+	struct event_operators_t **operators;
+	struct event_functions_t *function;
+	/* Function arguments in case none of them are nested functions */
+	struct JsonNode *arguments;
+	unsigned short *connectors;
+	struct event_node_t **childs;
+	int nrchilds;
+} event_node_t;
+
+static struct event_node_t *event_compile_condition(struct rules_t *obj, char *str, size_t len);
+
+static struct event_node_t *event_node_create(unsigned short type) {
+	struct event_node_t *node = NULL;
+	if((node = MALLOC(sizeof(struct event_node_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(node, 0, sizeof(struct event_node_t));
+	node->type = type;
+	return node;
+}
+
+static void event_node_free(struct event_node_t *node) {
+	int i = 0;
+
+	if(node == NULL) {
+		return;
+	}
+	for(i=0;i<node->nrchilds;i++) {
+		event_node_free(node->childs[i]);
+	}
+	if(node->childs != NULL) {
+		FREE(node->childs);
+	}
+	if(node->operators != NULL) {
+		FREE(node->operators);
+	}
+	if(node->connectors != NULL) {
+		FREE(node->connectors);
+	}
+	if(node->arguments != NULL) {
+		json_delete(node->arguments);
+	}
+	if(node->text != NULL) {
+		FREE(node->text);
+	}
+	if(node->word != NULL) {
+		FREE(node->word);
+	}
+	FREE(node);
+}
+
+static void event_node_add(struct event_node_t *node, struct event_node_t *child) {
+	if((node->childs = REALLOC(node->childs, sizeof(struct event_node_t *)*(unsigned int)(node->nrchilds+1))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	node->childs[node->nrchilds++] = child;
+}
+
+static char *event_node_strndup(char *str, size_t len) {
+	char *p = NULL;
+	if((p = MALLOC(len+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strncpy(p, str, len);
+	p[len] = '\0';
+	return p;
+}
+
+/*
+ * Find the hook closing the one at str[0]
+ */
+static int event_compile_hooks(char *str, size_t len) {
+	size_t i = 0;
+	int hooks = 0;
+
+	for(i=0;i<len;i++) {
+		if(str[i] == '(') {
+			hooks++;
+		}
+		if(str[i] == ')') {
+			if(--hooks == 0) {
+				return (int)i;
+			}
+		}
+	}
+	return -1;
+}
+
+static struct event_node_t *event_compile_function(struct rules_t *obj, char *str, size_t len) {
+	struct event_node_t *node = NULL, *child = NULL;
+	struct event_functions_t *tmp_function = event_functions;
+	char *ohook = memchr(str, '(', len);
+	size_t pos = 0, i = 0, start = 0;
+	int hooks = 0, nested = 0;
+
+	if(ohook == NULL || ohook == str || str[len-1] != ')' ||
+	   event_compile_hooks(ohook, len-(size_t)(ohook-str)) != (int)(len-(size_t)(ohook-str))-1) {
+		return NULL;
+	}
+	pos = (size_t)(ohook-str);
+
+	node = event_node_create(EVENT_FUNCTION);
+	node->text = event_node_strndup(str, len);
+	while(tmp_function) {
+		if(strlen(tmp_function->name) == pos && strncmp(tmp_function->name, str, pos) == 0) {
+			node->function = tmp_function;
+			break;
+		}
+		tmp_function = tmp_function->next;
+	}
+	if(node->function == NULL || node->function->run == NULL) {
+		event_node_free(node);
+		return NULL;
+	}
+
+	/*
+	 * Arguments are split on the comma's, the spaces
+	 * following a comma are not part of the argument.
+	 */
+	start = pos+1;
+	for(i=pos+1;i<len;i++) {
+		if(str[i] == '(') {
+			hooks++;
+		} else if(str[i] == ')' && hooks > 0) {
+			hooks--;
+		} else if((str[i] == ',' && hooks == 0) || i == len-1) {
+			if(memchr(&str[start], '(', i-start) != NULL) {
+				if((child = event_compile_function(obj, &str[start], i-start)) == NULL) {
+					event_node_free(node);
+					return NULL;
+				}
+				nested = 1;
+			} else if(memchr(&str[start], ')', i-start) != NULL) {
+				event_node_free(node);
+				return NULL;
+			} else {
+				child = event_node_create(EVENT_VALUE);
+				child->text = event_node_strndup(&str[start], i-start);
+			}
+			event_node_add(node, child);
+			while(str[i+1] == ' ' && i+1 < len-1) {
+				i++;
+			}
+			start = i+1;
+		}
+	}
+
+	if(nested == 0) {
+		node->arguments = json_mkarray();
+		for(i=0;i<node->nrchilds;i++) {
+			json_append_element(node->arguments, json_mkstring(node->childs[i]->text));
+		}
+	}
+	return node;
+}
+
+static struct event_node_t *event_compile_operand(struct rules_t *obj, char *str, size_t len, int type) {
+	struct event_node_t *node = NULL;
+	struct devices_t *dev = NULL;
+	struct devices_settings_t *tmp_settings = NULL;
+	char *p = NULL;
+	int rtype = 0;
+
+	if(len == 0) {
+		return NULL;
+	}
+
+	if(str[0] == '(') {
+		if(event_compile_hooks(str, len) != (int)len-1) {
+			return NULL;
+		}
+		return event_compile_condition(obj, &str[1], len-2);
+	}
+	if(memchr(str, '(', len) != NULL) {
+		return event_compile_function(obj, str, len);
+	}
+	if(memchr(str, ')', len) != NULL) {
+		return NULL;
+	}
+
+	node = event_node_create(EVENT_VALUE);
+	node->text = event_node_strndup(str, len);
+	if((p = memchr(str, '"', len)) != NULL) {
+		if(p != str || len < 3 || str[len-1] != '"' || memchr(&str[1], '"', len-2) != NULL) {
+			event_node_free(node);
+			return NULL;
+		}
+		node->word = event_node_strndup(&str[1], len-2);
+	} else {
+		node->word = event_node_strndup(str, len);
+	}
+
+	/*
+	 * Variables with one dot are device variables when the
+	 * part before the dot is a known device.
+	 */
+	if(type != 0 && (p = strstr(node->word, ".")) != NULL && strstr(&p[1], ".") == NULL &&
+	   p != node->word && p[1] != '\0') {
+		*p = '\0';
+		if(devices_get(node->word, &dev) == 0) {
+			tmp_settings = dev->settings;
+			while(tmp_settings) {
+				if(strcmp(tmp_settings->name, &p[1]) == 0) {
+					break;
+				}
+				tmp_settings = tmp_settings->next;
+			}
+			if(tmp_settings == NULL || tmp_settings->values->type != type) {
+				event_node_free(node);
+				return NULL;
+			}
+			node->type = EVENT_DEVICE;
+			node->settings = tmp_settings;
+		}
+		*p = '.';
+	}
+
+	if(node->type == EVENT_VALUE && type != 0) {
+		if(event_lookup_variable(node->word, obj, type, &node->value, &rtype, 0, RULE) != 0 || rtype != type) {
+			event_node_free(node);
+			return NULL;
+		}
+		node->value.type_ = type;
+	}
+	return node;
+}
+
+static struct event_node_t *event_compile_formula(struct rules_t *obj, char *str, size_t len) {
+	struct event_node_t *node = event_node_create(EVENT_FORMULA), *child = NULL;
+	struct event_operators_t *tmp_operator = NULL;
+	struct {
+		char *str;
+		size_t len;
+	} words[len/2+1];
+	size_t i = 0, start = 0;
+	int nrwords = 0, hooks = 0, quote = 0, x = 0, type = 0;
+
+	for(i=0;i<=len;i++) {
+		if(i < len && str[i] == '"') {
+			quote ^= 1;
+		} else if(i < len && str[i] == '(') {
+			hooks++;
+		} else if(i < len && str[i] == ')') {
+			hooks--;
+		} else if(i == len || (str[i] == ' ' && hooks == 0 && quote == 0)) {
+			if(i == start) {
+				event_node_free(node);
+				return NULL;
+			}
+			words[nrwords].str = &str[start];
+			words[nrwords].len = i-start;
+			nrwords++;
+			start = i+1;
+		}
+	}
+	if(quote == 1 || (nrwords % 2) == 0) {
+		event_node_free(node);
+		return NULL;
+	}
+
+	if(nrwords > 1) {
+		if((node->operators = MALLOC(sizeof(struct event_operators_t *)*(unsigned int)(nrwords/2))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		for(x=1;x<nrwords;x+=2) {
+			tmp_operator = event_operators;
+			while(tmp_operator) {
+				if(strlen(tmp_operator->name) == words[x].len &&
+				   strncmp(tmp_operator->name, words[x].str, words[x].len) == 0) {
+					break;
+				}
+				tmp_operator = tmp_operator->next;
+			}
+			if(tmp_operator == NULL || (tmp_operator->callback_typed == NULL &&
+			   tmp_operator->callback_string == NULL && tmp_operator->callback_number == NULL)) {
+				event_node_free(node);
+				return NULL;
+			}
+			node->operators[x/2] = tmp_operator;
+		}
+	}
+
+	for(x=0;x<nrwords;x+=2) {
+		type = 0;
+		if(nrwords > 1) {
+			tmp_operator = node->operators[(x == 0) ? 0 : (x/2)-1];
+			type = event_operator_type(tmp_operator);
+		}
+		if((child = event_compile_operand(obj, words[x].str, words[x].len, type)) == NULL) {
+			event_node_free(node);
+			return NULL;
+		}
+		event_node_add(node, child);
+	}
+	return node;
+}
+
+static struct event_node_t *event_compile_condition(struct rules_t *obj, char *str, size_t len) {
+	struct event_node_t *node = event_node_create(EVENT_CONDITION), *child = NULL;
+	size_t i = 0, start = 0, y = 0, z = 0;
+	int hooks = 0, quote = 0, connector = NONE, depth = 0;
+
+	for(i=0;i<=len;i++) {
+		connector = NONE;
+		if(i < len) {
+			if(str[i] == '"') {
+				quote ^= 1;
+			} else if(str[i] == '(' || str[i] == ')') {
+				/* Hooks inside strings are parsed by the text parser */
+				if(quote == 1) {
+					event_node_free(node);
+					return NULL;
+				}
+				hooks += (str[i] == '(') ? 1 : -1;
+			}
+			if(i+5 <= len && strncmp(&str[i], " AND ", 5) == 0) {
+				connector = AND;
+			} else if(i+4 <= len && strncmp(&str[i], " OR ", 4) == 0) {
+				connector = OR;
+			}
+			if(connector != NONE && (quote == 1 || hooks < 0)) {
+				event_node_free(node);
+				return NULL;
+			}
+			if(connector == NONE || hooks > 0) {
+				continue;
+			}
+			/*
+			 * The text parser splits a subcondition on the first
+			 * AND or OR it finds so those should not be part of
+			 * the words in front of the connector.
+			 */
+			depth = 0;
+			for(y=start;y<i;y++) {
+				if(str[y] == '(') {
+					depth++;
+				} else if(str[y] == ')') {
+					depth--;
+				} else if(depth == 0 && (strncmp(&str[y], "AND", 3) == 0 || strncmp(&str[y], "OR", 2) == 0)) {
+					/* Function names are replaced by their output first */
+					z = y;
+					while(z < i && str[z] != ' ' && str[z] != '(') {
+						z++;
+					}
+					if(z == i || str[z] != '(') {
+						event_node_free(node);
+						return NULL;
+					}
+				}
+			}
+		}
+		if((child = event_compile_formula(obj, &str[start], i-start)) == NULL) {
+			event_node_free(node);
+			return NULL;
+		}
+		event_node_add(node, child);
+		if(connector != NONE) {
+			if((node->connectors = REALLOC(node->connectors, sizeof(unsigned short)*(unsigned int)node->nrchilds)) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			node->connectors[node->nrchilds-1] = (unsigned short)connector;
+			i += (connector == AND) ? 4 : 3;
+			start = i+1;
+		}
+	}
+	if(hooks != 0 || quote != 0) {
+		event_node_free(node);
+		return NULL;
+	}
+	return node;
+}
+
+static int event_eval_node(struct rules_t *obj, struct event_node_t *node, struct varcont_t *out, char *buf);
+
+static int event_value_int(struct varcont_t *v) {
+	if(v->type_ == JSON_STRING) {
+		return atoi(v->string_);
+	}
+	return (int)v->number_;
+}
+
+/*
+ * Convert an outcome to the type an operator expects. Strings are
+ * resolved as if they were written in the rule, so they can still
+ * refer to device variables.
+ */
+static int event_eval_convert(struct rules_t *obj, struct varcont_t *v, int type, char *buf) {
+	size_t len = 0;
+	int rtype = 0;
+
+	if(v->type_ == type && type != JSON_STRING) {
+		return 0;
+	}
+	if(v->type_ == JSON_BOOL) {
+		if(type == JSON_NUMBER) {
+			v->type_ = JSON_NUMBER;
+			v->decimals_ = 0;
+			return 0;
+		}
+		strcpy(buf, (v->number_ > 0) ? "1" : "0");
+	} else if(v->type_ == JSON_NUMBER) {
+		/* Let the lookup report the number to string comparison */
+		sprintf(buf, "%f", v->number_);
+	} else {
+		if(v->string_ != buf) {
+			snprintf(buf, BUFFER_SIZE, "%s", v->string_);
+		}
+		len = strlen(buf);
+		if(len > 1 && buf[0] == '"' && buf[len-1] == '"') {
+			memmove(buf, &buf[1], len-2);
+			buf[len-2] = '\0';
+		}
+	}
+	if(event_lookup_variable(buf, obj, type, v, &rtype, 0, RULE) != 0 || rtype != type) {
+		return -1;
+	}
+	v->type_ = type;
+	return 0;
+}
+
+static int event_eval_operand(struct rules_t *obj, struct event_node_t *node, int type, struct varcont_t *v, char *buf) {
+	struct devices_values_t *values = NULL;
+
+	switch(node->type) {
+		case EVENT_VALUE:
+			memcpy(v, &node->value, sizeof(struct varcont_t));
+		break;
+		case EVENT_DEVICE:
+			values = node->settings->values;
+			if(values->type != type) {
+				if(type == JSON_STRING) {
+					logprintf(LOG_ERR, "rule #%d invalid: trying to compare a integer variable \"%s\" to a string", obj->nr, node->word);
+				} else {
+					logprintf(LOG_ERR, "rule #%d invalid: trying to compare a string variable \"%s\" to an integer", obj->nr, node->word);
+				}
+				return -1;
+			}
+			if(values->type == JSON_STRING) {
+				v->string_ = values->string_;
+			} else {
+				v->number_ = values->number_;
+				v->decimals_ = values->decimals;
+			}
+			v->type_ = type;
+		break;
+		default:
+			if(event_eval_node(obj, node, v, buf) == -1) {
+				return -1;
+			}
+			return event_eval_convert(obj, v, type, buf);
+		break;
+	}
+	return 0;
+}
+
+static int event_eval_formula(struct rules_t *obj, struct event_node_t *node, struct varcont_t *out, char *buf) {
+	struct event_operators_t *tmp_operator = NULL;
+	struct varcont_t v1, v2;
+	char buf1[BUFFER_SIZE], buf2[BUFFER_SIZE], *p = buf;
+	int i = 0, type = 0;
+
+	if(node->nrchilds == 1) {
+		return event_eval_node(obj, node->childs[0], out, buf);
+	}
+
+	/*
+	 * Operators are solved from left to right. Typed operators
+	 * pass their outcome on as is, others as text.
+	 */
+	for(i=0;i<node->nrchilds-1;i++) {
+		tmp_operator = node->operators[i];
+		type = event_operator_type(tmp_operator);
+		if(i == 0) {
+			if(event_eval_operand(obj, node->childs[0], type, &v1, buf1) == -1) {
+				return -1;
+			}
+		} else {
+			memcpy(&v1, out, sizeof(struct varcont_t));
+			if(event_eval_convert(obj, &v1, type, buf1) == -1) {
+				return -1;
+			}
+		}
+		if(event_eval_operand(obj, node->childs[i+1], type, &v2, buf2) == -1) {
+			return -1;
+		}
+		if(tmp_operator->callback_typed != NULL) {
+			tmp_operator->callback_typed(&v1, &v2, out);
+		} else {
+			if(tmp_operator->callback_string != NULL) {
+				tmp_operator->callback_string(v1.string_, v2.string_, &p);
+			} else {
+				tmp_operator->callback_number(v1.number_, v2.number_, &p);
+			}
+			out->type_ = JSON_STRING;
+			out->string_ = buf;
+		}
+	}
+	return 0;
+}
+
+static int event_eval_function(struct rules_t *obj, struct event_node_t *node, struct varcont_t *out, char *buf) {
+	struct JsonNode *arguments = node->arguments;
+	struct varcont_t v;
+	char tmp[BUFFER_SIZE], *p = buf;
+	int error = 0, i = 0;
+
+	if(arguments == NULL) {
+		arguments = json_mkarray();
+		for(i=0;i<node->nrchilds;i++) {
+			if(node->childs[i]->type == EVENT_FUNCTION) {
+				if(event_eval_function(obj, node->childs[i], &v, tmp) == -1) {
+					json_delete(arguments);
+					return -1;
+				}
+				json_append_element(arguments, json_mkstring(tmp));
+			} else {
+				json_append_element(arguments, json_mkstring(node->childs[i]->text));
+			}
+		}
+	}
+
+	memset(buf, '\0', BUFFER_SIZE);
+	error = node->function->run(obj, arguments, &p, RULE);
+	/* Functions without output are left untouched */
+	if(error == 0 && strlen(buf) == 0) {
+		snprintf(buf, BUFFER_SIZE, "%s", node->text);
+	}
+	out->type_ = JSON_STRING;
+	out->string_ = buf;
+
+	if(arguments != node->arguments) {
+		json_delete(arguments);
+	}
+	return (error == -1) ? -1 : 0;
+}
+
+static int event_eval_condition(struct rules_t *obj, struct event_node_t *node, struct varcont_t *out, char *buf) {
+	int i = 0, pass = 0, ltype = NONE, skip = 0;
+
+	/*
+	 * Same semantics as event_parse_rule. Subconditions following
+	 * an AND that already failed are skipped, a subcondition followed
+	 * by an OR that passed makes the whole condition pass.
+	 */
+	for(i=0;i<node->nrchilds-1;i++) {
+		ltype = node->connectors[i];
+		if(skip == 0) {
+			if(event_eval_formula(obj, node->childs[i], out, buf) == -1) {
+				return -1;
+			}
+			if((pass = event_value_int(out)) == -1) {
+				return -1;
+			}
+		}
+		if((pass == 1 && ltype == OR) || (pass == 0 && ltype == AND)) {
+			out->type_ = JSON_BOOL;
+			out->number_ = pass;
+			out->decimals_ = 0;
+			if(ltype == OR) {
+				return 0;
+			}
+			skip = 1;
+		} else {
+			skip = 0;
+		}
+	}
+	if(ltype == AND && pass == 0) {
+		return 0;
+	}
+	return event_eval_formula(obj, node->childs[node->nrchilds-1], out, buf);
+}
+
+static int event_eval_node(struct rules_t *obj, struct event_node_t *node, struct varcont_t *out, char *buf) {
+	switch(node->type) {
+		case EVENT_CONDITION:
+			return event_eval_condition(obj, node, out, buf);
+		case EVENT_FORMULA:
+			return event_eval_formula(obj, node, out, buf);
+		case EVENT_FUNCTION:
+			return event_eval_function(obj, node, out, buf);
+		default:
+			out->type_ = JSON_STRING;
+			out->string_ = node->text;
+		break;
+	}
+	return 0;
+}
+
+int event_compile_rule(struct rules_t *obj) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	char *tloc = NULL;
+
+	if(obj->compiled != NULL) {
+		event_node_free(obj->compiled);
+		obj->compiled = NULL;
+	}
+	if(strncmp(obj->rule, "IF ", 3) != 0 || (tloc = strstr(obj->rule, " THEN ")) == NULL) {
+		return -1;
+	}
+	if((obj->compiled = event_compile_condition(obj, &obj->rule[3], (size_t)(tloc-obj->rule)-3)) == NULL) {
+		logprintf(LOG_DEBUG, "rule #%d %s could not be compiled and will be parsed on every event", obj->nr, obj->name);
+		return -1;
+	}
+	return 0;
+}
+
+void event_free_rule(struct rules_t *obj) {
+	if(obj->compiled != NULL) {
+		event_node_free(obj->compiled);
+		obj->compiled = NULL;
+	}
+}
+
+static int event_eval_rule(struct rules_t *obj) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	struct rules_actions_t *node = NULL;
+	struct varcont_t out;
+	char buf[BUFFER_SIZE];
+	int x = 0, error = 0;
+
+	if(event_eval_node(obj, obj->compiled, &out, buf) == -1) {
+		logprintf(LOG_INFO, "rule #%d could not be evaluated", obj->nr);
+		return -1;
+	}
+	obj->status = event_value_int(&out);
+	if(obj->status > 0) {
+		/* Run the actions in the order they were defined */
+		for(x=0;error == 0;x++) {
+			node = obj->actions;
+			while(node != NULL && node->nr != x) {
+				node = node->next;
+			}
+			if(node == NULL) {
+				break;
+			}
+			error = event_action_exec(node, obj, 0);
+		}
+		if(error != 0) {
+			return -1;
+		}
+		obj->status = 1;
+	}
+	return 0;
+}
+
+static int event_rules_cmp(const void *a, const void *b) {
+	return (*(struct rules_t **)a)->nr - (*(struct rules_t **)b)->nr;
+}
+
+/*
+ * Collect the active rules from list that should run
+ * because of an update of dev. The timed list is shared
+ * by all time devices so it has to be filtered.
+ */
+static void events_match(struct devices_t *dev, struct rules_t **list, int nrlist, int timed) {
+	int i = 0, x = 0;
+
+	for(i=0;i<nrlist;i++) {
+		if(list[i]->active != 1) {
+			continue;
+		}
+		if(timed == 1) {
+			for(x=0;x<list[i]->nrdevices;x++) {
+				if(strcmp(list[i]->devices[x], dev->id) == 0) {
+					break;
+				}
+			}
+			if(x == list[i]->nrdevices) {
+				continue;
+			}
+		}
+		if(dev->lastrule == list[i]->nr &&
+			 list[i]->nr == dev->prevrule &&
+			 dev->lastrule == dev->prevrule) {
+			logprintf(LOG_ERR, "skipped rule #%d because of an infinite loop triggered by device %s", list[i]->nr, dev->id);
+			continue;
+		}
+		for(x=0;x<nrmatched;x++) {
+			if(matched[x] == list[i]) {
+				break;
+			}
+		}
+		if(x == nrmatched) {
+			if(nrmatched == szmatched) {
+				szmatched += 16;
+				if((matched = REALLOC(matched, sizeof(struct rules_t *)*(size_t)szmatched)) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+			matched[nrmatched++] = list[i];
+		}
+	}
+}
+
 void *events_loop(void *param) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
@@ -1645,10 +2438,10 @@ void *events_loop(void *param) {
 
 	struct devices_t *dev = NULL;
 	struct JsonNode *jdevices = NULL, *jchilds = NULL;
-	struct rules_t *tmp_rules = NULL;
+	struct rules_t *tmp_rules = NULL, **list = NULL;
 	char *str = NULL;
-	unsigned short match = 0;
-	unsigned int i = 0;
+	int i = 0, nrlist = 0;
+	int ret = 0;
 
 	pthread_mutex_lock(&events_lock);
 	while(loop) {
@@ -1659,60 +2452,59 @@ void *events_loop(void *param) {
 
 			running = 1;
 
-			jdevices = json_find_member(eventsqueue->jconfig, "devices");
-			tmp_rules = rules_get();
-			while(tmp_rules) {
-				if(tmp_rules->active == 1) {
-					match = 0;
-					if((str = MALLOC(strlen(tmp_rules->rule)+1)) == NULL) {
-						fprintf(stderr, "out of memory\n");
-						exit(EXIT_FAILURE);
+			jdevices = eventsqueue->jdevices;
+			nrmatched = 0;
+			/* Only run those events that affect the updates devices */
+			if(jdevices != NULL) {
+				jchilds = json_first_child(jdevices);
+				while(jchilds) {
+					if(jchilds->tag == JSON_STRING && devices_get(jchilds->string_, &dev) == 0) {
+						events_match(dev, dev->rules, dev->nrrules, 0);
+						if(rules_timer_device(dev) == 1) {
+							list = rules_get_timed(&nrlist);
+							events_match(dev, list, nrlist, 1);
+						}
 					}
-					strcpy(str, tmp_rules->rule);
-					/* Only run those events that affect the updates devices */
-					if(jdevices != NULL) {
-						jchilds = json_first_child(jdevices);
-						while(jchilds) {
-							for(i=0;i<tmp_rules->nrdevices;i++) {
-								if(jchilds->tag == JSON_STRING &&
-								   strcmp(jchilds->string_, tmp_rules->devices[i]) == 0) {
-									if(devices_get(jchilds->string_, &dev) == 0) {
-										if(dev->lastrule == tmp_rules->nr &&
-											 tmp_rules->nr == dev->prevrule &&
-											 dev->lastrule == dev->prevrule) {
-											logprintf(LOG_ERR, "skipped rule #%d because of an infinite loop triggered by device %s", tmp_rules->nr, jchilds->string_);
-										} else {
-											match = 1;
-										}
-									} else {
-										match = 1;
-									}
-									break;
-								}
-							}
-							jchilds = jchilds->next;
+					jchilds = jchilds->next;
+				}
+			}
+			/* Keep running the rules in the order they were configured */
+			if(nrmatched > 1) {
+				qsort(matched, (size_t)nrmatched, sizeof(struct rules_t *), event_rules_cmp);
+			}
+			/* Only dispatch the net result of all rules for this update */
+			event_action_hold();
+			for(i=0;i<nrmatched;i++) {
+				tmp_rules = matched[i];
+				if(tmp_rules->status == 0) {
+					clock_gettime(CLOCK_MONOTONIC, &tmp_rules->timestamp.first);
+					if(tmp_rules->compiled != NULL) {
+						ret = event_eval_rule(tmp_rules);
+					} else {
+						if((str = MALLOC(strlen(tmp_rules->rule)+1)) == NULL) {
+							fprintf(stderr, "out of memory\n");
+							exit(EXIT_FAILURE);
 						}
+						strcpy(str, tmp_rules->rule);
+						ret = event_parse_rule(str, tmp_rules, 0, 0);
+						FREE(str);
 					}
-					if(match == 1 && tmp_rules->status == 0) {
-						clock_gettime(CLOCK_MONOTONIC, &tmp_rules->timestamp.first);
-						if(event_parse_rule(str, tmp_rules, 0, 0) == 0) {
-							if(tmp_rules->status == 1) {
-								logprintf(LOG_INFO, "executed rule: %s", tmp_rules->name);
-							}
+					if(ret == 0) {
+						if(tmp_rules->status == 1) {
+							logprintf(LOG_INFO, "executed rule: %s", tmp_rules->name);
 						}
-						clock_gettime(CLOCK_MONOTONIC, &tmp_rules->timestamp.second);
-						logprintf(LOG_DEBUG, "rule #%d %s was parsed in %.6f seconds", tmp_rules->nr, tmp_rules->name,
-							((double)tmp_rules->timestamp.second.tv_sec + 1.0e-9*tmp_rules->timestamp.second.tv_nsec) -
-							((double)tmp_rules->timestamp.first.tv_sec + 1.0e-9*tmp_rules->timestamp.first.tv_nsec));
-
-						tmp_rules->status = 0;
 					}
-					FREE(str);
+					clock_gettime(CLOCK_MONOTONIC, &tmp_rules->timestamp.second);
+					logprintf(LOG_DEBUG, "rule #%d %s was parsed in %.6f seconds", tmp_rules->nr, tmp_rules->name,
+						((double)tmp_rules->timestamp.second.tv_sec + 1.0e-9*tmp_rules->timestamp.second.tv_nsec) -
+						((double)tmp_rules->timestamp.first.tv_sec + 1.0e-9*tmp_rules->timestamp.first.tv_nsec));
+
+					tmp_rules->status = 0;
 				}
-				tmp_rules = tmp_rules->next;
 			}
+			event_action_release();
 			struct eventsqueue_t *tmp = eventsqueue;
-			json_delete(tmp->jconfig);
+			json_delete(tmp->jdevices);
 			eventsqueue = eventsqueue->next;
 			FREE(tmp);
 			eventsqueue_number--;
@@ -1722,6 +2514,7 @@ void *events_loop(void *param) {
 			pthread_cond_wait(&events_signal, &events_lock);
 		}
 	}
+	pthread_mutex_unlock(&events_lock);
 	return (void *)NULL;
 }
 
@@ -1736,13 +2529,14 @@ static void events_queue(char *message) {
 	if(eventslock_init == 1) {
 		pthread_mutex_lock(&events_lock);
 	}
-	if(eventsqueue_number < 1024) {
+	/* The events loop can have stopped while we waited for it */
+	if(loop == 1 && eventsqueue_number < 1024) {
 		struct eventsqueue_t *enode = MALLOC(sizeof(eventsqueue_t));
 		if(enode == NULL) {
 			fprintf(stderr, "out of memory\n");
 			exit(EXIT_FAILURE);
 		}
-		enode->jconfig = json_decode(message);
+		enode->jdevices = json_peek_node(message, "devices");
 
 		if(eventsqueue_number == 0) {
 			eventsqueue = enode;
@@ -1753,7 +2547,7 @@ static void events_queue(char *message) {
 		}
 
 		eventsqueue_number++;
-	} else {
+	} else if(loop == 1) {
 		logprintf(LOG_ERR, "event queue full");
 	}
 	if(eventslock_init == 1) {
@@ -20,18 +20,13 @@
 #define _EVENTS_H_
 
 #include "../config/rules.h"
-
-typedef struct varcont_t {
-	union {
-		char *string_;
-		double number_;
-	};
-	int decimals_;
-} varcont_t;
+#include "operator.h"
 
 void event_cache_device(struct rules_t *obj, char *device);
 int event_lookup_variable(char *var, struct rules_t *obj, int type, struct varcont_t *varcont, int *rtype, unsigned short validate, enum origin_t origin);
 int event_parse_rule(char *rule, struct rules_t *obj, int depth, unsigned short validate);
+int event_compile_rule(struct rules_t *obj);
+void event_free_rule(struct rules_t *obj);
 void *events_clientize(void *param);
 int events_gc(void);
 void *events_loop(void *param);
@@ -0,0 +1,4 @@
+	#include "date_add.h"
+	#include "date_format.h"
+	#include "random.h"
+
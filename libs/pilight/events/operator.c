@@ -179,6 +179,8 @@ void event_operator_register(struct event_operators_t **op, const char *name) {
 
 	(*op)->callback_string = NULL;
 	(*op)->callback_number = NULL;
+	(*op)->callback_typed = NULL;
+	(*op)->type = 0;
 
 	(*op)->next = event_operators;
 	event_operators = (*op);
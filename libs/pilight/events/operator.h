@@ -19,10 +19,28 @@
 #ifndef _EVENT_OPERATOR_H_
 #define _EVENT_OPERATOR_H_
 
+#include "../core/json.h"
+
+typedef struct varcont_t {
+	union {
+		char *string_;
+		double number_;
+	};
+	int decimals_;
+	/* JSON_NUMBER, JSON_STRING or JSON_BOOL */
+	int type_;
+} varcont_t;
+
 typedef struct event_operators_t {
 	char *name;
 	void (*callback_string)(char *a, char *b, char **ret);
 	void (*callback_number)(double a, double b, char **ret);
+	/*
+	 * Typed operators receive both operands as the
+	 * type set in the type field and return a tagged
+	 * value instead of printing their result.
+	 */
+	void (*callback_typed)(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret);
 	unsigned short type;
 	struct event_operators_t *next;
 } event_operators_t;
@@ -25,11 +25,13 @@
 #include "../../core/dso.h"
 #include "and.h"
 
-static void operatorAndCallback(double a, double b, char **ret) {
-	if(a > 0 && b > 0) {
-		strcpy(*ret, "1");
+static void operatorAndCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_BOOL;
+	ret->decimals_ = 0;
+	if(a->number_ > 0 && b->number_ > 0) {
+		ret->number_ = 1;
 	} else {
-		strcpy(*ret, "0");
+		ret->number_ = 0;
 	}
 }
 
@@ -38,13 +40,14 @@ __attribute__((weak))
 #endif
 void operatorAndInit(void) {
 	event_operator_register(&operator_and, "AND");
-	operator_and->callback_number = &operatorAndCallback;
+	operator_and->callback_typed = &operatorAndCallback;
+	operator_and->type = JSON_NUMBER;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "AND";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
@@ -27,11 +27,13 @@
 #include "../../core/dso.h"
 #include "eq.h"
 
-static void operatorEqCallback(double a, double b, char **ret) {
-	if(fabs(a-b) < EPSILON) {
-		strcpy(*ret, "1");
+static void operatorEqCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_BOOL;
+	ret->decimals_ = 0;
+	if(fabs(a->number_-b->number_) < EPSILON) {
+		ret->number_ = 1;
 	} else {
-		strcpy(*ret, "0");
+		ret->number_ = 0;
 	}
 }
 
@@ -40,13 +42,14 @@ __attribute__((weak))
 #endif
 void operatorEqInit(void) {
 	event_operator_register(&operator_eq, "==");
-	operator_eq->callback_number = &operatorEqCallback;
+	operator_eq->callback_typed = &operatorEqCallback;
+	operator_eq->type = JSON_NUMBER;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "==";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
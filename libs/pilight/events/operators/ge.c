@@ -25,11 +25,13 @@
 #include "../../core/dso.h"
 #include "ge.h"
 
-static void operatorGeCallback(double a, double b, char **ret) {
-	if(a >= b) {
-		strcpy(*ret, "1");
+static void operatorGeCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_BOOL;
+	ret->decimals_ = 0;
+	if(a->number_ >= b->number_) {
+		ret->number_ = 1;
 	} else {
-		strcpy(*ret, "0");
+		ret->number_ = 0;
 	}
 }
 
@@ -38,13 +40,14 @@ __attribute__((weak))
 #endif
 void operatorGeInit(void) {
 	event_operator_register(&operator_ge, ">=");
-	operator_ge->callback_number = &operatorGeCallback;
+	operator_ge->callback_typed = &operatorGeCallback;
+	operator_ge->type = JSON_NUMBER;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = ">=";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
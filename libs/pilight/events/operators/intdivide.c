@@ -28,8 +28,10 @@
 #include "intdivide.h"
 
 
-static void operatorIntDivideCallback(double a, double b, char **ret) {
-	sprintf(*ret, "%f", (a < 0 ? -floor(-a / b) : floor(a / b)));
+static void operatorIntDivideCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_NUMBER;
+	ret->number_ = (a->number_ < 0 ? -floor(-a->number_ / b->number_) : floor(a->number_ / b->number_));
+	ret->decimals_ = (a->decimals_ > b->decimals_) ? a->decimals_ : b->decimals_;
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
@@ -37,13 +39,14 @@ __attribute__((weak))
 #endif
 void operatorIntDivideInit(void) {
 	event_operator_register(&operator_int_divide, "\\");
-	operator_int_divide->callback_number = &operatorIntDivideCallback;
+	operator_int_divide->callback_typed = &operatorIntDivideCallback;
+	operator_int_divide->type = JSON_NUMBER;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "\\";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "84";
 }
@@ -25,11 +25,13 @@
 #include "../../core/dso.h"
 #include "is.h"
 
-static void operatorIsCallback(char *a, char *b, char **ret) {
-	if(strcmp(a, b) == 0) {
-		strcpy(*ret, "1");
+static void operatorIsCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_BOOL;
+	ret->decimals_ = 0;
+	if(strcmp(a->string_, b->string_) == 0) {
+		ret->number_ = 1;
 	} else {
-		strcpy(*ret, "0");
+		ret->number_ = 0;
 	}
 }
 
@@ -38,13 +40,14 @@ __attribute__((weak))
 #endif
 void operatorIsInit(void) {
 	event_operator_register(&operator_is, "IS");
-	operator_is->callback_string = &operatorIsCallback;
+	operator_is->callback_typed = &operatorIsCallback;
+	operator_is->type = JSON_STRING;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "IS";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
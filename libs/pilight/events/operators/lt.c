@@ -25,11 +25,13 @@
 #include "../../core/dso.h"
 #include "lt.h"
 
-static void operatorLtCallback(double a, double b, char **ret) {
-	if(a < b) {
-		strcpy(*ret, "1");
+static void operatorLtCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_BOOL;
+	ret->decimals_ = 0;
+	if(a->number_ < b->number_) {
+		ret->number_ = 1;
 	} else {
-		strcpy(*ret, "0");
+		ret->number_ = 0;
 	}
 }
 
@@ -38,14 +40,15 @@ __attribute__((weak))
 #endif
 void operatorLtInit(void) {
 	event_operator_register(&operator_lt, "<");
-	operator_lt->callback_number = &operatorLtCallback;
+	operator_lt->callback_typed = &operatorLtCallback;
+	operator_lt->type = JSON_NUMBER;
 }
 
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "<";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
@@ -27,8 +27,10 @@
 #include "../../core/log.h"
 #include "modulus.h"
 
-static void operatorModulusCallback(double a, double b, char **ret) {
-	sprintf(*ret, "%f",  a - b * floor(a / b));
+static void operatorModulusCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_NUMBER;
+	ret->number_ = a->number_ - b->number_ * floor(a->number_ / b->number_);
+	ret->decimals_ = (a->decimals_ > b->decimals_) ? a->decimals_ : b->decimals_;
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
@@ -36,13 +38,14 @@ __attribute__((weak))
 #endif
 void operatorModulusInit(void) {
 	event_operator_register(&operator_modulus, "%");
-	operator_modulus->callback_number = &operatorModulusCallback;
+	operator_modulus->callback_typed = &operatorModulusCallback;
+	operator_modulus->type = JSON_NUMBER;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "%";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
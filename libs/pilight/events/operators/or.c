@@ -25,11 +25,13 @@
 #include "../../core/dso.h"
 #include "or.h"
 
-static void operatorOrCallback(double a, double b, char **ret) {
-	if(a > 0 || b > 0) {
-		strcpy(*ret, "1");
+static void operatorOrCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_BOOL;
+	ret->decimals_ = 0;
+	if(a->number_ > 0 || b->number_ > 0) {
+		ret->number_ = 1;
 	} else {
-		strcpy(*ret, "0");
+		ret->number_ = 0;
 	}
 }
 
@@ -38,13 +40,14 @@ __attribute__((weak))
 #endif
 void operatorOrInit(void) {
 	event_operator_register(&operator_or, "OR");
-	operator_or->callback_number = &operatorOrCallback;
+	operator_or->callback_typed = &operatorOrCallback;
+	operator_or->type = JSON_NUMBER;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "OR";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
@@ -25,8 +25,10 @@
 #include "../../core/dso.h"
 #include "plus.h"
 
-static void operatorPlusCallback(double a, double b, char **ret) {
-	sprintf(*ret, "%f", (a + b));
+static void operatorPlusCallback(struct varcont_t *a, struct varcont_t *b, struct varcont_t *ret) {
+	ret->type_ = JSON_NUMBER;
+	ret->number_ = a->number_ + b->number_;
+	ret->decimals_ = (a->decimals_ > b->decimals_) ? a->decimals_ : b->decimals_;
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
@@ -34,13 +36,14 @@ __attribute__((weak))
 #endif
 void operatorPlusInit(void) {
 	event_operator_register(&operator_plus, "+");
-	operator_plus->callback_number = &operatorPlusCallback;
+	operator_plus->callback_typed = &operatorPlusCallback;
+	operator_plus->type = JSON_NUMBER;
 }
 
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "+";
-	module->version = "1.0";
+	module->version = "1.1";
 	module->reqversion = "5.0";
 	module->reqcommit = "87";
 }
@@ -0,0 +1,5 @@
+	gpio433Init();
+	lirc433Init();
+	nano433Init();
+	noneInit();
+
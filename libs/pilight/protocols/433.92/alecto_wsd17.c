@@ -44,10 +44,10 @@ typedef struct settings_t {
 
 static struct settings_t *settings = NULL;
 
-static int validate(void) {
-	if(alecto_wsd17->rawlen == RAW_LENGTH) {
-		if(alecto_wsd17->raw[alecto_wsd17->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   alecto_wsd17->raw[alecto_wsd17->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -55,12 +55,12 @@ static int validate(void) {
 	return -1;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, id = 0, binary[RAW_LENGTH/2];
 	double temp_offset = 0.0, temperature = 0.0;
 
-	for(x=1;x<alecto_wsd17->rawlen-1;x+=2) {
-		if(alecto_wsd17->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=1;x<decode->rawlen-1;x+=2) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -81,9 +81,9 @@ static void parseCode(void) {
 
 	temperature += temp_offset;
 
-	alecto_wsd17->message = json_mkobject();
-	json_append_member(alecto_wsd17->message, "id", json_mknumber(id, 0));
-	json_append_member(alecto_wsd17->message, "temperature", json_mknumber(temperature/10, 1));
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id, 0));
+	json_append_member(decode->message, "temperature", json_mknumber(temperature/10, 1));
 }
 
 static int checkValues(struct JsonNode *jvalues) {
@@ -50,17 +50,17 @@ typedef struct settings_t {
 
 static struct settings_t *settings = NULL;
 
-static int validate(void) {
-	if(alecto_wx500->rawlen == RAW_LENGTH) {
-		if(alecto_wx500->raw[alecto_wx500->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   alecto_wx500->raw[alecto_wx500->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
 	return -1;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, type = 0, id = 0, binary[RAW_LENGTH/2];
 	double temp_offset = 0.0, humi_offset = 0.0;
 	double humidity = 0.0, temperature = 0.0;
@@ -70,8 +70,8 @@ static void parseCode(void) {
 	int n4 = 0, n5 = 0, n6 = 0, n7 = 0, n8 = 0;
 	int checksum = 1;
 
-	for(x=1;x<alecto_wx500->rawlen-1;x+=2) {
-		if(alecto_wx500->raw[x] > AVG_PULSE) {
+	for(x=1;x<decode->rawlen-1;x+=2) {
+		if(decode->raw[x] > AVG_PULSE) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -135,7 +135,7 @@ static void parseCode(void) {
 		return;
 	}
 
-	alecto_wx500->message = json_mkobject();
+	decode->message = json_mkobject();
 	switch(type) {
 		case 1:
 			id = binToDec(binary, 0, 7);
@@ -146,19 +146,19 @@ static void parseCode(void) {
 			temperature += temp_offset;
 			humidity += humi_offset;
 
-			json_append_member(alecto_wx500->message, "id", json_mknumber(id, 0));
-			json_append_member(alecto_wx500->message, "temperature", json_mknumber(temperature, 1));
-			json_append_member(alecto_wx500->message, "humidity", json_mknumber(humidity, 1));
-			json_append_member(alecto_wx500->message, "battery", json_mknumber(battery, 0));
+			json_append_member(decode->message, "id", json_mknumber(id, 0));
+			json_append_member(decode->message, "temperature", json_mknumber(temperature, 1));
+			json_append_member(decode->message, "humidity", json_mknumber(humidity, 1));
+			json_append_member(decode->message, "battery", json_mknumber(battery, 0));
 		break;
 		case 2:
 			id = binToDec(binary, 0, 7);
 			windavg = binToDec(binary, 24, 31) * 2;
 			battery = !binary[8];
 
-			json_append_member(alecto_wx500->message, "id", json_mknumber(id, 0));
-			json_append_member(alecto_wx500->message, "windavg", json_mknumber((double)windavg/10, 1));
-			json_append_member(alecto_wx500->message, "battery", json_mknumber(battery, 0));
+			json_append_member(decode->message, "id", json_mknumber(id, 0));
+			json_append_member(decode->message, "windavg", json_mknumber((double)windavg/10, 1));
+			json_append_member(decode->message, "battery", json_mknumber(battery, 0));
 		break;
 		case 3:
 			id = binToDec(binary, 0, 7);
@@ -166,23 +166,23 @@ static void parseCode(void) {
 			windgust = binToDec(binary, 24, 31) * 2;
 			battery = !binary[8];
 
-			json_append_member(alecto_wx500->message, "id", json_mknumber(id, 0));
-			json_append_member(alecto_wx500->message, "winddir", json_mknumber((double)winddir, 0));
-			json_append_member(alecto_wx500->message, "windgust", json_mknumber((double)windgust/10, 1));
-			json_append_member(alecto_wx500->message, "battery", json_mknumber(battery, 0));
+			json_append_member(decode->message, "id", json_mknumber(id, 0));
+			json_append_member(decode->message, "winddir", json_mknumber((double)winddir, 0));
+			json_append_member(decode->message, "windgust", json_mknumber((double)windgust/10, 1));
+			json_append_member(decode->message, "battery", json_mknumber(battery, 0));
 		break;
 		case 4:
 			id = binToDec(binary, 0, 7);
 			/*rain = binToDec(binary, 16, 30) * 5;*/
 			battery = !binary[8];
-			//json_append_member(alecto_wx500->message, "rain", json_mknumber((double)rain/10, 1));
-			json_append_member(alecto_wx500->message, "id", json_mknumber(id, 0));
-			json_append_member(alecto_wx500->message, "battery", json_mknumber(battery, 0));
+			//json_append_member(decode->message, "rain", json_mknumber((double)rain/10, 1));
+			json_append_member(decode->message, "id", json_mknumber(id, 0));
+			json_append_member(decode->message, "battery", json_mknumber(battery, 0));
 		break;
 		default:
 			type=0x5;
-			json_delete(alecto_wx500->message);
-			alecto_wx500->message = NULL;
+			json_delete(decode->message);
+			decode->message = NULL;
 			return;
 		break;
 	}
@@ -38,11 +38,11 @@
 #define MAX_RAW_LENGTH		148
 #define RAW_LENGTH				148
 
-static int validate(void) {
-	if(arctech_contact->rawlen == MIN_RAW_LENGTH || arctech_contact->rawlen == MAX_RAW_LENGTH) {
-		if(arctech_contact->raw[arctech_contact->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   arctech_contact->raw[arctech_contact->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
-			 arctech_contact->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*2)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == MIN_RAW_LENGTH || decode->rawlen == MAX_RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
+			 decode->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*2)) {
 			return 0;
 		}
 	}
@@ -50,27 +50,29 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state, int all) {
-	arctech_contact->message = json_mkobject();
-	json_append_member(arctech_contact->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int unit, int state, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all == 1) {
-		json_append_member(arctech_contact->message, "all", json_mknumber(all, 0));
+		json_append_member(message, "all", json_mknumber(all, 0));
 	} else {
-		json_append_member(arctech_contact->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 
 	if(state == 1) {
-		json_append_member(arctech_contact->message, "state", json_mkstring("opened"));
+		json_append_member(message, "state", json_mkstring("opened"));
 	} else {
-		json_append_member(arctech_contact->message, "state", json_mkstring("closed"));
+		json_append_member(message, "state", json_mkstring("closed"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/4], x = 0, i = 0;
 
-	for(x=0;x<arctech_contact->rawlen;x+=4) {
-		if(arctech_contact->raw[x+3] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
+	for(x=0;x<decode->rawlen;x+=4) {
+		if(decode->raw[x+3] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -82,7 +84,7 @@ static void parseCode(void) {
 	int all = binary[26];
 	int id = binToDecRev(binary, 0, 25);
 
-	createMessage(id, unit, state, all);
+	decode->message = createMessage(id, unit, state, all);
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
@@ -38,11 +38,11 @@
 #define AVG_PULSE_LENGTH	300
 #define RAW_LENGTH				148
 
-static int validate(void) {
-	if(arctech_dimmer->rawlen == RAW_LENGTH) {
-		if(arctech_dimmer->raw[arctech_dimmer->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   arctech_dimmer->raw[arctech_dimmer->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
-			 arctech_dimmer->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*2)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
+			 decode->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*2)) {
 			return 0;
 		}
 	}
@@ -50,39 +50,35 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state, int all, int dimlevel, int learn) {
-	arctech_dimmer->message = json_mkobject();
-	json_append_member(arctech_dimmer->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int unit, int state, int all, int dimlevel) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 
 	if(all == 1) {
-		json_append_member(arctech_dimmer->message, "all", json_mknumber(all, 0));
+		json_append_member(message, "all", json_mknumber(all, 0));
 	} else {
-		json_append_member(arctech_dimmer->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 
 	if(dimlevel >= 0) {
 		state = 1;
-		json_append_member(arctech_dimmer->message, "dimlevel", json_mknumber(dimlevel, 0));
+		json_append_member(message, "dimlevel", json_mknumber(dimlevel, 0));
 	}
 
 	if(state == 1) {
-		json_append_member(arctech_dimmer->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(arctech_dimmer->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
 
-	if(learn == 1) {
-		arctech_dimmer->txrpt = LEARN_REPEATS;
-	} else {
-		arctech_dimmer->txrpt = NORMAL_REPEATS;
-	}
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/4], x = 0, i = 0;
 
-	for(x=0;x<arctech_dimmer->rawlen;x+=4) {
-		if(arctech_dimmer->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen;x+=4) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -95,7 +91,7 @@ static void parseCode(void) {
 	int all = binary[26];
 	int id = binToDecRev(binary, 0, 25);
 
-	createMessage(id, unit, state, all, dimlevel, 0);
+	decode->message = createMessage(id, unit, state, all, dimlevel);
 }
 
 static void createLow(int s, int e) {
@@ -276,7 +272,12 @@ static int createCode(struct JsonNode *code) {
 		if(dimlevel >= 0) {
 			state = -1;
 		}
-		createMessage(id, unit, state, all, dimlevel, learn);
+		arctech_dimmer->message = createMessage(id, unit, state, all, dimlevel);
+		if(learn == 1) {
+			arctech_dimmer->txrpt = LEARN_REPEATS;
+		} else {
+			arctech_dimmer->txrpt = NORMAL_REPEATS;
+		}
 		createStart();
 		clearCode();
 		createId(id);
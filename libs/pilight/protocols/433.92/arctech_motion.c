@@ -35,11 +35,11 @@
 #define AVG_PULSE_LENGTH	279
 #define RAW_LENGTH				132
 
-static int validate(void) {
-	if(arctech_motion->rawlen == RAW_LENGTH) {
-		if(arctech_motion->raw[arctech_motion->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   arctech_motion->raw[arctech_motion->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
-			 arctech_motion->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*3)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
+			 decode->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*3)) {
 			return 0;
 		}
 	}
@@ -47,27 +47,29 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state, int all) {
-	arctech_motion->message = json_mkobject();
-	json_append_member(arctech_motion->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int unit, int state, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all == 1) {
-		json_append_member(arctech_motion->message, "all", json_mknumber(all, 0));
+		json_append_member(message, "all", json_mknumber(all, 0));
 	} else {
-		json_append_member(arctech_motion->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 
 	if(state == 1) {
-		json_append_member(arctech_motion->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(arctech_motion->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/4], x = 0, i = 0;
 
-	for(x=0;x<arctech_motion->rawlen;x+=4) {
-		if(arctech_motion->raw[x+3] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
+	for(x=0;x<decode->rawlen;x+=4) {
+		if(decode->raw[x+3] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -79,7 +81,7 @@ static void parseCode(void) {
 	int all = binary[26];
 	int id = binToDecRev(binary, 0, 25);
 
-	createMessage(id, unit, state, all);
+	decode->message = createMessage(id, unit, state, all);
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
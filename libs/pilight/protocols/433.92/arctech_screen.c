@@ -38,11 +38,11 @@
 #define AVG_PULSE_LENGTH	300
 #define RAW_LENGTH				132
 
-static int validate(void) {
-	if(arctech_screen->rawlen == RAW_LENGTH) {
-		if(arctech_screen->raw[arctech_screen->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   arctech_screen->raw[arctech_screen->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
-			 arctech_screen->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*1.5)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
+			 decode->raw[1] >= AVG_PULSE_LENGTH*(PULSE_MULTIPLIER*1.5)) {
 			return 0;
 		}
 	}
@@ -50,33 +50,29 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state, int all, int learn) {
-	arctech_screen->message = json_mkobject();
-	json_append_member(arctech_screen->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int unit, int state, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all == 1) {
-		json_append_member(arctech_screen->message, "all", json_mknumber(all, 0));
+		json_append_member(message, "all", json_mknumber(all, 0));
 	} else {
-		json_append_member(arctech_screen->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 
 	if(state == 1) {
-		json_append_member(arctech_screen->message, "state", json_mkstring("up"));
+		json_append_member(message, "state", json_mkstring("up"));
 	} else {
-		json_append_member(arctech_screen->message, "state", json_mkstring("down"));
+		json_append_member(message, "state", json_mkstring("down"));
 	}
 
-	if(learn == 1) {
-		arctech_screen->txrpt = LEARN_REPEATS;
-	} else {
-		arctech_screen->txrpt = NORMAL_REPEATS;
-	}
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/4], x = 0, i = 0;
 
-	for(x=0;x<arctech_screen->rawlen;x+=4) {
-		if(arctech_screen->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen;x+=4) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -88,7 +84,7 @@ static void parseCode(void) {
 	int all = binary[26];
 	int id = binToDecRev(binary, 0, 25);
 
-	createMessage(id, unit, state, all, 0);
+	decode->message = createMessage(id, unit, state, all);
 }
 
 static void createLow(int s, int e) {
@@ -203,7 +199,12 @@ static int createCode(struct JsonNode *code) {
 		if(unit == -1 && all == 1) {
 			unit = 0;
 		}
-		createMessage(id, unit, state, all, learn);
+		arctech_screen->message = createMessage(id, unit, state, all);
+		if(learn == 1) {
+			arctech_screen->txrpt = LEARN_REPEATS;
+		} else {
+			arctech_screen->txrpt = NORMAL_REPEATS;
+		}
 		createStart();
 		clearCode();
 		createId(id);
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	335
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(arctech_screen_old->rawlen == RAW_LENGTH) {
-		if(arctech_screen_old->raw[arctech_screen_old->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   arctech_screen_old->raw[arctech_screen_old->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,22 +47,24 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state) {
-	arctech_screen_old->message = json_mkobject();
-	json_append_member(arctech_screen_old->message, "id", json_mknumber(id, 0));
-	json_append_member(arctech_screen_old->message, "unit", json_mknumber(unit, 0));
+static struct JsonNode *createMessage(int id, int unit, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
+	json_append_member(message, "unit", json_mknumber(unit, 0));
 	if(state == 1)
-		json_append_member(arctech_screen_old->message, "state", json_mkstring("up"));
+		json_append_member(message, "state", json_mkstring("up"));
 	else
-		json_append_member(arctech_screen_old->message, "state", json_mkstring("down"));
+		json_append_member(message, "state", json_mkstring("down"));
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/4], x = 0, i = 0;
 	int len = (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2));
 
-	for(x=0;x<arctech_screen_old->rawlen-2;x+=4) {
-		if(arctech_screen_old->raw[x+3] > len) {
+	for(x=0;x<decode->rawlen-2;x+=4) {
+		if(decode->raw[x+3] > len) {
 			binary[i++] = 0;
 		} else {
 			binary[i++] = 1;
@@ -72,7 +74,7 @@ static void parseCode(void) {
 	int unit = binToDec(binary, 0, 3);
 	int state = binary[11];
 	int id = binToDec(binary, 4, 8);
-	createMessage(id, unit, state);
+	decode->message = createMessage(id, unit, state);
 }
 
 static void createLow(int s, int e) {
@@ -166,7 +168,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "arctech_screen_old: invalid unit range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(id, unit, state);
+		arctech_screen_old->message = createMessage(id, unit, state);
 		clearCode();
 		createUnit(unit);
 		createId(id);
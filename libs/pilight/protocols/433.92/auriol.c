@@ -44,10 +44,10 @@ typedef struct settings_t {
 
 static struct settings_t *settings = NULL;
 
-static int validate(void) {
-	if(auriol->rawlen == RAW_LENGTH) {
-		if(auriol->raw[auriol->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   auriol->raw[auriol->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -55,13 +55,13 @@ static int validate(void) {
 	return -1;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, binary[RAW_LENGTH/2];
 	int channel = 0, id = 0, battery = 0;
 	double temp_offset = 0.0, temperature = 0.0;
 
-	for(x=1;x<auriol->rawlen-2;x+=2) {
-		if(auriol->raw[x] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
+	for(x=1;x<decode->rawlen-2;x+=2) {
+		if(decode->raw[x] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -85,10 +85,10 @@ static void parseCode(void) {
 	temperature += temp_offset;
 
 	if(channel != 4) {
-		auriol->message = json_mkobject();
-		json_append_member(auriol->message, "id", json_mknumber(channel, 0));
-		json_append_member(auriol->message, "temperature", json_mknumber(temperature, 1));
-		json_append_member(auriol->message, "battery", json_mknumber(battery, 0));
+		decode->message = json_mkobject();
+		json_append_member(decode->message, "id", json_mknumber(channel, 0));
+		json_append_member(decode->message, "temperature", json_mknumber(temperature, 1));
+		json_append_member(decode->message, "battery", json_mknumber(battery, 0));
 	}
 }
 
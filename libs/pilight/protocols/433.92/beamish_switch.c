@@ -38,10 +38,10 @@
 
 static int map[7] = {0, 192, 48, 12, 3, 15, 195};
 
-static int validate(void) {
-	if(beamish_switch->rawlen == RAW_LENGTH) {
-		if(beamish_switch->raw[beamish_switch->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   beamish_switch->raw[beamish_switch->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -49,28 +49,30 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state, int all) {
-	beamish_switch->message = json_mkobject();
-	json_append_member(beamish_switch->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int unit, int state, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all == 1) {
-		json_append_member(beamish_switch->message, "all", json_mknumber(1, 0));
+		json_append_member(message, "all", json_mknumber(1, 0));
 	} else {
-		json_append_member(beamish_switch->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 	if(state == 0) {
-		json_append_member(beamish_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
 	if(state == 1) {
-		json_append_member(beamish_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, y = 0, binary[RAW_LENGTH/2];
 	int id = -1, state = -1, unit = -1, all = 0, code = 0;
 
-	for(x=0;x<beamish_switch->rawlen;x+=2) {
-		if(beamish_switch->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen;x+=2) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -96,7 +98,7 @@ static void parseCode(void) {
 		all = 1;
 	}
 
-	createMessage(id, unit, state, all);
+	decode->message = createMessage(id, unit, state, all);
 }
 
 static void createHigh(int s, int e) {
@@ -187,7 +189,7 @@ static int createCode(struct JsonNode *code) {
 		if(all == 1 && state == 0)
 			unit = 6;
 
-		createMessage(id, unit, state, all);
+		beamish_switch->message = createMessage(id, unit, state, all);
 		clearCode();
 		createId(id);
 		unit = map[unit];
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	180
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(clarus_switch->rawlen == RAW_LENGTH) {
-		if(clarus_switch->raw[clarus_switch->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   clarus_switch->raw[clarus_switch->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,25 +47,27 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(char *id, int unit, int state) {
-	clarus_switch->message = json_mkobject();
-	json_append_member(clarus_switch->message, "id", json_mkstring(id));
-	json_append_member(clarus_switch->message, "unit", json_mknumber(unit, 0));
+static struct JsonNode *createMessage(char *id, int unit, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mkstring(id));
+	json_append_member(message, "unit", json_mknumber(unit, 0));
 	if(state == 2)
-		json_append_member(clarus_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	else
-		json_append_member(clarus_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, z = 65, binary[RAW_LENGTH/4];
 	char id[3];
 
 	/* Convert the one's and zero's into binary */
-	for(x=0;x<clarus_switch->rawlen-2;x+=4) {
-		if(clarus_switch->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-2;x+=4) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x/4]=1;
-		} else if(clarus_switch->raw[x+0] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+		} else if(decode->raw[x+0] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x/4]=2;
 		} else {
 			binary[x/4]=0;
@@ -84,7 +86,7 @@ static void parseCode(void) {
 	int y = binToDecRev(binary, 6, 9);
 	sprintf(&id[0], "%c%d", z, y);
 
-	createMessage(id, unit, state);
+	decode->message = createMessage(id, unit, state);
 }
 
 static void createLow(int s, int e) {
@@ -202,7 +204,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "clarus_switch: invalid unit range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(id, unit, ((state == 2 || state == 1) ? 2 : 0));
+		clarus_switch->message = createMessage(id, unit, ((state == 2 || state == 1) ? 2 : 0));
 		clearCode();
 		createUnit(unit);
 		createId(id);
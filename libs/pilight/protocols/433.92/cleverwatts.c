@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	269
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(cleverwatts->rawlen == RAW_LENGTH) {
-		if(cleverwatts->raw[cleverwatts->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   cleverwatts->raw[cleverwatts->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,26 +47,28 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state, int all) {
-	cleverwatts->message = json_mkobject();
-	json_append_member(cleverwatts->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int unit, int state, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all == 0) {
-		json_append_member(cleverwatts->message, "all", json_mknumber(1, 0));
+		json_append_member(message, "all", json_mknumber(1, 0));
 	} else {
-		json_append_member(cleverwatts->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 	if(state == 0)
-		json_append_member(cleverwatts->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	else
-		json_append_member(cleverwatts->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, binary[RAW_LENGTH/2];
 	int id = 0, state = 0, unit = 0, all = 0;
 
-	for(x=1;x<cleverwatts->rawlen-1;x+=2) {
-		if(cleverwatts->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=1;x<decode->rawlen-1;x+=2) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -78,7 +80,7 @@ static void parseCode(void) {
 	unit = binToDecRev(binary, 21, 22);
 	all = binary[23];
 
-	createMessage(id, unit, state, all);
+	decode->message = createMessage(id, unit, state, all);
 }
 
 static void createLow(int s, int e) {
@@ -179,7 +181,7 @@ static int createCode(struct JsonNode *code) {
 		if(unit == -1 && all == 1) {
 			unit = 3;
 		}
-		createMessage(id, unit, state, all ^ 1);
+		cleverwatts->message = createMessage(id, unit, state, all ^ 1);
 		clearCode();
 		createId(id);
 		createState(state);
@@ -35,10 +35,10 @@
 #define AVG_PULSE_LENGTH	190
 #define RAW_LENGTH				66
 
-static int validate(void) {
-	if(conrad_rsl_contact->rawlen == RAW_LENGTH) {
-		if(conrad_rsl_contact->raw[conrad_rsl_contact->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   conrad_rsl_contact->raw[conrad_rsl_contact->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -46,22 +46,24 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int state) {
-	conrad_rsl_contact->message = json_mkobject();
-	json_append_member(conrad_rsl_contact->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(state == 1) {
-		json_append_member(conrad_rsl_contact->message, "state", json_mkstring("opened"));
+		json_append_member(message, "state", json_mkstring("opened"));
 	} else {
-		json_append_member(conrad_rsl_contact->message, "state", json_mkstring("closed"));
+		json_append_member(message, "state", json_mkstring("closed"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, binary[RAW_LENGTH/2];
 
 	/* Convert the one's and zero's into binary */
-	for(x=0; x<conrad_rsl_contact->rawlen; x+=2) {
-		if(conrad_rsl_contact->raw[x+1] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0; x<decode->rawlen; x+=2) {
+		if(decode->raw[x+1] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x/2]=1;
 		} else {
 			binary[x/2]=0;
@@ -74,7 +76,7 @@ static void parseCode(void) {
 	int state = binary[4];
 
 	if(check == 5 && check1 == 1) {
-		createMessage(id, state);
+		decode->message = createMessage(id, state);
 	}
 }
 
@@ -38,10 +38,10 @@
 
 static int codes[5][4][2];
 
-static int validate(void) {
-	if(conrad_rsl_switch->rawlen == RAW_LENGTH) {
-		if(conrad_rsl_switch->raw[conrad_rsl_switch->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   conrad_rsl_switch->raw[conrad_rsl_switch->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -49,29 +49,31 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state) {
-	conrad_rsl_switch->message = json_mkobject();
+static struct JsonNode *createMessage(int id, int unit, int state) {
+	struct JsonNode *message = json_mkobject();
 
 	if(id == 4) {
-		json_append_member(conrad_rsl_switch->message, "all", json_mknumber(1, 0));
+		json_append_member(message, "all", json_mknumber(1, 0));
 	} else {
-		json_append_member(conrad_rsl_switch->message, "id", json_mknumber(id+1, 0));
+		json_append_member(message, "id", json_mknumber(id+1, 0));
 	}
-	json_append_member(conrad_rsl_switch->message, "unit", json_mknumber(unit+1, 0));
+	json_append_member(message, "unit", json_mknumber(unit+1, 0));
 	if(state == 1) {
-		json_append_member(conrad_rsl_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(conrad_rsl_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, binary[RAW_LENGTH/2];
 	int id = 0, unit = 0, state = 0;
 
 	/* Convert the one's and zero's into binary */
-	for(x=0;x<conrad_rsl_switch->rawlen;x+=2) {
-		if(conrad_rsl_switch->raw[x+1] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen;x+=2) {
+		if(decode->raw[x+1] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x/2]=0;
 		} else {
 			binary[x/2]=1;
@@ -98,7 +100,7 @@ static void parseCode(void) {
 			break;
 		}
 	}
-	createMessage(id, unit, state);
+	decode->message = createMessage(id, unit, state);
 }
 
 static void createLow(int s, int e) {
@@ -197,7 +199,7 @@ static int createCode(struct JsonNode *code) {
 		}
 		id -= 1;
 		unit -= 1;
-		createMessage(id, unit, state);
+		conrad_rsl_switch->message = createMessage(id, unit, state);
 		clearCode();
 		createId(id, unit, state);
 		createFooter();
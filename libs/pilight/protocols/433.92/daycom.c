@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH        284
 #define RAW_LENGTH              50
 
-static int validate(void) {
-	if(daycom->rawlen == RAW_LENGTH) {
-		if(daycom->raw[daycom->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-			daycom->raw[daycom->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+			decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,24 +47,26 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int systemcode, int unit, int state) {
-	daycom->message = json_mkobject();
-	json_append_member(daycom->message, "id", json_mknumber(id, 0));
-	json_append_member(daycom->message, "systemcode", json_mknumber(systemcode, 0));
-	json_append_member(daycom->message, "unit", json_mknumber(unit, 0));
+static struct JsonNode *createMessage(int id, int systemcode, int unit, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
+	json_append_member(message, "systemcode", json_mknumber(systemcode, 0));
+	json_append_member(message, "unit", json_mknumber(unit, 0));
 	if(state == 0) {
-		json_append_member(daycom->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(daycom->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/2], x = 0, i = 0;
 	int id = -1, state = -1, unit = -1, systemcode = -1;
 
-	for(x=0;x<daycom->rawlen;x+=2) {
-		if(daycom->raw[x] > AVG_PULSE_LENGTH*(PULSE_MULTIPLIER/2)) {
+	for(x=0;x<decode->rawlen;x+=2) {
+		if(decode->raw[x] > AVG_PULSE_LENGTH*(PULSE_MULTIPLIER/2)) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -75,7 +77,7 @@ static void parseCode(void) {
 	systemcode = binToDecRev(binary, 6, 19);
 	unit = binToDecRev(binary, 21, 23 );
 	state = binary[20];
-	createMessage(id, systemcode, unit, state);
+	decode->message = createMessage(id, systemcode, unit, state);
 }
 
 static void createLow(int s, int e) {
@@ -183,7 +185,7 @@ static int createCode(JsonNode *code) {
 		logprintf(LOG_ERR, "daycom: invalid unit range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(id, systemcode, unit, state);
+		daycom->message = createMessage(id, systemcode, unit, state);
 		clearCode();
 		createId(id);
 		createSystemCode(systemcode);
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	282
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(ehome->rawlen == RAW_LENGTH) {
-		if(ehome->raw[ehome->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   ehome->raw[ehome->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,21 +47,23 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int state) {
-	ehome->message = json_mkobject();
-	json_append_member(ehome->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(state == 1) {
-		json_append_member(ehome->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(ehome->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, binary[RAW_LENGTH/4];
 
-	for(i=0;i<ehome->rawlen-2;i+=4) {
-		if(ehome->raw[i+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(i=0;i<decode->rawlen-2;i+=4) {
+		if(decode->raw[i+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i/4]=1;
 		} else {
 			binary[i/4]=0;
@@ -71,7 +73,7 @@ static void parseCode(void) {
 	int id = binToDec(binary, 1, 3);
 	int state = binary[0];
 
-	createMessage(id, state);
+	decode->message = createMessage(id, state);
 }
 
 static void createLow(int s, int e) {
@@ -157,7 +159,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "ehome: invalid id range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(id, state);
+		ehome->message = createMessage(id, state);
 		clearCode();
 		createId(id);
 		createState(state);
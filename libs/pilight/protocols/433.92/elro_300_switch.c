@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	302
 #define RAW_LENGTH				116
 
-static int validate(void) {
-	if(elro_300_switch->rawlen == RAW_LENGTH) {
-		if(elro_300_switch->raw[elro_300_switch->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   elro_300_switch->raw[elro_300_switch->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -55,23 +55,25 @@ static int validate(void) {
  * state : either 2 (off) or 1 (on)
  * group : if 1 this affects a whole group of devices
  */
-static void createMessage(unsigned long long systemcode, int unitcode, int state, int group) {
-	elro_300_switch->message = json_mkobject();
+static struct JsonNode *createMessage(unsigned long long systemcode, int unitcode, int state, int group) {
+	struct JsonNode *message = json_mkobject();
 	//aka address
-	json_append_member(elro_300_switch->message, "systemcode", json_mknumber((double)systemcode, 0));
+	json_append_member(message, "systemcode", json_mknumber((double)systemcode, 0));
 	//toggle all or just one unit
 	if(group == 1) {
-	    json_append_member(elro_300_switch->message, "all", json_mknumber(group, 0));
+	    json_append_member(message, "all", json_mknumber(group, 0));
 	} else {
-	    json_append_member(elro_300_switch->message, "unitcode", json_mknumber(unitcode, 0));
+	    json_append_member(message, "unitcode", json_mknumber(unitcode, 0));
 	}
 	//aka command
 	if(state == 1) {
-		json_append_member(elro_300_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	}
 	else if(state == 2) {
-		json_append_member(elro_300_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
 /**
@@ -79,14 +81,14 @@ static void createMessage(unsigned long long systemcode, int unitcode, int state
  * Decodes the received stream
  *
  */
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, binary[RAW_LENGTH/2];
 	//utilize the "code" field
 	//at this point the code field holds translated "0" and "1" codes from the received pulses
 	//this means that we have to combine these ourselves into meaningful values in groups of 2
 
-	for(i=0; i < elro_300_switch->rawlen; i++) {
-		if(elro_300_switch->raw[i] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(i=0; i < decode->rawlen; i++) {
+		if(decode->raw[i] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x++] = 1;
 		} else {
 			binary[x++] = 0;
@@ -111,7 +113,7 @@ static void parseCode(void) {
 	if(state < 1 || state > 2) {
 		return;
 	} else {
-		createMessage(systemcode, unitcode, state, groupRes);
+		decode->message = createMessage(systemcode, unitcode, state, groupRes);
 	}
 }
 
@@ -285,7 +287,7 @@ static int createCode(struct JsonNode *code) {
 	} else if(systemcode > 4294967295u || unitcode > 99 || unitcode < 0) {
 		logprintf(LOG_ERR, "elro_300_switch: values out of valid range");
 	} else {
-		createMessage(systemcode, unitcode, state, group);
+		elro_300_switch->message = createMessage(systemcode, unitcode, state, group);
 		elro300ClearCode();
 		createPreamble();
 		createSystemCode(systemcode);
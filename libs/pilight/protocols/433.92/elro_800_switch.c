@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	300
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(elro_800_switch->rawlen == RAW_LENGTH) {
-		if(elro_800_switch->raw[elro_800_switch->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   elro_800_switch->raw[elro_800_switch->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,22 +47,24 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int systemcode, int unitcode, int state) {
-	elro_800_switch->message = json_mkobject();
-	json_append_member(elro_800_switch->message, "systemcode", json_mknumber(systemcode, 0));
-	json_append_member(elro_800_switch->message, "unitcode", json_mknumber(unitcode, 0));
+static struct JsonNode *createMessage(int systemcode, int unitcode, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "systemcode", json_mknumber(systemcode, 0));
+	json_append_member(message, "unitcode", json_mknumber(unitcode, 0));
 	if(state == 0) {
-		json_append_member(elro_800_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(elro_800_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/4], x = 0, i = 0;
 
-	for(x=0;x<elro_800_switch->rawlen-2;x+=4) {
-		if(elro_800_switch->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-2;x+=4) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -72,7 +74,7 @@ static void parseCode(void) {
 	int systemcode = binToDec(binary, 0, 4);
 	int unitcode = binToDec(binary, 5, 9);
 	int state = binary[11];
-	createMessage(systemcode, unitcode, state);
+	decode->message = createMessage(systemcode, unitcode, state);
 }
 
 static void createLow(int s, int e) {
@@ -166,7 +168,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "elro_800_switch: invalid unitcode range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(systemcode, unitcode, state);
+		elro_800_switch->message = createMessage(systemcode, unitcode, state);
 		clearCode();
 		createSystemCode(systemcode);
 		createUnitCode(unitcode);
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	256
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(ev1527->rawlen == RAW_LENGTH) {
-		if(ev1527->raw[ev1527->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   ev1527->raw[ev1527->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,21 +47,23 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int unitcode, int state) {
-	ev1527->message = json_mkobject();
-	json_append_member(ev1527->message, "unitcode", json_mknumber(unitcode, 0));
+static struct JsonNode *createMessage(int unitcode, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "unitcode", json_mknumber(unitcode, 0));
 	if(state == 0) {
-		json_append_member(ev1527->message, "state", json_mkstring("opened"));
+		json_append_member(message, "state", json_mkstring("opened"));
 	} else {
-		json_append_member(ev1527->message, "state", json_mkstring("closed"));
+		json_append_member(message, "state", json_mkstring("closed"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/2], x = 0, i = 0;
 
-	for(x=0;x<ev1527->rawlen-2;x+=2) {
-		if(ev1527->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-2;x+=2) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -70,7 +72,7 @@ static void parseCode(void) {
 
 	int unitcode = binToDec(binary, 0, 19);
 	int state = binary[20];
-	createMessage(unitcode, state);
+	decode->message = createMessage(unitcode, state);
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
@@ -37,10 +37,10 @@
 #define AVG_PULSE_LENGTH	280
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(heitech->rawlen == RAW_LENGTH) {
-		if(heitech->raw[heitech->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   heitech->raw[heitech->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -48,23 +48,25 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int systemcode, int unitcode, int state) {
-	heitech->message = json_mkobject();
-	json_append_member(heitech->message, "systemcode", json_mknumber(systemcode, 0));
-	json_append_member(heitech->message, "unitcode", json_mknumber(unitcode, 0));
+static struct JsonNode *createMessage(int systemcode, int unitcode, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "systemcode", json_mknumber(systemcode, 0));
+	json_append_member(message, "unitcode", json_mknumber(unitcode, 0));
 
 	if(state == 0) {
-		json_append_member(heitech->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(heitech->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, binary[RAW_LENGTH/4];
 
-	for(x=0;x<heitech->rawlen-2;x+=4) {
-		if(heitech->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-2;x+=4) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x/4]=1;
 		} else {
 			binary[x/4]=0;
@@ -77,7 +79,7 @@ static void parseCode(void) {
 	int state = binary[11];
 
 	if(check != state) {
-		createMessage(systemcode, unitcode, state);
+		decode->message = createMessage(systemcode, unitcode, state);
 	}
 }
 
@@ -172,7 +174,7 @@ static int createCode(JsonNode *code) {
 		logprintf(LOG_ERR, "heitech: invalid unitcode range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(systemcode, unitcode, state);
+		heitech->message = createMessage(systemcode, unitcode, state);
 		clearCode();
 		createSystemCode(systemcode);
 		createUnitCode(unitcode);
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	150
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(impuls->rawlen == RAW_LENGTH) {
-		if(impuls->raw[impuls->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   impuls->raw[impuls->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,24 +47,26 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int systemcode, int programcode, int state) {
-	impuls->message = json_mkobject();
-	json_append_member(impuls->message, "systemcode", json_mknumber(systemcode, 0));
-	json_append_member(impuls->message, "programcode", json_mknumber(programcode, 0));
+static struct JsonNode *createMessage(int systemcode, int programcode, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "systemcode", json_mknumber(systemcode, 0));
+	json_append_member(message, "programcode", json_mknumber(programcode, 0));
 	if(state == 1) {
-		json_append_member(impuls->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(impuls->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, binary[RAW_LENGTH/4];
 
 	/* Convert the one's and zero's into binary */
-	for(x=0;x<impuls->rawlen-2;x+=4) {
-		if(impuls->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2)) ||
-		   impuls->raw[x+0] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-2;x+=4) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2)) ||
+		   decode->raw[x+0] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x/4]=1;
 		} else {
 			binary[x/4]=0;
@@ -77,7 +79,7 @@ static void parseCode(void) {
 	int state = binary[11];
 
 	if(check != state) {
-		createMessage(systemcode, programcode, state);
+		decode->message = createMessage(systemcode, programcode, state);
 	}
 }
 
@@ -184,7 +186,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "impuls: invalid programcode range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(systemcode, programcode, state);
+		impuls->message = createMessage(systemcode, programcode, state);
 		clearCode();
 		createSystemCode(systemcode);
 		createProgramCode(programcode);
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	284
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(logilink_switch->rawlen == RAW_LENGTH) {
-		if(logilink_switch->raw[logilink_switch->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   logilink_switch->raw[logilink_switch->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,23 +47,25 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int systemcode, int unitcode, int state) {
-	logilink_switch->message = json_mkobject();
-	json_append_member(logilink_switch->message, "systemcode", json_mknumber(systemcode, 0));
-	json_append_member(logilink_switch->message, "unitcode", json_mknumber(unitcode, 0));
+static struct JsonNode *createMessage(int systemcode, int unitcode, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "systemcode", json_mknumber(systemcode, 0));
+	json_append_member(message, "unitcode", json_mknumber(unitcode, 0));
 	if(state == 0) {
-		json_append_member(logilink_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(logilink_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, binary[RAW_LENGTH/2];
 	int systemcode = 0, state = 0, unitcode = 0;
 
-	for(x=0;x<logilink_switch->rawlen-1;x+=2) {
-		if(logilink_switch->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-1;x+=2) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -73,7 +75,7 @@ static void parseCode(void) {
 	state = binary[20];
 	unitcode = binToDecRev(binary, 21, 23);
 
-	createMessage(systemcode, unitcode, state);
+	decode->message = createMessage(systemcode, unitcode, state);
 }
 
 static void createLow(int s, int e) {
@@ -177,7 +179,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "logilink_switch: invalid unitcode range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(systemcode, unitcode, state);
+		logilink_switch->message = createMessage(systemcode, unitcode, state);
 		clearCode();
 		createSystemCode(systemcode);
 		createUnitCode(unitcode);
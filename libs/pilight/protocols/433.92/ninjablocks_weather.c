@@ -54,10 +54,10 @@ typedef struct settings_t {
 
 static struct settings_t *settings = NULL;
 
-static int validate(void) {
-	if(ninjablocks_weather->rawlen >= MIN_RAW_LENGTH && ninjablocks_weather->rawlen <= MAX_RAW_LENGTH) {
-		if(ninjablocks_weather->raw[ninjablocks_weather->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   ninjablocks_weather->raw[ninjablocks_weather->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen >= MIN_RAW_LENGTH && decode->rawlen <= MAX_RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -65,15 +65,17 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, double temperature, double humidity) {
-	ninjablocks_weather->message = json_mkobject();
-	json_append_member(ninjablocks_weather->message, "id", json_mknumber(id, 0));
-	json_append_member(ninjablocks_weather->message, "unit", json_mknumber(unit, 0));
-	json_append_member(ninjablocks_weather->message, "temperature", json_mknumber(temperature/100, 2));
-	json_append_member(ninjablocks_weather->message, "humidity", json_mknumber(humidity, 0));
+static struct JsonNode *createMessage(int id, int unit, double temperature, double humidity) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
+	json_append_member(message, "unit", json_mknumber(unit, 0));
+	json_append_member(message, "temperature", json_mknumber(temperature/100, 2));
+	json_append_member(message, "humidity", json_mknumber(humidity, 0));
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, pRaw = 0, binary[RAW_LENGTH/2];
 	int iParity = 1, iParityData = -1;	// init for even parity
 	int iHeaderSync = 12;				// 1100
@@ -83,8 +85,8 @@ static void parseCode(void) {
 
 	// Decode Biphase Mark Coded Differential Manchester (BMCDM) pulse stream into binary
 	for(x=0; x<=(RAW_LENGTH/2); x++) {
-		if(ninjablocks_weather->raw[pRaw] > PULSE_NINJA_WEATHER_LOWER &&
-		  ninjablocks_weather->raw[pRaw] < PULSE_NINJA_WEATHER_UPPER) {
+		if(decode->raw[pRaw] > PULSE_NINJA_WEATHER_LOWER &&
+		  decode->raw[pRaw] < PULSE_NINJA_WEATHER_UPPER) {
 			binary[x] = 1;
 			iParityData = iParity;
 			iParity = -iParity;
@@ -122,7 +124,7 @@ static void parseCode(void) {
 	humidity += humi_offset;
 
 	if(iParityData == 0 && (iHeaderSync == headerSync || dataSync == iDataSync)) {
-		createMessage(id, unit, temperature, humidity);
+		decode->message = createMessage(id, unit, temperature, humidity);
 	}
 }
 
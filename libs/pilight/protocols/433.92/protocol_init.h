@@ -0,0 +1,43 @@
+	alectoWS1700Init();
+	alectoWSD17Init();
+	alectoWX500Init();
+	arctechContactInit();
+	arctechDimmerInit();
+	arctechDuskInit();
+	arctechMotionInit();
+	arctechScreenInit();
+	arctechScreenOldInit();
+	arctechSwitchInit();
+	arctechSwitchOldInit();
+	auriolInit();
+	beamishSwitchInit();
+	clarusSwitchInit();
+	cleverwattsInit();
+	conradRSLContactInit();
+	conradRSLSwitchInit();
+	daycomInit();
+	ehomeInit();
+	elro300SwitchInit();
+	elro400SwitchInit();
+	elro800ContactInit();
+	elro800SwitchInit();
+	ev1527Init();
+	heitechInit();
+	impulsInit();
+	logilinkSwitchInit();
+	mumbiInit();
+	ninjablocksWeatherInit();
+	pollinInit();
+	quiggGT1000Init();
+	quiggGT7000Init();
+	quiggScreenInit();
+	rc101Init();
+	rsl366Init();
+	sc2262Init();
+	selectremoteInit();
+	silvercrestInit();
+	techlicoSwitchInit();
+	teknihallInit();
+	tfaInit();
+	x10Init();
+
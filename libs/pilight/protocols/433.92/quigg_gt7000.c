@@ -43,46 +43,42 @@
 #define MAX_PULSE_LENGTH	AVG_PULSE_LENGTH+260
 #define RAW_LENGTH				42
 
-static int validate(void) {
-	if(quigg_gt7000->rawlen == RAW_LENGTH) {
-		if(quigg_gt7000->raw[quigg_gt7000->rawlen-1] >= (int)(PULSE_QUIGG_FOOTER*0.9) &&
-			 quigg_gt7000->raw[quigg_gt7000->rawlen-1] <= (int)(PULSE_QUIGG_FOOTER*1.1) &&
-			 quigg_gt7000->raw[0] >= MIN_PULSE_LENGTH &&
-			 quigg_gt7000->raw[0] <= MAX_PULSE_LENGTH) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (int)(PULSE_QUIGG_FOOTER*0.9) &&
+			 decode->raw[decode->rawlen-1] <= (int)(PULSE_QUIGG_FOOTER*1.1) &&
+			 decode->raw[0] >= MIN_PULSE_LENGTH &&
+			 decode->raw[0] <= MAX_PULSE_LENGTH) {
 		return 0;
 		}
 	}
 	return -1;
 }
 
-static void createMessage(int id, int state, int unit, int all, int learn) {
-	quigg_gt7000->message = json_mkobject();
-	json_append_member(quigg_gt7000->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int state, int unit, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all == 1) {
-		json_append_member(quigg_gt7000->message, "all", json_mknumber(all, 0));
+		json_append_member(message, "all", json_mknumber(all, 0));
 	} else {
-		json_append_member(quigg_gt7000->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 
 	if(state == 1) {
-		json_append_member(quigg_gt7000->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(quigg_gt7000->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
 
-	if(learn == 1) {
-		quigg_gt7000->txrpt = LEARN_REPEATS;
-	} else {
-		quigg_gt7000->txrpt = NORMAL_REPEATS;
-	}
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/2], x = 0, dec_unit[4] = {0, 3, 1, 2};
 	int iParity=1, iParityData=-1; // init for even parity
 
-	for(x=0; x<quigg_gt7000->rawlen-1; x+=2) {
-		if(quigg_gt7000->raw[x+1] > PULSE_QUIGG_50) {
+	for(x=0; x<decode->rawlen-1; x+=2) {
+		if(decode->raw[x+1] > PULSE_QUIGG_50) {
 			binary[x/2] = 1;
 			if((x / 2) > 11 && (x / 2) < 19) {
 				iParityData = iParity;
@@ -102,7 +98,6 @@ static void parseCode(void) {
 	int state = binToDecRev(binary, 15, 15);
 	int dimm = binToDecRev(binary, 16, 16);
 	int parity = binToDecRev(binary, 19, 19);
-	int learn = 0;
 
 	unit = dec_unit[unit];
 
@@ -111,7 +106,7 @@ static void parseCode(void) {
 	}
 
 	if (iParityData == parity && dimm < 1) {
-		createMessage(id, state, unit, all, learn);
+		decode->message = createMessage(id, state, unit, all);
 	}
 }
 
@@ -229,7 +224,12 @@ static int createCode(JsonNode *code) {
 			unit = 4;
 		}
 		quigg_gt7000->rawlen = RAW_LENGTH;
-		createMessage(id, state, unit, all, learn);
+		quigg_gt7000->message = createMessage(id, state, unit, all);
+		if(learn == 1) {
+			quigg_gt7000->txrpt = LEARN_REPEATS;
+		} else {
+			quigg_gt7000->txrpt = NORMAL_REPEATS;
+		}
 		clearCode();
 		createId(id);
 		createUnit(unit);
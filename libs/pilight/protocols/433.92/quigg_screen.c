@@ -43,12 +43,12 @@
 #define MAX_PULSE_LENGTH	AVG_PULSE_LENGTH+260
 #define RAW_LENGTH				42
 
-static int validate(void) {
-	if(quigg_screen->rawlen == RAW_LENGTH) {
-		if(quigg_screen->raw[quigg_screen->rawlen-1] >= (int)(PULSE_QUIGG_SCREEN_FOOTER*0.9) &&
-			 quigg_screen->raw[quigg_screen->rawlen-1] <= (int)(PULSE_QUIGG_SCREEN_FOOTER*1.1) &&
-			 quigg_screen->raw[0] >= MIN_PULSE_LENGTH &&
-			 quigg_screen->raw[0] <= MAX_PULSE_LENGTH) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (int)(PULSE_QUIGG_SCREEN_FOOTER*0.9) &&
+			 decode->raw[decode->rawlen-1] <= (int)(PULSE_QUIGG_SCREEN_FOOTER*1.1) &&
+			 decode->raw[0] >= MIN_PULSE_LENGTH &&
+			 decode->raw[0] <= MAX_PULSE_LENGTH) {
 		return 0;
 		}
 	}
@@ -56,36 +56,32 @@ static int validate(void) {
 }
 
 
-static void createMessage(int id, int state, int unit, int all, int learn) {
-	quigg_screen->message = json_mkobject();
-	json_append_member(quigg_screen->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int state, int unit, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all==1) {
-		json_append_member(quigg_screen->message, "all", json_mknumber(all, 0));
+		json_append_member(message, "all", json_mknumber(all, 0));
 	} else {
-		json_append_member(quigg_screen->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 	if(state==0) {
-		json_append_member(quigg_screen->message, "state", json_mkstring("up"));
+		json_append_member(message, "state", json_mkstring("up"));
 	} else {
-		json_append_member(quigg_screen->message, "state", json_mkstring("down"));
+		json_append_member(message, "state", json_mkstring("down"));
 	}
 
-	if(learn == 1) {
-		quigg_screen->txrpt = LEARN_REPEATS;
-	} else {
-		quigg_screen->txrpt = NORMAL_REPEATS;
-	}
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/2], x = 0, dec_unit[4] = {0, 3, 1, 2};
 	int iParity = 1, iParityData = -1;	// init for even parity
 	int iSwitch = 0;
 
 	// 42 bytes are the number of raw bytes
 	// Byte 1,2 in raw buffer is the first logical byte, rawlen-3,-2 is the parity bit, rawlen-1 is the footer
-	for(x=0; x<quigg_screen->rawlen-1; x+=2) {
-		if(quigg_screen->raw[x+1] > PULSE_QUIGG_SCREEN_50) {
+	for(x=0; x<decode->rawlen-1; x+=2) {
+		if(decode->raw[x+1] > PULSE_QUIGG_SCREEN_50) {
 			binary[x/2] = 1;
 			if((x / 2) > 11 && (x / 2) < 19) {
 				iParityData = iParity;
@@ -104,7 +100,6 @@ static void parseCode(void) {
 	int state = binToDecRev(binary, 15, 15);
 	int screen = binToDecRev(binary, 16, 16);
 	int parity = binToDecRev(binary, 19, 19);
-	int learn = 0;
 
 	unit = dec_unit[unit];
 
@@ -122,7 +117,7 @@ static void parseCode(void) {
 		break;
 	}
 	if((iParityData == parity) && (screen != -1)) {
-		createMessage(id, state, unit, all, learn);
+		decode->message = createMessage(id, state, unit, all);
 	}
 }
 
@@ -246,7 +241,12 @@ static int createCode(JsonNode *code) {
 			unit = 4;
 		}
 		quigg_screen->rawlen = RAW_LENGTH;
-		createMessage(id, state, unit, all, learn);
+		quigg_screen->message = createMessage(id, state, unit, all);
+		if(learn == 1) {
+			quigg_screen->txrpt = LEARN_REPEATS;
+		} else {
+			quigg_screen->txrpt = NORMAL_REPEATS;
+		}
 		clearCode();
 		createId(id);
 		createUnit(unit);
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	241
 #define RAW_LENGTH				66
 
-static int validate(void) {
-	if(rc101->rawlen == RAW_LENGTH) {
-		if(rc101->raw[rc101->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   rc101->raw[rc101->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,26 +47,28 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int state, int unit, int all) {
-	rc101->message = json_mkobject();
-	json_append_member(rc101->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int state, int unit, int all) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(all == 1) {
-		json_append_member(rc101->message, "all", json_mknumber(1, 0));
+		json_append_member(message, "all", json_mknumber(1, 0));
 	} else {
-		json_append_member(rc101->message, "unit", json_mknumber(unit, 0));
+		json_append_member(message, "unit", json_mknumber(unit, 0));
 	}
 	if(state == 1) {
-		json_append_member(rc101->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(rc101->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, binary[RAW_LENGTH/2];
 
-	for(i=0;i<rc101->rawlen; i+=2) {
-		if(rc101->raw[i] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(i=0;i<decode->rawlen; i+=2) {
+		if(decode->raw[i] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[x++] = 1;
 		} else {
 			binary[x++] = 0;
@@ -85,7 +87,7 @@ static void parseCode(void) {
 		all = 1;
 		state = 1;
 	}
-	createMessage(id, state, unit, all);
+	decode->message = createMessage(id, state, unit, all);
 }
 
 static void createLow(int s, int e) {
@@ -183,7 +185,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "rc101: invalid id range");
 		return EXIT_FAILURE;
 	} else if(unit > 4 || unit < 0) {
-		createMessage(id, state, unit, all);
+		rc101->message = createMessage(id, state, unit, all);
 		clearCode();
 		createId(id);
 		createState(state);
@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	390
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(rsl366->rawlen == RAW_LENGTH) {
-		if(rsl366->raw[rsl366->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   rsl366->raw[rsl366->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,24 +47,26 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int systemcode, int programcode, int state) {
-	rsl366->message = json_mkobject();
-	json_append_member(rsl366->message, "systemcode", json_mknumber(systemcode, 0));
-	json_append_member(rsl366->message, "programcode", json_mknumber(programcode, 0));
+static struct JsonNode *createMessage(int systemcode, int programcode, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "systemcode", json_mknumber(systemcode, 0));
+	json_append_member(message, "programcode", json_mknumber(programcode, 0));
 	if(state == 1) {
-		json_append_member(rsl366->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(rsl366->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, i = 0, binary[RAW_LENGTH/4];
 
 	/* Convert the one's and zero's into binary */
-	for(x=0;x<rsl366->rawlen-2;x+=4) {
-		if(rsl366->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2)) ||
-		  rsl366->raw[x+0] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-2;x+=4) {
+		if(decode->raw[x+3] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2)) ||
+		  decode->raw[x+0] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++]=1;
 		} else {
 			binary[i++]=0;
@@ -76,7 +78,7 @@ static void parseCode(void) {
 	// There seems to be no check and binary[10] is always a low
 	int state = binary[11]^1;
 
-	createMessage(systemcode, programcode, state);
+	decode->message = createMessage(systemcode, programcode, state);
 }
 
 static void createLow(int s, int e) {
@@ -149,7 +151,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "rsl366: invalid programcode range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(systemcode, programcode, state);
+		rsl366->message = createMessage(systemcode, programcode, state);
 		clearCode();
 		createSystemCode(systemcode);
 		createProgramCode(programcode);
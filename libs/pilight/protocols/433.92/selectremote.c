@@ -36,10 +36,10 @@
 #define AVG_PULSE_LENGTH	396
 #define RAW_LENGTH				50
 
-static int validate(void) {
-	if(selectremote->rawlen == RAW_LENGTH) {
-		if(selectremote->raw[selectremote->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   selectremote->raw[selectremote->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -47,21 +47,23 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int state) {
-	selectremote->message = json_mkobject();
-	json_append_member(selectremote->message, "id", json_mknumber(id, 0));
+static struct JsonNode *createMessage(int id, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
 	if(state == 1) {
-		json_append_member(selectremote->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(selectremote->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/4], x = 0, i = 0;
 
-	for(x=0;x<selectremote->rawlen-2;x+=4) {
-		if(selectremote->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen-2;x+=4) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -71,7 +73,7 @@ static void parseCode(void) {
 	int id = 7-binToDec(binary, 1, 3);
 	int state = binary[8];
 
-	createMessage(id, state);
+	decode->message = createMessage(id, state);
 }
 
 static void createLow(int s, int e) {
@@ -145,7 +147,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "selectremote: invalid id range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(id, state);
+		selectremote->message = createMessage(id, state);
 		clearCode();
 		createId(id);
 		createState(state);
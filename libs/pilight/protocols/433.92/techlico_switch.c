@@ -39,10 +39,10 @@
 
 static int map[NRMAP]={0, 3, 192, 15, 12};
 
-static int validate(void) {
-	if(techlico_switch->rawlen == RAW_LENGTH) {
-		if(techlico_switch->raw[techlico_switch->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   techlico_switch->raw[techlico_switch->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -50,24 +50,26 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int id, int unit, int state) {
-	techlico_switch->message = json_mkobject();
-	json_append_member(techlico_switch->message, "id", json_mknumber(id, 0));
-	json_append_member(techlico_switch->message, "unit", json_mknumber(unit, 0));
+static struct JsonNode *createMessage(int id, int unit, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id, 0));
+	json_append_member(message, "unit", json_mknumber(unit, 0));
 	if(state == 0) {
-		json_append_member(techlico_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
 	if(state == 1) {
-		json_append_member(techlico_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, y = 0, binary[RAW_LENGTH/2];
 	int id = -1, state = -1, unit = -1, code = 0;
 
-	for(x=0;x<techlico_switch->rawlen;x+=2) {
-		if(techlico_switch->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=0;x<decode->rawlen;x+=2) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -85,7 +87,7 @@ static void parseCode(void) {
 	}
 
 	if(unit > -1) {
-		createMessage(id, unit, state);
+		decode->message = createMessage(id, unit, state);
 	}
 }
 
@@ -170,7 +172,7 @@ static int createCode(struct JsonNode *code) {
 		return EXIT_FAILURE;
 	} else {
 
-		createMessage(id, unit, state);
+		techlico_switch->message = createMessage(id, unit, state);
 		clearCode();
 		createId(id);
 		unit = map[unit];
@@ -45,10 +45,10 @@ typedef struct settings_t {
 
 static struct settings_t *settings = NULL;
 
-static int validate(void) {
-	if(teknihall->rawlen == RAW_LENGTH) {
-		if(teknihall->raw[teknihall->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   teknihall->raw[teknihall->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -56,14 +56,14 @@ static int validate(void) {
 	return -1;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, binary[RAW_LENGTH/2];
 	int id = 0, battery = 0;
 	double temperature = 0.0, humidity = 0.0;
 	double humi_offset = 0.0, temp_offset = 0.0;
 
-	for(x=1;x<teknihall->rawlen-1;x+=2) {
-		if(teknihall->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=1;x<decode->rawlen-1;x+=2) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -88,11 +88,11 @@ static void parseCode(void) {
 	temperature += temp_offset;
 	humidity += humi_offset;
 
-	teknihall->message = json_mkobject();
-	json_append_member(teknihall->message, "id", json_mknumber(id, 1));
-	json_append_member(teknihall->message, "temperature", json_mknumber(temperature/10, 1));
-	json_append_member(teknihall->message, "humidity", json_mknumber(humidity, 1));
-	json_append_member(teknihall->message, "battery", json_mknumber(battery, 1));
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id, 1));
+	json_append_member(decode->message, "temperature", json_mknumber(temperature/10, 1));
+	json_append_member(decode->message, "humidity", json_mknumber(humidity, 1));
+	json_append_member(decode->message, "battery", json_mknumber(battery, 1));
 }
 
 static int checkValues(struct JsonNode *jvalues) {
@@ -46,10 +46,10 @@ typedef struct settings_t {
 
 static struct settings_t *settings = NULL;
 
-static int validate(void) {
-	if(tfa->rawlen == RAW_LENGTH) {
-		if(tfa->raw[tfa->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   tfa->raw[tfa->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -57,7 +57,7 @@ static int validate(void) {
 	return -1;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int binary[RAW_LENGTH/2];
 	int temp1 = 0, temp2 = 0, temp3 = 0;
 	int humi1 = 0, humi2 = 0;
@@ -67,8 +67,8 @@ static void parseCode(void) {
 	double humi_offset = 0.0, temp_offset = 0.0;
 	double temperature = 0.0, humidity = 0.0;
 
-	for(x=1;x<tfa->rawlen-2;x+=2) {
-		if(tfa->raw[x] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
+	for(x=1;x<decode->rawlen-2;x+=2) {
+		if(decode->raw[x] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
 			binary[i++] = 1;
 		} else {
 			binary[i++] = 0;
@@ -107,12 +107,12 @@ static void parseCode(void) {
 	temperature += temp_offset;
 	humidity += humi_offset;
 
-	tfa->message = json_mkobject();
-	json_append_member(tfa->message, "id", json_mknumber(id, 0));
-	json_append_member(tfa->message, "temperature", json_mknumber(temperature/100, 2));
-	json_append_member(tfa->message, "humidity", json_mknumber(humidity, 2));
-	json_append_member(tfa->message, "battery", json_mknumber(battery, 0));
-	json_append_member(tfa->message, "channel", json_mknumber(channel, 0));
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id, 0));
+	json_append_member(decode->message, "temperature", json_mknumber(temperature/100, 2));
+	json_append_member(decode->message, "humidity", json_mknumber(humidity, 2));
+	json_append_member(decode->message, "battery", json_mknumber(battery, 0));
+	json_append_member(decode->message, "channel", json_mknumber(channel, 0));
 }
 
 static int checkValues(struct JsonNode *jvalues) {
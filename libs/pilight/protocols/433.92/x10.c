@@ -38,10 +38,10 @@
 
 static char letters[18] = {"MNOPCDABEFGHKL IJ"};
 
-static int validate(void) {
-	if(x10->rawlen == RAW_LENGTH) {
-		if(x10->raw[x10->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   x10->raw[x10->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV)) {
 			return 0;
 		}
 	}
@@ -49,21 +49,23 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(char *id, int state) {
-	x10->message = json_mkobject();
-	json_append_member(x10->message, "id", json_mkstring(id));
+static struct JsonNode *createMessage(char *id, int state) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mkstring(id));
 	if(state == 0) {
-		json_append_member(x10->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(x10->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int x = 0, y = 0, binary[RAW_LENGTH/2];
 
-	for(x=1;x<x10->rawlen-1;x+=2) {
-		if(x10->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
+	for(x=1;x<decode->rawlen-1;x+=2) {
+		if(decode->raw[x] > (int)((double)AVG_PULSE_LENGTH*((double)PULSE_MULTIPLIER/2))) {
 			binary[y++] = 1;
 		} else {
 			binary[y++] = 0;
@@ -85,7 +87,7 @@ static void parseCode(void) {
 	i += binToDec(binary, 19, 20);
 	if(c1 == 255 && c2 == 255) {
 		sprintf(id, "%c%d", l, i);
-		createMessage(id, s);
+		decode->message = createMessage(id, s);
 	}
 }
 
@@ -194,7 +196,7 @@ static int createCode(struct JsonNode *code) {
 		logprintf(LOG_ERR, "x10: invalid id range");
 		return EXIT_FAILURE;
 	} else {
-		createMessage(id, state);
+		x10->message = createMessage(id, state);
 		x10clearCode();
 		createLetter((int)id[0]);
 		createNumber(atoi(&id[1]));
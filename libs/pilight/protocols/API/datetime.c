@@ -57,148 +57,163 @@
 #include "../../core/json.h"
 #include "../../core/gc.h"
 #include "../../core/datetime.h"
+#include "../../core/timer.h"
 #include "datetime.h"
 
-static unsigned short loop = 1;
-static unsigned short threads = 0;
+typedef struct settings_t {
+	double longitude;
+	double latitude;
+	char *tz;
+	int target_offset;
+	int dst;
+	int x;
+	struct timer_task_t *timer;
+	struct settings_t *next;
+} settings_t;
+
+static struct settings_t *settings = NULL;
+static int nrsettings = 0;
 static char *format = NULL;
+static char UTC[] = "UTC";
 
 static pthread_mutex_t lock;
 
-static void *thread(void *param) {
-	char UTC[] = "UTC";
-	struct protocol_threads_t *thread = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)thread->param;
-	struct JsonNode *jid = NULL;
-	struct JsonNode *jchild = NULL;
-	struct JsonNode *jchild1 = NULL;
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
 	struct tm tm;
-	char *tz = NULL;
 	time_t t;
-	int target_offset = 0, counter = 0, dst = 0, x = 0;
-	double longitude = 0.0, latitude = 0.0;
 
-	threads++;
+	pthread_mutex_lock(&lock);
+	/* Looking up the timezone is expensive so it is done on the first run */
+	if(wnode->tz == NULL) {
+		if((wnode->tz = coord2tz(wnode->longitude, wnode->latitude)) == NULL) {
+			logprintf(LOG_INFO, "datetime #%d, could not determine timezone", nrsettings);
+			wnode->tz = UTC;
+		} else {
+			logprintf(LOG_INFO, "datetime #%d %.6f:%.6f seems to be in timezone: %s", nrsettings, wnode->longitude, wnode->latitude, wnode->tz);
+		}
 
-	if((jid = json_find_member(json, "id"))) {
-		jchild = json_first_child(jid);
-		while(jchild) {
-			jchild1 = json_first_child(jchild);
-			while(jchild1) {
-				if(strcmp(jchild1->key, "longitude") == 0) {
-					longitude = jchild1->number_;
-				}
-				if(strcmp(jchild1->key, "latitude") == 0) {
-					latitude = jchild1->number_;
-				}
-				jchild1 = jchild1->next;
-			}
-			jchild = jchild->next;
+		t = time(NULL);
+		t -= getntpdiff();
+		wnode->dst = isdst(t, wnode->tz);
+		if(isntpsynced() == 0) {
+			wnode->x = 1;
 		}
-	}
 
-	if((tz = coord2tz(longitude, latitude)) == NULL) {
-		logprintf(LOG_INFO, "datetime #%d, could not determine timezone", threads);
-		tz = UTC;
-	} else {
-		logprintf(LOG_INFO, "datetime #%d %.6f:%.6f seems to be in timezone: %s", threads, longitude, latitude, tz);
+		/* Check how many hours we differ from UTC? */
+		wnode->target_offset = tzoffset(UTC, wnode->tz);
 	}
 
 	t = time(NULL);
 	t -= getntpdiff();
-	dst = isdst(t, tz);
-	if(isntpsynced() == 0) {
-		x = 1;
-	}
-
-	/* Check how many hours we differ from UTC? */
-	target_offset = tzoffset(UTC, tz);
-
-	while(loop) {
-		pthread_mutex_lock(&lock);
-		t = time(NULL);
-		t -= getntpdiff();
 
-		/* Get UTC time */
+	/* Get UTC time */
 #ifdef _WIN32
-		struct tm *tm1;
-		if((tm1 = gmtime(&t)) != NULL) {
-			memcpy(&tm, tm1, sizeof(struct tm));
+	struct tm *tm1;
+	if((tm1 = gmtime(&t)) != NULL) {
+		memcpy(&tm, tm1, sizeof(struct tm));
 #else
-		if(gmtime_r(&t, &tm) != NULL) {
+	if(gmtime_r(&t, &tm) != NULL) {
 #endif
-			int year = tm.tm_year+1900;
-			int month = tm.tm_mon+1;
-			int day = tm.tm_mday;
-			/* Add our hour difference to the UTC time */
-			tm.tm_hour += target_offset;
-			/* Add possible daylist savings time hour */
-			tm.tm_hour += dst;
-			int hour = tm.tm_hour;
-			int minute = tm.tm_min;
-			int second = tm.tm_sec;
-			int weekday = tm.tm_wday+1;
-
-			datefix(&year, &month, &day, &hour, &minute, &second);
-
-			if((minute == 0 && second == 0) || (isntpsynced() == 0 && x == 0)) {
-				x = 1;
-				dst = isdst(t, tz);
-			}
-
-			datetime->message = json_mkobject();
-
-			JsonNode *code = json_mkobject();
-			json_append_member(code, "longitude", json_mknumber(longitude, 6));
-			json_append_member(code, "latitude", json_mknumber(latitude, 6));
-			json_append_member(code, "year", json_mknumber(year, 0));
-			json_append_member(code, "month", json_mknumber(month, 0));
-			json_append_member(code, "day", json_mknumber(day, 0));
-			json_append_member(code, "weekday", json_mknumber(weekday, 0));
-			json_append_member(code, "hour", json_mknumber(hour, 0));
-			json_append_member(code, "minute", json_mknumber(minute, 0));
-			json_append_member(code, "second", json_mknumber(second, 0));
-			json_append_member(code, "dst", json_mknumber(dst, 0));
-
-			json_append_member(datetime->message, "message", code);
-			json_append_member(datetime->message, "origin", json_mkstring("receiver"));
-			json_append_member(datetime->message, "protocol", json_mkstring(datetime->id));
-
-			if(pilight.broadcast != NULL) {
-				pilight.broadcast(datetime->id, datetime->message, PROTOCOL);
-			}
+		int year = tm.tm_year+1900;
+		int month = tm.tm_mon+1;
+		int day = tm.tm_mday;
+		/* Add our hour difference to the UTC time */
+		tm.tm_hour += wnode->target_offset;
+		/* Add possible daylist savings time hour */
+		tm.tm_hour += wnode->dst;
+		int hour = tm.tm_hour;
+		int minute = tm.tm_min;
+		int second = tm.tm_sec;
+		int weekday = tm.tm_wday+1;
+
+		datefix(&year, &month, &day, &hour, &minute, &second);
+
+		if((minute == 0 && second == 0) || (isntpsynced() == 0 && wnode->x == 0)) {
+			wnode->x = 1;
+			wnode->dst = isdst(t, wnode->tz);
+		}
 
-			json_delete(datetime->message);
-			datetime->message = NULL;
-			counter++;
+		datetime->message = json_mkobject();
+
+		JsonNode *code = json_mkobject();
+		json_append_member(code, "longitude", json_mknumber(wnode->longitude, 6));
+		json_append_member(code, "latitude", json_mknumber(wnode->latitude, 6));
+		json_append_member(code, "year", json_mknumber(year, 0));
+		json_append_member(code, "month", json_mknumber(month, 0));
+		json_append_member(code, "day", json_mknumber(day, 0));
+		json_append_member(code, "weekday", json_mknumber(weekday, 0));
+		json_append_member(code, "hour", json_mknumber(hour, 0));
+		json_append_member(code, "minute", json_mknumber(minute, 0));
+		json_append_member(code, "second", json_mknumber(second, 0));
+		json_append_member(code, "dst", json_mknumber(wnode->dst, 0));
+
+		json_append_member(datetime->message, "message", code);
+		json_append_member(datetime->message, "origin", json_mkstring("receiver"));
+		json_append_member(datetime->message, "protocol", json_mkstring(datetime->id));
+
+		if(pilight.broadcast != NULL) {
+			pilight.broadcast(datetime->id, datetime->message, PROTOCOL);
 		}
-		pthread_mutex_unlock(&lock);
-		sleep(1);
+
+		json_delete(datetime->message);
+		datetime->message = NULL;
 	}
 	pthread_mutex_unlock(&lock);
-
-	threads--;
-	return (void *)NULL;
 }
 
 static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
+	struct JsonNode *jid = NULL;
+	struct JsonNode *jchild = NULL;
+	struct JsonNode *jchild1 = NULL;
+	struct settings_t *wnode = NULL;
+
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	wnode->longitude = 0.0;
+	wnode->latitude = 0.0;
+	wnode->tz = NULL;
+	wnode->target_offset = 0;
+	wnode->dst = 0;
+	wnode->x = 0;
+
+	if((jid = json_find_member(jdevice, "id"))) {
+		jchild = json_first_child(jid);
+		while(jchild) {
+			jchild1 = json_first_child(jchild);
+			while(jchild1) {
+				if(strcmp(jchild1->key, "longitude") == 0) {
+					wnode->longitude = jchild1->number_;
+				}
+				if(strcmp(jchild1->key, "latitude") == 0) {
+					wnode->latitude = jchild1->number_;
+				}
+				jchild1 = jchild1->next;
+			}
+			jchild = jchild->next;
+		}
+	}
+
+	wnode->next = settings;
+	settings = wnode;
+	nrsettings++;
 
-	struct protocol_threads_t *node = protocol_thread_init(datetime, json);
-	return threads_register("datetime", &thread, (void *)node, 0);
+	wnode->timer = timer_add_clock("datetime", 0, 1000, 0, &poll, (void *)wnode);
+	return NULL;
 }
 
 static void threadGC(void) {
-	loop = 0;
+	struct settings_t *wtmp = NULL;
 
-	protocol_thread_stop(datetime);
-	while(threads > 0) {
-		usleep(10);
+	while(settings) {
+		wtmp = settings;
+		timer_cancel(wtmp->timer);
+		settings = settings->next;
+		FREE(wtmp);
 	}
-	protocol_thread_free(datetime);
+	nrsettings = 0;
 }
 
 static void gc(void) {
@@ -243,7 +258,7 @@ void datetimeInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "datetime";
-	module->version = "2.6";
+	module->version = "2.7";
 	module->reqversion = "6.0";
 	module->reqcommit = "115";
 }
@@ -44,6 +44,7 @@
 #include "../../core/binary.h"
 #include "../../core/json.h"
 #include "../../core/gc.h"
+#include "../../core/timer.h"
 #include "openweathermap.h"
 
 #define INTERVAL 	600
@@ -51,8 +52,13 @@
 typedef struct settings_t {
 	char *country;
 	char *location;
-	protocol_threads_t *thread;
 	time_t update;
+	int interval;
+	int ointerval;
+	int timeout;
+	int firstrun;
+	int forced;
+	struct timer_task_t *timer;
 	struct settings_t *next;
 } settings_t;
 
@@ -60,24 +66,13 @@ static pthread_mutex_t lock;
 static pthread_mutexattr_t attr;
 
 static struct settings_t *settings;
-static unsigned short loop = 1;
-static unsigned short threads = 0;
 
-static void *openweathermapParse(void *param) {
-	struct protocol_threads_t *thread = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)thread->param;
-	struct JsonNode *jid = NULL;
-	struct JsonNode *jchild = NULL;
-	struct JsonNode *jchild1 = NULL;
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
 	struct JsonNode *node = NULL;
 	struct JsonNode *jdata = NULL;
 	struct JsonNode *jmain = NULL;
 	struct JsonNode *jsys = NULL;
-	struct settings_t *wnode = MALLOC(sizeof(struct settings_t));
-
-	int interval = 86400, ointerval = 86400, event = 0;
-	int firstrun = 1, nrloops = 0, timeout = 0;
-	double itmp = 0;
 
 	char url[1024];
 	char *data = NULL;
@@ -88,231 +83,217 @@ static void *openweathermapParse(void *param) {
 	time_t timenow = 0;
 	struct tm tm;
 
-	threads++;
-
 	memset(&typebuf, '\0', 255);
 
-	if(wnode == NULL) {
-		fprintf(stderr, "out of memory\n");
-		exit(EXIT_FAILURE);
-	}
-
-	int has_country = 0, has_location = 0;
-	if((jid = json_find_member(json, "id"))) {
-		jchild = json_first_child(jid);
-		while(jchild) {
-			has_country = 0, has_location = 0;
-			jchild1 = json_first_child(jchild);
-
-			while(jchild1) {
-				if(strcmp(jchild1->key, "location") == 0) {
-					has_location = 1;
-					if((wnode->location = MALLOC(strlen(jchild1->string_)+1)) == NULL) {
-						fprintf(stderr, "out of memory\n");
-						exit(EXIT_FAILURE);
-					}
-					strcpy(wnode->location, jchild1->string_);
-				}
-				if(strcmp(jchild1->key, "country") == 0) {
-					has_country = 1;
-					if((wnode->country = MALLOC(strlen(jchild1->string_)+1)) == NULL) {
-						fprintf(stderr, "out of memory\n");
-						exit(EXIT_FAILURE);
-					}
-					strcpy(wnode->country, jchild1->string_);
-				}
-				jchild1 = jchild1->next;
-			}
-			if(has_country == 1 && has_location == 1) {
-				wnode->thread = thread;
-				wnode->next = settings;
-				settings = wnode;
-			} else {
-				if(has_country == 1) {
-					FREE(wnode->country);
-				}
-				if(has_location == 1) {
-					FREE(wnode->location);
-				}
-				FREE(wnode);
-				wnode = NULL;
-			}
-			jchild = jchild->next;
-		}
-	}
-
-	if(wnode == NULL) {
-		return 0;
-	}
+	pthread_mutex_lock(&lock);
+	wnode->timeout += INTERVAL;
+	if(wnode->timeout >= wnode->interval || wnode->forced == 1 || wnode->firstrun == 1) {
+		wnode->forced = 0;
+		wnode->timeout = 0;
+		wnode->interval = wnode->ointerval;
 
-	if(json_find_number(json, "poll-interval", &itmp) == 0)
-		interval = (int)round(itmp);
-	ointerval = interval;
-
-	while(loop) {
-		event = protocol_thread_wait(thread, INTERVAL, &nrloops);
+		data = NULL;
+		sprintf(url, "http://api.openweathermap.org/data/2.5/weather?q=%s,%s&APPID=8db24c4ac56251371c7ea87fd3115493", wnode->location, wnode->country);
+		/* Other devices can go ahead while we wait for the server */
+		pthread_mutex_unlock(&lock);
+		data = http_get_content(url, &tp, &ret, &size);
 		pthread_mutex_lock(&lock);
-		if(loop == 0) {
-			break;
-		}
-		timeout += INTERVAL;
-		if(timeout >= interval || event != ETIMEDOUT || firstrun == 1) {
-			timeout = 0;
-			interval = ointerval;
-
-			data = NULL;
-			sprintf(url, "http://api.openweathermap.org/data/2.5/weather?q=%s,%s&APPID=8db24c4ac56251371c7ea87fd3115493", wnode->location, wnode->country);
-			data = http_get_content(url, &tp, &ret, &size);
-			if(ret == 200) {
-				if(strstr(typebuf, "application/json") != NULL) {
-					if(json_validate(data) == true) {
-						if((jdata = json_decode(data)) != NULL) {
-							if((jmain = json_find_member(jdata, "main")) != NULL
-							   && (jsys = json_find_member(jdata, "sys")) != NULL) {
-								if((node = json_find_member(jmain, "temp")) == NULL) {
+		if(ret == 200) {
+			if(strstr(typebuf, "application/json") != NULL) {
+				if(json_validate(data) == true) {
+					if((jdata = json_decode(data)) != NULL) {
+						if((jmain = json_find_member(jdata, "main")) != NULL
+						   && (jsys = json_find_member(jdata, "sys")) != NULL) {
+							if((node = json_find_member(jmain, "temp")) == NULL) {
+								printf("api.openweathermap.org json has no temp key");
+							} else if(json_find_number(jmain, "humidity", &humi) != 0) {
+								printf("api.openweathermap.org json has no humidity key");
+							} else if(json_find_number(jsys, "sunrise", &sunrise) != 0) {
+								printf("api.openweathermap.org json has no sunrise key");
+							} else if(json_find_number(jsys, "sunset", &sunset) != 0) {
+								printf("api.openweathermap.org json has no sunset key");
+							} else {
+								if(node->tag != JSON_NUMBER) {
 									printf("api.openweathermap.org json has no temp key");
-								} else if(json_find_number(jmain, "humidity", &humi) != 0) {
-									printf("api.openweathermap.org json has no humidity key");
-								} else if(json_find_number(jsys, "sunrise", &sunrise) != 0) {
-									printf("api.openweathermap.org json has no sunrise key");
-								} else if(json_find_number(jsys, "sunset", &sunset) != 0) {
-									printf("api.openweathermap.org json has no sunset key");
 								} else {
-									if(node->tag != JSON_NUMBER) {
-										printf("api.openweathermap.org json has no temp key");
-									} else {
-										temp = node->number_-273.15;
+									temp = node->number_-273.15;
 
-										timenow = time(NULL);
-										struct tm current;
-										memset(&current, '\0', sizeof(struct tm));
+									timenow = time(NULL);
+									struct tm current;
+									memset(&current, '\0', sizeof(struct tm));
 #ifdef _WIN32
-										localtime(&timenow);
+									localtime(&timenow);
 #else
-										localtime_r(&timenow, &current);
+									localtime_r(&timenow, &current);
 #endif
 
-										int month = current.tm_mon+1;
-										int mday = current.tm_mday;
-										int year = current.tm_year+1900;
+									int month = current.tm_mon+1;
+									int mday = current.tm_mday;
+									int year = current.tm_year+1900;
 
-										time_t midnight = (datetime2ts(year, month, mday, 23, 59, 59, 0)+1);
+									time_t midnight = (datetime2ts(year, month, mday, 23, 59, 59, 0)+1);
 
-										openweathermap->message = json_mkobject();
+									openweathermap->message = json_mkobject();
 
-										JsonNode *code = json_mkobject();
+									JsonNode *code = json_mkobject();
 
-										json_append_member(code, "location", json_mkstring(wnode->location));
-										json_append_member(code, "country", json_mkstring(wnode->country));
-										json_append_member(code, "temperature", json_mknumber(temp, 2));
-										json_append_member(code, "humidity", json_mknumber(humi, 2));
-										json_append_member(code, "update", json_mknumber(0, 0));
+									json_append_member(code, "location", json_mkstring(wnode->location));
+									json_append_member(code, "country", json_mkstring(wnode->country));
+									json_append_member(code, "temperature", json_mknumber(temp, 2));
+									json_append_member(code, "humidity", json_mknumber(humi, 2));
+									json_append_member(code, "update", json_mknumber(0, 0));
 
-										time_t a = (time_t)sunrise;
-										memset(&tm, '\0', sizeof(struct tm));
+									time_t a = (time_t)sunrise;
+									memset(&tm, '\0', sizeof(struct tm));
 #ifdef _WIN32
-										localtime(&a);
+									localtime(&a);
 #else
-										localtime_r(&a, &tm);
+									localtime_r(&a, &tm);
 #endif
-										json_append_member(code, "sunrise", json_mknumber((double)((tm.tm_hour*100)+tm.tm_min)/100, 2));
+									json_append_member(code, "sunrise", json_mknumber((double)((tm.tm_hour*100)+tm.tm_min)/100, 2));
 
-										a = (time_t)sunset;
-										memset(&tm, '\0', sizeof(struct tm));
+									a = (time_t)sunset;
+									memset(&tm, '\0', sizeof(struct tm));
 #ifdef _WIN32
-										localtime(&a);
+									localtime(&a);
 #else
-										localtime_r(&a, &tm);
+									localtime_r(&a, &tm);
 #endif
-										json_append_member(code, "sunset", json_mknumber((double)((tm.tm_hour*100)+tm.tm_min)/100, 2));
-										if(timenow > (int)round(sunrise) && timenow < (int)round(sunset)) {
-											json_append_member(code, "sun", json_mkstring("rise"));
-										} else {
-											json_append_member(code, "sun", json_mkstring("set"));
-										}
+									json_append_member(code, "sunset", json_mknumber((double)((tm.tm_hour*100)+tm.tm_min)/100, 2));
+									if(timenow > (int)round(sunrise) && timenow < (int)round(sunset)) {
+										json_append_member(code, "sun", json_mkstring("rise"));
+									} else {
+										json_append_member(code, "sun", json_mkstring("set"));
+									}
+
+									json_append_member(openweathermap->message, "message", code);
+									json_append_member(openweathermap->message, "origin", json_mkstring("receiver"));
+									json_append_member(openweathermap->message, "protocol", json_mkstring(openweathermap->id));
 
-										json_append_member(openweathermap->message, "message", code);
-										json_append_member(openweathermap->message, "origin", json_mkstring("receiver"));
-										json_append_member(openweathermap->message, "protocol", json_mkstring(openweathermap->id));
+									if(pilight.broadcast != NULL) {
+										pilight.broadcast(openweathermap->id, openweathermap->message, PROTOCOL);
+									}
+									json_delete(openweathermap->message);
+									openweathermap->message = NULL;
 
-										if(pilight.broadcast != NULL) {
-											pilight.broadcast(openweathermap->id, openweathermap->message, PROTOCOL);
+									/* Send message when sun rises */
+									if((int)round(sunrise) > timenow) {
+										if(((int)round(sunrise)-timenow) < wnode->ointerval) {
+											wnode->interval = (int)((int)round(sunrise)-timenow);
 										}
-										json_delete(openweathermap->message);
-										openweathermap->message = NULL;
-
-										/* Send message when sun rises */
-										if((int)round(sunrise) > timenow) {
-											if(((int)round(sunrise)-timenow) < ointerval) {
-												interval = (int)((int)round(sunrise)-timenow);
-											}
-										/* Send message when sun sets */
-										} else if((int)round(sunset) > timenow) {
-											if(((int)round(sunset)-timenow) < ointerval) {
-												interval = (int)((int)round(sunset)-timenow);
-											}
-										/* Update all values when a new day arrives */
-										} else {
-											if((midnight-timenow) < ointerval) {
-												interval = (int)(midnight-timenow);
-											}
+									/* Send message when sun sets */
+									} else if((int)round(sunset) > timenow) {
+										if(((int)round(sunset)-timenow) < wnode->ointerval) {
+											wnode->interval = (int)((int)round(sunset)-timenow);
+										}
+									/* Update all values when a new day arrives */
+									} else {
+										if((midnight-timenow) < wnode->ointerval) {
+											wnode->interval = (int)(midnight-timenow);
 										}
-
-										wnode->update = time(NULL);
 									}
+
+									wnode->update = time(NULL);
 								}
-							} else {
-								logprintf(LOG_NOTICE, "api.openweathermap.org json has no current_observation key");
 							}
-							json_delete(jdata);
 						} else {
-							logprintf(LOG_NOTICE, "api.openweathermap.org json could not be parsed");
+							logprintf(LOG_NOTICE, "api.openweathermap.org json has no current_observation key");
 						}
-					}  else {
-						logprintf(LOG_NOTICE, "api.openweathermap.org response was not in a valid json format");
+						json_delete(jdata);
+					} else {
+						logprintf(LOG_NOTICE, "api.openweathermap.org json could not be parsed");
 					}
-				} else {
+				}  else {
 					logprintf(LOG_NOTICE, "api.openweathermap.org response was not in a valid json format");
 				}
 			} else {
-				logprintf(LOG_NOTICE, "could not reach api.openweathermap.org");
-			}
-			if(data) {
-				FREE(data);
+				logprintf(LOG_NOTICE, "api.openweathermap.org response was not in a valid json format");
 			}
 		} else {
-			openweathermap->message = json_mkobject();
-			JsonNode *code = json_mkobject();
-			json_append_member(code, "location", json_mkstring(wnode->location));
-			json_append_member(code, "country", json_mkstring(wnode->country));
-			json_append_member(code, "update", json_mknumber(1, 0));
-			json_append_member(openweathermap->message, "message", code);
-			json_append_member(openweathermap->message, "origin", json_mkstring("receiver"));
-			json_append_member(openweathermap->message, "protocol", json_mkstring(openweathermap->id));
-			if(pilight.broadcast != NULL) {
-				pilight.broadcast(openweathermap->id, openweathermap->message, PROTOCOL);
-			}
-			json_delete(openweathermap->message);
-			openweathermap->message = NULL;
+			logprintf(LOG_NOTICE, "could not reach api.openweathermap.org");
 		}
-		firstrun = 0;
-
-		pthread_mutex_unlock(&lock);
+		if(data) {
+			FREE(data);
+		}
+	} else {
+		openweathermap->message = json_mkobject();
+		JsonNode *code = json_mkobject();
+		json_append_member(code, "location", json_mkstring(wnode->location));
+		json_append_member(code, "country", json_mkstring(wnode->country));
+		json_append_member(code, "update", json_mknumber(1, 0));
+		json_append_member(openweathermap->message, "message", code);
+		json_append_member(openweathermap->message, "origin", json_mkstring("receiver"));
+		json_append_member(openweathermap->message, "protocol", json_mkstring(openweathermap->id));
+		if(pilight.broadcast != NULL) {
+			pilight.broadcast(openweathermap->id, openweathermap->message, PROTOCOL);
+		}
+		json_delete(openweathermap->message);
+		openweathermap->message = NULL;
 	}
+	wnode->firstrun = 0;
 	pthread_mutex_unlock(&lock);
-
-	threads--;
-	return (void *)NULL;
 }
 
 static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
+	struct JsonNode *jid = NULL;
+	struct JsonNode *jchild = NULL;
+	struct JsonNode *jchild1 = NULL;
+	struct settings_t *wnode = NULL;
+	double itmp = 0;
+
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(wnode, '\0', sizeof(struct settings_t));
 
-	struct protocol_threads_t *node = protocol_thread_init(openweathermap, json);
-	return threads_register("openweathermap", &openweathermapParse, (void *)node, 0);
+	if((jid = json_find_member(jdevice, "id"))) {
+		jchild = json_first_child(jid);
+		while(jchild) {
+			jchild1 = json_first_child(jchild);
+			while(jchild1) {
+				if(strcmp(jchild1->key, "location") == 0) {
+					if((wnode->location = REALLOC(wnode->location, strlen(jchild1->string_)+1)) == NULL) {
+						fprintf(stderr, "out of memory\n");
+						exit(EXIT_FAILURE);
+					}
+					strcpy(wnode->location, jchild1->string_);
+				}
+				if(strcmp(jchild1->key, "country") == 0) {
+					if((wnode->country = REALLOC(wnode->country, strlen(jchild1->string_)+1)) == NULL) {
+						fprintf(stderr, "out of memory\n");
+						exit(EXIT_FAILURE);
+					}
+					strcpy(wnode->country, jchild1->string_);
+				}
+				jchild1 = jchild1->next;
+			}
+			jchild = jchild->next;
+		}
+	}
+
+	if(wnode->location == NULL || wnode->country == NULL) {
+		if(wnode->location != NULL) {
+			FREE(wnode->location);
+		}
+		if(wnode->country != NULL) {
+			FREE(wnode->country);
+		}
+		FREE(wnode);
+		return NULL;
+	}
+
+	wnode->interval = 86400;
+	if(json_find_number(jdevice, "poll-interval", &itmp) == 0)
+		wnode->interval = (int)round(itmp);
+	wnode->ointerval = wnode->interval;
+	wnode->firstrun = 1;
+
+	wnode->next = settings;
+	settings = wnode;
+
+	wnode->timer = timer_add("openweathermap", 1000, INTERVAL*1000, 0, &poll, (void *)wnode);
+	return NULL;
 }
 
 static int checkValues(JsonNode *code) {
@@ -348,8 +329,8 @@ static int createCode(JsonNode *code) {
 			if(strcmp(wtmp->country, country) == 0
 			   && strcmp(wtmp->location, location) == 0) {
 				if((currenttime-wtmp->update) > INTERVAL) {
-					pthread_mutex_unlock(&wtmp->thread->mutex);
-					pthread_cond_signal(&wtmp->thread->cond);
+					wtmp->forced = 1;
+					timer_trigger(wtmp->timer);
 					wtmp->update = time(NULL);
 				}
 			}
@@ -363,16 +344,10 @@ static int createCode(JsonNode *code) {
 }
 
 static void threadGC(void) {
-	loop = 0;
-	protocol_thread_stop(openweathermap);
-	while(threads > 0) {
-		usleep(10);
-	}
-	protocol_thread_free(openweathermap);
-
 	struct settings_t *wtmp = NULL;
 	while(settings) {
 		wtmp = settings;
+		timer_cancel(wtmp->timer);
 		FREE(settings->country);
 		FREE(settings->location);
 		settings = settings->next;
@@ -434,7 +409,7 @@ void openweathermapInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "openweathermap";
-	module->version = "1.12";
+	module->version = "1.13";
 	module->reqversion = "6.0";
 	module->reqcommit = "84";
 }
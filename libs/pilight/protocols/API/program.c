@@ -44,12 +44,10 @@
 #include "../../core/binary.h"
 #include "../../core/json.h"
 #include "../../core/gc.h"
+#include "../../core/timer.h"
 #include "program.h"
 
 #ifndef _WIN32
-static unsigned short loop = 1;
-static unsigned short threads = 0;
-
 static pthread_mutex_t lock;
 static pthread_mutexattr_t attr;
 
@@ -64,32 +62,67 @@ typedef struct settings_t {
 	int laststate;
 	pthread_t pth;
 	int hasthread;
-	protocol_threads_t *thread;
+	struct timer_task_t *timer;
 	struct settings_t *next;
 } settings_t;
 
 static struct settings_t *settings = NULL;
 
-static void *thread(void *param) {
-	struct protocol_threads_t *pnode = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)pnode->param;
+static void poll(void *param) {
+	struct settings_t *lnode = (struct settings_t *)param;
+	int pid = 0;
+
+	pthread_mutex_lock(&lock);
+	if(lnode->wait == 0) {
+		struct JsonNode *message = json_mkobject();
+
+		JsonNode *code = json_mkobject();
+		json_append_member(code, "name", json_mkstring(lnode->name));
+
+		if((pid = (int)findproc(lnode->program, lnode->arguments, 0)) > 0) {
+			lnode->currentstate = 1;
+			json_append_member(code, "state", json_mkstring("running"));
+			json_append_member(code, "pid", json_mknumber((int)pid, 0));
+		} else {
+			lnode->currentstate = 0;
+			json_append_member(code, "state", json_mkstring("stopped"));
+			json_append_member(code, "pid", json_mknumber(0, 0));
+		}
+		json_append_member(message, "message", code);
+		json_append_member(message, "origin", json_mkstring("receiver"));
+		json_append_member(message, "protocol", json_mkstring(program->id));
+
+		if(lnode->currentstate != lnode->laststate) {
+			lnode->laststate = lnode->currentstate;
+			if(pilight.broadcast != NULL) {
+				pilight.broadcast(program->id, message, PROTOCOL);
+			}
+		}
+		json_delete(message);
+		message = NULL;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static struct threadqueue_t *initDev(JsonNode *jdevice) {
 	struct JsonNode *jid = NULL;
 	struct JsonNode *jchild = NULL;
 	struct JsonNode *jchild1 = NULL;
 	char *prog = NULL, *args = NULL, *stopcmd = NULL, *startcmd = NULL;
 
-	int interval = 1, nrloops = 0;
-	int pid = 0;
+	int interval = 1;
 	double itmp = 0;
 
-	threads++;
-
-	json_find_string(json, "program", &prog);
-	json_find_string(json, "arguments", &args);
-	json_find_string(json, "stop-command", &stopcmd);
-	json_find_string(json, "start-command", &startcmd);
+	json_find_string(jdevice, "program", &prog);
+	json_find_string(jdevice, "arguments", &args);
+	json_find_string(jdevice, "stop-command", &stopcmd);
+	json_find_string(jdevice, "start-command", &startcmd);
 
-	struct settings_t *lnode = MALLOC(sizeof(struct settings_t));
+	struct settings_t *lnode = NULL;
+	if((lnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
 	lnode->wait = 0;
 	lnode->hasthread = 0;
 	memset(&lnode->pth, '\0', sizeof(pthread_t));
@@ -135,7 +168,7 @@ static void *thread(void *param) {
 	}
 
 	lnode->name = NULL;
-	if((jid = json_find_member(json, "id"))) {
+	if((jid = json_find_member(jdevice, "id"))) {
 		jchild = json_first_child(jid);
 		while(jchild) {
 			jchild1 = json_first_child(jchild);
@@ -153,63 +186,16 @@ static void *thread(void *param) {
 		}
 	}
 
-	lnode->thread = pnode;
 	lnode->laststate = -1;
 
 	lnode->next = settings;
 	settings = lnode;
 
-	if(json_find_number(json, "poll-interval", &itmp) == 0)
+	if(json_find_number(jdevice, "poll-interval", &itmp) == 0)
 		interval = (int)round(itmp);
 
-	while(loop) {
-		if(protocol_thread_wait(pnode, interval, &nrloops) == ETIMEDOUT) {
-			pthread_mutex_lock(&lock);
-			if(lnode->wait == 0) {
-				struct JsonNode *message = json_mkobject();
-
-				JsonNode *code = json_mkobject();
-				json_append_member(code, "name", json_mkstring(lnode->name));
-
-				if((pid = (int)findproc(lnode->program, lnode->arguments, 0)) > 0) {
-					lnode->currentstate = 1;
-					json_append_member(code, "state", json_mkstring("running"));
-					json_append_member(code, "pid", json_mknumber((int)pid, 0));
-				} else {
-					lnode->currentstate = 0;
-					json_append_member(code, "state", json_mkstring("stopped"));
-					json_append_member(code, "pid", json_mknumber(0, 0));
-				}
-				json_append_member(message, "message", code);
-				json_append_member(message, "origin", json_mkstring("receiver"));
-				json_append_member(message, "protocol", json_mkstring(program->id));
-
-				if(lnode->currentstate != lnode->laststate) {
-					lnode->laststate = lnode->currentstate;
-					if(pilight.broadcast != NULL) {
-						pilight.broadcast(program->id, message, PROTOCOL);
-					}
-				}
-				json_delete(message);
-				message = NULL;
-			}
-			pthread_mutex_unlock(&lock);
-		}
-	}
-	pthread_mutex_unlock(&lock);
-
-	threads--;
-	return (void *)NULL;
-}
-
-static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
-
-	struct protocol_threads_t *node = protocol_thread_init(program, json);
-	return threads_register("program", &thread, (void *)node, 0);
+	lnode->timer = timer_add("program", 1000, interval*1000, 0, &poll, (void *)lnode);
+	return NULL;
 }
 
 static void *execute(void *param) {
@@ -238,8 +224,7 @@ static void *execute(void *param) {
 	p->hasthread = 0;
 	p->laststate = -1;
 
-	pthread_mutex_unlock(&p->thread->mutex);
-	pthread_cond_signal(&p->thread->cond);
+	timer_trigger(p->timer);
 
 	return NULL;
 }
@@ -329,16 +314,10 @@ static int createCode(JsonNode *code) {
 }
 
 static void threadGC(void) {
-	loop = 0;
-	protocol_thread_stop(program);
-	while(threads > 0) {
-		usleep(10);
-	}
-	protocol_thread_free(program);
-
 	struct settings_t *tmp;
 	while(settings) {
 		tmp = settings;
+		timer_cancel(tmp->timer);
 		if(tmp->stop) FREE(tmp->stop);
 		if(tmp->start) FREE(tmp->start);
 		if(tmp->name) FREE(tmp->name);
@@ -402,7 +381,7 @@ void programInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "program";
-	module->version = "1.6";
+	module->version = "1.7";
 	module->reqversion = "6.0";
 	module->reqcommit = "84";
 }
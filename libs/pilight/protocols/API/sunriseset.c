@@ -42,14 +42,29 @@
 #include "../protocol.h"
 #include "../../core/json.h"
 #include "../../core/gc.h"
+#include "../../core/timer.h"
 #include "sunriseset.h"
 
 #define PI 3.1415926
 #define PIX 57.29578049044297 // 180 / PI
 #define ZENITH 90.83333333333333
 
-static unsigned short loop = 1;
-static unsigned short threads = 0;
+typedef struct settings_t {
+	double longitude;
+	double latitude;
+	char *tz;
+	int target_offset;
+	int risetime;
+	int settime;
+	int dst;
+	int dstchange;
+	int x;
+	struct timer_task_t *timer;
+	struct settings_t *next;
+} settings_t;
+
+static struct settings_t *settings = NULL;
+static char UTC[] = "UTC";
 
 static double calculate(int year, int month, int day, double lon, double lat, int rising, int tz) {
 	int N = (int)((floor(275 * month / 9)) - ((floor((month + 9) / 12)) *
@@ -103,169 +118,166 @@ static double calculate(int year, int month, int day, double lon, double lat, in
 	return ((round(hour)+min)+tz)*100;
 }
 
-static void *thread(void *param) {
-	struct protocol_threads_t *thread = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)thread->param;
-	struct JsonNode *jid = NULL;
-	struct JsonNode *jchild = NULL;
-	struct JsonNode *jchild1 = NULL;
-	double longitude = 0, latitude = 0;
-	char UTC[] = "UTC", *tz = NULL;
-
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
 	time_t timenow = 0;
 	struct tm tm;
-	int nrloops = 0, risetime = 0, settime = 0, hournow = 0, newdst = 0;
-	int firstrun = 0, target_offset = 0, x = 0, dst = 0, dstchange = 0;
+	int hournow = 0, newdst = 0, firstrun = 0;
 	int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
 
-	threads++;
+	/* Looking up the timezone is expensive so it is done on the first run */
+	if(wnode->tz == NULL) {
+		if((wnode->tz = coord2tz(wnode->longitude, wnode->latitude)) == NULL) {
+			logprintf(LOG_DEBUG, "could not determine timezone");
+			wnode->tz = UTC;
+		} else {
+			logprintf(LOG_DEBUG, "%.6f:%.6f seems to be in timezone: %s", wnode->longitude, wnode->latitude, wnode->tz);
+		}
 
-	if((jid = json_find_member(json, "id"))) {
-		jchild = json_first_child(jid);
-		while(jchild) {
-			jchild1 = json_first_child(jchild);
-			while(jchild1) {
-				if(strcmp(jchild1->key, "longitude") == 0) {
-					longitude = jchild1->number_;
-				}
-				if(strcmp(jchild1->key, "latitude") == 0) {
-					latitude = jchild1->number_;
-				}
-				jchild1 = jchild1->next;
-			}
-			jchild = jchild->next;
+		timenow = time(NULL);
+		timenow -= getntpdiff();
+		wnode->dst = isdst(timenow, wnode->tz);
+		if(isntpsynced() == 0) {
+			wnode->x = 1;
 		}
-	}
 
-	if((tz = coord2tz(longitude, latitude)) == NULL) {
-		logprintf(LOG_DEBUG, "could not determine timezone");
-		tz = UTC;
-	} else {
-		logprintf(LOG_DEBUG, "%.6f:%.6f seems to be in timezone: %s", longitude, latitude, tz);
+		/* Check how many hours we differ from UTC? */
+		wnode->target_offset = tzoffset(UTC, wnode->tz);
 	}
 
 	timenow = time(NULL);
 	timenow -= getntpdiff();
-	dst = isdst(timenow, tz);
-	if(isntpsynced() == 0) {
-		x = 1;
-	}
 
-	/* Check how many hours we differ from UTC? */
-	target_offset = tzoffset(UTC, tz);
-
-	while(loop) {
-		protocol_thread_wait(thread, 1, &nrloops);
-		timenow = time(NULL);
-		timenow -= getntpdiff();
-
-			/* Get UTC time */
+	/* Get UTC time */
 #ifdef _WIN32
-		struct tm *tm1;
-		if((tm1 = gmtime(&timenow)) != NULL) {
-			memcpy(&tm, tm1, sizeof(struct tm));
+	struct tm *tm1;
+	if((tm1 = gmtime(&timenow)) != NULL) {
+		memcpy(&tm, tm1, sizeof(struct tm));
 #else
-		if(gmtime_r(&timenow, &tm) != NULL) {
+	if(gmtime_r(&timenow, &tm) != NULL) {
 #endif
-			year = tm.tm_year+1900;
-			month = tm.tm_mon+1;
-			day = tm.tm_mday;
-			/* Add our hour difference to the UTC time */
-			tm.tm_hour += target_offset;
-			/* Add possible daylist savings time hour */
-			tm.tm_hour += dst;
-			hour = tm.tm_hour;
-			minute = tm.tm_min;
-			second = tm.tm_sec;
-
-			datefix(&year, &month, &day, &hour, &minute, &second);
-
-			if((minute == 0 && second == 1) || (isntpsynced() == 0 && x == 0)) {
-				x = 1;
-				if((newdst = isdst(timenow, tz)) != dst) {
-					dstchange = 1;
-				} else {
-					dstchange = 0;
-				}
-				dst = newdst;
+		year = tm.tm_year+1900;
+		month = tm.tm_mon+1;
+		day = tm.tm_mday;
+		/* Add our hour difference to the UTC time */
+		tm.tm_hour += wnode->target_offset;
+		/* Add possible daylist savings time hour */
+		tm.tm_hour += wnode->dst;
+		hour = tm.tm_hour;
+		minute = tm.tm_min;
+		second = tm.tm_sec;
+
+		datefix(&year, &month, &day, &hour, &minute, &second);
+
+		if((minute == 0 && second == 1) || (isntpsynced() == 0 && wnode->x == 0)) {
+			wnode->x = 1;
+			if((newdst = isdst(timenow, wnode->tz)) != wnode->dst) {
+				wnode->dstchange = 1;
+			} else {
+				wnode->dstchange = 0;
 			}
+			wnode->dst = newdst;
+		}
 
-			hournow = (hour*100)+minute;
-			if(((hournow == 0 || hournow == risetime || hournow == settime) && second == 0)
-				 || (settime == 0 && risetime == 0) || dstchange == 1) {
+		hournow = (hour*100)+minute;
+		if(((hournow == 0 || hournow == wnode->risetime || hournow == wnode->settime) && second == 0)
+			 || (wnode->settime == 0 && wnode->risetime == 0) || wnode->dstchange == 1) {
 
-				if(settime == 0 && risetime == 0) {
-					firstrun = 1;
-				}
+			if(wnode->settime == 0 && wnode->risetime == 0) {
+				firstrun = 1;
+			}
 
-				sunriseset->message = json_mkobject();
-				JsonNode *code = json_mkobject();
-				risetime = (int)calculate(year, month, day, longitude, latitude, 1, target_offset);
-				settime = (int)calculate(year, month, day, longitude, latitude, 0, target_offset);
-
-				if(dst == 1) {
-					risetime += 100;
-					settime += 100;
-					if(risetime > 2400) {
-						risetime -= 2400;
-					}
-					if(settime > 2400) {
-						settime -= 2400;
-					}
-				}
+			sunriseset->message = json_mkobject();
+			JsonNode *code = json_mkobject();
+			wnode->risetime = (int)calculate(year, month, day, wnode->longitude, wnode->latitude, 1, wnode->target_offset);
+			wnode->settime = (int)calculate(year, month, day, wnode->longitude, wnode->latitude, 0, wnode->target_offset);
 
-				json_append_member(code, "longitude", json_mknumber(longitude, 6));
-				json_append_member(code, "latitude", json_mknumber(latitude, 6));
-
-				/* Only communicate the sun state change when they actually occur,
-					 and only communicate the new times when the day changes */
-				if(hournow != 0 || firstrun == 1) {
-					if(hournow >= risetime && hournow < settime) {
-						json_append_member(code, "sun", json_mkstring("rise"));
-					} else {
-						json_append_member(code, "sun", json_mkstring("set"));
-					}
+			if(wnode->dst == 1) {
+				wnode->risetime += 100;
+				wnode->settime += 100;
+				if(wnode->risetime > 2400) {
+					wnode->risetime -= 2400;
 				}
-				if(hournow == 0 || firstrun == 1) {
-					json_append_member(code, "sunrise", json_mknumber(((double)risetime/100), 2));
-					json_append_member(code, "sunset", json_mknumber(((double)settime/100), 2));
+				if(wnode->settime > 2400) {
+					wnode->settime -= 2400;
 				}
+			}
 
-				json_append_member(sunriseset->message, "message", code);
-				json_append_member(sunriseset->message, "origin", json_mkstring("receiver"));
-				json_append_member(sunriseset->message, "protocol", json_mkstring(sunriseset->id));
+			json_append_member(code, "longitude", json_mknumber(wnode->longitude, 6));
+			json_append_member(code, "latitude", json_mknumber(wnode->latitude, 6));
 
-				if(pilight.broadcast != NULL) {
-					pilight.broadcast(sunriseset->id, sunriseset->message, PROTOCOL);
+			/* Only communicate the sun state change when they actually occur,
+				 and only communicate the new times when the day changes */
+			if(hournow != 0 || firstrun == 1) {
+				if(hournow >= wnode->risetime && hournow < wnode->settime) {
+					json_append_member(code, "sun", json_mkstring("rise"));
+				} else {
+					json_append_member(code, "sun", json_mkstring("set"));
 				}
-				json_delete(sunriseset->message);
-				sunriseset->message = NULL;
-				firstrun = 0;
 			}
+			if(hournow == 0 || firstrun == 1) {
+				json_append_member(code, "sunrise", json_mknumber(((double)wnode->risetime/100), 2));
+				json_append_member(code, "sunset", json_mknumber(((double)wnode->settime/100), 2));
+			}
+
+			json_append_member(sunriseset->message, "message", code);
+			json_append_member(sunriseset->message, "origin", json_mkstring("receiver"));
+			json_append_member(sunriseset->message, "protocol", json_mkstring(sunriseset->id));
+
+			if(pilight.broadcast != NULL) {
+				pilight.broadcast(sunriseset->id, sunriseset->message, PROTOCOL);
+			}
+			json_delete(sunriseset->message);
+			sunriseset->message = NULL;
 		}
 	}
-
-	threads--;
-	return (void *)NULL;
 }
 
 static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
+	struct JsonNode *jid = NULL;
+	struct JsonNode *jchild = NULL;
+	struct JsonNode *jchild1 = NULL;
+	struct settings_t *wnode = NULL;
 
-	struct protocol_threads_t *node = protocol_thread_init(sunriseset, json);
-	return threads_register("sunriseset", &thread, (void *)node, 0);
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(wnode, '\0', sizeof(struct settings_t));
+
+	if((jid = json_find_member(jdevice, "id"))) {
+		jchild = json_first_child(jid);
+		while(jchild) {
+			jchild1 = json_first_child(jchild);
+			while(jchild1) {
+				if(strcmp(jchild1->key, "longitude") == 0) {
+					wnode->longitude = jchild1->number_;
+				}
+				if(strcmp(jchild1->key, "latitude") == 0) {
+					wnode->latitude = jchild1->number_;
+				}
+				jchild1 = jchild1->next;
+			}
+			jchild = jchild->next;
+		}
+	}
+
+	wnode->next = settings;
+	settings = wnode;
+
+	wnode->timer = timer_add_clock("sunriseset", 1000, 1000, 0, &poll, (void *)wnode);
+	return NULL;
 }
 
 static void threadGC(void) {
-	loop = 0;
-	protocol_thread_stop(sunriseset);
-	while(threads > 0) {
-		usleep(10);
+	struct settings_t *wtmp = NULL;
+
+	while(settings) {
+		wtmp = settings;
+		timer_cancel(wtmp->timer);
+		settings = settings->next;
+		FREE(wtmp);
 	}
-	protocol_thread_free(sunriseset);
 }
 
 static int checkValues(JsonNode *code) {
@@ -312,7 +324,7 @@ void sunRiseSetInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "sunriseset";
-	module->version = "2.6";
+	module->version = "2.7";
 	module->reqversion = "6.0";
 	module->reqcommit = "115";
 }
@@ -44,6 +44,7 @@
 #include "../../core/binary.h"
 #include "../../core/json.h"
 #include "../../core/gc.h"
+#include "../../core/timer.h"
 #include "wunderground.h"
 
 #define INTERVAL	900
@@ -53,7 +54,12 @@ typedef struct settings_t {
 	char *country;
 	char *location;
 	time_t update;
-	protocol_threads_t *thread;
+	int interval;
+	int ointerval;
+	int timeout;
+	int firstrun;
+	int forced;
+	struct timer_task_t *timer;
 	struct settings_t *next;
 } settings_t;
 
@@ -61,26 +67,16 @@ static pthread_mutex_t lock;
 static pthread_mutexattr_t attr;
 
 static struct settings_t *settings;
-static unsigned short loop = 1;
-static unsigned short threads = 0;
 
-static void *thread(void *param) {
-	struct protocol_threads_t *thread = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)thread->param;
-	struct JsonNode *jid = NULL;
-	struct JsonNode *jchild = NULL;
-	struct JsonNode *jchild1 = NULL;
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
 	struct JsonNode *node = NULL;
-	struct settings_t *wnode = MALLOC(sizeof(struct settings_t));
-
-	int interval = 86400, ointerval = 86400, event = 0;
-	int firstrun = 1, nrloops = 0, timeout = 0;
 
 	char url[1024];
 	char *filename = NULL, *data = NULL;
 	char typebuf[255], *tp = typebuf;
 	char *stmp = NULL;
-	double temp = 0, itmp = -1;
+	double temp = 0;
 	int humi = 0, ret = 0, size = 0;
 
 	JsonNode *jdata = NULL;
@@ -92,272 +88,260 @@ static void *thread(void *param) {
 	char *shour = NULL, *smin = NULL;
 	char *rhour = NULL, *rmin = NULL;
 
-	memset(&typebuf, '\0', 255);
-
-	if(wnode == NULL) {
-		fprintf(stderr, "out of memory\n");
-		exit(EXIT_FAILURE);
-	}
-
 	time_t timenow = 0;
 
-	threads++;
-
-	int has_country = 0, has_api = 0, has_location = 0;
-	if((jid = json_find_member(json, "id"))) {
-		jchild = json_first_child(jid);
-		while(jchild) {
-			has_country = 0, has_api = 0, has_location = 0;
-			jchild1 = json_first_child(jchild);
-
-			while(jchild1) {
-				if(strcmp(jchild1->key, "api") == 0) {
-					has_api = 1;
-					if((wnode->api = MALLOC(strlen(jchild1->string_)+1)) == NULL) {
-						fprintf(stderr, "out of memory\n");
-						exit(EXIT_FAILURE);
-					}
-					strcpy(wnode->api, jchild1->string_);
-				}
-				if(strcmp(jchild1->key, "location") == 0) {
-					has_location = 1;
-					if((wnode->location = MALLOC(strlen(jchild1->string_)+1)) == NULL) {
-						fprintf(stderr, "out of memory\n");
-						exit(EXIT_FAILURE);
-					}
-					strcpy(wnode->location, jchild1->string_);
-				}
-				if(strcmp(jchild1->key, "country") == 0) {
-					has_country = 1;
-					if((wnode->country = MALLOC(strlen(jchild1->string_)+1)) == NULL) {
-						fprintf(stderr, "out of memory\n");
-						exit(EXIT_FAILURE);
-					}
-					strcpy(wnode->country, jchild1->string_);
-				}
-				jchild1 = jchild1->next;
-			}
-			if(has_country == 1 && has_api == 1 && has_location == 1) {
-				wnode->thread = thread;
-				wnode->next = settings;
-				settings = wnode;
-			} else {
-				if(has_country == 1) {
-					FREE(wnode->country);
-				}
-				if(has_location == 1) {
-					FREE(wnode->location);
-				}
-				if(has_api == 1) {
-					FREE(wnode->api);
-				}
-				FREE(wnode);
-				wnode = NULL;
-			}
-			jchild = jchild->next;
-		}
-	}
-
-	if(!wnode) {
-		return 0;
-	}
-
-	if(json_find_number(json, "poll-interval", &itmp) == 0)
-		interval = (int)round(itmp);
-	ointerval = interval;
+	memset(&typebuf, '\0', 255);
 
-	while(loop) {
-		event = protocol_thread_wait(thread, INTERVAL, &nrloops);
+	pthread_mutex_lock(&lock);
+	wnode->timeout += INTERVAL;
+	if(wnode->timeout >= wnode->interval || wnode->forced == 1 || wnode->firstrun == 1) {
+		wnode->forced = 0;
+		wnode->timeout = 0;
+		wnode->interval = wnode->ointerval;
+		data = NULL;
+		sprintf(url, "http://api.wunderground.com/api/%s/geolookup/conditions/q/%s/%s.json", wnode->api, wnode->country, wnode->location);
+		/* Other devices can go ahead while we wait for the server */
+		pthread_mutex_unlock(&lock);
+		data = http_get_content(url, &tp, &ret, &size);
 		pthread_mutex_lock(&lock);
-		if(loop == 0) {
-			break;
-		}
-		timeout += INTERVAL;
-		if(timeout >= interval || event != ETIMEDOUT || firstrun == 1) {
-			timeout = 0;
-			interval = ointerval;
-			data = NULL;
-			sprintf(url, "http://api.wunderground.com/api/%s/geolookup/conditions/q/%s/%s.json", wnode->api, wnode->country, wnode->location);
-			data = http_get_content(url, &tp, &ret, &size);
-			if(ret == 200) {
-				if(strstr(typebuf, "application/json") != NULL) {
-					if(json_validate(data) == true) {
-						if((jdata = json_decode(data)) != NULL) {
-							if((jobs = json_find_member(jdata, "current_observation")) != NULL) {
-								if((node = json_find_member(jobs, "temp_c")) == NULL) {
+		if(ret == 200) {
+			if(strstr(typebuf, "application/json") != NULL) {
+				if(json_validate(data) == true) {
+					if((jdata = json_decode(data)) != NULL) {
+						if((jobs = json_find_member(jdata, "current_observation")) != NULL) {
+							if((node = json_find_member(jobs, "temp_c")) == NULL) {
+								printf("api.wunderground.com json has no temp_c key");
+							} else if(json_find_string(jobs, "relative_humidity", &stmp) != 0) {
+								printf("api.wunderground.com json has no relative_humidity key");
+							} else {
+								if(node->tag != JSON_NUMBER) {
 									printf("api.wunderground.com json has no temp_c key");
-								} else if(json_find_string(jobs, "relative_humidity", &stmp) != 0) {
-									printf("api.wunderground.com json has no relative_humidity key");
 								} else {
-									if(node->tag != JSON_NUMBER) {
-										printf("api.wunderground.com json has no temp_c key");
-									} else {
-										if(data) {
-											FREE(data);
-											data = NULL;
-										}
+									if(data) {
+										FREE(data);
+										data = NULL;
+									}
 
-										sprintf(url, "http://api.wunderground.com/api/%s/astronomy/q/%s/%s.json", wnode->api, wnode->country, wnode->location);
-										data = http_get_content(url, &tp, &ret, &size);
-										if(ret == 200) {
-											if(strcmp(typebuf, "application/json") == 0) {
-												if(json_validate(data) == true) {
-													if((jdata1 = json_decode(data)) != NULL) {
-														if((jsun = json_find_member(jdata1, "sun_phase")) != NULL) {
-															if((jsunr = json_find_member(jsun, "sunrise")) != NULL
-															   && (jsuns = json_find_member(jsun, "sunset")) != NULL) {
-																if(json_find_string(jsuns, "hour", &shour) != 0) {
-																	printf("api.wunderground.com json has no sunset hour key");
-																} else if(json_find_string(jsuns, "minute", &smin) != 0) {
-																	printf("api.wunderground.com json has no sunset minute key");
-																} else if(json_find_string(jsunr, "hour", &rhour) != 0) {
-																	printf("api.wunderground.com json has no sunrise hour key");
-																} else if(json_find_string(jsunr, "minute", &rmin) != 0) {
-																	printf("api.wunderground.com json has no sunrise minute key");
-																} else {
-																	temp = node->number_;
-																	sscanf(stmp, "%d%%", &humi);
+									sprintf(url, "http://api.wunderground.com/api/%s/astronomy/q/%s/%s.json", wnode->api, wnode->country, wnode->location);
+									pthread_mutex_unlock(&lock);
+									data = http_get_content(url, &tp, &ret, &size);
+									pthread_mutex_lock(&lock);
+									if(ret == 200) {
+										if(strcmp(typebuf, "application/json") == 0) {
+											if(json_validate(data) == true) {
+												if((jdata1 = json_decode(data)) != NULL) {
+													if((jsun = json_find_member(jdata1, "sun_phase")) != NULL) {
+														if((jsunr = json_find_member(jsun, "sunrise")) != NULL
+														   && (jsuns = json_find_member(jsun, "sunset")) != NULL) {
+															if(json_find_string(jsuns, "hour", &shour) != 0) {
+																printf("api.wunderground.com json has no sunset hour key");
+															} else if(json_find_string(jsuns, "minute", &smin) != 0) {
+																printf("api.wunderground.com json has no sunset minute key");
+															} else if(json_find_string(jsunr, "hour", &rhour) != 0) {
+																printf("api.wunderground.com json has no sunrise hour key");
+															} else if(json_find_string(jsunr, "minute", &rmin) != 0) {
+																printf("api.wunderground.com json has no sunrise minute key");
+															} else {
+																temp = node->number_;
+																sscanf(stmp, "%d%%", &humi);
 
-																	timenow = time(NULL);
-																	struct tm current;
-																	memset(&current, '\0', sizeof(struct tm));
+																timenow = time(NULL);
+																struct tm current;
+																memset(&current, '\0', sizeof(struct tm));
 #ifdef _WIN32
-																	localtime(&timenow);
+																localtime(&timenow);
 #else
-																	localtime_r(&timenow, &current);
+																localtime_r(&timenow, &current);
 #endif
-																	int month = current.tm_mon+1;
-																	int mday = current.tm_mday;
-																	int year = current.tm_year+1900;
-
-																	time_t midnight = (datetime2ts(year, month, mday, 23, 59, 59, 0)+1);
-																	time_t sunset = 0;
-																	time_t sunrise = 0;
-
-																	wunderground->message = json_mkobject();
-
-																	JsonNode *code = json_mkobject();
-
-																	json_append_member(code, "api", json_mkstring(wnode->api));
-																	json_append_member(code, "location", json_mkstring(wnode->location));
-																	json_append_member(code, "country", json_mkstring(wnode->country));
-																	json_append_member(code, "temperature", json_mknumber((double)temp, 2));
-																	json_append_member(code, "humidity", json_mknumber((double)humi, 0));
-																	json_append_member(code, "update", json_mknumber(0, 0));
-																	sunrise = datetime2ts(year, month, mday, atoi(rhour), atoi(rmin), 0, 0);
-																	json_append_member(code, "sunrise", json_mknumber((double)((atoi(rhour)*100)+atoi(rmin))/100, 2));
-																	sunset = datetime2ts(year, month, mday, atoi(shour), atoi(smin), 0, 0);
-																	json_append_member(code, "sunset", json_mknumber((double)((atoi(shour)*100)+atoi(smin))/100, 2));
-																	if(timenow > sunrise && timenow < sunset) {
-																		json_append_member(code, "sun", json_mkstring("rise"));
-																	} else {
-																		json_append_member(code, "sun", json_mkstring("set"));
-																	}
+																int month = current.tm_mon+1;
+																int mday = current.tm_mday;
+																int year = current.tm_year+1900;
+
+																time_t midnight = (datetime2ts(year, month, mday, 23, 59, 59, 0)+1);
+																time_t sunset = 0;
+																time_t sunrise = 0;
+
+																wunderground->message = json_mkobject();
+
+																JsonNode *code = json_mkobject();
+
+																json_append_member(code, "api", json_mkstring(wnode->api));
+																json_append_member(code, "location", json_mkstring(wnode->location));
+																json_append_member(code, "country", json_mkstring(wnode->country));
+																json_append_member(code, "temperature", json_mknumber((double)temp, 2));
+																json_append_member(code, "humidity", json_mknumber((double)humi, 0));
+																json_append_member(code, "update", json_mknumber(0, 0));
+																sunrise = datetime2ts(year, month, mday, atoi(rhour), atoi(rmin), 0, 0);
+																json_append_member(code, "sunrise", json_mknumber((double)((atoi(rhour)*100)+atoi(rmin))/100, 2));
+																sunset = datetime2ts(year, month, mday, atoi(shour), atoi(smin), 0, 0);
+																json_append_member(code, "sunset", json_mknumber((double)((atoi(shour)*100)+atoi(smin))/100, 2));
+																if(timenow > sunrise && timenow < sunset) {
+																	json_append_member(code, "sun", json_mkstring("rise"));
+																} else {
+																	json_append_member(code, "sun", json_mkstring("set"));
+																}
 
-																	json_append_member(wunderground->message, "message", code);
-																	json_append_member(wunderground->message, "origin", json_mkstring("receiver"));
-																	json_append_member(wunderground->message, "protocol", json_mkstring(wunderground->id));
+																json_append_member(wunderground->message, "message", code);
+																json_append_member(wunderground->message, "origin", json_mkstring("receiver"));
+																json_append_member(wunderground->message, "protocol", json_mkstring(wunderground->id));
 
-																	if(pilight.broadcast != NULL) {
-																		pilight.broadcast(wunderground->id, wunderground->message, PROTOCOL);
+																if(pilight.broadcast != NULL) {
+																	pilight.broadcast(wunderground->id, wunderground->message, PROTOCOL);
+																}
+																json_delete(wunderground->message);
+																wunderground->message = NULL;
+																/* Send message when sun rises */
+																if(sunrise > timenow) {
+																	if((sunrise-timenow) < wnode->ointerval) {
+																		wnode->interval = (int)(sunrise-timenow);
 																	}
-																	json_delete(wunderground->message);
-																	wunderground->message = NULL;
-																	/* Send message when sun rises */
-																	if(sunrise > timenow) {
-																		if((sunrise-timenow) < ointerval) {
-																			interval = (int)(sunrise-timenow);
-																		}
-																	/* Send message when sun sets */
-																	} else if(sunset > timenow) {
-																		if((sunset-timenow) < ointerval) {
-																			interval = (int)(sunset-timenow);
-																		}
-																	/* Update all values when a new day arrives */
-																	} else {
-																		if((midnight-timenow) < ointerval) {
-																			interval = (int)(midnight-timenow);
-																		}
+																/* Send message when sun sets */
+																} else if(sunset > timenow) {
+																	if((sunset-timenow) < wnode->ointerval) {
+																		wnode->interval = (int)(sunset-timenow);
+																	}
+																/* Update all values when a new day arrives */
+																} else {
+																	if((midnight-timenow) < wnode->ointerval) {
+																		wnode->interval = (int)(midnight-timenow);
 																	}
-
-																	wnode->update = time(NULL);
 																}
-															} else {
-																logprintf(LOG_NOTICE, "api.wunderground.com json has no sunset and/or sunrise key");
+
+																wnode->update = time(NULL);
 															}
 														} else {
-															logprintf(LOG_NOTICE, "api.wunderground.com json has no sun_phase key");
+															logprintf(LOG_NOTICE, "api.wunderground.com json has no sunset and/or sunrise key");
 														}
-														json_delete(jdata1);
 													} else {
-														logprintf(LOG_NOTICE, "api.wunderground.com json could not be parsed");
+														logprintf(LOG_NOTICE, "api.wunderground.com json has no sun_phase key");
 													}
-												}  else {
-													logprintf(LOG_NOTICE, "api.wunderground.com response was not in a valid json format");
+													json_delete(jdata1);
+												} else {
+													logprintf(LOG_NOTICE, "api.wunderground.com json could not be parsed");
 												}
-											} else {
-													logprintf(LOG_NOTICE, "api.wunderground.com response was not in a valid json format");
+											}  else {
+												logprintf(LOG_NOTICE, "api.wunderground.com response was not in a valid json format");
 											}
 										} else {
-											logprintf(LOG_NOTICE, "could not reach api.wundergrond.com");
+												logprintf(LOG_NOTICE, "api.wunderground.com response was not in a valid json format");
 										}
+									} else {
+										logprintf(LOG_NOTICE, "could not reach api.wundergrond.com");
 									}
 								}
-							} else {
-								logprintf(LOG_NOTICE, "api.wunderground.com json has no current_observation key");
 							}
-							json_delete(jdata);
 						} else {
-							logprintf(LOG_NOTICE, "api.wunderground.com json could not be parsed");
+							logprintf(LOG_NOTICE, "api.wunderground.com json has no current_observation key");
 						}
+						json_delete(jdata);
 					} else {
-						logprintf(LOG_NOTICE, "api.wunderground.com response was not in a valid json format");
+						logprintf(LOG_NOTICE, "api.wunderground.com json could not be parsed");
 					}
 				} else {
 					logprintf(LOG_NOTICE, "api.wunderground.com response was not in a valid json format");
 				}
 			} else {
-				logprintf(LOG_NOTICE, "could not reach api.wundergrond.com");
-			}
-			if(data) {
-				FREE(data);
-			}
-			if(filename) {
-				FREE(filename);
+				logprintf(LOG_NOTICE, "api.wunderground.com response was not in a valid json format");
 			}
 		} else {
-			wunderground->message = json_mkobject();
-			JsonNode *code = json_mkobject();
-			json_append_member(code, "api", json_mkstring(wnode->api));
-			json_append_member(code, "location", json_mkstring(wnode->location));
-			json_append_member(code, "country", json_mkstring(wnode->country));
-			json_append_member(code, "update", json_mknumber(1, 0));
-			json_append_member(wunderground->message, "message", code);
-			json_append_member(wunderground->message, "origin", json_mkstring("receiver"));
-			json_append_member(wunderground->message, "protocol", json_mkstring(wunderground->id));
-			if(pilight.broadcast != NULL) {
-				pilight.broadcast(wunderground->id, wunderground->message, PROTOCOL);
-			}
-			json_delete(wunderground->message);
-			wunderground->message = NULL;
+			logprintf(LOG_NOTICE, "could not reach api.wundergrond.com");
 		}
-		firstrun = 0;
-		pthread_mutex_unlock(&lock);
+		if(data) {
+			FREE(data);
+		}
+		if(filename) {
+			FREE(filename);
+		}
+	} else {
+		wunderground->message = json_mkobject();
+		JsonNode *code = json_mkobject();
+		json_append_member(code, "api", json_mkstring(wnode->api));
+		json_append_member(code, "location", json_mkstring(wnode->location));
+		json_append_member(code, "country", json_mkstring(wnode->country));
+		json_append_member(code, "update", json_mknumber(1, 0));
+		json_append_member(wunderground->message, "message", code);
+		json_append_member(wunderground->message, "origin", json_mkstring("receiver"));
+		json_append_member(wunderground->message, "protocol", json_mkstring(wunderground->id));
+		if(pilight.broadcast != NULL) {
+			pilight.broadcast(wunderground->id, wunderground->message, PROTOCOL);
+		}
+		json_delete(wunderground->message);
+		wunderground->message = NULL;
 	}
+	wnode->firstrun = 0;
 	pthread_mutex_unlock(&lock);
-
-	threads--;
-	return (void *)NULL;
 }
 
 static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
+	struct JsonNode *jid = NULL;
+	struct JsonNode *jchild = NULL;
+	struct JsonNode *jchild1 = NULL;
+	struct settings_t *wnode = NULL;
+	double itmp = 0;
+
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(wnode, '\0', sizeof(struct settings_t));
+
+	if((jid = json_find_member(jdevice, "id"))) {
+		jchild = json_first_child(jid);
+		while(jchild) {
+			jchild1 = json_first_child(jchild);
+			while(jchild1) {
+				if(strcmp(jchild1->key, "api") == 0) {
+					if((wnode->api = REALLOC(wnode->api, strlen(jchild1->string_)+1)) == NULL) {
+						fprintf(stderr, "out of memory\n");
+						exit(EXIT_FAILURE);
+					}
+					strcpy(wnode->api, jchild1->string_);
+				}
+				if(strcmp(jchild1->key, "location") == 0) {
+					if((wnode->location = REALLOC(wnode->location, strlen(jchild1->string_)+1)) == NULL) {
+						fprintf(stderr, "out of memory\n");
+						exit(EXIT_FAILURE);
+					}
+					strcpy(wnode->location, jchild1->string_);
+				}
+				if(strcmp(jchild1->key, "country") == 0) {
+					if((wnode->country = REALLOC(wnode->country, strlen(jchild1->string_)+1)) == NULL) {
+						fprintf(stderr, "out of memory\n");
+						exit(EXIT_FAILURE);
+					}
+					strcpy(wnode->country, jchild1->string_);
+				}
+				jchild1 = jchild1->next;
+			}
+			jchild = jchild->next;
+		}
+	}
 
-	struct protocol_threads_t *node = protocol_thread_init(wunderground, json);
-	return threads_register("wunderground", &thread, (void *)node, 0);
+	if(wnode->api == NULL || wnode->location == NULL || wnode->country == NULL) {
+		if(wnode->api != NULL) {
+			FREE(wnode->api);
+		}
+		if(wnode->location != NULL) {
+			FREE(wnode->location);
+		}
+		if(wnode->country != NULL) {
+			FREE(wnode->country);
+		}
+		FREE(wnode);
+		return NULL;
+	}
+
+	wnode->interval = 86400;
+	if(json_find_number(jdevice, "poll-interval", &itmp) == 0)
+		wnode->interval = (int)round(itmp);
+	wnode->ointerval = wnode->interval;
+	wnode->firstrun = 1;
+
+	wnode->next = settings;
+	settings = wnode;
+
+	wnode->timer = timer_add("wunderground", 1000, INTERVAL*1000, 0, &poll, (void *)wnode);
+	return NULL;
 }
 
 static int checkValues(JsonNode *code) {
@@ -396,8 +380,8 @@ static int createCode(JsonNode *code) {
 			   && strcmp(wtmp->location, location) == 0
 			   && strcmp(wtmp->api, api) == 0) {
 				if((currenttime-wtmp->update) > INTERVAL) {
-					pthread_mutex_unlock(&wtmp->thread->mutex);
-					pthread_cond_signal(&wtmp->thread->cond);
+					wtmp->forced = 1;
+					timer_trigger(wtmp->timer);
 					wtmp->update = time(NULL);
 				}
 			}
@@ -411,16 +395,10 @@ static int createCode(JsonNode *code) {
 }
 
 static void threadGC(void) {
-	loop = 0;
-	protocol_thread_stop(wunderground);
-	while(threads > 0) {
-		usleep(10);
-	}
-	protocol_thread_free(wunderground);
-
 	struct settings_t *wtmp = NULL;
 	while(settings) {
 		wtmp = settings;
+		timer_cancel(wtmp->timer);
 		FREE(settings->api);
 		FREE(settings->country);
 		FREE(settings->location);
@@ -485,7 +463,7 @@ void wundergroundInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "wunderground";
-	module->version = "1.13";
+	module->version = "1.14";
 	module->reqversion = "6.0";
 	module->reqcommit = "84";
 }
@@ -42,6 +42,7 @@
 #include "../../core/binary.h"
 #include "../../core/gc.h"
 #include "../../core/json.h"
+#include "../../core/timer.h"
 #include "../protocol.h"
 #include "dht22.h"
 
@@ -50,8 +51,17 @@
 #if !defined(__FreeBSD__) && !defined(_WIN32)
 #include "../../../wiringx/wiringX.h"
 
+typedef struct settings_t {
+	int *id;
+	int nrid;
+	double temp_offset;
+	double humi_offset;
+	struct timer_task_t *timer;
+	struct settings_t *next;
+} settings_t;
+
+static struct settings_t *settings = NULL;
 static unsigned short loop = 1;
-static unsigned short threads = 0;
 
 static pthread_mutex_t lock;
 static pthread_mutexattr_t attr;
@@ -67,152 +77,158 @@ static uint8_t sizecvt(const int read_value) {
 	return (uint8_t)read_value;
 }
 
-static void *thread(void *param) {
-	struct protocol_threads_t *node = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)node->param;
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
+	int y = 0, x = 0;
+
+	/* The pins belong to this device, only the message is shared */
+	for(y=0;y<wnode->nrid;y++) {
+		int tries = 5;
+		unsigned short got_correct_date = 0;
+		while(tries && !got_correct_date && loop) {
+
+			uint8_t laststate = HIGH;
+			uint8_t counter = 0;
+			uint8_t j = 0, i = 0;
+
+			int dht22_dat[5] = {0,0,0,0,0};
+
+			// pull pin down for 18 milliseconds
+			pinMode(wnode->id[y], OUTPUT);
+			digitalWrite(wnode->id[y], HIGH);
+			usleep(500000);  // 500 ms
+			// then pull it up for 40 microseconds
+			digitalWrite(wnode->id[y], LOW);
+			usleep(20000);
+			// prepare to read the pin
+			pinMode(wnode->id[y], INPUT);
+
+			// detect change and read data
+			for(i=0; (i<MAXTIMINGS && loop); i++) {
+				counter = 0;
+				delayMicroseconds(10);
+
+				while((x = sizecvt(digitalRead(wnode->id[y]))) == laststate && x != -1 && loop) {
+					counter++;
+					delayMicroseconds(1);
+					if(counter == 255) {
+						break;
+					}
+				}
+				laststate = sizecvt(digitalRead(wnode->id[y]));
+
+				if(counter == 255) {
+					break;
+				}
+
+				// ignore first 3 transitions
+				if((i >= 4) && (i%2 == 0)) {
+					// shove each bit into the storage bytes
+					dht22_dat[(int)((double)j/8)] <<= 1;
+					if(counter > 16)
+						dht22_dat[(int)((double)j/8)] |= 1;
+					j++;
+				}
+			}
+
+			// check we read 40 bits (8bit x 5 ) + verify checksum in the last byte
+			// print it out if data is good
+			if((j >= 40) && (dht22_dat[4] == ((dht22_dat[0] + dht22_dat[1] + dht22_dat[2] + dht22_dat[3]) & 0xFF))) {
+				got_correct_date = 1;
+
+				double h = dht22_dat[0] * 256 + dht22_dat[1];
+				double t = (dht22_dat[2] & 0x7F)* 256 + dht22_dat[3];
+				t += wnode->temp_offset;
+				h += wnode->humi_offset;
+
+				if((dht22_dat[2] & 0x80) != 0)
+					t *= -1;
+
+				pthread_mutex_lock(&lock);
+				dht22->message = json_mkobject();
+				JsonNode *code = json_mkobject();
+				json_append_member(code, "gpio", json_mknumber(wnode->id[y], 0));
+				json_append_member(code, "temperature", json_mknumber(t/10, 1));
+				json_append_member(code, "humidity", json_mknumber(h/10, 1));
+
+				json_append_member(dht22->message, "message", code);
+				json_append_member(dht22->message, "origin", json_mkstring("receiver"));
+				json_append_member(dht22->message, "protocol", json_mkstring(dht22->id));
+
+				if(pilight.broadcast != NULL) {
+					pilight.broadcast(dht22->id, dht22->message, PROTOCOL);
+				}
+				json_delete(dht22->message);
+				dht22->message = NULL;
+				pthread_mutex_unlock(&lock);
+			} else {
+				logprintf(LOG_DEBUG, "dht22 data checksum was wrong");
+				tries--;
+				sleep(1);
+			}
+		}
+	}
+}
+
+static struct threadqueue_t *initDev(JsonNode *jdevice) {
 	struct JsonNode *jid = NULL;
 	struct JsonNode *jchild = NULL;
-	int *id = 0;
-	int nrid = 0, y = 0, interval = 10, nrloops = 0, x = 0;
-	double temp_offset = 0.0, humi_offset = 0.0, itmp = 0.0;
+	struct settings_t *wnode = NULL;
+	int interval = 10;
+	double itmp = 0.0;
 
-	threads++;
+	if(wiringXSupported() != 0 || wiringXSetup() != 0) {
+		return NULL;
+	}
+
+	loop = 1;
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(wnode, '\0', sizeof(struct settings_t));
 
-	if((jid = json_find_member(json, "id"))) {
+	if((jid = json_find_member(jdevice, "id"))) {
 		jchild = json_first_child(jid);
 		while(jchild) {
 			if(json_find_number(jchild, "gpio", &itmp) == 0) {
-				id = REALLOC(id, (sizeof(int)*(size_t)(nrid+1)));
-				id[nrid] = (int)round(itmp);
-				nrid++;
+				if((wnode->id = REALLOC(wnode->id, (sizeof(int)*(size_t)(wnode->nrid+1)))) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+				wnode->id[wnode->nrid] = (int)round(itmp);
+				wnode->nrid++;
 			}
 			jchild = jchild->next;
 		}
 	}
 
-	if(json_find_number(json, "poll-interval", &itmp) == 0)
+	if(json_find_number(jdevice, "poll-interval", &itmp) == 0)
 		interval = (int)round(itmp);
-	json_find_number(json, "temperature-offset", &temp_offset);
-	json_find_number(json, "humidity-offset", &humi_offset);
-
-	while(loop) {
-		if(protocol_thread_wait(node, interval, &nrloops) == ETIMEDOUT) {
-			pthread_mutex_lock(&lock);
-			for(y=0;y<nrid;y++) {
-				int tries = 5;
-				unsigned short got_correct_date = 0;
-				while(tries && !got_correct_date && loop) {
-
-					uint8_t laststate = HIGH;
-					uint8_t counter = 0;
-					uint8_t j = 0, i = 0;
-
-					int dht22_dat[5] = {0,0,0,0,0};
-
-					// pull pin down for 18 milliseconds
-					pinMode(id[y], OUTPUT);
-					digitalWrite(id[y], HIGH);
-					usleep(500000);  // 500 ms
-					// then pull it up for 40 microseconds
-					digitalWrite(id[y], LOW);
-					usleep(20000);
-					// prepare to read the pin
-					pinMode(id[y], INPUT);
-
-					// detect change and read data
-					for(i=0; (i<MAXTIMINGS && loop); i++) {
-						counter = 0;
-						delayMicroseconds(10);
-
-						while((x = sizecvt(digitalRead(id[y]))) == laststate && x != -1 && loop) {
-							counter++;
-							delayMicroseconds(1);
-							if(counter == 255) {
-								break;
-							}
-						}
-						laststate = sizecvt(digitalRead(id[y]));
-
-						if(counter == 255) {
-							break;
-						}
-
-						// ignore first 3 transitions
-						if((i >= 4) && (i%2 == 0)) {
-							// shove each bit into the storage bytes
-							dht22_dat[(int)((double)j/8)] <<= 1;
-							if(counter > 16)
-								dht22_dat[(int)((double)j/8)] |= 1;
-							j++;
-						}
-					}
+	json_find_number(jdevice, "temperature-offset", &wnode->temp_offset);
+	json_find_number(jdevice, "humidity-offset", &wnode->humi_offset);
 
-					// check we read 40 bits (8bit x 5 ) + verify checksum in the last byte
-					// print it out if data is good
-					if((j >= 40) && (dht22_dat[4] == ((dht22_dat[0] + dht22_dat[1] + dht22_dat[2] + dht22_dat[3]) & 0xFF))) {
-						got_correct_date = 1;
-
-						double h = dht22_dat[0] * 256 + dht22_dat[1];
-						double t = (dht22_dat[2] & 0x7F)* 256 + dht22_dat[3];
-						t += temp_offset;
-						h += humi_offset;
-
-						if((dht22_dat[2] & 0x80) != 0)
-							t *= -1;
-
-						dht22->message = json_mkobject();
-						JsonNode *code = json_mkobject();
-						json_append_member(code, "gpio", json_mknumber(id[y], 0));
-						json_append_member(code, "temperature", json_mknumber(t/10, 1));
-						json_append_member(code, "humidity", json_mknumber(h/10, 1));
-
-						json_append_member(dht22->message, "message", code);
-						json_append_member(dht22->message, "origin", json_mkstring("receiver"));
-						json_append_member(dht22->message, "protocol", json_mkstring(dht22->id));
-
-						if(pilight.broadcast != NULL) {
-							pilight.broadcast(dht22->id, dht22->message, PROTOCOL);
-						}
-						json_delete(dht22->message);
-						dht22->message = NULL;
-					} else {
-						logprintf(LOG_DEBUG, "dht22 data checksum was wrong");
-						tries--;
-						protocol_thread_wait(node, 1, &nrloops);
-					}
-				}
-			}
-			pthread_mutex_unlock(&lock);
-		}
-	}
-	pthread_mutex_unlock(&lock);
+	wnode->next = settings;
+	settings = wnode;
 
-	FREE(id);
-	threads--;
-	return (void *)NULL;
-}
-
-static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	if(wiringXSupported() == 0 && wiringXSetup() == 0) {
-		loop = 1;
-		char *output = json_stringify(jdevice, NULL);
-		JsonNode *json = json_decode(output);
-		json_free(output);
-
-		struct protocol_threads_t *node = protocol_thread_init(dht22, json);
-		return threads_register("dht22", &thread, (void *)node, 0);
-	} else {
-		return NULL;
-	}
+	wnode->timer = timer_add("dht22", 1000, interval*1000, 1000, &poll, (void *)wnode);
+	return NULL;
 }
 
 static void threadGC(void) {
+	struct settings_t *wtmp = NULL;
+
+	/* Make a running read give up on its retries */
 	loop = 0;
-	protocol_thread_stop(dht22);
-	while(threads > 0) {
-		usleep(10);
+	while(settings) {
+		wtmp = settings;
+		timer_cancel(wtmp->timer);
+		if(wtmp->id != NULL) {
+			FREE(wtmp->id);
+		}
+		settings = settings->next;
+		FREE(wtmp);
 	}
-	protocol_thread_free(dht22);
 }
 
 static int checkValues(JsonNode *code) {
@@ -282,7 +298,7 @@ void dht22Init(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "dht22";
-	module->version = "2.4";
+	module->version = "2.5";
 	module->reqversion = "6.0";
 	module->reqcommit = "84";
 }
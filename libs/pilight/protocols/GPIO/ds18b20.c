@@ -42,21 +42,27 @@
 #include "../../core/binary.h"
 #include "../../core/json.h"
 #include "../../core/gc.h"
+#include "../../core/timer.h"
 #include "ds18b20.h"
 
-static unsigned short loop = 1;
-static unsigned short threads = 0;
+typedef struct settings_t {
+	char **id;
+	int nrid;
+	double temp_offset;
+	char *sensor;
+	char *content;
+	struct timer_task_t *timer;
+	struct settings_t *next;
+} settings_t;
+
+static struct settings_t *settings = NULL;
 static char source_path[21];
 
 static pthread_mutex_t lock;
 static pthread_mutexattr_t attr;
 
-static void *ds18b20Parse(void *param) {
-	struct protocol_threads_t *node = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)node->param;
-	struct JsonNode *jid = NULL;
-	struct JsonNode *jchild = NULL;
-
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
 #ifndef _WIN32
 	struct dirent *file = NULL;
 	struct stat st;
@@ -67,155 +73,157 @@ static void *ds18b20Parse(void *param) {
 	int w1valid = 0;
 	double w1temp = 0.0;
 	size_t bytes = 0;
+	int y = 0;
+
+	/* The buffers belong to this device, only the message is shared */
+	for(y=0;y<wnode->nrid;y++) {
+		if((wnode->sensor = REALLOC(wnode->sensor, strlen(source_path)+strlen(wnode->id[y])+5)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		sprintf(wnode->sensor, "%s28-%s/", source_path, wnode->id[y]);
+		if((d = opendir(wnode->sensor))) {
+			while((file = readdir(d)) != NULL) {
+				if(file->d_type == DT_REG) {
+					if(strcmp(file->d_name, "w1_slave") == 0) {
+						size_t w1slavelen = strlen(wnode->sensor)+10;
+						char ds18b20_w1slave[w1slavelen];
+						memset(ds18b20_w1slave, '\0', w1slavelen);
+						strncpy(ds18b20_w1slave, wnode->sensor, strlen(wnode->sensor));
+						strcat(ds18b20_w1slave, "w1_slave");
+
+						if(!(fp = fopen(ds18b20_w1slave, "rb"))) {
+							logprintf(LOG_ERR, "cannot read w1 file: %s", ds18b20_w1slave);
+							break;
+						}
+
+						fstat(fileno(fp), &st);
+						bytes = (size_t)st.st_size;
+
+						if((wnode->content = REALLOC(wnode->content, bytes+1)) == NULL) {
+							fprintf(stderr, "out of memory\n");
+							fclose(fp);
+							break;
+						}
+						memset(wnode->content, '\0', bytes+1);
+
+						if(fread(wnode->content, sizeof(char), bytes, fp) == -1) {
+							logprintf(LOG_ERR, "cannot read config file: %s", ds18b20_w1slave);
+							fclose(fp);
+							break;
+						}
+						fclose(fp);
+						w1valid = 0;
+
+						char **array = NULL;
+						unsigned int n = explode(wnode->content, "\n", &array);
+						if(n > 0) {
+							sscanf(array[0], "%*x %*x %*x %*x %*x %*x %*x %*x %*x : crc=%*x %s", crcVar);
+							if(strncmp(crcVar, "YES", 3) == 0 && n > 1) {
+								w1valid = 1;
+								sscanf(array[1], "%*x %*x %*x %*x %*x %*x %*x %*x %*x t=%lf", &w1temp);
+								w1temp = (w1temp/1000)+wnode->temp_offset;
+							}
+						}
+						array_free(&array, n);
+
+						if(w1valid) {
+							pthread_mutex_lock(&lock);
+							ds18b20->message = json_mkobject();
+
+							JsonNode *code = json_mkobject();
+
+							json_append_member(code, "id", json_mkstring(wnode->id[y]));
+							json_append_member(code, "temperature", json_mknumber(w1temp, 3));
+
+							json_append_member(ds18b20->message, "message", code);
+							json_append_member(ds18b20->message, "origin", json_mkstring("receiver"));
+							json_append_member(ds18b20->message, "protocol", json_mkstring(ds18b20->id));
+
+							if(pilight.broadcast != NULL) {
+								pilight.broadcast(ds18b20->id, ds18b20->message, PROTOCOL);
+							}
+							json_delete(ds18b20->message);
+							ds18b20->message = NULL;
+							pthread_mutex_unlock(&lock);
+						}
+					}
+				}
+			}
+			closedir(d);
+		} else {
+			logprintf(LOG_ERR, "1-wire device %s does not exists", wnode->sensor);
+		}
+	}
 #endif
-	char **id = NULL, *stmp = NULL, *content = NULL;
-	char *ds18b20_sensor = NULL;
-	int nrid = 0, interval = 10, nrloops = 0, y = 0;
-	double temp_offset = 0.0, itmp = 0.0;
+}
 
-	threads++;
+static struct threadqueue_t *initDev(JsonNode *jdevice) {
+	struct JsonNode *jid = NULL;
+	struct JsonNode *jchild = NULL;
+	struct settings_t *wnode = NULL;
+	char *stmp = NULL;
+	int interval = 10;
+	double itmp = 0.0;
+
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(wnode, '\0', sizeof(struct settings_t));
 
-	if((jid = json_find_member(json, "id"))) {
+	if((jid = json_find_member(jdevice, "id"))) {
 		jchild = json_first_child(jid);
 		while(jchild) {
 			if(json_find_string(jchild, "id", &stmp) == 0) {
-				if((id = REALLOC(id, (sizeof(char *)*(size_t)(nrid+1)))) == NULL) {
+				if((wnode->id = REALLOC(wnode->id, (sizeof(char *)*(size_t)(wnode->nrid+1)))) == NULL) {
 					fprintf(stderr, "out of memory\n");
 					exit(EXIT_FAILURE);
 				}
-				if((id[nrid] = MALLOC(strlen(stmp)+1)) == NULL) {
+				if((wnode->id[wnode->nrid] = MALLOC(strlen(stmp)+1)) == NULL) {
 					fprintf(stderr, "out of memory\n");
 					exit(EXIT_FAILURE);
 				}
-				strcpy(id[nrid], stmp);
-				nrid++;
+				strcpy(wnode->id[wnode->nrid], stmp);
+				wnode->nrid++;
 			}
 			jchild = jchild->next;
 		}
 	}
 
-	if(json_find_number(json, "poll-interval", &itmp) == 0)
+	if(json_find_number(jdevice, "poll-interval", &itmp) == 0)
 		interval = (int)round(itmp);
-	json_find_number(json, "temperature-offset", &temp_offset);
-
-	while(loop) {
-		if(protocol_thread_wait(node, interval, &nrloops) == ETIMEDOUT) {
-#ifndef _WIN32
-			pthread_mutex_lock(&lock);
-			for(y=0;y<nrid;y++) {
-				if((ds18b20_sensor = REALLOC(ds18b20_sensor, strlen(source_path)+strlen(id[y])+5)) == NULL) {
-					fprintf(stderr, "out of memory\n");
-					exit(EXIT_FAILURE);
-				}
-				sprintf(ds18b20_sensor, "%s28-%s/", source_path, id[y]);
-				if((d = opendir(ds18b20_sensor))) {
-					while((file = readdir(d)) != NULL) {
-						if(file->d_type == DT_REG) {
-							if(strcmp(file->d_name, "w1_slave") == 0) {
-								size_t w1slavelen = strlen(ds18b20_sensor)+10;
-								char ds18b20_w1slave[w1slavelen];
-								memset(ds18b20_w1slave, '\0', w1slavelen);
-								strncpy(ds18b20_w1slave, ds18b20_sensor, strlen(ds18b20_sensor));
-								strcat(ds18b20_w1slave, "w1_slave");
-
-								if(!(fp = fopen(ds18b20_w1slave, "rb"))) {
-									logprintf(LOG_ERR, "cannot read w1 file: %s", ds18b20_w1slave);
-									break;
-								}
-
-								fstat(fileno(fp), &st);
-								bytes = (size_t)st.st_size;
-
-								if((content = REALLOC(content, bytes+1)) == NULL) {
-									fprintf(stderr, "out of memory\n");
-									fclose(fp);
-									break;
-								}
-								memset(content, '\0', bytes+1);
-
-								if(fread(content, sizeof(char), bytes, fp) == -1) {
-									logprintf(LOG_ERR, "cannot read config file: %s", ds18b20_w1slave);
-									fclose(fp);
-									break;
-								}
-								fclose(fp);
-								w1valid = 0;
-
-								char **array = NULL;
-								unsigned int n = explode(content, "\n", &array);
-								if(n > 0) {
-									sscanf(array[0], "%*x %*x %*x %*x %*x %*x %*x %*x %*x : crc=%*x %s", crcVar);
-									if(strncmp(crcVar, "YES", 3) == 0 && n > 1) {
-										w1valid = 1;
-										sscanf(array[1], "%*x %*x %*x %*x %*x %*x %*x %*x %*x t=%lf", &w1temp);
-										w1temp = (w1temp/1000)+temp_offset;
-									}
-								}
-								array_free(&array, n);
-
-								if(w1valid) {
-									ds18b20->message = json_mkobject();
-
-									JsonNode *code = json_mkobject();
-
-									json_append_member(code, "id", json_mkstring(id[y]));
-									json_append_member(code, "temperature", json_mknumber(w1temp, 3));
-
-									json_append_member(ds18b20->message, "message", code);
-									json_append_member(ds18b20->message, "origin", json_mkstring("receiver"));
-									json_append_member(ds18b20->message, "protocol", json_mkstring(ds18b20->id));
-
-									if(pilight.broadcast != NULL) {
-										pilight.broadcast(ds18b20->id, ds18b20->message, PROTOCOL);
-									}
-									json_delete(ds18b20->message);
-									ds18b20->message = NULL;
-								}
-							}
-						}
-					}
-					closedir(d);
-				} else {
-					logprintf(LOG_ERR, "1-wire device %s does not exists", ds18b20_sensor);
-				}
-			}
-#endif
-			pthread_mutex_unlock(&lock);
-		}
-	}
-	pthread_mutex_unlock(&lock);
+	json_find_number(jdevice, "temperature-offset", &wnode->temp_offset);
 
-	if(ds18b20_sensor) {
-		FREE(ds18b20_sensor);
-	}
-	if(content) {
-		FREE(content);
-	}
-	for(y=0;y<nrid;y++) {
-		FREE(id[y]);
-	}
-	FREE(id);
-	threads--;
-	return (void *)NULL;
-}
+	wnode->next = settings;
+	settings = wnode;
 
-static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
-
-	struct protocol_threads_t *node = protocol_thread_init(ds18b20, json);
-	return threads_register("ds18b20", &ds18b20Parse, (void *)node, 0);
+	wnode->timer = timer_add("ds18b20", 1000, interval*1000, 1000, &poll, (void *)wnode);
+	return NULL;
 }
 
 static void threadGC(void) {
-	loop = 0;
-	protocol_thread_stop(ds18b20);
-	while(threads > 0) {
-		usleep(10);
+	struct settings_t *wtmp = NULL;
+	int y = 0;
+
+	while(settings) {
+		wtmp = settings;
+		timer_cancel(wtmp->timer);
+		if(wtmp->sensor != NULL) {
+			FREE(wtmp->sensor);
+		}
+		if(wtmp->content != NULL) {
+			FREE(wtmp->content);
+		}
+		for(y=0;y<wtmp->nrid;y++) {
+			FREE(wtmp->id[y]);
+		}
+		if(wtmp->id != NULL) {
+			FREE(wtmp->id);
+		}
+		settings = settings->next;
+		FREE(wtmp);
 	}
-	protocol_thread_free(ds18b20);
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
@@ -251,7 +259,7 @@ void ds18b20Init(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "ds18b20";
-	module->version = "2.0";
+	module->version = "2.1";
 	module->reqversion = "6.0";
 	module->reqcommit = "84";
 }
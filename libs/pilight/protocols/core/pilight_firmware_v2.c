@@ -35,11 +35,11 @@
 #define AVG_PULSE_LENGTH	183
 #define RAW_LENGTH				196
 
-static int validate(void) {
-	if(pilight_firmware_v2->rawlen == RAW_LENGTH) {
-		if(pilight_firmware_v2->raw[pilight_firmware_v2->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
-		   pilight_firmware_v2->raw[pilight_firmware_v2->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
-			 pilight_firmware_v2->raw[1] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
+static int validate(struct protocol_decode_t *decode) {
+	if(decode->rawlen == RAW_LENGTH) {
+		if(decode->raw[decode->rawlen-1] >= (MIN_PULSE_LENGTH*PULSE_DIV) &&
+		   decode->raw[decode->rawlen-1] <= (MAX_PULSE_LENGTH*PULSE_DIV) &&
+			 decode->raw[1] > AVG_PULSE_LENGTH*PULSE_MULTIPLIER) {
 			return 0;
 		}
 	}
@@ -47,21 +47,23 @@ static int validate(void) {
 	return -1;
 }
 
-static void createMessage(int version, int high, int low) {
-	pilight_firmware_v2->message = json_mkobject();
-	json_append_member(pilight_firmware_v2->message, "version", json_mknumber(version, 2));
-	json_append_member(pilight_firmware_v2->message, "lpf", json_mknumber(high*10, 0));
-	json_append_member(pilight_firmware_v2->message, "hpf", json_mknumber(low*10, 0));
+static struct JsonNode *createMessage(int version, int high, int low) {
+	struct JsonNode *message = json_mkobject();
+	json_append_member(message, "version", json_mknumber(version, 2));
+	json_append_member(message, "lpf", json_mknumber(high*10, 0));
+	json_append_member(message, "hpf", json_mknumber(low*10, 0));
+
+	return message;
 }
 
-static void parseCode(void) {
+static void parseCode(struct protocol_decode_t *decode) {
 	int i = 0, x = 0, binary[RAW_LENGTH/4];
 
-	for(i=0;i<pilight_firmware_v2->rawlen;i+=4) {
-		if(pilight_firmware_v2->raw[i+3] < 100) {
-			pilight_firmware_v2->raw[i+3]*=10;
+	for(i=0;i<decode->rawlen;i+=4) {
+		if(decode->raw[i+3] < 100) {
+			decode->raw[i+3]*=10;
 		}
-		if(pilight_firmware_v2->raw[i+3] > AVG_PULSE_LENGTH*(PULSE_MULTIPLIER/2)) {
+		if(decode->raw[i+3] > AVG_PULSE_LENGTH*(PULSE_MULTIPLIER/2)) {
 			binary[x++] = 1;
 		} else {
 			binary[x++] = 0;
@@ -71,7 +73,7 @@ static void parseCode(void) {
 	int version = binToDec(binary, 0, 15);
 	int high = binToDec(binary, 16, 31);
 	int low = binToDec(binary, 32, 47);
-	createMessage(version, high, low);
+	decode->message = createMessage(version, high, low);
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
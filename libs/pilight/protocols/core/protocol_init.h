@@ -0,0 +1,4 @@
+	pilightFirmwareV2Init();
+	pilightFirmwareV3Init();
+	rawInit();
+
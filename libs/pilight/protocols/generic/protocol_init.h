@@ -0,0 +1,7 @@
+	genericDimmerInit();
+	genericLabelInit();
+	genericScreenInit();
+	genericSwitchInit();
+	genericWeatherInit();
+	genericWebcamInit();
+
@@ -53,32 +53,112 @@
 #include "../protocol.h"
 #include "../../core/json.h"
 #include "../../core/gc.h"
+#include "../../core/timer.h"
 #include "arping.h"
 
-static unsigned short loop = 1;
-static unsigned short threads = 0;
+#define CONNECTED				1
+#define DISCONNECTED 		0
+#define INTERVAL				5
+
+typedef struct settings_t {
+	char *dstmac;
+	char srcmac[ETH_ALEN];
+	char dstip[INET_ADDRSTRLEN+1];
+	char **devs;
+	int nrdevs;
+	int srcip[4];
+	int state;
+	struct timer_task_t *timer;
+	struct settings_t *next;
+} settings_t;
+
+static struct settings_t *settings = NULL;
 
 static pthread_mutex_t lock;
 static pthread_mutexattr_t attr;
 
-#define CONNECTED				1
-#define DISCONNECTED 		0
-#define INTERVAL				5
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
+	char ip[INET_ADDRSTRLEN+1], *p = ip;
+	int i = 0;
+
+	pthread_mutex_lock(&lock);
+	if(strlen(wnode->dstip) == 0) {
+		for(i=0;i<255;i++) {
+			memset(ip, '\0', INET_ADDRSTRLEN+1);
+			snprintf(ip, sizeof(ip), "%d.%d.%d.%d", wnode->srcip[0], wnode->srcip[1], wnode->srcip[2], i);
+			arp_add_host(ip);
+		}
+	} else {
+		arp_add_host(wnode->dstip);
+	}
+
+	memset(ip, '\0', INET_ADDRSTRLEN+1);
+	if(arp_resolv(wnode->devs[0], wnode->srcmac, wnode->dstmac, &p) == 0) {
+		if(strlen(wnode->dstip) == 0) {
+			strcpy(wnode->dstip, ip);
+		}
+		if(strcmp(wnode->dstip, ip) != 0) {
+			logprintf(LOG_NOTICE, "ip address changed from %s to %s", wnode->dstip, ip);
+			memset(wnode->dstip, '\0', INET_ADDRSTRLEN+1);
+			strcpy(wnode->dstip, ip);
+		}
+		if(wnode->state == DISCONNECTED) {
+			wnode->state = CONNECTED;
+			arping->message = json_mkobject();
+			JsonNode *code = json_mkobject();
+			json_append_member(code, "mac", json_mkstring(wnode->dstmac));
+			json_append_member(code, "ip", json_mkstring(ip));
+			json_append_member(code, "state", json_mkstring("connected"));
+
+			json_append_member(arping->message, "message", code);
+			json_append_member(arping->message, "origin", json_mkstring("receiver"));
+			json_append_member(arping->message, "protocol", json_mkstring(arping->id));
+
+			if(pilight.broadcast != NULL) {
+				pilight.broadcast(arping->id, arping->message, PROTOCOL);
+			}
+			json_delete(arping->message);
+			arping->message = NULL;
+		}
+	} else if(wnode->state == CONNECTED) {
+		wnode->state = DISCONNECTED;
+
+		arping->message = json_mkobject();
+		JsonNode *code = json_mkobject();
+		json_append_member(code, "mac", json_mkstring(wnode->dstmac));
+		json_append_member(code, "ip", json_mkstring("0.0.0.0"));
+		json_append_member(code, "state", json_mkstring("disconnected"));
+
+		json_append_member(arping->message, "message", code);
+		json_append_member(arping->message, "origin", json_mkstring("receiver"));
+		json_append_member(arping->message, "protocol", json_mkstring(arping->id));
+
+		if(pilight.broadcast != NULL) {
+			pilight.broadcast(arping->id, arping->message, PROTOCOL);
+		}
+		json_delete(arping->message);
+		arping->message = NULL;
+	}
+	pthread_mutex_unlock(&lock);
+}
 
-static void *thread(void *param) {
-	struct protocol_threads_t *node = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)node->param;
+static void settings_free(struct settings_t *wnode) {
+	array_free(&wnode->devs, wnode->nrdevs);
+	FREE(wnode->dstmac);
+	FREE(wnode);
+}
+
+static struct threadqueue_t *initDev(JsonNode *jdevice) {
 	struct JsonNode *jid = NULL;
 	struct JsonNode *jchild = NULL;
-	char *dstmac = NULL, srcmac[ETH_ALEN], *a = srcmac;
-	char *tmpip[INET_ADDRSTRLEN+1], dstip[INET_ADDRSTRLEN+1];
-	char ip[INET_ADDRSTRLEN+1], *p = ip, **devs = NULL;
+	struct settings_t *wnode = NULL;
+	char *dstmac = NULL, *a = NULL;
+	char ip[INET_ADDRSTRLEN+1], *p = ip;
 	double itmp = 0.0;
-	int state = 0, nrloops = 0, interval = INTERVAL, i = 0, srcip[4], nrdevs = 0;
+	int interval = INTERVAL, i = 0;
 
-	threads++;
-
-	if((jid = json_find_member(json, "id"))) {
+	if((jid = json_find_member(jdevice, "id"))) {
 		jchild = json_first_child(jid);
 		while(jchild) {
 			if(json_find_string(jchild, "mac", &dstmac) == 0) {
@@ -87,135 +167,75 @@ static void *thread(void *param) {
 			jchild = jchild->next;
 		}
 	}
+	if(dstmac == NULL) {
+		return NULL;
+	}
 
-	if(json_find_number(json, "poll-interval", &itmp) == 0)
+	if(json_find_number(jdevice, "poll-interval", &itmp) == 0)
 		interval = (int)round(itmp);
 
-	memset(dstip, '\0', INET_ADDRSTRLEN+1);
-	memset(tmpip, '\0', INET_ADDRSTRLEN+1);
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(wnode, '\0', sizeof(struct settings_t));
+	if((wnode->dstmac = MALLOC(strlen(dstmac)+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(wnode->dstmac, dstmac);
+	wnode->state = DISCONNECTED;
 
-	for(i=0;i<strlen(dstmac);i++) {
-		if(isNumeric(&dstmac[i]) != 0) {
-			dstmac[i] = (char)tolower(dstmac[i]);
+	for(i=0;i<strlen(wnode->dstmac);i++) {
+		if(isNumeric(&wnode->dstmac[i]) != 0) {
+			wnode->dstmac[i] = (char)tolower(wnode->dstmac[i]);
 		}
 	}
 
-	if((nrdevs = inetdevs(&devs)) == 0) {
+	if((wnode->nrdevs = inetdevs(&wnode->devs)) == 0) {
 		logprintf(LOG_ERR, "could not determine default network interface");
-		array_free(&devs, nrdevs);
+		settings_free(wnode);
 		return NULL;
 	}
 
 	memset(&ip, '\0', INET_ADDRSTRLEN+1);
-	if(dev2ip(devs[0], &p, AF_INET) != 0) {
+	if(dev2ip(wnode->devs[0], &p, AF_INET) != 0) {
 		logprintf(LOG_ERR, "could not determine host ip address");
-		array_free(&devs, nrdevs);
+		settings_free(wnode);
 		return NULL;
 	}
 
-	memset(&srcmac, '\0', ETH_ALEN);
-	if(dev2mac(devs[0], &a) != 0 || (srcmac[0] == 0 && srcmac[1] == 0 &&
-		srcmac[2] == 0 && srcmac[3] == 0 &&
-		srcmac[4] == 0 && srcmac[5] == 0)) {
-		logprintf(LOG_ERR, "could not obtain MAC address for interface %s", devs[0]);
-		array_free(&devs, nrdevs);
+	a = wnode->srcmac;
+	if(dev2mac(wnode->devs[0], &a) != 0 || (wnode->srcmac[0] == 0 && wnode->srcmac[1] == 0 &&
+		wnode->srcmac[2] == 0 && wnode->srcmac[3] == 0 &&
+		wnode->srcmac[4] == 0 && wnode->srcmac[5] == 0)) {
+		logprintf(LOG_ERR, "could not obtain MAC address for interface %s", wnode->devs[0]);
+		settings_free(wnode);
 		return NULL;
 	}
 
-	if(sscanf(ip, "%d.%d.%d.%d", &srcip[0], &srcip[1], &srcip[2], &srcip[3]) != 4) {
+	if(sscanf(ip, "%d.%d.%d.%d", &wnode->srcip[0], &wnode->srcip[1], &wnode->srcip[2], &wnode->srcip[3]) != 4) {
 		logprintf(LOG_ERR, "could not extract ip address");
-		array_free(&devs, nrdevs);
+		settings_free(wnode);
 		return NULL;
 	}
 
-	while(loop) {
-		if(protocol_thread_wait(node, interval, &nrloops) == ETIMEDOUT) {
-			pthread_mutex_lock(&lock);
-			if(strlen(dstip) == 0) {
-				for(i=0;i<255;i++) {
-					memset(ip, '\0', INET_ADDRSTRLEN+1);
-					snprintf(ip, sizeof(ip), "%d.%d.%d.%d", srcip[0], srcip[1], srcip[2], i);
-					arp_add_host(ip);
-				}
-			} else {
-				arp_add_host(dstip);
-			}
+	wnode->next = settings;
+	settings = wnode;
 
-			if(arp_resolv(devs[0], srcmac, dstmac, &p) == 0) {
-				if(strlen(dstip) == 0) {
-					strcpy(dstip, ip);
-				}
-				if(strcmp(dstip, ip) != 0) {
-					memset(dstip, '\0', INET_ADDRSTRLEN+1);
-					logprintf(LOG_NOTICE, "ip address changed from %s to %s", dstip, ip);
-					strcpy(dstip, ip);
-				}
-				if(state == DISCONNECTED) {
-					state = CONNECTED;
-					arping->message = json_mkobject();
-					JsonNode *code = json_mkobject();
-					json_append_member(code, "mac", json_mkstring(dstmac));
-					json_append_member(code, "ip", json_mkstring(ip));
-					json_append_member(code, "state", json_mkstring("connected"));
-
-					json_append_member(arping->message, "message", code);
-					json_append_member(arping->message, "origin", json_mkstring("receiver"));
-					json_append_member(arping->message, "protocol", json_mkstring(arping->id));
-
-					if(pilight.broadcast != NULL) {
-						pilight.broadcast(arping->id, arping->message, PROTOCOL);
-					}
-					json_delete(arping->message);
-					arping->message = NULL;
-				}
-			} else if(state == CONNECTED) {
-				state = DISCONNECTED;
-
-				arping->message = json_mkobject();
-				JsonNode *code = json_mkobject();
-				json_append_member(code, "mac", json_mkstring(dstmac));
-				json_append_member(code, "ip", json_mkstring("0.0.0.0"));
-				json_append_member(code, "state", json_mkstring("disconnected"));
-
-				json_append_member(arping->message, "message", code);
-				json_append_member(arping->message, "origin", json_mkstring("receiver"));
-				json_append_member(arping->message, "protocol", json_mkstring(arping->id));
-
-				if(pilight.broadcast != NULL) {
-					pilight.broadcast(arping->id, arping->message, PROTOCOL);
-				}
-				json_delete(arping->message);
-				arping->message = NULL;
-			}
-			pthread_mutex_unlock(&lock);
-		}
-	}
-	pthread_mutex_unlock(&lock);
-
-	array_free(&devs, nrdevs);
-
-	threads--;
-
-	return (void *)NULL;
-}
-
-static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
-
-	struct protocol_threads_t *node = protocol_thread_init(arping, json);
-	return threads_register("arping", &thread, (void *)node, 0);
+	wnode->timer = timer_add("arping", 1000, interval*1000, 1000, &poll, (void *)wnode);
+	return NULL;
 }
 
 static void threadGC(void) {
-	loop = 0;
-	protocol_thread_stop(arping);
-	while(threads > 0) {
-		usleep(10);
+	struct settings_t *wtmp = NULL;
+
+	while(settings) {
+		wtmp = settings;
+		timer_cancel(wtmp->timer);
+		settings = settings->next;
+		settings_free(wtmp);
 	}
-	protocol_thread_free(arping);
 }
 
 static int checkValues(JsonNode *code) {
@@ -262,7 +282,7 @@ void arpingInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "arping";
-	module->version = "2.2";
+	module->version = "2.3";
 	module->reqversion = "6.0";
 	module->reqcommit = "158";
 }
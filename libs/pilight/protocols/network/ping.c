@@ -42,30 +42,79 @@
 #include "../protocol.h"
 #include "../../core/json.h"
 #include "../../core/gc.h"
+#include "../../core/timer.h"
 #include "ping.h"
 
-static unsigned short loop = 1;
-static unsigned short threads = 0;
+#define CONNECTED				1
+#define DISCONNECTED 		0
+
+typedef struct settings_t {
+	char *ip;
+	int state;
+	struct timer_task_t *timer;
+	struct settings_t *next;
+} settings_t;
+
+static struct settings_t *settings = NULL;
 
 static pthread_mutex_t lock;
 static pthread_mutexattr_t attr;
 
-#define CONNECTED				1
-#define DISCONNECTED 		0
+static void poll(void *param) {
+	struct settings_t *wnode = (struct settings_t *)param;
+	/* Only the message needs the lock, not the ping itself */
+	int ret = ping(wnode->ip);
+
+	pthread_mutex_lock(&lock);
+	if(ret == 0) {
+		if(wnode->state == DISCONNECTED) {
+			wnode->state = CONNECTED;
+			pping->message = json_mkobject();
+			JsonNode *code = json_mkobject();
+			json_append_member(code, "ip", json_mkstring(wnode->ip));
+			json_append_member(code, "state", json_mkstring("connected"));
+
+			json_append_member(pping->message, "message", code);
+			json_append_member(pping->message, "origin", json_mkstring("receiver"));
+			json_append_member(pping->message, "protocol", json_mkstring(pping->id));
+
+			if(pilight.broadcast != NULL) {
+				pilight.broadcast(pping->id, pping->message, PROTOCOL);
+			}
+			json_delete(pping->message);
+			pping->message = NULL;
+		}
+	} else if(wnode->state == CONNECTED) {
+		wnode->state = DISCONNECTED;
+
+		pping->message = json_mkobject();
+		JsonNode *code = json_mkobject();
+		json_append_member(code, "ip", json_mkstring(wnode->ip));
+		json_append_member(code, "state", json_mkstring("disconnected"));
 
-static void *thread(void *param) {
-	struct protocol_threads_t *node = (struct protocol_threads_t *)param;
-	struct JsonNode *json = (struct JsonNode *)node->param;
+		json_append_member(pping->message, "message", code);
+		json_append_member(pping->message, "origin", json_mkstring("receiver"));
+		json_append_member(pping->message, "protocol", json_mkstring(pping->id));
+
+		if(pilight.broadcast != NULL) {
+			pilight.broadcast(pping->id, pping->message, PROTOCOL);
+		}
+		json_delete(pping->message);
+		pping->message = NULL;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static struct threadqueue_t *initDev(JsonNode *jdevice) {
 	struct JsonNode *jid = NULL;
 	struct JsonNode *jchild = NULL;
+	struct settings_t *wnode = NULL;
 	char *ip = NULL;
 	char *pstate = NULL;
 	double itmp = 0.0;
-	int state = 0, nrloops = 0, interval = 1;
+	int interval = 1;
 
-	threads++;
-
-	if((jid = json_find_member(json, "id"))) {
+	if((jid = json_find_member(jdevice, "id"))) {
 		jchild = json_first_child(jid);
 		while(jchild) {
 			if(json_find_string(jchild, "ip", &ip) == 0) {
@@ -74,80 +123,50 @@ static void *thread(void *param) {
 			jchild = jchild->next;
 		}
 	}
+	if(ip == NULL) {
+		return NULL;
+	}
+
+	if((wnode = MALLOC(sizeof(struct settings_t))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if((wnode->ip = MALLOC(strlen(ip)+1)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(wnode->ip, ip);
+	wnode->state = DISCONNECTED;
 
-	if(json_find_number(json, "poll-interval", &itmp) == 0)
+	if(json_find_number(jdevice, "poll-interval", &itmp) == 0)
 		interval = (int)round(itmp);
 
-   if(json_find_string(json, "state", &pstate) == 0) {
-      if(strcmp(pstate,"connected") == 0) state = CONNECTED;
-      if(strcmp(pstate,"disconnected") == 0) state = DISCONNECTED;
-      }
-
-	while(loop) {
-		if(protocol_thread_wait(node, interval, &nrloops) == ETIMEDOUT) {
-			pthread_mutex_lock(&lock);
-			if(ping(ip) == 0) {
-				if(state == DISCONNECTED) {
-					state = CONNECTED;
-					pping->message = json_mkobject();
-					JsonNode *code = json_mkobject();
-					json_append_member(code, "ip", json_mkstring(ip));
-					json_append_member(code, "state", json_mkstring("connected"));
-
-					json_append_member(pping->message, "message", code);
-					json_append_member(pping->message, "origin", json_mkstring("receiver"));
-					json_append_member(pping->message, "protocol", json_mkstring(pping->id));
-
-					if(pilight.broadcast != NULL) {
-						pilight.broadcast(pping->id, pping->message, PROTOCOL);
-					}
-					json_delete(pping->message);
-					pping->message = NULL;
-				}
-			} else if(state == CONNECTED) {
-				state = DISCONNECTED;
-
-				pping->message = json_mkobject();
-				JsonNode *code = json_mkobject();
-				json_append_member(code, "ip", json_mkstring(ip));
-				json_append_member(code, "state", json_mkstring("disconnected"));
-
-				json_append_member(pping->message, "message", code);
-				json_append_member(pping->message, "origin", json_mkstring("receiver"));
-				json_append_member(pping->message, "protocol", json_mkstring(pping->id));
-
-				if(pilight.broadcast != NULL) {
-					pilight.broadcast(pping->id, pping->message, PROTOCOL);
-				}
-				json_delete(pping->message);
-				pping->message = NULL;
-			}
-			pthread_mutex_unlock(&lock);
+	if(json_find_string(jdevice, "state", &pstate) == 0) {
+		if(strcmp(pstate, "connected") == 0) {
+			wnode->state = CONNECTED;
+		}
+		if(strcmp(pstate, "disconnected") == 0) {
+			wnode->state = DISCONNECTED;
 		}
 	}
-	pthread_mutex_unlock(&lock);
 
-	threads--;
-	return (void *)NULL;
-}
-
-static struct threadqueue_t *initDev(JsonNode *jdevice) {
-	loop = 1;
-	char *output = json_stringify(jdevice, NULL);
-	JsonNode *json = json_decode(output);
-	json_free(output);
+	wnode->next = settings;
+	settings = wnode;
 
-	struct protocol_threads_t *node = protocol_thread_init(pping, json);
-	return threads_register("ping", &thread, (void *)node, 0);
+	wnode->timer = timer_add("ping", 1000, interval*1000, 1000, &poll, (void *)wnode);
+	return NULL;
 }
 
 static void threadGC(void) {
-	loop = 0;
-	protocol_thread_stop(pping);
-	while(threads > 0) {
-		usleep(10);
+	struct settings_t *wtmp = NULL;
+
+	while(settings) {
+		wtmp = settings;
+		timer_cancel(wtmp->timer);
+		FREE(wtmp->ip);
+		settings = settings->next;
+		FREE(wtmp);
 	}
-	protocol_thread_free(pping);
 }
 
 #if !defined(MODULE) && !defined(_WIN32)
@@ -179,7 +198,7 @@ void pingInit(void) {
 #if defined(MODULE) && !defined(_WIN32)
 void compatibility(struct module_t *module) {
 	module->name = "ping";
-	module->version = "2.0";
+	module->version = "2.1";
 	module->reqversion = "6.0";
 	module->reqcommit = "84";
 }
@@ -48,6 +48,15 @@
 
 struct protocols_t *protocols;
 
+/* Per rawlen lists of protocols that are able to validate a pulse train
+   of that length. The last list holds the protocols that don't announce
+   their rawlen and gaplen boundaries, so they are always validated. */
+static struct protocol_dispatch_t **dispatch = NULL;
+static int dispatch_size = 0;
+/* Number of validating protocols per hardware type (offset by one) */
+static int dispatch_hwcount[API+2];
+static unsigned long dispatch_avoided = 0;
+
 #ifndef _WIN32
 void protocol_remove(char *name) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
@@ -224,6 +233,7 @@ void protocol_register(protocol_t **proto) {
 	(*proto)->config = 1;
 	(*proto)->masterOnly = 0;
 	(*proto)->parseCode = NULL;
+	(*proto)->validate = NULL;
 	(*proto)->createCode = NULL;
 	(*proto)->checkValues = NULL;
 	(*proto)->initDev = NULL;
@@ -375,12 +385,152 @@ int protocol_device_exists(protocol_t *proto, const char *id) {
 	return 1;
 }
 
+static int protocol_dispatch_bounded(struct protocol_t *proto) {
+	return (proto->minrawlen > 0 && proto->maxrawlen > 0 &&
+	        proto->mingaplen > 0 && proto->maxgaplen > 0);
+}
+
+void protocol_dispatch_init(void) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	struct protocols_t *pnode = NULL;
+	struct protocol_t *proto = NULL;
+	int i = 0, x = 0, n = 0, match = 0;
+
+	protocol_dispatch_gc();
+
+	if((dispatch = MALLOC(sizeof(struct protocol_dispatch_t *)*(MAXPULSESTREAMLENGTH+1))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(dispatch_hwcount, 0, sizeof(dispatch_hwcount));
+
+	for(i=0;i<=MAXPULSESTREAMLENGTH;i++) {
+		/* First count and then fill the candidates for this rawlen */
+		for(x=0;x<2;x++) {
+			n = 0;
+			pnode = protocols;
+			while(pnode) {
+				proto = pnode->listener;
+				if(proto->validate != NULL && proto->parseCode != NULL) {
+					if(protocol_dispatch_bounded(proto) == 1) {
+						match = (i < MAXPULSESTREAMLENGTH && i >= proto->minrawlen && i <= proto->maxrawlen);
+					} else {
+						match = 1;
+					}
+					if(match == 1) {
+						if(x == 1) {
+							dispatch[i][n].listener = proto;
+							/* Some protocols have their gaplen boundaries swapped */
+							if(protocol_dispatch_bounded(proto) == 1) {
+								if(proto->mingaplen <= proto->maxgaplen) {
+									dispatch[i][n].minfooter = proto->mingaplen;
+									dispatch[i][n].maxfooter = proto->maxgaplen;
+								} else {
+									dispatch[i][n].minfooter = proto->maxgaplen;
+									dispatch[i][n].maxfooter = proto->mingaplen;
+								}
+							} else {
+								dispatch[i][n].minfooter = 0;
+								dispatch[i][n].maxfooter = -1;
+							}
+						}
+						n++;
+					}
+				}
+				pnode = pnode->next;
+			}
+			if(x == 0) {
+				if((dispatch[i] = MALLOC(sizeof(struct protocol_dispatch_t)*(size_t)(n+1))) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+				dispatch[i][n].listener = NULL;
+			}
+		}
+	}
+
+	pnode = protocols;
+	while(pnode) {
+		proto = pnode->listener;
+		if(proto->validate != NULL && proto->parseCode != NULL) {
+			dispatch_size++;
+			for(i=HWINTERNAL;i<=API;i++) {
+				if(proto->hwtype == i || proto->hwtype == HWINTERNAL || i == HWINTERNAL) {
+					dispatch_hwcount[i+1]++;
+				}
+			}
+		}
+		pnode = pnode->next;
+	}
+	dispatch_avoided = 0;
+}
+
+int protocol_dispatch_size(void) {
+	return dispatch_size;
+}
+
+/*
+ * Fill the candidates array with all protocols that should validate
+ * this pulse train. The array should be able to hold at least
+ * protocol_dispatch_size() elements.
+ */
+int protocol_dispatch(int *raw, int rawlen, int hwtype, struct protocol_t **candidates) {
+	struct protocol_dispatch_t *node = NULL;
+	int footer = 0, n = 0;
+
+	if(dispatch == NULL) {
+		return 0;
+	}
+
+	if(rawlen > 0 && rawlen < MAXPULSESTREAMLENGTH) {
+		node = dispatch[rawlen];
+		footer = raw[rawlen-1];
+	} else {
+		node = dispatch[MAXPULSESTREAMLENGTH];
+	}
+
+	while(node->listener != NULL) {
+		if((node->listener->hwtype == hwtype || node->listener->hwtype == HWINTERNAL || hwtype == HWINTERNAL) &&
+		   (node->maxfooter < 0 || (footer >= node->minfooter && footer <= node->maxfooter))) {
+			candidates[n++] = node->listener;
+		}
+		node++;
+	}
+
+	if(hwtype >= HWINTERNAL && hwtype <= API) {
+		__sync_add_and_fetch(&dispatch_avoided, (unsigned long)(dispatch_hwcount[hwtype+1]-n));
+	}
+
+	return n;
+}
+
+unsigned long protocol_dispatch_avoided(void) {
+	return dispatch_avoided;
+}
+
+void protocol_dispatch_gc(void) {
+	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
+
+	int i = 0;
+
+	if(dispatch != NULL) {
+		for(i=0;i<=MAXPULSESTREAMLENGTH;i++) {
+			FREE(dispatch[i]);
+		}
+		FREE(dispatch);
+	}
+	dispatch_size = 0;
+}
+
 int protocol_gc(void) {
 	logprintf(LOG_STACK, "%s(...)", __FUNCTION__);
 
 	struct protocols_t *ptmp;
 	struct protocol_devices_t *dtmp;
 
+	protocol_dispatch_gc();
+
 	while(protocols) {
 		ptmp = protocols;
 		logprintf(LOG_DEBUG, "protocol %s", ptmp->listener->id);
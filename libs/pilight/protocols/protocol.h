@@ -71,6 +71,17 @@ typedef struct protocol_threads_t {
 	struct protocol_threads_t *next;
 } protocol_threads_t;
 
+/*
+ * State of a single decoding attempt. The protocols validate and
+ * parse the pulse train passed in here instead of their own raw
+ * buffer, so several pulse trains can be decoded at the same time.
+ */
+typedef struct protocol_decode_t {
+	int *raw;
+	int rawlen;
+	struct JsonNode *message;
+} protocol_decode_t;
+
 typedef struct protocol_t {
 	char *id;
 	int rawlen;
@@ -97,8 +108,8 @@ typedef struct protocol_t {
 	struct protocol_devices_t *devices;
 	struct protocol_threads_t *threads;
 
-	void (*parseCode)(void);
-	int (*validate)(void);
+	void (*parseCode)(struct protocol_decode_t *decode);
+	int (*validate)(struct protocol_decode_t *decode);
 	int (*createCode)(JsonNode *code);
 	int (*checkValues)(JsonNode *code);
 	struct threadqueue_t *(*initDev)(JsonNode *device);
@@ -115,6 +126,13 @@ typedef struct protocols_t {
 
 extern struct protocols_t *protocols;
 
+/* Receive dispatch index, see protocol_dispatch_init */
+typedef struct protocol_dispatch_t {
+	struct protocol_t *listener;
+	int minfooter;
+	int maxfooter;
+} protocol_dispatch_t;
+
 void protocol_init(void);
 struct protocol_threads_t *protocol_thread_init(protocol_t *proto, struct JsonNode *param);
 int protocol_thread_wait(struct protocol_threads_t *node, int interval, int *nrloops);
@@ -125,6 +143,11 @@ void protocol_plslen_add(protocol_t *proto, int plslen);
 void protocol_register(protocol_t **proto);
 void protocol_device_add(protocol_t *proto, const char *id, const char *desc);
 int protocol_device_exists(protocol_t *proto, const char *id);
+void protocol_dispatch_init(void);
+int protocol_dispatch_size(void);
+int protocol_dispatch(int *raw, int rawlen, int hwtype, struct protocol_t **candidates);
+unsigned long protocol_dispatch_avoided(void);
+void protocol_dispatch_gc(void);
 int protocol_gc(void);
 
 #endif
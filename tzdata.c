@@ -0,0 +1,130 @@
+/*
+	Copyright (C) 2014 CurlyMo
+
+	This file is part of pilight.
+
+	pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+	pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/pilight/core/pilight.h"
+#include "libs/pilight/core/common.h"
+#include "libs/pilight/core/log.h"
+#include "libs/pilight/core/options.h"
+#include "libs/pilight/core/datetime.h"
+#include "libs/pilight/core/gc.h"
+
+int main_gc(void) {
+	log_shell_disable();
+
+	options_gc();
+	log_gc();
+	gc_clear();
+
+	FREE(progname);
+	xfree();
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+	// memtrack();
+	atomicinit();
+	gc_attach(main_gc);
+
+	/* Catch all exit signals for gc */
+	gc_catch();
+
+	log_shell_enable();
+	log_file_disable();
+	log_level_set(LOG_NOTICE);
+
+	struct options_t *options = NULL;
+	char *args = NULL;
+	char *in = NULL, *out = NULL;
+	int ret = EXIT_SUCCESS;
+
+	if((progname = MALLOC(15)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(progname, "pilight-tzdata");
+
+	options_add(&options, 'H', "help", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
+	options_add(&options, 'V', "version", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
+	options_add(&options, 'i', "input", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, NULL);
+	options_add(&options, 'o', "output", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, NULL);
+
+	while (1) {
+		int c;
+		c = options_parse(&options, argc, argv, 1, &args);
+		if(c == -1)
+			break;
+		if(c == -2)
+			c = 'H';
+		switch (c) {
+			case 'H':
+				printf("Usage: %s [options]\n", progname);
+				printf("\t -H --help\t\tdisplay usage summary\n");
+				printf("\t -V --version\t\tdisplay version\n");
+				printf("\t -i --input=file\tjson tzdata to compile\n");
+				printf("\t -o --output=file\tbinary tzdata to write\n");
+				goto close;
+			break;
+			case 'V':
+				printf("%s v%s\n", progname, PILIGHT_VERSION);
+				goto close;
+			break;
+			case 'i':
+				if((in = REALLOC(in, strlen(args)+1)) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+				strcpy(in, args);
+			break;
+			case 'o':
+				if((out = REALLOC(out, strlen(args)+1)) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+				strcpy(out, args);
+			break;
+			default:
+				printf("Usage: %s [options]\n", progname);
+				ret = EXIT_FAILURE;
+				goto close;
+			break;
+		}
+	}
+
+	if(in == NULL || out == NULL) {
+		logprintf(LOG_ERR, "both an input and an output file are required");
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+
+	ret = tzdata_compile(in, out);
+
+close:
+	options_delete(options);
+	if(in != NULL) {
+		FREE(in);
+	}
+	if(out != NULL) {
+		FREE(out);
+	}
+	main_gc();
+	return ret;
+}